@@ -0,0 +1,618 @@
+/**
+ * @file bench_bridge.c
+ * @brief Banc de mesure du pipeline du pont MQTT ↔ CAN.
+ *
+ * Pour des dictionnaires synthétiques de 10 à 10 000 entrées (ou un
+ * dictionnaire et un mélange de messages enregistrés), mesure :
+ * - pack_payload() / unpack_payload() (chemin cJSON) ;
+ * - pack_parse_json() / pack_encode_json() (chemin direct) ;
+ * - table_find_by_topic() / table_find_rx() ;
+ * - le chemin complet MQTT -> CAN : callback on_message de mqtt_io.c
+ *   jusqu’à l’écriture de la trame (can_flush()) ;
+ * - le chemin complet CAN -> MQTT : can_poll() jusqu’à mosquitto_publish().
+ *
+ * Le transport CAN est une interface réelle ou virtuelle (vcan0 par
+ * défaut) ; sans elle, une socketpair AF_UNIX la remplace (can_init_fd()).
+ * Côté MQTT, l’API mosquitto est remplacée par un faux en mémoire
+ * (fake_mosquitto.c) : on_message est appelé directement,
+ * mosquitto_publish ne fait que compter. Toutes les allocations du processus sont comptées
+ * (malloc/calloc/realloc remplacés, glibc).
+ *
+ * Pour chaque mesure : débit (msg/s), latences p50/p99/p999 par message
+ * (coût de l’horloge déduit) et allocations par message. Le journal est
+ * au niveau warn pendant les mesures.
+ *
+ * Mélange enregistré (-m) : une ligne par message,
+ *   mqtt <topic> <json>
+ *   can <id hexa>#<données hexa>
+ * un ID de plus de 3 chiffres est un ID étendu (29 bits), comme pour
+ * candump ; les lignes vides ou commençant par '#' sont ignorées.
+ *
+ * Usage : ./build/bench_bridge [-n messages] [-i interface] [-d conversion.json [-m mélange]]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+
+#include <sys/socket.h>
+#include <net/if.h>
+#include <linux/can.h>
+#include <mosquitto.h>
+#include <cjson/cJSON.h>
+
+#include "types.h"
+#include "log.h"
+#include "table.h"
+#include "pack.h"
+#include "mqtt_io.h"
+#include "spsc.h"
+#include "can_io.h"
+#include "fake_mosquitto.h"
+
+/* -------------------------------------------------------------------------- */
+/*                          Comptage des allocations                          */
+/* -------------------------------------------------------------------------- */
+
+extern void *__libc_malloc(size_t n);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *p, size_t n);
+extern void  __libc_free(void *p);
+
+static _Atomic uint64_t g_allocs;
+
+void *malloc(size_t n){
+  atomic_fetch_add_explicit(&g_allocs, 1, memory_order_relaxed);
+  return __libc_malloc(n);
+}
+
+void *calloc(size_t n, size_t size){
+  atomic_fetch_add_explicit(&g_allocs, 1, memory_order_relaxed);
+  return __libc_calloc(n, size);
+}
+
+void *realloc(void *p, size_t n){
+  atomic_fetch_add_explicit(&g_allocs, 1, memory_order_relaxed);
+  return __libc_realloc(p, n);
+}
+
+void free(void *p){
+  __libc_free(p);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               Mesures                                      */
+/* -------------------------------------------------------------------------- */
+
+/** @brief Message MQTT du mélange. */
+typedef struct bench_msg_s {
+  char   topic[128];
+  char   payload[256];
+  size_t len;
+} bench_msg_t;
+
+/** @brief Mélange de messages : commandes MQTT et trames CAN reçues. */
+typedef struct bench_mix_s {
+  bench_msg_t      *msgs;
+  size_t            msg_count;
+  struct canfd_frame *frames;
+  size_t            frame_count;
+} bench_mix_t;
+
+static uint64_t g_clock_ns;   /* coût d’une lecture d’horloge, déduit des mesures */
+static uint64_t *g_lat;       /* latences de la mesure en cours */
+
+/**
+ * @brief Horloge monotone en nanosecondes.
+ */
+static uint64_t now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Mesure le coût minimal d’une paire de lectures d’horloge.
+ */
+static void clock_calibrate(void){
+  uint64_t best = UINT64_MAX;
+  for(int i = 0; i < 10000; i++){
+    uint64_t a = now_ns(), b = now_ns();
+    if(b - a < best) best = b - a;
+  }
+  g_clock_ns = best;
+}
+
+/**
+ * @brief Enregistre la latence du message i (coût de l’horloge déduit).
+ */
+static void lat_put(size_t i, uint64_t t0, uint64_t t1){
+  uint64_t d = t1 - t0;
+  g_lat[i] = (d > g_clock_ns) ? d - g_clock_ns : 0;
+}
+
+static int cmp_u64(const void *a, const void *b){
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Affiche une ligne de résultats à partir de g_lat[0..n).
+ *
+ * @param name nom de la mesure.
+ * @param n nombre de messages.
+ * @param allocs allocations pendant la mesure.
+ */
+static void report(const char *name, size_t n, uint64_t allocs){
+  uint64_t total = 0;
+  for(size_t i = 0; i < n; i++) total += g_lat[i];
+  qsort(g_lat, n, sizeof(g_lat[0]), cmp_u64);
+  printf("%-18s %12.0f %9.3f %9.3f %9.3f %10.2f\n", name,
+         total ? (double)n * 1e9 / (double)total : 0.0,
+         (double)g_lat[n * 50 / 100] / 1000.0, (double)g_lat[n * 99 / 100] / 1000.0,
+         (double)g_lat[n * 999 / 1000] / 1000.0, (double)allocs / (double)n);
+}
+
+/**
+ * @brief Vide la socket pair (trames émises par le pont).
+ *
+ * @return nombre de trames lues.
+ */
+static size_t peer_drain(int peer){
+  struct canfd_frame f;
+  size_t n = 0;
+  while(recv(peer, &f, sizeof(f), MSG_DONTWAIT) > 0) n++;
+  return n;
+}
+
+/** @brief Taille sur le fil : CAN_MTU (classique) ou CANFD_MTU. */
+static size_t frame_mtu(const struct canfd_frame *f){
+  return f->len > 8 ? CANFD_MTU : CAN_MTU;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                         Dictionnaires et mélanges                          */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Écrit un dictionnaire synthétique de n entrées.
+ *
+ * Cinq gabarits de champs alternent (int/bool, hex/int16, enum/int,
+ * 6 int, champs de bits signés et mis à l’échelle). Les 2048 premières
+ * entrées paires sont en mode direct (IDs 11 bits), les autres en
+ * tunnel sur l’ID de transport 0x7F0.
+ *
+ * @param n nombre d’entrées.
+ * @param[out] path chemin du fichier créé (à supprimer par l’appelant).
+ * @param len taille du buffer path.
+ * @return true si succès.
+ */
+static bool write_synth_dict(size_t n, char *path, size_t len){
+  static const char *const data[5] = {
+    "{ \"a\": \"int\", \"b\": \"bool\" }",
+    "{ \"rgb\": \"hex\", \"t\": \"int16\" }",
+    "[ { \"name\": \"mode\", \"type\": \"enum\", \"dict\": { \"off\": 0, \"eco\": 1, \"on\": 2 } },"
+    " { \"name\": \"lvl\", \"type\": \"int\" } ]",
+    "{ \"a\": \"int\", \"b\": \"int\", \"c\": \"int\", \"d\": \"int\", \"e\": \"int\", \"f\": \"int\" }",
+    "[ { \"name\": \"on\", \"type\": \"bool\", \"bits\": 1 }, { \"name\": \"lvl\", \"type\": \"int\", \"bits\": 3 },"
+    " { \"name\": \"t\", \"type\": \"sint16\", \"bits\": 12, \"scale\": 0.5, \"offset\": -40 },"
+    " { \"name\": \"d\", \"type\": \"sint16\", \"byte_order\": \"little\" } ]"
+  };
+
+  snprintf(path, len, "/tmp/bench_bridge_XXXXXX");
+  int fd = mkstemp(path);
+  if(fd < 0) return false;
+  FILE *f = fdopen(fd, "w");
+  if(!f){ close(fd); return false; }
+
+  fprintf(f, "{\n");
+  for(size_t i = 0; i < n; i++){
+    bool direct = (i % 2 == 0) && (i / 2 < 0x7F0);
+    fprintf(f, "  \"g%zu\": { \"arbitration_id\": %zu, \"topic\": \"group%zu/entry%zu\", %s"
+               " \"data\": %s }%s\n",
+            i, direct ? i / 2 : 0x1000 + i, i % 37, i,
+            direct ? "\"transport\": \"direct\"," : "\"transport\": \"tunnel\", \"transport_id\": 2032,",
+            data[i % 5], (i + 1 < n) ? "," : "");
+  }
+  fprintf(f, "}\n");
+  fclose(f);
+  return true;
+}
+
+/**
+ * @brief Écrit un payload JSON valide pour une entrée.
+ *
+ * @param e entrée.
+ * @param seed graine des valeurs.
+ * @param[out] buf tampon.
+ * @param cap taille du tampon.
+ * @return longueur écrite, 0 si le tampon est trop petit.
+ */
+static size_t synth_payload(const entry_t *e, unsigned seed, char *buf, size_t cap){
+  size_t pos = 0;
+  for(size_t k = 0; k < e->field_count; k++){
+    const field_spec_t *fs = &e->fields[k];
+    unsigned v = seed * 2654435761u + (unsigned)k * 40503u;
+    char val[64] = "0";
+    switch(fs->type){
+      case FT_INT:
+      case FT_INT16:
+      case FT_UINT:  snprintf(val, sizeof(val), "%.17g", (v & fs->mask) * fs->scale + fs->bias); break;
+      case FT_SINT:  snprintf(val, sizeof(val), "%.17g", ((double)(v & fs->mask) - (double)(fs->mask / 2 + 1)) * fs->scale + fs->bias); break;
+      case FT_FLOAT: snprintf(val, sizeof(val), "%.17g", (double)(v % 10000) / 8); break;
+      case FT_BOOL:  snprintf(val, sizeof(val), "%s", (v & 1) ? "true" : "false"); break;
+      case FT_HEX:   snprintf(val, sizeof(val), "\"#%06X\"", v & 0xFFFFFF); break;
+      case FT_ENUM:{
+        const enum_kv_t *kv = fs->enum_list;
+        for(unsigned s = v % 3; kv && kv->next && s; s--) kv = kv->next;
+        if(kv) snprintf(val, sizeof(val), "\"%s\"", kv->key);
+        break;
+      }
+    }
+    int r = snprintf(buf + pos, cap - pos, "%s\"%s\":%s", k ? "," : "{", fs->name, val);
+    if(r < 0 || (size_t)r >= cap - pos) return 0;
+    pos += (size_t)r;
+  }
+  int r = snprintf(buf + pos, cap - pos, "%s}", e->field_count ? "" : "{");
+  if(r < 0 || (size_t)r >= cap - pos) return 0;
+  return pos + (size_t)r;
+}
+
+/**
+ * @brief Trame CAN telle que le pont la reçoit pour une entrée et un payload.
+ *
+ * @return false si le payload ne se packe pas.
+ */
+static bool frame_for(const entry_t *e, const char *payload, size_t len, struct canfd_frame *f){
+  unsigned hdr = (e->route == ROUTE_TUNNEL) ? 2u : 0u;
+  memset(f, 0, sizeof(*f));
+  if(pack_parse_json(f->data + hdr, e, payload, len) != PACK_OK) return false;
+  f->len = e->frame_len;
+  if(hdr){
+    f->can_id = e->transport_id;
+    f->data[0] = (uint8_t)(e->can_id >> 8);
+    f->data[1] = (uint8_t)e->can_id;
+  }else{
+    f->can_id = e->can_id;
+  }
+  return true;
+}
+
+/**
+ * @brief Mélange synthétique : un message et une trame par entrée, dans
+ *        un ordre pseudo-aléatoire.
+ */
+static bool mix_synth(const table_t *t, bench_mix_t *mix){
+  size_t n = t->entry_count;
+  mix->msgs = calloc(n ? n : 1, sizeof(*mix->msgs));
+  mix->frames = calloc(n ? n : 1, sizeof(*mix->frames));
+  if(!mix->msgs || !mix->frames) return false;
+  for(size_t i = 0; i < n; i++){
+    const entry_t *e = &t->entries[(i * 2654435761u) % n];
+    bench_msg_t *m = &mix->msgs[mix->msg_count];
+    snprintf(m->topic, sizeof(m->topic), "%s", e->topic);
+    m->len = synth_payload(e, (unsigned)i, m->payload, sizeof(m->payload));
+    if(!m->len) continue;
+    if(frame_for(e, m->payload, m->len, &mix->frames[mix->frame_count])) mix->frame_count++;
+    mix->msg_count++;
+  }
+  return mix->msg_count > 0;
+}
+
+/**
+ * @brief Lit un mélange enregistré (format : cf. en-tête du fichier).
+ */
+static bool mix_load(const char *path, bench_mix_t *mix){
+  FILE *f = fopen(path, "r");
+  if(!f){ fprintf(stderr, "Ouvrir %s: %s\n", path, strerror(errno)); return false; }
+  size_t cap = 0;
+  char line[512];
+  bool ok = true;
+  while(ok && fgets(line, sizeof(line), f)){
+    line[strcspn(line, "\r\n")] = '\0';
+    if(line[0] == '\0' || line[0] == '#') continue;
+    if(mix->msg_count == cap || mix->frame_count == cap){
+      cap = cap ? cap * 2 : 256;
+      bench_msg_t *m = realloc(mix->msgs, cap * sizeof(*m));
+      struct canfd_frame *fr = m ? realloc(mix->frames, cap * sizeof(*fr)) : NULL;
+      if(m) mix->msgs = m;
+      if(fr) mix->frames = fr;
+      if(!m || !fr){ ok = false; break; }
+    }
+    char topic[128];
+    int off = 0;
+    unsigned id;
+    if(sscanf(line, "mqtt %127s %n", topic, &off) == 1 && off > 0){
+      bench_msg_t *m = &mix->msgs[mix->msg_count++];
+      snprintf(m->topic, sizeof(m->topic), "%s", topic);
+      m->len = (size_t)snprintf(m->payload, sizeof(m->payload), "%s", line + off);
+      if(m->len >= sizeof(m->payload)) m->len = sizeof(m->payload) - 1;
+    }else if(sscanf(line, "can %x#%n", &id, &off) == 1 && off > 0){
+      struct canfd_frame *fr = &mix->frames[mix->frame_count++];
+      memset(fr, 0, sizeof(*fr));
+      fr->can_id = (off - 5 > 3) ? (id & CAN_ID_EXT_MASK) | CAN_ID_EXT : id & CAN_ID_STD_MASK;
+      for(const char *p = line + off; fr->len < CAN_PAYLOAD_MAX && p[0] && p[1]; p += 2){
+        unsigned b;
+        if(sscanf(p, "%2x", &b) != 1) break;
+        fr->data[fr->len++] = (uint8_t)b;
+      }
+      fr->len = (uint8_t)can_fd_len(fr->len);
+    }else{
+      fprintf(stderr, "Ligne ignorée: %s\n", line);
+    }
+  }
+  fclose(f);
+  return ok && (mix->msg_count || mix->frame_count);
+}
+
+static void mix_free(bench_mix_t *mix){
+  free(mix->msgs);
+  free(mix->frames);
+  memset(mix, 0, sizeof(*mix));
+}
+
+/* -------------------------------------------------------------------------- */
+/*                             Transport CAN                                  */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Ouvre le transport : interface CAN (le pair est une seconde socket
+ *        sur la même interface) ou, à défaut, socketpair AF_UNIX.
+ *
+ * @param ifname interface CAN (NULL : socketpair).
+ * @param[out] c contexte CAN du pont.
+ * @param[out] peer socket qui injecte et reçoit les trames.
+ * @return nom du transport, NULL si échec.
+ */
+static const char *transport_open(const char *ifname, can_ctx_t *c, int *peer){
+  if(ifname && can_init(c, ifname, NULL)){
+    int fd = socket(PF_CAN, SOCK_RAW, CAN_RAW);
+    struct sockaddr_can addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = (int)if_nametoindex(ifname);
+    if(fd >= 0 && addr.can_ifindex > 0 && bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0){
+      *peer = fd;
+      return ifname;
+    }
+    if(fd >= 0) close(fd);
+    can_cleanup(c);
+  }
+
+  int sv[2];
+  if(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) < 0) return NULL;
+  if(!can_init_fd(c, sv[0])){ close(sv[1]); return NULL; }
+  *peer = sv[1];
+  return "socketpair";
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               Banc                                         */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Mesure une table et son mélange.
+ *
+ * @param t table chargée.
+ * @param mix mélange de messages.
+ * @param n messages par mesure (le mélange est parcouru en boucle).
+ * @param ifname interface CAN (NULL : socketpair).
+ * @return false si un message du chemin complet est perdu.
+ */
+static bool bench_table(table_t *t, const bench_mix_t *mix, size_t n, const char *ifname){
+  bool ok = true;
+  uint64_t a0, t0;
+  volatile uintptr_t sink = 0;
+
+  /* Entrées et objets cJSON du mélange, préparés hors mesure */
+  size_t nm = mix->msg_count;
+  const entry_t **ents = calloc(nm ? nm : 1, sizeof(*ents));
+  cJSON **objs = calloc(nm ? nm : 1, sizeof(*objs));
+  uint8_t (*bodies)[CAN_PAYLOAD_MAX] = calloc(nm ? nm : 1, sizeof(*bodies));
+  if(!ents || !objs || !bodies){ free(ents); free(objs); free(bodies); return false; }
+  size_t valid = 0;
+  for(size_t i = 0; i < nm; i++){
+    ents[i] = table_find_by_topic(t, mix->msgs[i].topic);
+    objs[i] = ents[i] ? cJSON_Parse(mix->msgs[i].payload) : NULL;
+    if(ents[i] && pack_parse_json(bodies[i], ents[i], mix->msgs[i].payload, mix->msgs[i].len) == PACK_OK) valid++;
+  }
+
+  printf("# chemin                    msg/s   p50(us)   p99(us)  p999(us) allocs/msg\n");
+
+  if(valid){
+    /* Les messages invalides (topic inconnu, payload refusé) sont sautés */
+    #define EACH_VALID(i, k) for(size_t k = 0, i = 0; k < n; i++) if(ents[i % nm] && objs[i % nm] && \
+      pack_parse_json(bodies[i % nm], ents[i % nm], mix->msgs[i % nm].payload, mix->msgs[i % nm].len) == PACK_OK && ++k)
+
+    a0 = atomic_load(&g_allocs);
+    EACH_VALID(i, k){
+      uint8_t out[CAN_PAYLOAD_MAX];
+      t0 = now_ns();
+      sink += pack_payload(out, ents[i % nm], objs[i % nm]);
+      lat_put(k - 1, t0, now_ns());
+    }
+    report("pack_payload", n, atomic_load(&g_allocs) - a0);
+
+    a0 = atomic_load(&g_allocs);
+    EACH_VALID(i, k){
+      t0 = now_ns();
+      cJSON *o = unpack_payload(bodies[i % nm], ents[i % nm]);
+      cJSON_Delete(o);
+      lat_put(k - 1, t0, now_ns());
+      sink += (uintptr_t)o;
+    }
+    report("unpack_payload", n, atomic_load(&g_allocs) - a0);
+
+    a0 = atomic_load(&g_allocs);
+    EACH_VALID(i, k){
+      uint8_t out[CAN_PAYLOAD_MAX];
+      t0 = now_ns();
+      sink += pack_parse_json(out, ents[i % nm], mix->msgs[i % nm].payload, mix->msgs[i % nm].len);
+      lat_put(k - 1, t0, now_ns());
+    }
+    report("pack_parse_json", n, atomic_load(&g_allocs) - a0);
+
+    a0 = atomic_load(&g_allocs);
+    EACH_VALID(i, k){
+      char buf[512];
+      t0 = now_ns();
+      sink += pack_encode_json(buf, sizeof(buf), bodies[i % nm], ents[i % nm]);
+      lat_put(k - 1, t0, now_ns());
+    }
+    report("pack_encode_json", n, atomic_load(&g_allocs) - a0);
+
+    a0 = atomic_load(&g_allocs);
+    EACH_VALID(i, k){
+      t0 = now_ns();
+      sink += (uintptr_t)table_find_by_topic(t, mix->msgs[i % nm].topic);
+      lat_put(k - 1, t0, now_ns());
+    }
+    report("find_by_topic", n, atomic_load(&g_allocs) - a0);
+    #undef EACH_VALID
+  }
+
+  if(mix->frame_count){
+    a0 = atomic_load(&g_allocs);
+    for(size_t k = 0; k < n; k++){
+      const struct canfd_frame *f = &mix->frames[k % mix->frame_count];
+      uint8_t hdr;
+      t0 = now_ns();
+      sink += (uintptr_t)table_find_rx(t, f->can_id, f->data, f->len, &hdr);
+      lat_put(k, t0, now_ns());
+    }
+    report("find_rx", n, atomic_load(&g_allocs) - a0);
+  }
+
+  /* Chemins complets : faux mosquitto + transport CAN */
+  can_ctx_t can;
+  int peer = -1;
+  const char *kind = transport_open(ifname, &can, &peer);
+  mqtt_ctx_t mq;
+  table_rcu_t tables;
+  table_rcu_init(&tables, t);
+  if(!kind || !mqtt_init(&mq, NULL, 0, 60)){
+    fprintf(stderr, "Transport ou client MQTT indisponible\n");
+    if(kind){ can_cleanup(&can); close(peer); }
+    free(ents); free(objs); free(bodies);
+    return false;
+  }
+  user_bundle_t ub = { .tables = &tables, .can = &can, .mqtt = &mq, .txq = NULL };
+  mqtt_set_user_data(&mq, &ub);
+
+  if(valid){
+    size_t sent = 0;
+    a0 = atomic_load(&g_allocs);
+    for(size_t k = 0, i = 0; k < n; i++){
+      const bench_msg_t *m = &mix->msgs[i % nm];
+      if(!ents[i % nm] || pack_parse_json(bodies[i % nm], ents[i % nm], m->payload, m->len) != PACK_OK) continue;
+      struct mosquitto_message msg;
+      memset(&msg, 0, sizeof(msg));
+      msg.topic = (char *)m->topic;
+      msg.payload = (void *)m->payload;
+      msg.payloadlen = (int)m->len;
+      t0 = now_ns();
+      g_mosq.on_message(&g_mosq, g_mosq.ud, &msg);
+      (void)can_flush(&can);
+      lat_put(k++, t0, now_ns());
+      sent += peer_drain(peer);
+    }
+    report("MQTT->CAN", n, atomic_load(&g_allocs) - a0);
+    if(sent != n){
+      fprintf(stderr, "MQTT->CAN : %zu trames reçues sur %zu\n", sent, n);
+      ok = false;
+    }
+  }
+
+  if(mix->frame_count){
+    uint64_t pub0 = g_published;
+    a0 = atomic_load(&g_allocs);
+    for(size_t k = 0; k < n; k++){
+      const struct canfd_frame *f = &mix->frames[k % mix->frame_count];
+      if(send(peer, f, frame_mtu(f), 0) != (ssize_t)frame_mtu(f)){ ok = false; break; }
+      t0 = now_ns();
+      const table_t *ct = table_rcu_enter(&tables, TABLE_READER_CAN);
+      can_poll(&can, ct, &mq, 64);
+      table_rcu_leave(&tables, TABLE_READER_CAN);
+      lat_put(k, t0, now_ns());
+    }
+    uint64_t pub = g_published - pub0;
+    report("CAN->MQTT", n, atomic_load(&g_allocs) - a0);
+    /* Trames inconnues ou refusées d’un mélange enregistré : non publiées */
+    if(pub != n && mix->frame_count == mix->msg_count){
+      fprintf(stderr, "CAN->MQTT : %llu publications sur %zu\n", (unsigned long long)pub, n);
+      ok = false;
+    }
+  }
+  printf("# transport : %s\n", kind);
+
+  (void)sink;
+  mqtt_cleanup(&mq);
+  can_cleanup(&can);
+  close(peer);
+  for(size_t i = 0; i < nm; i++) cJSON_Delete(objs[i]);
+  free(ents); free(objs); free(bodies);
+  return ok;
+}
+
+int main(int argc, char **argv){
+  size_t n = 100000;
+  const char *ifname = "vcan0", *dict = NULL, *mixpath = NULL;
+  int opt;
+  while((opt = getopt(argc, argv, "n:i:d:m:")) != -1){
+    switch(opt){
+      case 'n': n = (size_t)strtoul(optarg, NULL, 10); break;
+      case 'i': ifname = optarg; break;
+      case 'd': dict = optarg; break;
+      case 'm': mixpath = optarg; break;
+      default:
+        fprintf(stderr, "Usage : %s [-n messages] [-i interface] [-d conversion.json [-m mélange]]\n", argv[0]);
+        return 2;
+    }
+  }
+  if(n == 0) n = 1;
+  if(mixpath && !dict){ fprintf(stderr, "-m demande -d\n"); return 2; }
+
+  g_lat = __libc_malloc(n * sizeof(*g_lat));
+  if(!g_lat) return 1;
+  clock_calibrate();
+  log_set_level(LOG_WARN);
+
+  bool ok = true;
+  static const size_t sizes[] = { 10, 100, 1000, 10000 };
+  size_t runs = dict ? 1 : sizeof(sizes) / sizeof(sizes[0]);
+  for(size_t r = 0; r < runs; r++){
+    char path[64];
+    if(!dict && !write_synth_dict(sizes[r], path, sizeof(path))){ ok = false; continue; }
+    table_t *t = calloc(1, sizeof(*t));
+    bool loaded = t && table_load(t, dict ? dict : path);
+    if(!dict) unlink(path);
+    bench_mix_t mix = { 0 };
+    if(!loaded || !(mixpath ? mix_load(mixpath, &mix) : mix_synth(t, &mix))){
+      fprintf(stderr, "Dictionnaire ou mélange inutilisable\n");
+      if(t) table_free(t);
+      free(t);
+      mix_free(&mix);
+      ok = false;
+      continue;
+    }
+    printf("\n# dictionnaire : %s, %zu entrées ; mélange : %s (%zu messages MQTT, %zu trames CAN) ; %zu messages par mesure\n",
+           dict ? dict : "synthétique", t->entry_count, mixpath ? mixpath : "synthétique",
+           mix.msg_count, mix.frame_count, n);
+    ok = bench_table(t, &mix, n, ifname) && ok;
+    mix_free(&mix);
+    table_free(t);
+    free(t);
+  }
+  __libc_free(g_lat);
+  return ok ? 0 : 1;
+}
+
+// End of file
@@ -0,0 +1,208 @@
+/**
+ * @file bench_dbc.c
+ * @brief Temps de chargement d’un dictionnaire DBC.
+ *
+ * Génère des fichiers DBC synthétiques de taille croissante (8 signaux
+ * par message : intel et motorola, signés, mis à l’échelle, une table
+ * VAL_, un commentaire CM_ sur deux lignes par message, un attribut de
+ * topic sur quelques messages) puis mesure :
+ * - dbc_to_json() : lecture du DBC seule ;
+ * - table_load() du DBC : lecture et construction de la table ;
+ * - table_load() du même dictionnaire écrit en JSON, pour référence.
+ *
+ * Les tables obtenues depuis le DBC et depuis le JSON sont comparées.
+ *
+ * Usage : ./build/bench_dbc [nombre_de_messages_max]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <cjson/cJSON.h>
+
+#include "types.h"
+#include "log.h"
+#include "table.h"
+#include "dbc.h"
+
+/* Signaux d’un message synthétique (64 bits, sans recouvrement) */
+static const char *const synth_sigs[] = {
+  " SG_ Mode : 0|8@1+ (1,0) [0|3] \"\" Gateway",
+  " SG_ Speed : 8|16@1+ (0.1,0) [0|6553.5] \"km/h\" Gateway,Dash",
+  " SG_ Temp : 24|8@1- (0.5,-40) [-104|23.5] \"degC\" Gateway",
+  " SG_ Gear : 39|4@0+ (1,0) [0|15] \"\" Gateway",
+  " SG_ Torque : 35|12@0- (0.25,0) [-512|511.75] \"Nm\" Gateway",
+  " SG_ Valid : 48|1@1+ (1,0) [0|1] \"\" Gateway",
+  " SG_ Load : 49|7@1+ (2,0) [0|254] \"%\" Gateway",
+  " SG_ Counter : 56|8@1+ (1,0) [0|255] \"\" Gateway",
+};
+#define SYNTH_SIGS (sizeof(synth_sigs) / sizeof(synth_sigs[0]))
+
+/**
+ * @brief Horloge monotone en nanosecondes.
+ */
+static uint64_t now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief ID DBC synthétique : 1024 IDs standard, étendus (bit 31) au-delà.
+ */
+static uint32_t synth_id(size_t i){
+  return (i < 1024) ? (uint32_t)(0x100 + i) : (uint32_t)(0x80000000u | (0x18F00000u + i));
+}
+
+/**
+ * @brief Écrit un DBC synthétique de n messages dans un fichier temporaire.
+ *
+ * @param n nombre de messages.
+ * @param[out] path chemin du fichier créé (à supprimer par l’appelant).
+ * @param len taille du buffer path.
+ * @return true si succès.
+ */
+static bool write_synth_dbc(size_t n, char *path, size_t len){
+  snprintf(path, len, "/tmp/bench_dbc_%ld.dbc", (long)getpid());
+  FILE *f = fopen(path, "w");
+  if(!f) return false;
+
+  fprintf(f, "VERSION \"\"\n\nNS_ :\n\tCM_\n\tBA_DEF_\n\tBA_\n\tVAL_\n\nBS_:\n\nBU_: Gateway Dash");
+  for(size_t e = 0; e < 16; e++) fprintf(f, " Ecu%zu", e);
+  fprintf(f, "\n\n");
+  for(size_t i = 0; i < n; i++){
+    char node[16];
+    if(i % 17 == 16) snprintf(node, sizeof(node), "Vector__XXX");
+    else snprintf(node, sizeof(node), "Ecu%zu", i % 16);
+    fprintf(f, "BO_ %u Msg%zu: 8 %s\n", synth_id(i), i, node);
+    for(size_t s = 0; s < SYNTH_SIGS; s++) fprintf(f, "%s\n", synth_sigs[s]);
+    fprintf(f, "\n");
+  }
+  for(size_t i = 0; i < n; i++)
+    fprintf(f, "CM_ BO_ %u \"Message synthétique %zu,\ncommentaire sur deux lignes\";\n", synth_id(i), i);
+  fprintf(f, "BA_DEF_ BO_ \"%s\" STRING ;\n", DBC_TOPIC_ATTR);
+  for(size_t i = 0; i < n; i += 50)
+    fprintf(f, "BA_ \"%s\" BO_ %u \"vehicle/msg%zu\";\n", DBC_TOPIC_ATTR, synth_id(i), i);
+  for(size_t i = 0; i < n; i++)
+    fprintf(f, "VAL_ %u Mode 3 \"Sport\" 2 \"Eco\" 1 \"Normal\" 0 \"Off\" ;\n", synth_id(i));
+  fclose(f);
+  return true;
+}
+
+/**
+ * @brief Écrit le document JSON d’un dictionnaire dans un fichier temporaire.
+ */
+static bool write_json(const cJSON *root, char *path, size_t len){
+  char *txt = cJSON_PrintUnformatted(root);
+  if(!txt) return false;
+  snprintf(path, len, "/tmp/bench_dbc_%ld.json", (long)getpid());
+  FILE *f = fopen(path, "w");
+  bool ok = f && fputs(txt, f) >= 0;
+  if(f && fclose(f) != 0) ok = false;
+  free(txt);
+  return ok;
+}
+
+/**
+ * @brief Compare deux tables champ par champ.
+ */
+static bool same_table(const table_t *a, const table_t *b){
+  if(a->entry_count != b->entry_count) return false;
+  for(size_t i = 0; i < a->entry_count; i++){
+    const entry_t *x = &a->entries[i], *y = &b->entries[i];
+    if(strcmp(x->topic, y->topic) || x->can_id != y->can_id || x->field_count != y->field_count ||
+       x->packed_size != y->packed_size) return false;
+    for(size_t k = 0; k < x->field_count; k++){
+      const field_spec_t *f = &x->fields[k], *g = &y->fields[k];
+      if(strcmp(f->name, g->name) || f->type != g->type || f->offset != g->offset || f->width != g->width ||
+         f->shift != g->shift || f->bits != g->bits || f->little != g->little ||
+         f->scale != g->scale || f->bias != g->bias) return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Mesure une taille de DBC et affiche une ligne de résultats.
+ */
+static bool bench_size(size_t n){
+  char dbc[64], json[64];
+  if(!write_synth_dbc(n, dbc, sizeof(dbc))) return false;
+
+  size_t reps = 200000 / (n * SYNTH_SIGS) + 1;
+  uint64_t t0, ns_parse, ns_dbc, ns_json;
+  bool ok = true;
+
+  t0 = now_ns();
+  for(size_t r = 0; ok && r < reps; r++){
+    cJSON *root = dbc_to_json(dbc);
+    ok = root != NULL;
+    cJSON_Delete(root);
+  }
+  ns_parse = now_ns() - t0;
+
+  t0 = now_ns();
+  for(size_t r = 0; ok && r < reps; r++){
+    table_t t;
+    ok = table_load(&t, dbc) && t.entry_count == n;
+    table_free(&t);
+  }
+  ns_dbc = now_ns() - t0;
+
+  cJSON *root = ok ? dbc_to_json(dbc) : NULL;
+  ok = root && write_json(root, json, sizeof(json));
+  cJSON_Delete(root);
+  if(!ok){ unlink(dbc); return false; }
+
+  t0 = now_ns();
+  for(size_t r = 0; ok && r < reps; r++){
+    table_t t;
+    ok = table_load(&t, json);
+    table_free(&t);
+  }
+  ns_json = now_ns() - t0;
+
+  /* Vérification : même table par les deux chemins, topics attendus */
+  table_t a, b;
+  bool la = table_load(&a, dbc), lb = table_load(&b, json);
+  if(ok && (!la || !lb || !same_table(&a, &b) || a.entries[0].field_count != SYNTH_SIGS ||
+            !table_find_by_topic(&a, "ecu1/msg1") || !table_find_by_topic(&a, "vehicle/msg0") ||
+            table_find_by_canid(&a, synth_id(n - 1)) == NULL)){
+    fprintf(stderr, "Table DBC incohérente (n=%zu)\n", n);
+    ok = false;
+  }
+  table_free(&a);
+  table_free(&b);
+  unlink(dbc);
+  unlink(json);
+
+  double sigs = (double)(n * SYNTH_SIGS);
+  printf("%8zu %8zu | %10.2f %10.2f %10.2f | %8.0f\n", n, n * SYNTH_SIGS,
+         ns_parse / 1e6 / reps, ns_dbc / 1e6 / reps, ns_json / 1e6 / reps,
+         (double)ns_dbc / reps / sigs);
+  return ok;
+}
+
+int main(int argc, char **argv){
+  size_t max = (argc > 1) ? (size_t)strtoul(argv[1], NULL, 10) : 8000;
+  if(max == 0) max = 1;
+
+  /* Une ligne de journal par chargement : seuls les avertissements comptent ici */
+  log_set_level(LOG_WARN);
+
+  printf("# ms par chargement, ns par signal (table_load du DBC)\n");
+  printf("# messages  signaux | dbc_to_json table(dbc) table(json) | ns/signal\n");
+
+  bool ok = true;
+  for(size_t n = 100; n <= max; n *= 10){
+    ok = bench_size(n) && ok;
+    if(n < max && n * 10 > max) ok = bench_size(max) && ok;
+  }
+  return ok ? 0 : 1;
+}
+
+// End of file
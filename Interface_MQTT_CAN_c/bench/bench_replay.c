@@ -0,0 +1,238 @@
+/**
+ * @file bench_replay.c
+ * @brief Rejeu d’un fichier de capture (cobien_bridge --record) à travers
+ *        le pipeline du pont, transports remplacés par des puits en mémoire.
+ *
+ * Chaque enregistrement repasse par le même code que sur le bus :
+ * - message MQTT : callback on_message de mqtt_io.c puis can_flush() ;
+ * - trame CAN : can_poll() jusqu’à mosquitto_publish().
+ * L’API mosquitto est le faux en mémoire de fake_mosquitto.c ; les trames
+ * CAN passent par une socketpair AF_UNIX (can_init_fd()), dont l’autre
+ * extrémité injecte les trames reçues et absorbe les trames émises.
+ *
+ * Le calendrier de la capture est respecté à la vitesse demandée (1x par
+ * défaut, Nx, ou max : sans attente). Le rapport donne, par étage, le
+ * débit et les latences p50/p99/p999/max, le retard sur le calendrier,
+ * ce qui est sorti des puits, puis les métriques du pont (metrics.h).
+ * Le journal est au niveau err pendant le rejeu.
+ *
+ * Usage : ./build/bench_replay [-s vitesse|max] [-l boucles] conversion.json capture
+ *
+ * bench/sample.cap (rejouée par make bench) : quatre tours des entrées de
+ * conversion.json, un message MQTT valide et une trame CAN par entrée
+ * (message seul pour les entrées segmentées), enregistrés avec
+ * capture_mqtt() / capture_can().
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <errno.h>
+
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <mosquitto.h>
+
+#include "types.h"
+#include "log.h"
+#include "table.h"
+#include "mqtt_io.h"
+#include "spsc.h"
+#include "can_io.h"
+#include "metrics.h"
+#include "capture.h"
+#include "fake_mosquitto.h"
+
+/** @brief Latences d’un étage du pipeline. */
+typedef struct stage_s {
+  const char *name;
+  uint64_t   *lat;
+  size_t      n;
+} stage_t;
+
+static uint64_t now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t t){
+  struct timespec ts = { .tv_sec = (time_t)(t / 1000000000ull), .tv_nsec = (long)(t % 1000000000ull) };
+  while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR)
+    ;
+}
+
+static int cmp_u64(const void *a, const void *b){
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Affiche une ligne de résultats (trie les valeurs).
+ *
+ * @param name nom de la ligne.
+ * @param v valeurs en ns.
+ * @param n nombre de valeurs.
+ * @param rate true : débit calculé sur la somme des valeurs.
+ */
+static void report(const char *name, uint64_t *v, size_t n, bool rate){
+  if(!n){
+    printf("%-12s %10u %12s\n", name, 0u, "-");
+    return;
+  }
+  uint64_t total = 0;
+  for(size_t i = 0; i < n; i++) total += v[i];
+  qsort(v, n, sizeof(v[0]), cmp_u64);
+  char r[32] = "-";
+  if(rate && total) snprintf(r, sizeof(r), "%.0f", (double)n * 1e9 / (double)total);
+  printf("%-12s %10zu %12s %9.3f %9.3f %9.3f %10.3f\n", name, n, r,
+         (double)v[n * 50 / 100] / 1000.0, (double)v[n * 99 / 100] / 1000.0,
+         (double)v[n * 999 / 1000] / 1000.0, (double)v[n - 1] / 1000.0);
+}
+
+/**
+ * @brief Vide l’extrémité puits de la socketpair.
+ *
+ * @return nombre de trames lues.
+ */
+static size_t sink_drain(int peer){
+  struct canfd_frame f;
+  size_t n = 0;
+  while(recv(peer, &f, sizeof(f), MSG_DONTWAIT) > 0) n++;
+  return n;
+}
+
+int main(int argc, char **argv){
+  double speed = 1.0;
+  unsigned loops = 1;
+  int opt;
+  while((opt = getopt(argc, argv, "s:l:")) != -1){
+    switch(opt){
+      case 's': speed = strcmp(optarg, "max") ? strtod(optarg, NULL) : 0.0; break;
+      case 'l': loops = (unsigned)strtoul(optarg, NULL, 10); break;
+      default: optind = argc + 1; break;
+    }
+  }
+  if(optind + 2 != argc || speed < 0.0 || loops == 0){
+    fprintf(stderr, "Usage : %s [-s vitesse|max] [-l boucles] conversion.json capture\n", argv[0]);
+    return 2;
+  }
+
+  log_set_level(LOG_ERR);    /* topics inconnus, etc. : comptés dans les métriques */
+  capture_reader_t cap;
+  if(!capture_reader_open(&cap, argv[optind + 1])) return 1;
+
+  /* Premier passage : effectifs par étage et durée enregistrée */
+  capture_rec_t rec;
+  size_t n_mqtt = 0, n_can = 0;
+  uint64_t duration = 0;
+  while(capture_next(&cap, &rec)){
+    if(rec.kind == CAPTURE_MQTT) n_mqtt++;
+    else n_can++;
+    duration = rec.ts_ns;
+  }
+  size_t total = (n_mqtt + n_can) * loops;
+
+  table_t *t = calloc(1, sizeof(*t));
+  stage_t st[2] = { { "MQTT->CAN", NULL, 0 }, { "CAN->MQTT", NULL, 0 } };
+  uint64_t *lag = malloc((total ? total : 1) * sizeof(*lag));
+  st[0].lat = malloc((n_mqtt ? n_mqtt * loops : 1) * sizeof(uint64_t));
+  st[1].lat = malloc((n_can ? n_can * loops : 1) * sizeof(uint64_t));
+  if(!t || !lag || !st[0].lat || !st[1].lat || !table_load(t, argv[optind])){
+    fprintf(stderr, "Dictionnaire %s inutilisable\n", argv[optind]);
+    return 1;
+  }
+
+  /* Puits : socketpair pour le CAN, faux mosquitto pour MQTT */
+  int sv[2];
+  can_ctx_t can;
+  mqtt_ctx_t mq;
+  table_rcu_t tables;
+  table_rcu_init(&tables, t);
+  if(socketpair(AF_UNIX, SOCK_DGRAM, 0, sv) < 0 || !can_init_fd(&can, sv[0]) || !mqtt_init(&mq, NULL, 0, 60)){
+    fprintf(stderr, "Puits indisponibles: %s\n", strerror(errno));
+    return 1;
+  }
+  user_bundle_t ub = { .tables = &tables, .can = &can, .mqtt = &mq, .txq = NULL };
+  mqtt_set_user_data(&mq, &ub);
+  char json[METRICS_JSON_MAX];
+  (void)metrics_json(json, sizeof(json));   /* origine de l’intervalle des latences */
+
+  size_t frames_out = 0, nlag = 0;
+  uint64_t start = now_ns();
+  for(unsigned l = 0; l < loops; l++){
+    capture_rewind(&cap);
+    while(capture_next(&cap, &rec)){
+      if(speed > 0.0){
+        uint64_t target = start + (uint64_t)((double)(l * duration + rec.ts_ns) / speed);
+        uint64_t now = now_ns();
+        if(now < target) sleep_until(target);
+        now = now_ns();
+        lag[nlag++] = now > target ? now - target : 0;
+      }
+
+      uint64_t t0, t1;
+      if(rec.kind == CAPTURE_MQTT){
+        struct mosquitto_message msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.topic = (char *)rec.topic;
+        msg.payload = (void *)rec.payload;
+        msg.payloadlen = (int)rec.len;
+        t0 = now_ns();
+        g_mosq.on_message(&g_mosq, g_mosq.ud, &msg);
+        (void)can_flush(&can);
+        t1 = now_ns();
+        st[0].lat[st[0].n++] = t1 - t0;
+        frames_out += sink_drain(sv[1]);
+      }else{
+        /* Trame classique (CAN_MTU) ou FD (CANFD_MTU) selon sa longueur */
+        struct canfd_frame f;
+        memset(&f, 0, sizeof(f));
+        f.can_id = rec.can_id;
+        f.len = rec.dlc;
+        memcpy(f.data, rec.data, rec.dlc);
+        size_t mtu = rec.dlc > 8 ? CANFD_MTU : CAN_MTU;
+        if(send(sv[1], &f, mtu, 0) != (ssize_t)mtu) continue;
+        t0 = now_ns();
+        const table_t *ct = table_rcu_enter(&tables, TABLE_READER_CAN);
+        can_poll(&can, ct, &mq, 64);
+        table_rcu_leave(&tables, TABLE_READER_CAN);
+        t1 = now_ns();
+        st[1].lat[st[1].n++] = t1 - t0;
+      }
+    }
+  }
+  double wall = (double)(now_ns() - start) / 1e9;
+
+  char vit[32];
+  if(speed > 0.0) snprintf(vit, sizeof(vit), "%gx", speed);
+  else snprintf(vit, sizeof(vit), "max");
+  printf("# capture : %s, %zu messages MQTT, %zu trames CAN, %.3f s enregistrées ; vitesse %s, %u boucle(s)\n",
+         argv[optind + 1], n_mqtt, n_can, (double)duration / 1e9, vit, loops);
+  printf("# étage       messages        msg/s   p50(us)   p99(us)  p999(us)    max(us)\n");
+  for(int i = 0; i < 2; i++) report(st[i].name, st[i].lat, st[i].n, true);
+  if(speed > 0.0) report("retard", lag, nlag, false);
+  printf("# rejeu : %.3f s, %.0f msg/s ; puits : %zu trames CAN émises, %llu publications MQTT\n",
+         wall, wall > 0.0 ? (double)(st[0].n + st[1].n) / wall : 0.0, frames_out,
+         (unsigned long long)g_published);
+
+  if(metrics_json(json, sizeof(json))) printf("# métriques : %s\n", json);
+
+  mqtt_cleanup(&mq);
+  can_cleanup(&can);
+  close(sv[1]);
+  table_free(t);
+  free(t);
+  free(lag);
+  free(st[0].lat);
+  free(st[1].lat);
+  capture_reader_close(&cap);
+  return 0;
+}
+
+// End of file
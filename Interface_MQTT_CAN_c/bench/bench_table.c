@@ -0,0 +1,162 @@
+/**
+ * @file bench_table.c
+ * @brief Micro-benchmark des recherches dans la table de conversion.
+ *
+ * Génère des dictionnaires synthétiques de taille croissante, les charge
+ * avec table_load() puis mesure le coût moyen de :
+ * - table_find_by_topic()
+ * - table_find_by_canid()
+ *
+ * Un parcours linéaire (l’ancienne implémentation) sert de référence :
+ * son coût croît avec la taille de la table, celui des index doit rester
+ * constant.
+ *
+ * Usage : ./build/bench_table [nombre_de_recherches]
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "types.h"
+#include "log.h"
+#include "table.h"
+
+/**
+ * @brief Horloge monotone en nanosecondes.
+ */
+static uint64_t now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief CAN ID synthétique : moitié en plage directe, moitié au-delà.
+ */
+static uint32_t synth_canid(size_t i){
+  return (i & 1) ? (uint32_t)(0x1000 + i) : (uint32_t)((i / 2) % TABLE_CANID_DIRECT);
+}
+
+/**
+ * @brief Écrit un dictionnaire synthétique de n entrées dans un fichier temporaire.
+ *
+ * @param n nombre d’entrées.
+ * @param[out] path chemin du fichier créé (à supprimer par l’appelant).
+ * @param len taille du buffer path.
+ * @return true si succès.
+ */
+static bool write_synth_dict(size_t n, char *path, size_t len){
+  snprintf(path, len, "/tmp/bench_table_XXXXXX");
+  int fd = mkstemp(path);
+  if(fd < 0) return false;
+  FILE *f = fdopen(fd, "w");
+  if(!f){ close(fd); return false; }
+
+  fprintf(f, "{\n");
+  for(size_t i = 0; i < n; i++){
+    fprintf(f, "  \"g%zu\": { \"arbitration_id\": %u, \"topic\": \"group%zu/entry%zu\","
+               " \"data\": { \"a\": \"int\", \"b\": \"int16\" } }%s\n",
+            i, synth_canid(i), i % 37, i, (i + 1 < n) ? "," : "");
+  }
+  fprintf(f, "}\n");
+  fclose(f);
+  return true;
+}
+
+/* Références : parcours linéaire (comportement d’origine) */
+static const entry_t* linear_by_topic(const table_t *t, const char *topic){
+  for(size_t i = 0; i < t->entry_count; i++)
+    if(t->entries[i].topic && strcmp(t->entries[i].topic, topic) == 0) return &t->entries[i];
+  return NULL;
+}
+
+static const entry_t* linear_by_canid(const table_t *t, uint32_t id){
+  for(size_t i = 0; i < t->entry_count; i++)
+    if(t->entries[i].can_id == id) return &t->entries[i];
+  return NULL;
+}
+
+/**
+ * @brief Mesure une taille de table et affiche une ligne de résultats.
+ */
+static bool bench_size(size_t n, size_t lookups){
+  char path[64];
+  if(!write_synth_dict(n, path, sizeof(path))) return false;
+
+  table_t t;
+  bool ok = table_load(&t, path);
+  unlink(path);
+  if(!ok || t.entry_count != n){ table_free(&t); return false; }
+
+  /* Clés de recherche : toutes présentes, ordre pseudo-aléatoire */
+  char (*topics)[48] = malloc(n * sizeof(*topics));
+  uint32_t *ids = malloc(n * sizeof(uint32_t));
+  if(!topics || !ids){ free(topics); free(ids); table_free(&t); return false; }
+  for(size_t i = 0; i < n; i++){
+    size_t j = (i * 2654435761u) % n;
+    snprintf(topics[i], sizeof(topics[i]), "group%zu/entry%zu", j % 37, j);
+    ids[i] = synth_canid(j);
+  }
+
+  volatile uintptr_t sink = 0;
+  uint64_t t0, ns_topic, ns_canid, ns_lin_topic, ns_lin_canid;
+
+  t0 = now_ns();
+  for(size_t k = 0; k < lookups; k++) sink += (uintptr_t)table_find_by_topic(&t, topics[k % n]);
+  ns_topic = now_ns() - t0;
+
+  t0 = now_ns();
+  for(size_t k = 0; k < lookups; k++) sink += (uintptr_t)table_find_by_canid(&t, ids[k % n]);
+  ns_canid = now_ns() - t0;
+
+  /* La référence linéaire est limitée pour garder un temps d’exécution raisonnable */
+  size_t lin = lookups / (n / 10 + 1) + 1;
+  t0 = now_ns();
+  for(size_t k = 0; k < lin; k++) sink += (uintptr_t)linear_by_topic(&t, topics[k % n]);
+  ns_lin_topic = now_ns() - t0;
+
+  t0 = now_ns();
+  for(size_t k = 0; k < lin; k++) sink += (uintptr_t)linear_by_canid(&t, ids[k % n]);
+  ns_lin_canid = now_ns() - t0;
+
+  /* Vérification : l’index renvoie la même entrée que le parcours linéaire */
+  for(size_t i = 0; i < n; i++){
+    if(table_find_by_topic(&t, topics[i]) != linear_by_topic(&t, topics[i]) ||
+       table_find_by_canid(&t, ids[i]) != linear_by_canid(&t, ids[i])){
+      fprintf(stderr, "Incohérence index/linéaire (n=%zu, i=%zu)\n", n, i);
+      ok = false;
+      break;
+    }
+  }
+
+  printf("%8zu | %10.1f %10.1f | %12.1f %12.1f\n", n,
+         (double)ns_topic / lookups, (double)ns_canid / lookups,
+         (double)ns_lin_topic / lin, (double)ns_lin_canid / lin);
+
+  (void)sink;
+  free(topics);
+  free(ids);
+  table_free(&t);
+  return ok;
+}
+
+int main(int argc, char **argv){
+  size_t lookups = (argc > 1) ? (size_t)strtoul(argv[1], NULL, 10) : 2000000;
+  if(lookups == 0) lookups = 1;
+
+  static const size_t sizes[] = { 10, 100, 1000, 10000 };
+  printf("# ns par recherche (%zu recherches par taille)\n", lookups);
+  printf("# entrées |  topic(idx) canid(idx) | topic(linéaire) canid(linéaire)\n");
+
+  bool ok = true;
+  for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    ok = bench_size(sizes[i], lookups) && ok;
+  return ok ? 0 : 1;
+}
+
+// End of file
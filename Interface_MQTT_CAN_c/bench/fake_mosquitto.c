@@ -0,0 +1,84 @@
+/**
+ * @file fake_mosquitto.c
+ * @brief Faux client mosquitto en mémoire (cf. fake_mosquitto.h).
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <mosquitto.h>
+
+#include "fake_mosquitto.h"
+
+struct mosquitto g_mosq;
+uint64_t g_published;
+int mosquitto_lib_init(void){ return MOSQ_ERR_SUCCESS; }
+int mosquitto_lib_cleanup(void){ return MOSQ_ERR_SUCCESS; }
+
+struct mosquitto *mosquitto_new(const char *id, bool clean_session, void *obj){
+  (void)id; (void)clean_session;
+  memset(&g_mosq, 0, sizeof(g_mosq));
+  g_mosq.ud = obj;
+  return &g_mosq;
+}
+
+void mosquitto_destroy(struct mosquitto *mosq){ (void)mosq; }
+
+int mosquitto_int_option(struct mosquitto *mosq, enum mosq_opt_t option, int value){
+  (void)mosq; (void)option; (void)value;
+  return MOSQ_ERR_SUCCESS;
+}
+
+void mosquitto_connect_callback_set(struct mosquitto *mosq, void (*on_connect)(struct mosquitto *, void *, int)){
+  (void)mosq; (void)on_connect;
+}
+
+void mosquitto_disconnect_callback_set(struct mosquitto *mosq, void (*on_disconnect)(struct mosquitto *, void *, int)){
+  (void)mosq; (void)on_disconnect;
+}
+
+void mosquitto_message_callback_set(struct mosquitto *mosq,
+                                    void (*on_message)(struct mosquitto *, void *, const struct mosquitto_message *)){
+  mosq->on_message = on_message;
+}
+
+int mosquitto_connect(struct mosquitto *mosq, const char *host, int port, int keepalive){
+  (void)mosq; (void)host; (void)port; (void)keepalive;
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_disconnect(struct mosquitto *mosq){ (void)mosq; return MOSQ_ERR_SUCCESS; }
+
+int mosquitto_loop(struct mosquitto *mosq, int timeout, int max_packets){
+  (void)mosq; (void)timeout; (void)max_packets;
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_publish(struct mosquitto *mosq, int *mid, const char *topic, int payloadlen,
+                      const void *payload, int qos, bool retain){
+  (void)mosq; (void)mid; (void)topic; (void)payloadlen; (void)payload; (void)qos; (void)retain;
+  g_published++;
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_subscribe_v5(struct mosquitto *mosq, int *mid, const char *sub, int qos, int options,
+                           const mosquitto_property *properties){
+  (void)mosq; (void)mid; (void)sub; (void)qos; (void)options; (void)properties;
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_subscribe_multiple(struct mosquitto *mosq, int *mid, int sub_count, char *const *const sub,
+                                 int qos, int options, const mosquitto_property *properties){
+  (void)mosq; (void)mid; (void)sub_count; (void)sub; (void)qos; (void)options; (void)properties;
+  return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_unsubscribe_multiple(struct mosquitto *mosq, int *mid, int sub_count, char *const *const sub,
+                                   const mosquitto_property *properties){
+  (void)mosq; (void)mid; (void)sub_count; (void)sub; (void)properties;
+  return MOSQ_ERR_SUCCESS;
+}
+
+void mosquitto_user_data_set(struct mosquitto *mosq, void *obj){ mosq->ud = obj; }
+
+// End of file
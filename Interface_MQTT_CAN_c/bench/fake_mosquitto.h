@@ -0,0 +1,24 @@
+#ifndef FAKE_MOSQUITTO_H
+#define FAKE_MOSQUITTO_H
+
+/*
+ * Faux client mosquitto en mémoire, pour les bancs de mesure.
+ *
+ * Remplace libmosquitto à l’édition de liens : aucune connexion, les
+ * callbacks sont mémorisés et mosquitto_publish ne fait que compter.
+ * Le banc appelle lui-même g_mosq.on_message pour injecter un message.
+ *
+ * Prérequis : <stdint.h>, <stdbool.h>, <mosquitto.h>.
+ */
+
+struct mosquitto {
+  void *ud;
+  void (*on_message)(struct mosquitto *, void *, const struct mosquitto_message *);
+};
+
+extern struct mosquitto g_mosq;     /* l’unique client (mosquitto_new) */
+extern uint64_t         g_published; /* appels à mosquitto_publish */
+
+#endif
+
+// End of file
@@ -1,26 +1,185 @@
 #ifndef CAN_IO_H
 #define CAN_IO_H
 
+#include <semaphore.h>
+
+
+/* Nombre de trames lues par appel système (recvmmsg) */
+#ifndef CAN_RX_BATCH
+#define CAN_RX_BATCH 32
+#endif
+
+/* Métadonnées de réception d’une trame */
+typedef struct can_rx_meta_s {
+  uint64_t ts_ns;   /* horodatage noyau (CLOCK_REALTIME, ns), 0 si indisponible */
+  uint32_t drops;   /* trames perdues par la socket, cumulé (SO_RXQ_OVFL) */
+} can_rx_meta_t;
+
+/* Trame reçue (classique ou CAN FD) */
+typedef struct can_rx_frame_s {
+  uint32_t      can_id;
+  uint8_t       len;                    /* octets de données (0..64) */
+  uint8_t       data[CAN_PAYLOAD_MAX];  /* complétées par des 0 */
+  can_rx_meta_t meta;
+} can_rx_frame_t;
+
+/* Taille de la file d’émission (trames en attente de sendmmsg) */
+#ifndef CAN_TX_QUEUE
+#define CAN_TX_QUEUE 256
+#endif
+
+/* Délai avant nouvel essai quand le contrôleur est saturé (ENOBUFS) */
+#ifndef CAN_TX_RETRY_MS
+#define CAN_TX_RETRY_MS 5
+#endif
+
+/* Clé de fusion absente : la trame n’est jamais remplacée */
+#define CAN_TX_NO_KEY 0xFFFFFFFFu
+
+/* Compteurs de la file d’émission */
+typedef struct can_tx_stats_s {
+  uint64_t queued;      /* trames acceptées */
+  uint64_t sent;        /* trames écrites sur la socket */
+  uint64_t collapsed;   /* trames remplacées par une valeur plus récente */
+  uint64_t dropped;     /* trames perdues (file pleine, erreur socket) */
+  uint64_t busy;        /* envois différés (EAGAIN / ENOBUFS) */
+  uint64_t held;        /* commandes retenues (débit ou fenêtre de fusion, cf. can_queue_cmd) */
+} can_tx_stats_t;
+
+struct can_rx_batch_s;
+struct can_tx_batch_s;
+struct can_shape_s;
+struct can_txq_s;
+struct isotp_s;
 
 /* Contexte SocketCAN simple */
 typedef struct can_ctx_s {
   int fd;
+  bool fd_frames;                   /* trames CAN FD acceptées (CAN_RAW_FD_FRAMES, interface FD) */
+  struct can_rx_batch_s *batch;     /* tampons recvmmsg préalloués (privé) */
+  can_rx_frame_t rx[CAN_RX_BATCH];  /* dernier lot lu par can_poll_burst */
+  uint32_t       rx_drops;          /* dernier compteur SO_RXQ_OVFL vu */
+
+  struct can_tx_batch_s *txb;       /* file d’émission circulaire (privé) */
+  size_t         tx_head;           /* première trame en attente */
+  size_t         tx_count;          /* trames en attente */
+  int            tx_err;            /* errno du dernier envoi différé, 0 sinon */
+  bool           tx_collapse;       /* "dernière valeur gagne" par clé */
+  can_tx_stats_t tx_stats;
+
+  struct can_shape_s *shape;        /* commandes limitées, par (ID, clé) (privé) */
+  size_t         tx_held;           /* commandes retenues en attente d’échéance */
+
+  struct isotp_s *isotp;            /* sessions des messages segmentés (cf. isotp.h) */
+  struct can_txq_s *tx_wake;        /* mode multithread : file du thread TX, réveillée
+                                       par un FC reçu ; NULL sinon */
 } can_ctx_t;
 
-/* Init interface (ex: "can0" ou "vcan0"). Non-bloquant. */
-bool can_init(can_ctx_t *c, const char *ifname);
+/* Nombre maximal de filtres d’acceptation installés (CAN_RAW_FILTER) */
+#ifndef CAN_FILTER_MAX
+#define CAN_FILTER_MAX 32
+#endif
+
+/* Init interface (ex: "can0" ou "vcan0"). Non-bloquant.
+   Les filtres d’acceptation sont déduits de t (NULL = tout recevoir).
+   Les trames CAN FD sont activées si l’interface les accepte. */
+bool can_init(can_ctx_t *c, const char *ifname, const table_t *t);
+
+/* Init sur une socket datagramme déjà ouverte transportant des struct
+   can_frame ou canfd_frame (banc de mesure : socketpair AF_UNIX).
+   Pas de filtres. */
+bool can_init_fd(can_ctx_t *c, int fd);
 
-/* Send 8 octets sur un CAN ID standard */
-bool can_send(can_ctx_t *c, uint32_t can_id, const uint8_t data[8]);
+/* (Ré)installe les filtres d’acceptation après un changement de table */
+bool can_set_filters(can_ctx_t *c, const table_t *t);
+
+/* Les trames de len <= 8 octets partent en CAN classique, au-delà en
+   CAN FD (longueur arrondie à la longueur FD valide supérieure, débit
+   de données rapide) ; une trame FD est refusée si c->fd_frames est faux. */
+
+/* Send len octets sur un CAN ID standard : met la trame en file puis tente
+   de vider la file. true si la trame est envoyée ou en attente. */
+bool can_send(can_ctx_t *c, uint32_t can_id, const uint8_t *data, uint8_t len);
+
+/* Écrit une trame tout de suite, sans passer par la file d’émission ni
+   toucher à ses compteurs : utilisable depuis le lecteur CAN (FC des
+   messages segmentés). false si la socket ne l’accepte pas. */
+bool can_write(can_ctx_t *c, uint32_t can_id, const uint8_t *data, uint8_t len);
+
+/* Met une trame en file sans l’envoyer. Si tx_collapse est actif, une trame
+   en attente de même can_id et même clé est remplacée. false si file pleine.
+   t0 : réception de la commande MQTT (metrics_now_ns()), 0 si sans objet ;
+   la latence ML_MQTT_TO_CAN est relevée quand can_flush() écrit la trame. */
+bool can_queue(can_ctx_t *c, uint32_t can_id, const uint8_t *data, uint8_t len, uint32_t key, uint64_t t0);
+
+/* Met en file une commande selon la limitation de son entrée (cmd peut
+   être NULL) : envoyée tout de suite si le seau et la fenêtre de fusion
+   le permettent, sinon retenue, une commande retenue plus récente de même
+   ID et même clé la remplaçant. false si la file est pleine. t0 : cf. can_queue. */
+bool can_queue_cmd(can_ctx_t *c, uint32_t can_id, const uint8_t *data, uint8_t len, uint32_t key,
+                   const cmd_policy_t *cmd, uint64_t t0);
+
+/* Met en file les commandes retenues arrivées à échéance et fait avancer
+   les messages segmentés. Retourne le délai en ms jusqu’à la prochaine
+   échéance, -1 si rien n’est en attente. */
+int  can_tx_release(can_ctx_t *c);
+
+/* Envoie les trames en attente (sendmmsg, non bloquant).
+   Retourne le nombre de trames envoyées, -1 si erreur socket. */
+int  can_flush(can_ctx_t *c);
+
+/* true si des trames attendent d’être envoyées */
+bool can_tx_pending(const can_ctx_t *c);
+
+/* Journalise les compteurs de la file d’émission */
+void can_tx_report(const can_ctx_t *c);
 
 /* Pompe non-bloquante: lit au plus N trames et publie vers MQTT (via table) */
 void can_poll(can_ctx_t *c, const table_t *t, mqtt_ctx_t *m, int max_frames);
 
+/* Idem, mais attend au plus timeout_ms (-1 = infini) qu’une trame arrive */
+void can_poll_wait(can_ctx_t *c, const table_t *t, mqtt_ctx_t *m, int max_frames, int timeout_ms);
+
+/* Idem, sans attente : la socket est déjà signalée lisible (epoll) */
+void can_poll_ready(can_ctx_t *c, const table_t *t, mqtt_ctx_t *m, int max_frames);
+
+/* Attend au plus timeout_ms que la socket soit lisible */
+bool can_wait(can_ctx_t *c, int timeout_ms);
+
+/* Lit un lot d’au plus max_frames (<= CAN_RX_BATCH) trames en un appel
+   recvmmsg, dans ctx->rx. Attend au plus timeout_ms (0 = pas d’attente).
+   Retourne le nombre de trames lues, 0 si aucune, -1 si erreur. */
 int can_poll_burst(can_ctx_t *ctx, int max_frames, int timeout_ms);
 
 
 void can_cleanup(can_ctx_t *c);
 
+
+/* File d’émission inter-threads (mode multithread).
+   Producteur unique : callback MQTT. Consommateur unique : thread CAN TX.
+   Prérequis : spsc.h. */
+typedef struct can_txq_s {
+  spsc_t          ring;
+  sem_t           ready;     /* une unité par trame poussée */
+  _Atomic size_t  dropped;   /* trames perdues (file pleine) */
+} can_txq_t;
+
+bool can_txq_init(can_txq_t *q);
+void can_txq_destroy(can_txq_t *q);
+
+/* Producteur : dépose une trame (sans verrou), false si la file est pleine.
+   cmd (NULL = aucune) est appliquée par le consommateur (can_queue_cmd).
+   seg : 0, ou options ISOTP_* d’un message segmenté (data = charge utile,
+   key = inner ID) que le consommateur passe à isotp_send(). t0 : cf. can_queue. */
+bool can_txq_push(can_txq_t *q, uint32_t can_id, const uint8_t *data, uint8_t len, uint32_t key,
+                  const cmd_policy_t *cmd, uint8_t seg, uint64_t t0);
+
+/* Consommateur : attend une trame au plus timeout_ms, false si rien */
+bool can_txq_pop_wait(can_txq_t *q, can_msg_t *out, int timeout_ms);
+
+/* Réveille le consommateur (arrêt, FC d’un message segmenté) */
+void can_txq_wake(can_txq_t *q);
+
 #endif
 
 // End of file
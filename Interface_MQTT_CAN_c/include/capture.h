@@ -0,0 +1,93 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * Enregistrement du trafic du pont dans un fichier de capture binaire,
+ * relu par l’outil de rejeu (bench/bench_replay.c).
+ *
+ * Sont enregistrées les trames CAN reçues (avant la recherche dans la
+ * table) et les messages MQTT reçus par on_message, horodatés à
+ * l’horloge monotone. Le format est compact et indépendant de la
+ * plateforme (entiers variables, cf. capture.c).
+ *
+ * Les deux chemins (thread MQTT, thread CAN) copient l’enregistrement dans
+ * un anneau sans verrou ; un thread d’écriture l’écrit dans le fichier.
+ * Anneau plein : l’enregistrement est perdu et compté (journalisé par
+ * l’écrivain), sans attente. Hors enregistrement, un point de capture
+ * ne coûte qu’une lecture atomique.
+ */
+
+/* Charge utile CAN enregistrée au plus (trame CAN FD) */
+#define CAPTURE_CAN_MAX 64u
+
+#ifndef CAPTURE_RING_SIZE
+#define CAPTURE_RING_SIZE 1024u   /* enregistrements en attente d’écriture, puissance de 2 */
+#endif
+
+#ifndef CAPTURE_INLINE_MAX
+#define CAPTURE_INLINE_MAX 448u   /* topic + '\0' + payload copiés dans la case, au-delà alloués */
+#endif
+
+#ifndef CAPTURE_FLUSH_MS
+#define CAPTURE_FLUSH_MS 50       /* délai maximal avant écriture d’un enregistrement */
+#endif
+
+/* Types d’enregistrement */
+typedef enum capture_kind_e {
+  CAPTURE_CAN  = 1,   /* trame CAN reçue */
+  CAPTURE_MQTT = 2    /* message MQTT reçu */
+} capture_kind_t;
+
+extern _Atomic bool g_capture_on;
+
+static inline bool capture_on(void){
+  return atomic_load_explicit(&g_capture_on, memory_order_relaxed);
+}
+
+/* Démarre / arrête l’enregistrement et son thread d’écriture
+   (capture_close écrit les enregistrements en attente) */
+bool capture_open(const char *path);
+void capture_close(void);
+
+/* Points de capture (sans effet hors enregistrement) */
+void capture_can(uint32_t can_id, const uint8_t *data, uint8_t dlc);
+void capture_mqtt(const char *topic, const void *payload, size_t len);
+
+/* Enregistrement relu ; topic et payload pointent dans le fichier chargé */
+typedef struct capture_rec_s {
+  uint64_t        ts_ns;      /* depuis le début de la capture */
+  capture_kind_t  kind;
+  uint32_t        can_id;     /* CAPTURE_CAN */
+  uint8_t         dlc;        /* longueur de la charge utile */
+  uint8_t         data[CAPTURE_CAN_MAX];
+  const char     *topic;      /* CAPTURE_MQTT, terminé par '\0' */
+  const void     *payload;
+  size_t          len;
+} capture_rec_t;
+
+typedef struct capture_reader_s {
+  uint8_t  *buf;              /* fichier entier */
+  size_t    size;
+  size_t    pos;
+  uint64_t  ts_ns;            /* horodatage du dernier enregistrement lu */
+} capture_reader_t;
+
+/* Charge un fichier de capture (false : illisible ou en-tête invalide) */
+bool capture_reader_open(capture_reader_t *r, const char *path);
+
+/* Enregistrement suivant (false : fin du fichier ou enregistrement tronqué) */
+bool capture_next(capture_reader_t *r, capture_rec_t *rec);
+
+/* Revient au premier enregistrement */
+void capture_rewind(capture_reader_t *r);
+
+void capture_reader_close(capture_reader_t *r);
+
+#endif
+
+// End of file
@@ -0,0 +1,44 @@
+#ifndef DBC_H
+#define DBC_H
+
+#include <stdbool.h>
+
+/*
+ * Import d’un fichier DBC (Vector) comme source du dictionnaire : le
+ * fichier est traduit en un document de même forme que conversion.json,
+ * construit ensuite par table_load() (cf. table_load_dbc() et dbc.c pour
+ * la correspondance BO_/SG_/VAL_ -> entrées et champs).
+ *
+ * Topic d’un message : "<émetteur>/<message>" en minuscules, DBC_TOPIC_ROOT
+ * remplaçant un émetteur absent ("Vector__XXX"), ou la valeur de
+ * l’attribut de message DBC_TOPIC_ATTR s’il est défini.
+ */
+
+#ifndef DBC_TOPIC_ROOT
+#define DBC_TOPIC_ROOT "can"
+#endif
+
+#ifndef DBC_TOPIC_ATTR
+#define DBC_TOPIC_ATTR "MqttTopic"
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+struct cJSON;
+
+/* true si path désigne un fichier DBC (extension .dbc) */
+bool dbc_is(const char *path);
+
+/* Lit le fichier DBC path et rend le dictionnaire JSON équivalent
+   (à libérer par cJSON_Delete), NULL si le fichier est illisible */
+struct cJSON *dbc_to_json(const char *path);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DBC_H */
+
+// End of file
@@ -0,0 +1,29 @@
+#ifndef DICT_IMAGE_H
+#define DICT_IMAGE_H
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Signature et version du format (à incrémenter si types.h change) */
+#define DICT_IMAGE_MAGIC   "CBDICT\r\n"
+#define DICT_IMAGE_VERSION 5u
+
+/* Écrit l’image binaire d’une table chargée depuis le JSON (outil dictc) */
+bool dict_image_write(const table_t *t, const char *path);
+
+/* true si path commence par la signature d’image */
+bool dict_image_is(const char *path);
+
+/* Mappe une image (mmap, sans copie) ; libération par table_free() */
+bool dict_image_map(table_t *t, const char *path);
+void dict_image_unmap(table_t *t);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* DICT_IMAGE_H */
+
+// End of file
@@ -0,0 +1,22 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+
+/* Période du timer (keepalive MQTT, reconnexion, statistiques, métriques) */
+#ifndef EVENT_LOOP_TICK_MS
+#define EVENT_LOOP_TICK_MS 1000
+#endif
+
+/* Période d’affichage des latences réveil -> traitement */
+#ifndef EVENT_LOOP_STATS_S
+#define EVENT_LOOP_STATS_S 60
+#endif
+
+/* Boucle d’événements mono-thread (epoll) : socket CAN, socket MQTT,
+   timerfd, signalfd (SIGINT/SIGTERM, SIGHUP) et inotify (rechargement,
+   rl peut être NULL). Rend la main à l’arrêt. */
+bool event_loop_run(table_rcu_t *tables, can_ctx_t *c, mqtt_ctx_t *m, reload_t *rl);
+
+#endif
+
+// End of file
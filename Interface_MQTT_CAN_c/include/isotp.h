@@ -0,0 +1,75 @@
+#ifndef ISOTP_H
+#define ISOTP_H
+
+/*
+ * Transport segmenté façon ISO-TP (ISO 15765-2) des entrées dont la
+ * charge utile dépasse une trame (clé "segmented" du dictionnaire).
+ *
+ * Trames, après l’en-tête tunnel éventuel (PCI : premier octet) :
+ *   SF  0x0L données             message complet, L <= 7 (FD : 0x00 L données)
+ *   FF  0x1H LL données          premier segment, longueur sur 12 bits
+ *   CF  0x2N données             segment suivant, N = numéro de séquence (mod 16)
+ *   FC  0x3S BS STmin            contrôle de flux (S : 0 continuer, 1 attendre, 2 débordement)
+ * Les trames sont complétées par des 0 jusqu’à 8 octets (ou jusqu’à la
+ * longueur CAN FD valide suivante).
+ *
+ * Émission (propriétaire de la file d’émission, comme can_queue) : une
+ * session par (CAN ID, inner ID). Après le FC du récepteur, les CF d’un
+ * bloc partent ensemble dans la file, donc dans un même sendmmsg, si
+ * STmin vaut 0 ; sinon un CF par STmin (cf. can_tx_release()). Un message
+ * arrivé pendant une session part à sa suite ; s’il en arrive plusieurs,
+ * seul le plus récent est gardé.
+ *
+ * Réception (lecteur CAN) : réassemblage dans des tampons préalloués par
+ * (CAN ID, inner ID), avec un FC envoyé aussitôt (BS 0, STmin 0 : tout
+ * le message au rythme du bus) par can_write(). Une session sans trame
+ * depuis ISOTP_TIMEOUT_MS est abandonnée.
+ *
+ * Prérequis : types.h, mqtt_io.h, spsc.h, can_io.h.
+ */
+
+/* Sessions simultanées, dans chaque sens */
+#ifndef ISOTP_SESSIONS
+#define ISOTP_SESSIONS 16
+#endif
+
+/* Attente maximale d’un FC (N_Bs) ou d’un CF (N_Cr) */
+#ifndef ISOTP_TIMEOUT_MS
+#define ISOTP_TIMEOUT_MS 1000
+#endif
+
+/* Options d’un message segmenté (can_msg_t.seg, isotp_send) */
+#define ISOTP_ON     0x01u   /* message segmenté */
+#define ISOTP_TUNNEL 0x02u   /* inner ID (2 octets) en tête de chaque trame */
+#define ISOTP_FD     0x04u   /* trames CAN FD (64 octets) */
+
+/* Options d’une entrée, 0 si elle n’est pas segmentée */
+static inline uint8_t isotp_flags(const entry_t *e){
+  if(!e->seg) return 0;
+  return (uint8_t)(ISOTP_ON | (e->route == ROUTE_TUNNEL ? ISOTP_TUNNEL : 0) | (e->fd ? ISOTP_FD : 0));
+}
+
+struct isotp_s;
+
+/* Sessions préallouées (cf. can_init) */
+struct isotp_s *isotp_create(void);
+void isotp_destroy(struct isotp_s *s);
+
+/* Émet len octets (<= ENTRY_PAYLOAD_MAX) sur can_id ; key : inner ID ;
+   t0 : réception MQTT (cf. can_queue), relevée au premier segment.
+   false si le message ne peut partir (aucune session libre, file pleine). */
+bool isotp_send(can_ctx_t *c, uint32_t can_id, uint32_t key, uint8_t flags, const uint8_t *data, size_t len,
+                uint64_t t0);
+
+/* Fait avancer les émissions en cours (appelé par can_tx_release).
+   Retourne le délai en ms jusqu’à la prochaine échéance, -1 si aucune. */
+int  isotp_tx_release(can_ctx_t *c);
+
+/* Trame reçue d’une entrée segmentée (hdr : octets d’en-tête tunnel) :
+   réassemble et publie le message complet, ou transmet un FC à la
+   session d’émission concernée. */
+void isotp_rx(can_ctx_t *c, const entry_t *e, const can_rx_frame_t *r, unsigned hdr, mqtt_ctx_t *m);
+
+#endif
+
+// End of file
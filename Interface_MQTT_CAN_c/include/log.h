@@ -1,21 +1,103 @@
 #ifndef LOG_H
 #define LOG_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
 
+/*
+ * Journal asynchrone.
+ *
+ * Les macros LOGx déposent la ligne formatée dans un anneau sans verrou
+ * (plusieurs producteurs, un consommateur) ; un thread d’écriture la
+ * sort sur stdout (stderr pour les erreurs). L’appelant ne fait donc
+ * jamais d’entrée/sortie. LOG_BIN va plus loin : seuls le format et ses
+ * arguments entiers sont copiés, le formatage est fait par le thread
+ * d’écriture. Anneau plein : la ligne est perdue (et comptée), l’appelant
+ * n’attend jamais.
+ *
+ * Avant log_start() et après log_stop() (outils, démarrage, arrêt), les
+ * lignes sont écrites directement par l’appelant.
+ *
+ * Le niveau (log_set_level) et l’échantillonnage par catégorie
+ * (log_set_sampling) se changent à chaud ; une ligne filtrée ne coûte
+ * qu’une lecture atomique.
+ */
 
-static inline const char* now_ts(void) {
-  static char buf[32];
-  time_t t = time(NULL);
-  struct tm tm;
-  
-  localtime_r(&t, &tm);
-  strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
-  return buf;
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 1024u   /* lignes en attente d’écriture, puissance de 2 */
+#endif
+
+#ifndef LOG_LINE_MAX
+#define LOG_LINE_MAX 256      /* au-delà, la ligne est tronquée */
+#endif
+
+#ifndef LOG_FLUSH_MS
+#define LOG_FLUSH_MS 20       /* délai maximal avant écriture d’une ligne */
+#endif
+
+#define LOG_BIN_ARGS 4        /* arguments au plus pour LOG_BIN (1 au moins) */
+
+typedef enum log_level_e {
+  LOG_ERR,
+  LOG_WARN,
+  LOG_INFO,
+  LOG_DEBUG
+} log_level_t;
+
+/* Catégories échantillonnables (noms : "gen", "mqtt", "can") */
+typedef enum log_cat_e {
+  LOG_CAT_GEN,        /* messages ordinaires */
+  LOG_CAT_MQTT_CAN,   /* une ligne par commande MQTT -> CAN */
+  LOG_CAT_CAN_MQTT,   /* une ligne par trame CAN -> MQTT */
+  LOG_CAT_COUNT
+} log_cat_t;
+
+extern _Atomic int      g_log_level;
+extern _Atomic uint32_t g_log_sample[LOG_CAT_COUNT];
+
+/* Une ligne sur n de la catégorie (appelé seulement si n > 1) */
+bool log_sampled(log_cat_t cat);
+
+static inline bool log_enabled(log_level_t lvl, log_cat_t cat){
+  if((int)lvl > atomic_load_explicit(&g_log_level, memory_order_relaxed)) return false;
+  return atomic_load_explicit(&g_log_sample[cat], memory_order_relaxed) <= 1 || log_sampled(cat);
 }
 
-#define LOGI(fmt, ...) fprintf(stdout, "[%s] [INFO] " fmt "\n",  now_ts(), ##__VA_ARGS__)
-#define LOGW(fmt, ...) fprintf(stdout, "[%s] [WARN] " fmt "\n",  now_ts(), ##__VA_ARGS__)
-#define LOGE(fmt, ...) fprintf(stderr, "[%s] [ERR ] " fmt "\n",  now_ts(), ##__VA_ARGS__)
+/* Ligne formatée par l’appelant, écrite par le thread d’écriture */
+void log_printf(log_level_t lvl, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+/* Ligne formatée par le thread d’écriture : fmt doit rester valide
+   (littéral) et n’utiliser que des conversions 64 bits (%llu, %llx, %llX) */
+void log_binary(log_level_t lvl, const char *fmt, const uint64_t *args, unsigned n);
+
+#define LOG_AT(lvl, cat, fmt, ...) \
+  do{ if(log_enabled(lvl, cat)) log_printf(lvl, fmt, ##__VA_ARGS__); }while(0)
+
+#define LOG_BIN(lvl, cat, fmt, ...) \
+  do{ \
+    if(log_enabled(lvl, cat)){ \
+      const uint64_t log_args_[] = { __VA_ARGS__ }; \
+      _Static_assert(sizeof(log_args_) <= LOG_BIN_ARGS * sizeof(uint64_t), "LOG_BIN: trop d’arguments"); \
+      log_binary(lvl, fmt, log_args_, (unsigned)(sizeof(log_args_) / sizeof(log_args_[0]))); \
+    } \
+  }while(0)
+
+#define LOGD(fmt, ...) LOG_AT(LOG_DEBUG, LOG_CAT_GEN, fmt, ##__VA_ARGS__)
+#define LOGI(fmt, ...) LOG_AT(LOG_INFO,  LOG_CAT_GEN, fmt, ##__VA_ARGS__)
+#define LOGW(fmt, ...) LOG_AT(LOG_WARN,  LOG_CAT_GEN, fmt, ##__VA_ARGS__)
+#define LOGE(fmt, ...) LOG_AT(LOG_ERR,   LOG_CAT_GEN, fmt, ##__VA_ARGS__)
+
+/* Démarre / arrête le thread d’écriture (log_stop écrit les lignes restantes) */
+bool log_start(void);
+void log_stop(void);
+
+/* Niveau maximal écrit ("err", "warn", "info", "debug") */
+void log_set_level(log_level_t lvl);
+bool log_set_level_name(const char *name);
+
+/* Échantillonnage "cat=n" : une ligne sur n de la catégorie (1 : toutes) */
+bool log_set_sampling(const char *spec);
 
 #endif
 
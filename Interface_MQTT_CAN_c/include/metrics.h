@@ -0,0 +1,127 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <time.h>
+
+/*
+ * Compteurs et histogrammes de latence du pont, sans verrou.
+ *
+ * Mis à jour depuis n’importe quel thread (callback MQTT, threads CAN)
+ * par des additions atomiques relâchées : un compteur coûte une addition,
+ * une mesure de latence deux (seau + somme). Chaque compteur et chaque
+ * histogramme occupe ses propres lignes de cache (pas de faux partage
+ * entre le thread MQTT et les threads CAN).
+ *
+ * Les histogrammes sont log-linéaires (façon HDR) : 2^METRICS_SUB_BITS
+ * seaux par puissance de 2, soit une précision relative de 1/16 de la
+ * nanoseconde à 2^METRICS_MAX_BITS ns.
+ */
+
+/* Topic de publication périodique (cf. mqtt_metrics_tick) ; les filtres
+   '#' et '+' ne couvrent pas les topics en '$' : s’y abonner explicitement */
+#ifndef METRICS_TOPIC
+#define METRICS_TOPIC "$bridge/metrics"
+#endif
+
+/* Période de publication, 0 : désactivée */
+#ifndef METRICS_PERIOD_S
+#define METRICS_PERIOD_S 10
+#endif
+
+/* Taille maximale du JSON des métriques */
+#define METRICS_JSON_MAX 2048
+
+#define METRICS_SUB_BITS 4
+#define METRICS_SUB      (1u << METRICS_SUB_BITS)
+#define METRICS_MAX_BITS 40   /* au-delà de 2^40 ns (~18 min) : dernier seau */
+#define METRICS_BUCKETS  (METRICS_SUB + (METRICS_MAX_BITS - METRICS_SUB_BITS) * METRICS_SUB)
+
+/* Compteurs (noms JSON dans metrics.c) */
+typedef enum metric_id_e {
+  MC_MQTT_RX,           /* commandes MQTT reçues */
+  MC_TOPIC_MISS,        /* topic absent de la table */
+  MC_JSON_INVALID,      /* payload JSON illisible */
+  MC_PACK_FAIL,         /* champ invalide au pack */
+  MC_CAN_TX_SENT,       /* trames écrites sur la socket CAN */
+  MC_CAN_TX_DROP,       /* trames perdues (file pleine, erreur socket) */
+  MC_CAN_RX,            /* trames CAN lues */
+  MC_CANID_MISS,        /* CAN ID absent de la table */
+  MC_CAN_RX_OVERFLOW,   /* trames perdues par la socket (SO_RXQ_OVFL) */
+  MC_UNPACK_FAIL,       /* échec d’encodage JSON */
+  MC_MQTT_PUB,          /* publications réussies */
+  MC_MQTT_PUB_FAIL,     /* publications échouées */
+  MC_MQTT_PUB_SKIPPED,  /* trames non publiées (cf. pub_policy_t) */
+  MC_SEG_TX,            /* messages segmentés émis (cf. isotp.h) */
+  MC_SEG_RX,            /* messages segmentés réassemblés */
+  MC_SEG_FAIL,          /* sessions segmentées abandonnées (délai, séquence, débordement) */
+  MC_COUNT
+} metric_id_t;
+
+/* Latences mesurées */
+typedef enum metric_lat_e {
+  ML_MQTT_TO_CAN,       /* réception MQTT -> trame écrite sur la socket CAN (can_flush ;
+                           premier segment d’un message segmenté) */
+  ML_CAN_TO_MQTT,       /* horodatage noyau de la trame -> publication MQTT */
+  ML_COUNT
+} metric_lat_t;
+
+typedef struct metrics_counter_s {
+  alignas(64) _Atomic uint64_t v;
+} metrics_counter_t;
+
+typedef struct metrics_hist_s {
+  alignas(64) _Atomic uint64_t sum_ns;
+  _Atomic uint64_t bucket[METRICS_BUCKETS];
+} metrics_hist_t;
+
+typedef struct metrics_s {
+  metrics_counter_t counter[MC_COUNT];
+  metrics_hist_t    lat[ML_COUNT];
+} metrics_t;
+
+extern metrics_t g_metrics;
+
+/* Horloge monotone (ns) pour les mesures de latence */
+static inline uint64_t metrics_now_ns(void){
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static inline void metrics_add(metric_id_t id, uint64_t n){
+  atomic_fetch_add_explicit(&g_metrics.counter[id].v, n, memory_order_relaxed);
+}
+
+static inline void metrics_inc(metric_id_t id){
+  metrics_add(id, 1);
+}
+
+/* Seau d’une durée : exacte sous METRICS_SUB ns, puis
+   METRICS_SUB seaux par puissance de 2 */
+static inline unsigned metrics_bucket(uint64_t ns){
+  if(ns < METRICS_SUB) return (unsigned)ns;
+  unsigned msb = 63u - (unsigned)__builtin_clzll(ns);
+  if(msb >= METRICS_MAX_BITS) return METRICS_BUCKETS - 1;
+  return (msb - METRICS_SUB_BITS + 1) * METRICS_SUB +
+         (unsigned)((ns >> (msb - METRICS_SUB_BITS)) & (METRICS_SUB - 1));
+}
+
+static inline void metrics_lat(metric_lat_t id, uint64_t ns){
+  metrics_hist_t *h = &g_metrics.lat[id];
+  atomic_fetch_add_explicit(&h->bucket[metrics_bucket(ns)], 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&h->sum_ns, ns, memory_order_relaxed);
+}
+
+/* JSON des métriques : compteurs cumulés depuis le démarrage, latences
+   (nombre, moyenne, p50/p90/p99/max en µs) sur l’intervalle écoulé depuis
+   l’appel précédent. Un seul thread appelant. Renvoie la longueur écrite,
+   0 si len est insuffisant. */
+size_t metrics_json(char *buf, size_t len);
+
+#endif
+
+// End of file
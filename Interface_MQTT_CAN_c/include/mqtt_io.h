@@ -4,29 +4,76 @@
 
 struct mosquitto;
 struct table_s;
+struct table_rcu_s;
 struct entry_s;
 struct can_ctx_s;
+struct can_txq_s;
+struct can_rx_meta_s;
+struct pub_cache_s;
+
+/* Nombre de topics d’un même parent à partir duquel on s’abonne
+   à "parent/+" et "parent/+/cmd" plutôt qu’à chaque topic */
+#ifndef MQTT_SUB_WILDCARD_MIN
+#define MQTT_SUB_WILDCARD_MIN 4
+#endif
+
+/* Compteurs des publications CAN -> MQTT (cf. pub_policy_t) */
+typedef struct mqtt_pub_stats_s {
+  uint64_t published;   /* trames publiées */
+  uint64_t unchanged;   /* non publiées : payload identique au dernier publié */
+  uint64_t limited;     /* non publiées : intervalle minimal non écoulé */
+} mqtt_pub_stats_t;
 
 typedef struct mqtt_ctx_s {
   struct mosquitto *mosq;
   int qos_sub;  /* 0..2 (def 1) */
   int qos_pub;  /* 0..2 (def 1) */
+  char **subs;      /* abonnements calculés depuis la table (rejoués à la reconnexion) */
+  int    sub_count;
+  unsigned connects; /* nombre de CONNACK reçus */
+  struct pub_cache_s *pub;   /* derniers payloads publiés par entrée (privé) */
+  mqtt_pub_stats_t pub_stats;
+  uint64_t metrics_ns;       /* dernière publication des métriques (cf. mqtt_metrics_tick) */
 } mqtt_ctx_t;
 
+/* User-data des callbacks: {table,can,mqtt} (+ file TX en mode multithread) */
+typedef struct user_bundle_s {
+  struct table_rcu_s   *tables;   /* table courante (remplaçable à chaud) */
+  struct can_ctx_s     *can;
+  mqtt_ctx_t           *mqtt;
+  struct can_txq_s     *txq;   /* NULL : envoi CAN direct depuis on_message */
+} user_bundle_t;
+
 /* Init MQTT (v5 + no_local), callbacks installées mais pas de thread lancé */
 bool mqtt_init(mqtt_ctx_t *ctx, const char *host, int port, int keepalive);
 
 /* Subscription large (‘#’) avec option v5 no_local */
 bool mqtt_subscribe_all_nolocal(mqtt_ctx_t *ctx);
 
+/* Abonnements minimaux déduits de la table (topics + variantes /cmd),
+   en un seul SUBSCRIBE, option v5 no_local */
+bool mqtt_subscribe_table(mqtt_ctx_t *ctx, const struct table_s *t);
+
 /* Pompe non-bloquante (à appeler dans my_loop) */
 bool mqtt_poll(mqtt_ctx_t *ctx);
 
 /* Publier un JSON sur un topic */
 bool mqtt_publish_json(mqtt_ctx_t *ctx, const char *topic, const char *json_str);
 
-/* CAN -> MQTT (publie sur le topic de base, sans /state) */
-bool mqtt_handle_can_message(mqtt_ctx_t *ctx, const struct entry_s *e, const uint8_t data[8]);
+/* CAN -> MQTT (publie sur le topic de base, sans /state), selon la
+   politique de publication de l’entrée (trames inchangées ou trop
+   rapprochées ignorées avant tout encodage).
+   data : e->payload_max octets, en-tête tunnel retiré.
+   meta (horodatage noyau, pertes) peut être NULL. */
+bool mqtt_handle_can_message(mqtt_ctx_t *ctx, const struct entry_s *e, const uint8_t *data,
+                             const struct can_rx_meta_s *meta);
+
+/* Journalise les compteurs de publication CAN -> MQTT */
+void mqtt_pub_report(const mqtt_ctx_t *ctx);
+
+/* Publie les métriques (metrics.h) sur METRICS_TOPIC toutes les
+   METRICS_PERIOD_S secondes ; à appeler régulièrement, depuis un seul thread */
+bool mqtt_metrics_tick(mqtt_ctx_t *ctx);
 
 /* User-data: passer {table,can,mqtt} au callback on_message */
 void mqtt_set_user_data(mqtt_ctx_t *ctx, void *userdata);
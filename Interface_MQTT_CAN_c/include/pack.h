@@ -2,11 +2,29 @@
 #define PACK_H
 
 
-/* Packe un objet JSON vers 8 octets CAN selon l'entry. */
-bool pack_payload(uint8_t out8[8], const entry_t *entry, cJSON *json_in);
+/* Résultat de l’analyse directe d’un payload JSON */
+typedef enum {
+  PACK_OK = 0,      /* trame remplie */
+  PACK_ERR_JSON,    /* payload JSON invalide */
+  PACK_ERR_FIELD    /* champ manquant, mauvais type, hors plage, enum inconnu */
+} pack_status_t;
 
-/* Dépacke 8 octets CAN vers un objet JSON (à libérer avec cJSON_Delete). */
-cJSON* unpack_payload(const uint8_t in8[8], const entry_t *entry);
+/* Les charges utiles font entry->payload_max octets (en-tête tunnel
+   exclu) : un tampon de ENTRY_PAYLOAD_MAX octets convient toujours. */
+
+/* Packe un objet JSON vers la charge utile CAN de l'entry. */
+bool pack_payload(uint8_t *out, const entry_t *entry, cJSON *json_in);
+
+/* Dépacke une charge utile CAN vers un objet JSON (à libérer avec cJSON_Delete). */
+cJSON* unpack_payload(const uint8_t *in, const entry_t *entry);
+
+/* Encode une charge utile CAN en texte JSON dans buf, sans allocation.
+   Retourne la longueur écrite (hors '\0'), 0 si erreur ou cap <= entry->json_max. */
+size_t pack_encode_json(char *buf, size_t cap, const uint8_t *in, const entry_t *entry);
+
+/* Analyse un texte JSON (len octets, lu en place, sans DOM ni copie)
+   et le packe directement vers la charge utile CAN de l'entry. */
+pack_status_t pack_parse_json(uint8_t *out, const entry_t *entry, const char *json, size_t len);
 
 #endif /* PACK_H */
 
@@ -0,0 +1,44 @@
+#ifndef RELOAD_H
+#define RELOAD_H
+
+/*
+ * Rechargement à chaud de conversion.json.
+ *
+ * Déclenché par SIGHUP (reload_request) ou par une modification du
+ * fichier (inotify sur son répertoire, pour suivre aussi les éditeurs
+ * qui remplacent le fichier par renommage).
+ *
+ * Prérequis : "types.h", "mqtt_io.h", "can_io.h".
+ */
+
+typedef struct reload_s {
+  table_rcu_t *tables;
+  can_ctx_t   *can;
+  mqtt_ctx_t  *mqtt;
+  const char  *path;
+  const char  *name;        /* nom du fichier dans son répertoire */
+  int          ifd;         /* inotify, -1 si indisponible */
+  _Atomic int  requested;   /* positionné par SIGHUP */
+} reload_t;
+
+/* Prépare la surveillance de path (inotify facultatif) */
+bool reload_init(reload_t *r, const char *path, table_rcu_t *tables, can_ctx_t *can, mqtt_ctx_t *mqtt);
+void reload_cleanup(reload_t *r);
+
+/* Descripteur inotify à surveiller en lecture (-1 si indisponible) */
+int  reload_fd(const reload_t *r);
+
+/* Demande un rechargement (utilisable dans un gestionnaire de signal) */
+void reload_request(reload_t *r);
+
+/* Consomme les événements inotify en attente et recharge si le fichier
+   a changé ou si un rechargement a été demandé. Non bloquant. */
+bool reload_poll(reload_t *r);
+
+/* Recharge immédiatement : nouvelle table, bascule, filtres CAN,
+   abonnements MQTT. En cas d’échec la table courante est conservée. */
+bool reload_now(reload_t *r);
+
+#endif
+
+// End of file
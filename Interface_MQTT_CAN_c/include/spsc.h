@@ -0,0 +1,78 @@
+#ifndef SPSC_H
+#define SPSC_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <string.h>
+
+/*
+ * File circulaire sans verrou, un seul producteur / un seul consommateur.
+ *
+ * Utilisée entre le callback MQTT (thread réseau mosquitto) et le thread
+ * d’émission CAN. Les index de tête et de queue sont sur des lignes de
+ * cache distinctes pour éviter le faux partage.
+ *
+ * Seuls l’en-tête et les octets utiles d’un message sont recopiés : une
+ * trame de 8 octets ne paie pas la place d’un message segmenté.
+ *
+ * Prérequis : types.h.
+ */
+
+#ifndef SPSC_CAPACITY
+#define SPSC_CAPACITY 1024u   /* puissance de 2 */
+#endif
+
+/* Trame CAN (ou message segmenté) en attente d’émission */
+typedef struct can_msg_s {
+  uint64_t t0;        /* réception MQTT (metrics_now_ns()), 0 = non mesurée */
+  uint32_t can_id;
+  uint32_t key;       /* clé de fusion (cf. can_queue) ; inner ID si segmenté */
+  cmd_policy_t cmd;   /* limitation de l’entrée (cf. can_queue_cmd) */
+  uint8_t  seg;       /* 0 : trame ; sinon options ISOTP_* (cf. isotp.h) */
+  uint8_t  len;       /* octets de données (> 8 : trame CAN FD) */
+  uint8_t  data[ENTRY_PAYLOAD_MAX];   /* segmenté : charge utile, sans en-tête */
+} can_msg_t;
+
+/* Octets d’un message à recopier */
+static inline size_t can_msg_size(const can_msg_t *m){
+  return offsetof(can_msg_t, data) + m->len;
+}
+
+typedef struct spsc_s {
+  alignas(64) _Atomic size_t head;   /* écrit par le producteur */
+  alignas(64) _Atomic size_t tail;   /* écrit par le consommateur */
+  alignas(64) can_msg_t buf[SPSC_CAPACITY];
+} spsc_t;
+
+static inline void spsc_init(spsc_t *q){
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+}
+
+/* Producteur : false si la file est pleine */
+static inline bool spsc_push(spsc_t *q, const can_msg_t *m){
+  size_t h = atomic_load_explicit(&q->head, memory_order_relaxed);
+  size_t t = atomic_load_explicit(&q->tail, memory_order_acquire);
+  if(h - t >= SPSC_CAPACITY) return false;
+  memcpy(&q->buf[h & (SPSC_CAPACITY - 1)], m, can_msg_size(m));
+  atomic_store_explicit(&q->head, h + 1, memory_order_release);
+  return true;
+}
+
+/* Consommateur : false si la file est vide */
+static inline bool spsc_pop(spsc_t *q, can_msg_t *m){
+  size_t t = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  size_t h = atomic_load_explicit(&q->head, memory_order_acquire);
+  if(t == h) return false;
+  const can_msg_t *src = &q->buf[t & (SPSC_CAPACITY - 1)];
+  memcpy(m, src, can_msg_size(src));
+  atomic_store_explicit(&q->tail, t + 1, memory_order_release);
+  return true;
+}
+
+#endif /* SPSC_H */
+
+// End of file
@@ -6,13 +6,29 @@
 extern "C" {
 #endif
 
+/* Charge conversion.json, une image dictc ou un fichier .dbc (cf. dbc.h) */
 bool table_load(table_t *t, const char *json_path);
+bool table_load_dbc(table_t *t, const char *dbc_path);
 void table_free(table_t *t);
 
-/* lookups (O(1)) */
+/* Longueur max du JSON encodé d’une entrée compilée (entry_t.json_max) */
+size_t table_json_max(const entry_t *e);
+
+/* lookups (O(1) : index construits par table_load) */
 const entry_t* table_find_by_topic(const table_t *t, const char *topic);
 const entry_t* table_find_by_canid(const table_t *t, uint32_t can_id);
 
+/* Routage d’une trame reçue : tunnel si can_id est un ID de transport
+   (inner ID dans les 2 premiers octets, *hdr = 2), sinon ID direct (*hdr = 0) */
+const entry_t* table_find_rx(const table_t *t, uint32_t can_id, const uint8_t *data, uint8_t dlc, uint8_t *hdr);
+
+/* Table remplaçable à chaud (cf. table_rcu_t) */
+void           table_rcu_init(table_rcu_t *r, table_t *t);
+const table_t* table_rcu_enter(table_rcu_t *r, int reader);
+void           table_rcu_leave(table_rcu_t *r, int reader);
+/* Publie nt, attend la fin des lectures commencées avant, rend l’ancienne table */
+table_t*       table_rcu_swap(table_rcu_t *r, table_t *nt);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,54 +1,210 @@
 #ifndef TYPES_H
 #define TYPES_H
 
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
-/* Types de champ */
+/* Types de champ (largeur par défaut ; "bits" la change, sauf FT_HEX
+   et FT_FLOAT) */
 typedef enum {
   FT_INT   = 0,  /* 1 octet (0..255) */
-  FT_BOOL  = 1,  /* 0/1 */
+  FT_BOOL  = 1,  /* 0/1 sur 1 octet */
   FT_HEX   = 2,  /* "#RRGGBB" -> 3 octets */
   FT_INT16 = 3,  /* 2 octets big-endian */
-  FT_ENUM  = 4   /* 1 octet via dictionnaire */
+  FT_ENUM  = 4,  /* 1 octet via dictionnaire (8 bits au plus) */
+  FT_UINT  = 5,  /* entier non signé, 32 bits */
+  FT_SINT  = 6,  /* entier signé (complément à 2), largeur selon le type */
+  FT_FLOAT = 7   /* flottant IEEE 754 simple précision, 32 bits */
 } field_type_t;
 
+/* Bit de départ d’un champ placé à la suite du précédent */
+#define FIELD_START_AUTO 0xFFFFu
+
+
+/* Acheminement d’une entrée sur le bus */
+typedef enum {
+  ROUTE_TUNNEL = 0,  /* trame sur l’ID de transport : [inner ID (2 octets), 6 octets] */
+  ROUTE_DIRECT = 1   /* trame sur le CAN ID de l’entrée : 8 octets */
+} route_mode_t;
+
+/* Identifiants CAN (convention SocketCAN) : un ID étendu sur 29 bits porte
+   CAN_ID_EXT (même valeur que CAN_EFF_FLAG), un ID standard tient sur 11 bits */
+#define CAN_ID_EXT      0x80000000u
+#define CAN_ID_EXT_MASK 0x1FFFFFFFu
+#define CAN_ID_STD_MASK 0x7FFu
+
+/* ID tel qu’émis sur le bus : 29 bits et CAN_ID_EXT si étendu, 11 bits sinon */
+static inline uint32_t can_id_bus(uint32_t id){
+  return (id & CAN_ID_EXT) ? (id & (CAN_ID_EXT | CAN_ID_EXT_MASK)) : (id & CAN_ID_STD_MASK);
+}
+
+/* Charge utile maximale d’une trame (CAN FD ; 8 en CAN classique) */
+#define CAN_PAYLOAD_MAX 64u
+
+/* Charge utile maximale d’une entrée segmentée (clé "segmented", cf.
+   isotp.h) : bornée par les décalages de champ sur 8 bits */
+#define ENTRY_PAYLOAD_MAX 255u
+
+/* Nombre maximal de champs d’une entrée (les suivants sont ignorés au
+   chargement) */
+#define ENTRY_FIELDS_MAX ENTRY_PAYLOAD_MAX
+
+/* Longueurs de données valides en CAN FD au-delà de 8 octets : plus petite
+   longueur valide >= n (n <= CAN_PAYLOAD_MAX) */
+static inline uint8_t can_fd_len(unsigned n){
+  static const uint8_t len[] = { 12, 16, 20, 24, 32, 48, 64 };
+  if(n <= 8) return (uint8_t)n;
+  for(unsigned i = 0; i < sizeof(len) - 1; i++) if(n <= len[i]) return len[i];
+  return len[sizeof(len) - 1];
+}
+
+/* ID de transport tunnel par défaut (clé "transport_id" absente) */
+#ifndef TABLE_DEFAULT_TRANSPORT
+#define TABLE_DEFAULT_TRANSPORT 0x431u
+#endif
+
+
+/* Politique de publication CAN -> MQTT d’une entrée (défaut : chaque trame) */
+typedef struct pub_policy_s {
+  bool      on_change;        /* payload identique au dernier publié : non publié */
+  uint32_t  min_interval_ms;  /* au plus une publication par période (0 = sans limite) */
+  uint32_t  heartbeat_ms;     /* on_change : republication sans changement après ce délai (0 = jamais) */
+} pub_policy_t;
+
+
+/* Limitation des commandes MQTT -> CAN d’une entrée (défaut : aucune).
+   Une commande retenue est remplacée par toute commande plus récente
+   de même inner ID : seule la dernière part à l’échéance. */
+typedef struct cmd_policy_s {
+  uint32_t  interval_us;      /* seau à jetons : 1 jeton par intervalle (0 = sans limite) */
+  uint32_t  burst;            /* capacité du seau (>= 1) */
+  uint32_t  coalesce_ms;      /* fenêtre de fusion après chaque envoi (0 = aucune) */
+} cmd_policy_t;
+
 
-/* Paires enum "clé -> valeur" (liste chaînée) */
+/* Paires enum "clé -> valeur" (nœuds contigus dans l’arène, chaînés dans l’ordre) */
 typedef struct enum_kv_s {
-  char               *key;   /* alloué, libéré dans table_free */
   int                 value;
+  const char         *json;     /* clé pré-rendue en chaîne JSON ("\"ON\"") */
+  size_t              json_len;
+  const char         *key;      /* chaîne internée */
   struct enum_kv_s   *next;
 } enum_kv_t;
 
 
-/* Spéc d’un champ */
+/* Spéc d’un champ (champs utilisés par pack/unpack en tête) */
 typedef struct field_spec_s {
-  char        *name;       /* alloué, libéré dans table_free */
   field_type_t type;
-  enum_kv_t   *enum_list;  /* pour FT_ENUM sinon NULL */
+
+  /* Disposition précompilée par table_load : la valeur brute est lue sur
+     les octets [offset, offset + width) comme un entier (premier octet de
+     poids fort, ou de poids faible si little), puis (brut >> shift) & mask */
+  uint8_t      offset;       /* octet de départ dans la trame */
+  uint8_t      width;        /* nombre d’octets occupés (1..5) */
+  uint8_t      shift;        /* bit de poids faible de la valeur dans ces octets */
+  uint8_t      bits;         /* longueur en bits (1..32 ; 0 avant compilation = défaut du type) */
+  bool         little;       /* ordre Intel (octet de poids faible en tête) */
+  bool         scaled;       /* valeur physique = brut * scale + bias (sinon brut) */
+  uint32_t     mask;         /* (1 << bits) - 1 */
+  double       scale;
+  double       bias;         /* clé "offset" de conversion.json */
+  const enum_kv_t **enum_by_code; /* FT_ENUM : 256 paires indexées par code (NULL = inconnu) */
+  const char  *json_key;     /* fragment JSON pré-rendu : {"nom": ou ,"nom": */
+  size_t       json_key_len;
+
+  const char  *name;         /* chaîne internée */
+  enum_kv_t   *enum_list;    /* pour FT_ENUM sinon NULL */
+  uint16_t     start_bit;    /* bit de départ demandé (convention DBC), FIELD_START_AUTO sinon */
 } field_spec_t;
 
 
-/* Une entrée = topic + CAN ID + liste de champs */
+/* Une entrée = topic + CAN ID + liste de champs.
+   Tout est stocké dans l’arène de la table (libérée d’un bloc). */
 typedef struct entry_s {
-  char         *topic;        /* alloué, libéré dans table_free */
-  uint32_t      can_id;
+  uint32_t      can_id;       /* ID direct (CAN_ID_EXT si étendu), ou inner ID en mode tunnel */
+  route_mode_t  route;
+  uint32_t      transport_id; /* ID de transport (ROUTE_TUNNEL) */
+  bool          fd;           /* trames CAN FD (clé "can_fd") */
+  bool          seg;          /* message segmenté sur plusieurs trames (clé "segmented") */
+  uint8_t       payload_max;  /* octets disponibles pour les champs : trame (8, ou 64 en FD)
+                                 moins l’en-tête tunnel ; ENTRY_PAYLOAD_MAX si segmenté */
+  uint8_t       frame_len;    /* octets de données émis : 8, ou en FD la plus petite
+                                 longueur valide contenant en-tête et champs
+                                 (segmenté : longueur d’une trame pleine) */
+  uint8_t       packed_size;  /* octets occupés par les champs packables */
+  size_t        packed_count; /* nb de champs tenant dans payload_max octets (préfixe de fields) */
   size_t        field_count;
-  field_spec_t *fields;       /* tableau alloué, libéré dans table_free */
+  field_spec_t *fields;
+  size_t        json_max;     /* longueur max du JSON encodé (hors '\0') */
+  pub_policy_t  pub;          /* publication CAN -> MQTT */
+  cmd_policy_t  cmd;          /* commandes MQTT -> CAN */
+  const char   *topic;        /* chaîne internée */
 } entry_t;
 
 
+/* Plage des CAN ID indexés par accès direct (IDs standard 11 bits) */
+#define TABLE_CANID_DIRECT 0x800u
+
+
 /* Table complète */
 typedef struct table_s {
   size_t   entry_count;
-  entry_t *entries;           /* tableau alloué, libéré dans table_free */
+  entry_t *entries;
+
+  /* Champs chauds des entrées en tableaux parallèles (index d’entrée) :
+     les sondages des index ne lisent une entrée qu’en cas de correspondance */
+  uint32_t *entry_hash;       /* hash FNV-1a du topic */
+  uint32_t *entry_canid;      /* can_id */
+  uint32_t *entry_route;      /* clé (transport, inner ID), entrées tunnel */
+
+  /* Index construits par table_load (valeur = index d'entrée + 1, 0 = vide) */
+  uint32_t *topic_slots;      /* hash des topics, adressage ouvert */
+  size_t    topic_mask;       /* nombre de slots - 1 (puissance de 2) */
+  uint32_t *canid_direct;     /* accès direct pour can_id < TABLE_CANID_DIRECT */
+  uint32_t *canid_slots;      /* hash des autres can_id, adressage ouvert */
+  size_t    canid_mask;       /* nombre de slots - 1 (puissance de 2) */
+
+  /* Routage tunnel (construit par table_load) */
+  uint8_t  *transport_map;    /* [TABLE_CANID_DIRECT] : 1 si l’ID est un transport tunnel */
+  size_t    transport_count;
+  uint32_t *route_slots;      /* hash (transport, inner ID) -> entrée, adressage ouvert */
+  size_t    route_mask;       /* nombre de slots - 1 (puissance de 2) */
+
+  /* Arène : bloc unique contenant entrées, champs, enums, chaînes et index */
+  void     *arena;
+  size_t    arena_size;       /* octets utilisés */
+
+  /* Image binaire mappée (dict_image_map), NULL si table construite depuis le JSON */
+  void     *image;
+  size_t    image_size;
 } table_t;
 
 
+/* Lecteurs de la table courante (un emplacement par thread lecteur) */
+enum {
+  TABLE_READER_MQTT = 0,      /* callback on_message */
+  TABLE_READER_CAN  = 1,      /* réception CAN */
+  TABLE_READERS     = 2
+};
+
+/* Table courante, remplaçable à chaud (récupération par époques) :
+   les lecteurs ne bloquent jamais, l’ancienne table est libérée quand
+   plus aucun lecteur entré avant la bascule n’est actif. */
+typedef struct table_rcu_s {
+  _Atomic(table_t *)  cur;
+  _Atomic(uint64_t)   epoch;                  /* incrémentée à chaque bascule */
+  _Atomic(uint64_t)   reader[TABLE_READERS];  /* époque d’entrée, 0 = hors lecture */
+} table_rcu_t;
+
+
 #ifdef __cplusplus
 }
 #endif
@@ -21,18 +21,26 @@
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
 #include <time.h>
 #include <signal.h>
 #include <string.h>
 #include <stdlib.h>
 #include <unistd.h>
+#include <pthread.h>
 #include <mosquitto.h>
 
 #include "types.h"
 #include "table.h"
 #include "mqtt_io.h"
+#include "spsc.h"
 #include "can_io.h"
+#include "reload.h"
+#include "event_loop.h"
 #include "log.h"
+#include "capture.h"
+#include "isotp.h"
 
 
 // --- paramètres fixes par défaut ---
@@ -40,6 +48,10 @@ static const char *IFNAME    = "can0";        // ou "vcan0" en test logiciel
 static const char *MQTT_HOST = "localhost";
 static const int   MQTT_PORT = 1883;
 
+// --- mode multithread ---
+static const int   RX_WAIT_MS = 200;          // réveil périodique des threads CAN
+static const int   TX_WAIT_MS = 200;          // (pour tester l’arrêt)
+
 /* -------------------------------------------------------------------------- */
 /*                             Variables globales                             */
 /* -------------------------------------------------------------------------- */
@@ -51,12 +63,17 @@ static const int   MQTT_PORT = 1883;
  * Passe à 0 lorsqu’un signal (CTRL+C, SIGTERM) est reçu,
  * pour déclencher l’arrêt propre du programme.
  */
-static volatile int g_running = 1;
+static atomic_int g_running = 1;
+
+/**
+ * @brief Table de correspondance (topics MQTT ↔ IDs CAN), remplaçable à chaud.
+ */
+static table_rcu_t g_tables;
 
 /**
- * @brief Table de correspondance (topics MQTT ↔ IDs CAN).
+ * @brief Rechargement de conversion.json (SIGHUP, inotify).
  */
-static table_t    g_table;
+static reload_t   g_reload;
 
 /**
  * @brief Contexte MQTT (connexion, QoS, callbacks...).
@@ -68,6 +85,16 @@ static mqtt_ctx_t g_mqtt;
  */
 static can_ctx_t  g_can;
 
+/**
+ * @brief Données transmises aux callbacks MQTT (table + CAN + MQTT).
+ */
+static user_bundle_t g_bundle;
+
+/**
+ * @brief File d’émission CAN (mode multithread uniquement).
+ */
+static can_txq_t  g_txq;
+
 /**
  * @brief Gestion des signaux système (SIGINT, SIGTERM).
  * 
@@ -75,6 +102,11 @@ static can_ctx_t  g_can;
  */
 static void on_sig(int s){ (void)s; g_running = 0; }
 
+/**
+ * @brief SIGHUP : demande de rechargement de conversion.json.
+ */
+static void on_hup(int s){ (void)s; reload_request(&g_reload); }
+
 
 /* -------------------------------------------------------------------------- */
 /*                                SETUP                                       */
@@ -86,9 +118,10 @@ static void on_sig(int s){ (void)s; g_running = 0; }
  *
  * Étapes principales :
  * 1. Chargement du fichier `conversion.json`
- * 2. Initialisation du client MQTT et abonnement global
+ * 2. Initialisation du client MQTT et abonnement aux topics de la table
  * 3. Initialisation du bus CAN
  * 4. Liaison des modules entre eux via une structure commune (userdata)
+ * 5. Surveillance du fichier de configuration (rechargement à chaud)
  *
  * @param cfg_path Chemin du fichier JSON de configuration.
  * @return true si tout est correctement initialisé, false sinon.
@@ -99,15 +132,19 @@ bool my_setup(const char *cfg_path) {
     signal(SIGTERM, on_sig);
 
      /* Réinitialisation mémoire des structures globales */
-    memset(&g_table, 0, sizeof(g_table));
     memset(&g_mqtt,  0, sizeof(g_mqtt));
     memset(&g_can,   0, sizeof(g_can));
 
      /* Chargement du fichier de conversion */
-    if (!table_load(&g_table, cfg_path)) {
+    table_t *table = malloc(sizeof(*table));
+    if (!table) return false;
+    if (!table_load(table, cfg_path)) {
         LOGE("Echec chargement table: %s", cfg_path);
+        table_free(table);
+        free(table);
         return false;
     }
+    table_rcu_init(&g_tables, table);
 
     /* Initialisation du client MQTT */
     if (!mqtt_init(&g_mqtt, MQTT_HOST, MQTT_PORT, 60))
@@ -116,18 +153,19 @@ bool my_setup(const char *cfg_path) {
     mqtt_set_qos(&g_mqtt, 1, 1);
 
     /* Liaison des modules entre eux (Lier la callback MQTT -> CAN avec userdata (table+can+mqtt) */
-    struct { const table_t *t; can_ctx_t *c; mqtt_ctx_t *m; } *ub =
-        malloc(sizeof(*ub));
-    if (!ub) return false;
-
-    ub->t = &g_table; ub->c = &g_can; ub->m = &g_mqtt;
-    mqtt_set_user_data(&g_mqtt, ub);
+    memset(&g_bundle, 0, sizeof(g_bundle));
+    g_bundle.tables = &g_tables; g_bundle.can = &g_can; g_bundle.mqtt = &g_mqtt;
+    mqtt_set_user_data(&g_mqtt, &g_bundle);
 
-    /* Abonnement à tous les topics MQTT (sans doublon local) */
-    if (!mqtt_subscribe_all_nolocal(&g_mqtt)) return false;
+    /* Abonnement aux seuls topics de la table (sans doublon local) */
+    if (!mqtt_subscribe_table(&g_mqtt, table)) return false;
 
     /* Initialisation du bus CAN */
-    if (!can_init(&g_can, IFNAME)) return false;
+    if (!can_init(&g_can, IFNAME, table)) return false;
+
+    /* Rechargement à chaud : SIGHUP ou modification du fichier */
+    if (!reload_init(&g_reload, cfg_path, &g_tables, &g_can, &g_mqtt)) return false;
+    signal(SIGHUP, on_hup);
 
     LOGI("Setup OK (cfg=%s, if=%s, mqtt=%s:%d)", cfg_path, IFNAME, MQTT_HOST, MQTT_PORT);
     return true;
@@ -145,6 +183,9 @@ bool my_setup(const char *cfg_path) {
  * Tâches effectuées à chaque itération :
  * 1. Traitement des paquets MQTT disponibles
  * 2. Lecture et traitement des trames CAN reçues
+ * 3. Envoi groupé des trames CAN en attente
+ * 4. Rechargement de la table si demandé
+ * 5. Publication périodique des métriques ($bridge/metrics)
  *
  * @return true si le pont doit continuer à tourner, false sinon.
  */
@@ -156,11 +197,166 @@ bool my_loop(void)
     if (g_mqtt.mosq)
         mosquitto_loop(g_mqtt.mosq, 0, 100);
 
-    can_poll(&g_can, &g_table, &g_mqtt, 8);
+    const table_t *t = table_rcu_enter(&g_tables, TABLE_READER_CAN);
+    can_poll(&g_can, t, &g_mqtt, 64);
+    table_rcu_leave(&g_tables, TABLE_READER_CAN);
 
+    /* Envoi groupé des trames MQTT -> CAN mises en file (et des commandes
+       retenues arrivées à échéance) */
+    (void)can_tx_release(&g_can);
+    if (can_tx_pending(&g_can))
+        (void)can_flush(&g_can);
+
+    (void)reload_poll(&g_reload);
+    (void)mqtt_metrics_tick(&g_mqtt);
     return true;
 }
 
+/* -------------------------------------------------------------------------- */
+/*                              MODE MULTITHREAD                              */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Thread de réception CAN : dort dans poll() jusqu’à l’arrivée de
+ *        trames, puis les publie vers MQTT.
+ */
+static void *can_rx_thread(void *arg)
+{
+    (void)arg;
+    while (g_running) {
+        if (!can_wait(&g_can, RX_WAIT_MS))
+            continue;
+        /* La table n’est tenue que pendant le traitement, pas pendant l’attente */
+        const table_t *t = table_rcu_enter(&g_tables, TABLE_READER_CAN);
+        can_poll_ready(&g_can, t, &g_mqtt, 64);
+        table_rcu_leave(&g_tables, TABLE_READER_CAN);
+    }
+    return NULL;
+}
+
+/**
+ * @brief Met en file d’émission une trame reçue du thread MQTT.
+ *
+ * Les messages segmentés passent par isotp_send(), les autres par
+ * can_queue_cmd() selon la limitation de leur entrée.
+ *
+ * @param msg : trame dépilée de g_txq.
+ * @return false si la trame est perdue (file pleine, aucune session libre).
+ */
+static bool tx_submit(const can_msg_t *msg)
+{
+    if (msg->seg)
+        return isotp_send(&g_can, msg->can_id, msg->key, msg->seg, msg->data, msg->len, msg->t0);
+    return can_queue_cmd(&g_can, msg->can_id, msg->data, msg->len, msg->key, &msg->cmd, msg->t0);
+}
+
+/**
+ * @brief Thread d’émission CAN : consomme la file alimentée par on_message().
+ */
+static void *can_tx_thread(void *arg)
+{
+    (void)arg;
+    can_msg_t msg;
+
+    int due_ms = -1;
+
+    while (g_running) {
+        /* Attente courte si des trames sont bloquées par un bus saturé,
+           bornée par l’échéance de la prochaine commande retenue */
+        int wait_ms = can_tx_pending(&g_can) ? CAN_TX_RETRY_MS : TX_WAIT_MS;
+        if (due_ms >= 0 && due_ms < wait_ms)
+            wait_ms = due_ms;
+        bool got = can_txq_pop_wait(&g_txq, &msg, wait_ms);
+        /* Tout ce qui est arrivé entre-temps part dans le même sendmmsg */
+        while (got) {
+            if (!tx_submit(&msg))
+                LOGE("File CAN TX pleine, trame perdue (transport=0x%X)", msg.can_id);
+            got = spsc_pop(&g_txq.ring, &msg);
+        }
+        due_ms = can_tx_release(&g_can);
+        if (can_tx_pending(&g_can))
+            (void)can_flush(&g_can);
+    }
+    /* Vider la file avant de quitter (les commandes retenues partent
+       avec can_cleanup()) */
+    while (spsc_pop(&g_txq.ring, &msg))
+        (void)tx_submit(&msg);
+    (void)can_flush(&g_can);
+    return NULL;
+}
+
+/**
+ * @brief Fait tourner le pont en mode multithread jusqu’à SIGINT/SIGTERM.
+ *
+ * Threads :
+ * - réseau MQTT (mosquitto_loop_start) : reçoit les commandes, les packe
+ *   et les dépose dans la file TX (sans verrou) ;
+ * - CAN TX : vide la file vers le bus ;
+ * - CAN RX : lecture bloquante, conversion et publication MQTT.
+ *
+ * La table est partagée en lecture seule. Le thread principal attend
+ * les signaux (sigwait), bloqués dans tous les autres threads.
+ *
+ * @return true si l’arrêt est propre, false si un thread n’a pas démarré.
+ */
+static bool run_threaded(void)
+{
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGINT);
+    sigaddset(&set, SIGTERM);
+    sigaddset(&set, SIGHUP);
+    pthread_sigmask(SIG_BLOCK, &set, NULL);   /* hérité par les threads créés */
+
+    if (!can_txq_init(&g_txq)) {
+        LOGE("Init file CAN TX %c", 0);
+        return false;
+    }
+    g_bundle.txq = &g_txq;
+    g_can.tx_wake = &g_txq;   /* FC reçus par le thread RX */
+
+    pthread_t rx, tx;
+    bool rx_ok = (pthread_create(&rx, NULL, can_rx_thread, NULL) == 0);
+    bool tx_ok = (pthread_create(&tx, NULL, can_tx_thread, NULL) == 0);
+    bool mq_ok = (mosquitto_loop_start(g_mqtt.mosq) == MOSQ_ERR_SUCCESS);
+
+    if (rx_ok && tx_ok && mq_ok) {
+        LOGI("Mode multithread démarré %c", 0);
+        /* Réveil périodique pour surveiller conversion.json et publier
+           les métriques */
+        const struct timespec tick = { .tv_sec = 1, .tv_nsec = 0 };
+        while (g_running) {
+            int sig = sigtimedwait(&set, NULL, &tick);
+            if (sig == SIGHUP)
+                reload_request(&g_reload);
+            else if (sig > 0)
+                g_running = 0;
+            if (g_running) {
+                (void)reload_poll(&g_reload);
+                (void)mqtt_metrics_tick(&g_mqtt);
+            }
+        }
+    } else {
+        LOGE("Démarrage des threads échoué (rx=%d tx=%d mqtt=%d)", rx_ok, tx_ok, mq_ok);
+        g_running = 0;
+    }
+
+    /* Arrêt : d’abord le producteur (MQTT), puis les threads CAN */
+    if (mq_ok)
+        mosquitto_loop_stop(g_mqtt.mosq, true);
+    can_txq_wake(&g_txq);
+    if (tx_ok) pthread_join(tx, NULL);
+    if (rx_ok) pthread_join(rx, NULL);
+    g_can.tx_wake = NULL;
+
+    size_t dropped = atomic_load(&g_txq.dropped);
+    if (dropped)
+        LOGW("File CAN TX : %zu trames perdues", dropped);
+    g_bundle.txq = NULL;
+    can_txq_destroy(&g_txq);
+    return rx_ok && tx_ok && mq_ok;
+}
+
 /* -------------------------------------------------------------------------- */
 /*                                SHUTDOWN                                   */
 /* -------------------------------------------------------------------------- */
@@ -176,12 +372,14 @@ bool my_loop(void)
  */
 
 void my_shutdown(void) {
-    void *ud = g_mqtt.mosq ? mosquitto_userdata(g_mqtt.mosq) : NULL;
-    if (ud) free(ud);
-
+    can_tx_report(&g_can);
+    mqtt_pub_report(&g_mqtt);
     can_cleanup(&g_can);
     mqtt_cleanup(&g_mqtt);
-    table_free(&g_table);
+    reload_cleanup(&g_reload);
+    table_t *t = table_rcu_swap(&g_tables, NULL);
+    table_free(t);
+    free(t);
     LOGI("Shutdown OK %c", 0);
 }
 
@@ -196,8 +394,26 @@ void my_shutdown(void) {
  * Lit le fichier de configuration (par défaut `config/conversion.json`),
  * initialise le pont, puis entre dans la boucle principale.
  *
+ * Usage : cobien_bridge [--threads | --epoll] [--tx-collapse]
+ *                       [--log-level niveau] [--log-sample cat=n]... [--record capture]
+ *                       [conversion.json | image .cbd | fichier .dbc]
+ * - sans option : boucle unique (my_loop) ;
+ * - `--threads` : mode multithread (CAN RX, CAN TX, réseau MQTT) ;
+ * - `--epoll`   : boucle d’événements mono-thread (epoll), sans attente active ;
+ * - `--tx-collapse` : une commande MQTT -> CAN encore en attente d’émission
+ *   est remplacée par la suivante sur le même inner ID (dernière valeur gagne) ;
+ * - `--log-level` : niveau du journal (err, warn, info, debug ; def. info) ;
+ * - `--log-sample` : n’écrit qu’une ligne sur n d’une catégorie du journal
+ *   (mqtt : commandes MQTT -> CAN, can : trames CAN -> MQTT, gen : le reste) ;
+ * - `--record` : enregistre les trames CAN et messages MQTT reçus dans un
+ *   fichier de capture, rejouable par `build/bench_replay` (cf. capture.h).
+ *
+ * Le journal est écrit par un thread dédié (cf. log.h) : aucune
+ * écriture sur stdout/stderr dans les chemins MQTT -> CAN et CAN -> MQTT.
+ *
  * L’application s’arrête proprement à la réception d’un signal
- * (CTRL+C ou SIGTERM).
+ * (CTRL+C ou SIGTERM). SIGHUP, ou toute modification du fichier de
+ * configuration, recharge la table sans redémarrer le pont.
  *
  * @param argc Nombre d’arguments de la ligne de commande.
  * @param argv Tableau contenant les arguments.
@@ -206,16 +422,49 @@ void my_shutdown(void) {
 
 int main(int argc, char **argv)
 {
-    const char *cfg_path = (argc > 1) ? argv[1] : "config/conversion.json";
+    const char *cfg_path = "config/conversion.json";
+    const char *record_path = NULL;
+    bool threaded = false, epoll_mode = false, tx_collapse = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--threads")) threaded = true;
+        else if (!strcmp(argv[i], "--epoll")) epoll_mode = true;
+        else if (!strcmp(argv[i], "--tx-collapse")) tx_collapse = true;
+        else if (!strcmp(argv[i], "--log-level") && i + 1 < argc) {
+            if (!log_set_level_name(argv[++i]))
+                LOGW("Niveau de journal inconnu: %s", argv[i]);
+        }
+        else if (!strcmp(argv[i], "--log-sample") && i + 1 < argc) {
+            if (!log_set_sampling(argv[++i]))
+                LOGW("Échantillonnage du journal invalide: %s", argv[i]);
+        }
+        else if (!strcmp(argv[i], "--record") && i + 1 < argc) record_path = argv[++i];
+        else cfg_path = argv[i];
+    }
 
-    if (!my_setup(cfg_path))
+    if (!log_start())
+        LOGW("Thread du journal non démarré, écriture synchrone %c", 0);
+    if (!my_setup(cfg_path)) {
+        log_stop();
         return 1;
-
-    while (my_loop())
-        ; // boucle principale
-
+    }
+    g_can.tx_collapse = tx_collapse;
+    if (record_path && !capture_open(record_path))
+        LOGW("Enregistrement désactivé %c", 0);
+
+    bool ok = true;
+    if (threaded)
+        ok = run_threaded();
+    else if (epoll_mode)
+        ok = event_loop_run(&g_tables, &g_can, &g_mqtt, &g_reload);
+    else
+        while (my_loop())
+            ; // boucle principale
+
+    capture_close();
     my_shutdown();
-    return 0;
+    log_stop();
+    return ok ? 0 : 1;
 }
 
 // End of file
@@ -4,36 +4,87 @@
  *
  * Ce module gère la communication bas niveau avec le bus CAN :
  * - Initialisation et configuration de l’interface (socket CAN)
- * - Envoi et réception de trames 8 octets
+ * - Envoi et réception de trames classiques (8 octets) et CAN FD (64 octets)
  * - Conversion automatique entre ID CAN et topics MQTT (via table)
  *
  * Il permet donc au pont MQTT/CAN de dialoguer avec le matériel (STM32, capteurs, etc.)
  * à travers une interface comme `can0` ou `vcan0`.
+ *
+ * Les trames CAN FD (CAN_RAW_FD_FRAMES) ne sont émises et reçues que si
+ * l’interface les transporte.
+ *
+ * La réception se fait par lots (`recvmmsg()`), avec l’horodatage noyau
+ * de chaque trame et le compteur de pertes de la socket (SO_RXQ_OVFL).
+ * L’émission passe par une file bornée vidée par `sendmmsg()` : une
+ * socket saturée diffère l’envoi au lieu de perdre la trame.
+ *
+ * Des filtres d’acceptation noyau (CAN_RAW_FILTER), générés à partir de la
+ * table, évitent de recopier dans le processus les trames qui ne nous
+ * concernent pas.
+ *
+ * Les entrées segmentées passent par isotp.c, dont les sessions sont
+ * préallouées avec le contexte.
  */
 
+#define _GNU_SOURCE             /* recvmmsg(), sendmmsg() */
+
 #include <stdio.h>
+#include <stdlib.h>
 #include <stdbool.h>
 #include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdalign.h>
 #include <time.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
+#include <poll.h>
+#include <semaphore.h>
 
 #include <linux/can.h>
 #include <linux/can/raw.h>
+#include <linux/net_tstamp.h>
 #include <sys/socket.h>
 #include <sys/types.h>
-#include <linux/if.h>
+#include <sys/uio.h>
 #include <net/if.h>
 #include <sys/ioctl.h>
-#include <sys/select.h>
 
 #include "types.h"
 #include "table.h"       /**< Pour rechercher les correspondances ID ↔ topic */
 #include "mqtt_io.h"     /**< Pour renvoyer les messages vers MQTT */
 #include "log.h"
+#include "spsc.h"
 #include "can_io.h"
+#include "metrics.h"
+#include "capture.h"
+#include "isotp.h"
+
+
+/* Place des messages de contrôle par trame : horodatage (3 timespec
+   pour SCM_TIMESTAMPING) + compteur de pertes */
+#define CAN_RX_CTRL (CMSG_SPACE (sizeof (struct timespec) * 3) + CMSG_SPACE (sizeof (uint32_t)))
+
+/** @brief Tampons de réception préalloués pour recvmmsg(). */
+struct can_rx_batch_s
+{
+  struct canfd_frame frames[CAN_RX_BATCH];
+  struct iovec iov[CAN_RX_BATCH];
+  struct mmsghdr msgs[CAN_RX_BATCH];
+  alignas (struct cmsghdr) char ctrl[CAN_RX_BATCH][CAN_RX_CTRL];
+};
+
+/** @brief File d’émission circulaire et tampons sendmmsg(). */
+struct can_tx_batch_s
+{
+  struct canfd_frame frames[CAN_TX_QUEUE];  /* len <= 8 : envoyée en trame classique */
+  uint32_t keys[CAN_TX_QUEUE];
+  uint64_t t0[CAN_TX_QUEUE];                /* réception MQTT de la commande, 0 = non mesurée */
+  struct iovec iov[CAN_TX_QUEUE];
+  struct mmsghdr msgs[CAN_TX_QUEUE];
+};
 
 
 /**
@@ -54,6 +105,288 @@ set_nonblock (int fd)
 }
 
 
+/** @brief Bloc aligné d’IDs consécutifs : [base, base + size), size puissance de 2. */
+typedef struct id_block_s
+{
+  uint32_t base;
+  uint32_t size;
+} id_block_t;
+
+/**
+ * @brief Calcule des blocs d’IDs couvrant les IDs standard connus de la table.
+ *
+ * Les IDs retenus sont les CAN ID des entrées et les IDs de transport
+ * tunnel. Ils sont d’abord regroupés en blocs alignés exacts ; s’il y a
+ * plus de max blocs, les deux blocs voisins dont la fusion donne le plus
+ * petit bloc aligné sont fusionnés, jusqu’à tenir dans la limite (les
+ * trames en trop sont écartées par dispatch_frame()).
+ *
+ * @param t : table chargée.
+ * @param max : nombre maximal de blocs (1..CAN_FILTER_MAX).
+ * @param want : tampon de travail de TABLE_CANID_DIRECT octets (à l’appelant).
+ * @param[out] blk : blocs (au moins max + 1 places).
+ * @param[out] n_ids : nombre d’IDs distincts couverts exactement.
+ * @return nombre de blocs.
+ */
+static size_t
+filter_blocks (const table_t *t, size_t max, uint8_t *want, id_block_t *blk, size_t *n_ids)
+{
+  memset (want, 0, TABLE_CANID_DIRECT);
+  *n_ids = 0;
+
+  for (size_t i = 0; i < t->entry_count; i++)
+    {
+      uint32_t id = t->entries[i].can_id;
+      if (id < TABLE_CANID_DIRECT && !want[id])
+        {
+          want[id] = 1;
+          (*n_ids)++;
+        }
+    }
+  for (uint32_t id = 0; t->transport_map && id < TABLE_CANID_DIRECT; id++)
+    {
+      if (t->transport_map[id] && !want[id])
+        {
+          want[id] = 1;
+          (*n_ids)++;
+        }
+    }
+
+  /* Blocs alignés exacts, fusionnés au fil de l’eau dès que la limite est dépassée */
+  size_t n = 0;
+  for (uint32_t id = 0; id < TABLE_CANID_DIRECT;)
+    {
+      if (!want[id])
+        {
+          id++;
+          continue;
+        }
+      uint32_t size = 1;
+      while ((id & (2 * size - 1)) == 0 && id + 2 * size <= TABLE_CANID_DIRECT)
+        {
+          uint32_t k = id + size;
+          while (k < id + 2 * size && want[k])
+            k++;
+          if (k < id + 2 * size)
+            break;
+          size *= 2;
+        }
+      blk[n].base = id;
+      blk[n].size = size;
+      n++;
+      id += size;
+
+      while (n > max)
+        {
+          /* Fusion la moins coûteuse entre deux blocs voisins */
+          size_t best = 0;
+          uint32_t best_size = 0;
+          for (size_t i = 0; i + 1 < n; i++)
+            {
+              uint32_t sz = blk[i].size;
+              while (blk[i].base / sz != (blk[i + 1].base + blk[i + 1].size - 1) / sz)
+                sz *= 2;
+              if (!best_size || sz < best_size)
+                {
+                  best = i;
+                  best_size = sz;
+                }
+            }
+          uint32_t base = blk[best].base & ~(best_size - 1);
+          size_t j = best;
+          while (j > 0 && blk[j - 1].base >= base)
+            j--;
+          size_t k = best + 1;
+          while (k < n && blk[k].base + blk[k].size <= base + best_size)
+            k++;
+          blk[j].base = base;
+          blk[j].size = best_size;
+          memmove (&blk[j + 1], &blk[k], (n - k) * sizeof (*blk));
+          n -= k - j - 1;
+        }
+    }
+  return n;
+}
+
+/**
+ * @brief Compte les IDs étendus distincts des entrées de la table.
+ *
+ * @param t : table chargée.
+ * @param[out] ids : les max premiers IDs (CAN_ID_EXT compris).
+ * @param max : places de ids.
+ * @return nombre d’IDs distincts, max + 1 s’il y en a davantage.
+ */
+static size_t
+filter_ext_ids (const table_t *t, uint32_t *ids, size_t max)
+{
+  size_t n = 0;
+  for (size_t i = 0; i < t->entry_count; i++)
+    {
+      uint32_t id = t->entries[i].can_id;
+      if (!(id & CAN_ID_EXT))
+        continue;
+      size_t k = 0;
+      while (k < n && ids[k] != id)
+        k++;
+      if (k < n)
+        continue;
+      if (n == max)
+        return max + 1;
+      ids[n++] = id;
+    }
+  return n;
+}
+
+/**
+ * @brief Installe les filtres d’acceptation noyau déduits de la table.
+ *
+ * Seules les trames de données (ni RTR, ni erreur) dont l’ID est connu de
+ * la table, directement ou comme transport tunnel, sont remises à la
+ * socket. Les IDs étendus ont chacun leur filtre exact, dans la limite de
+ * la moitié des CAN_FILTER_MAX règles ; au-delà, toutes les trames
+ * étendues sont acceptées et triées par dispatch_frame(). Les IDs
+ * standard se partagent les règles restantes (cf. filter_blocks()).
+ * À rappeler après chaque changement de table.
+ *
+ * @param c : contexte CAN (socket ouverte).
+ * @param t : table chargée (NULL : accepter toutes les trames).
+ * @return true si les filtres sont installés.
+ */
+bool
+can_set_filters (can_ctx_t *c, const table_t *t)
+{
+  if (!c || c->fd < 0)
+    return false;
+
+  if (!t)
+    {
+      struct can_filter all = {.can_id = 0,.can_mask = 0 };
+      return (setsockopt (c->fd, SOL_CAN_RAW, CAN_RAW_FILTER, &all, sizeof (all)) == 0);
+    }
+
+  uint32_t ext[CAN_FILTER_MAX / 2];
+  size_t n_ext = filter_ext_ids (t, ext, CAN_FILTER_MAX / 2);
+  size_t ext_rules = (n_ext > CAN_FILTER_MAX / 2) ? 1 : n_ext;
+
+  uint8_t want[TABLE_CANID_DIRECT];
+  id_block_t blk[CAN_FILTER_MAX + 1];
+  size_t n_ids;
+  size_t n = filter_blocks (t, CAN_FILTER_MAX - ext_rules, want, blk, &n_ids);
+
+  struct can_filter flt[CAN_FILTER_MAX];
+  for (size_t i = 0; i < n; i++)
+    {
+      flt[i].can_id = blk[i].base;
+      flt[i].can_mask = (~(blk[i].size - 1) & CAN_SFF_MASK) | CAN_EFF_FLAG | CAN_RTR_FLAG;
+    }
+  if (n_ext > CAN_FILTER_MAX / 2)
+    {
+      /* trop d’IDs étendus : toutes les trames de données étendues */
+      flt[n].can_id = CAN_EFF_FLAG;
+      flt[n].can_mask = CAN_EFF_FLAG | CAN_RTR_FLAG;
+      n++;
+    }
+  else
+    {
+      for (size_t i = 0; i < n_ext; i++, n++)
+        {
+          flt[n].can_id = ext[i];
+          flt[n].can_mask = CAN_EFF_MASK | CAN_EFF_FLAG | CAN_RTR_FLAG;
+        }
+      n_ids += n_ext;
+    }
+
+  if (setsockopt (c->fd, SOL_CAN_RAW, CAN_RAW_FILTER, flt, (socklen_t) (n * sizeof (flt[0]))) < 0)
+    {
+      LOGW ("setsockopt(CAN_RAW_FILTER): %s", strerror (errno));
+      return false;
+    }
+  LOGI ("Filtres CAN: %zu règle(s) pour %zu ID(s)", n, n_ids);
+  return true;
+}
+
+/**
+ * @brief Active l’horodatage noyau des trames reçues.
+ *
+ * SO_TIMESTAMPING (horodatage logiciel seul), sinon SO_TIMESTAMPNS :
+ * dans les deux cas CLOCK_REALTIME, comparable à l’heure de publication
+ * (l’horloge matérielle du contrôleur ne l’est pas). Active aussi
+ * SO_RXQ_OVFL pour connaître les trames perdues faute de place dans le
+ * buffer de la socket.
+ *
+ * @param fd : socket CAN.
+ */
+static void
+enable_rx_meta (int fd)
+{
+  int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+  if (setsockopt (fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof (flags)) < 0)
+    {
+      int on = 1;
+      if (setsockopt (fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof (on)) < 0)
+        LOGW ("Horodatage CAN indisponible: %s", strerror (errno));
+    }
+
+  int ovfl = 1;
+  if (setsockopt (fd, SOL_SOCKET, SO_RXQ_OVFL, &ovfl, sizeof (ovfl)) < 0)
+    LOGW ("setsockopt(SO_RXQ_OVFL): %s", strerror (errno));
+}
+
+/**
+ * @brief Convertit un timespec en nanosecondes (0 si nul).
+ */
+static uint64_t
+ts_to_ns (const struct timespec *ts)
+{
+  return (uint64_t) ts->tv_sec * 1000000000ull + (uint64_t) ts->tv_nsec;
+}
+
+/**
+ * @brief Prépare une socket déjà ouverte et liée : mode non bloquant,
+ *        tampons, métadonnées de réception, tampons recvmmsg/sendmmsg.
+ *
+ * @param c : contexte CAN (remis à zéro par l’appelant).
+ * @param fd : socket, fermée en cas d’échec.
+ * @return true si succès.
+ */
+static bool
+can_adopt (can_ctx_t *c, int fd)
+{
+  /* Mode non bloquant */
+  if (!set_nonblock (fd))
+    {
+      LOGW ("fcntl(O_NONBLOCK) échoué (socket bloquant) %c", 0);
+    }
+
+  /* Agrandir les buffers de réception/émission */
+  int rcvbuf = 256 * 1024;
+  (void) setsockopt (fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof (rcvbuf));
+  int sndbuf = 256 * 1024;
+  (void) setsockopt (fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof (sndbuf));
+
+  enable_rx_meta (fd);
+
+  /* Tampons de réception par lots, file d’émission et sessions segmentées */
+  c->batch = malloc (sizeof (*c->batch));
+  c->txb = malloc (sizeof (*c->txb));
+  c->isotp = isotp_create ();
+  if (!c->batch || !c->txb || !c->isotp)
+    {
+      LOGE ("Allocation tampons CAN échouée %c", 0);
+      free (c->batch);
+      free (c->txb);
+      isotp_destroy (c->isotp);
+      c->batch = NULL;
+      c->txb = NULL;
+      c->isotp = NULL;
+      close (fd);
+      return false;
+    }
+
+  c->fd = fd;
+  return true;
+}
+
 /**
  * @brief Initialise la connexion au bus CAN (via socket PF_CAN).
  *
@@ -61,14 +394,16 @@ set_nonblock (int fd)
  e (RAW)
  * - associe l’interface réseau (ex : "can0", "vcan0")
  * - désactive la réception de ses propres trames (évite les doublons)
+ * - installe les filtres d’acceptation déduits de la table
  * - configure la socket en mode non bloquant
  *
  * @param c : structure du contexte CAN à initialiser.
  * @param ifname : nom de l’interface CAN (par ex. "can0").
+ * @param t : table chargée (NULL : aucune trame filtrée).
  * @return true si l’initialisation réussit, false sinon.
  */
 bool
-can_init (can_ctx_t *c, const char *ifname)
+can_init (can_ctx_t *c, const char *ifname, const table_t *t)
 {
   if (!c || !ifname)
     return false;
@@ -101,6 +436,24 @@ can_init (can_ctx_t *c, const char *ifname)
       LOGW ("setsockopt(CAN_RAW_RECV_OWN_MSGS): %s", strerror (errno));
     }
 
+  /* Trames CAN FD : seulement si l’interface les transporte (MTU CANFD_MTU) */
+  bool fd_frames = false;
+  if (ioctl (fd, SIOCGIFMTU, &ifr) == 0 && ifr.ifr_mtu == (int) CANFD_MTU)
+    {
+      int on = 1;
+      if (setsockopt (fd, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &on, sizeof (on)) == 0)
+        fd_frames = true;
+      else
+        LOGW ("setsockopt(CAN_RAW_FD_FRAMES): %s", strerror (errno));
+    }
+  LOGI ("Interface %s : CAN %s", ifname, fd_frames ? "FD (64 octets)" : "classique (8 octets)");
+
+  /* Filtres d’acceptation, avant bind() pour ne rien recevoir d’inutile */
+  c->fd = fd;
+  if (t && !can_set_filters (c, t))
+    LOGW ("Filtres CAN non installés, toutes les trames sont reçues %c", 0);
+  c->fd = -1;
+
   /* Liaison de la socket à l’interface CAN */
   struct sockaddr_can addr;
   memset (&addr, 0, sizeof (addr));
@@ -114,51 +467,481 @@ can_init (can_ctx_t *c, const char *ifname)
       return false;
     }
 
-  /* Mode non bloquant */
-  if (!set_nonblock (fd))
-    {
-      LOGW ("fcntl(O_NONBLOCK) échoué (socket bloquant) %c", 0);
-    }
+  c->fd_frames = fd_frames;
+  return can_adopt (c, fd);
+}
 
-  /* Agrandir les buffers de réception/émission */
-  int rcvbuf = 256 * 1024;
-  (void) setsockopt (fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof (rcvbuf));
-  int sndbuf = 256 * 1024;
-  (void) setsockopt (fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof (sndbuf));
 
-  c->fd = fd;
-  return true;
+/**
+ * @brief Initialise le contexte sur une socket déjà ouverte.
+ *
+ * Toute socket datagramme qui transporte des `struct can_frame` (ou
+ * `struct canfd_frame` pour les trames FD, toujours acceptées) convient
+ * (ex : socketpair AF_UNIX pour un banc de mesure sans interface CAN).
+ * Aucun filtre d’acceptation n’est installé.
+ *
+ * @param c : structure du contexte CAN à initialiser.
+ * @param fd : socket, adoptée par le contexte (fermée par can_cleanup()).
+ * @return true si succès.
+ */
+bool
+can_init_fd (can_ctx_t *c, int fd)
+{
+  if (!c || fd < 0)
+    return false;
+  memset (c, 0, sizeof (*c));
+  c->fd = -1;
+  c->fd_frames = true;
+  return can_adopt (c, fd);
 }
 
 
 /**
- * @brief Envoie une trame CAN standard de 8 octets.
+ * @brief Envoie une trame CAN (classique, ou FD au-delà de 8 octets).
+ *
+ * La trame passe par la file d’émission : si la socket est saturée,
+ * elle reste en attente et sera envoyée au prochain can_flush().
  *
  * @param c : nontexte CAN actif.
- * @param can_id : identifiant CAN (11 bits).
- * @param data : tableau de 8 octets à envoyer.
- * @return true si l’envoi réussit, false sinon.
+ * @param can_id : identifiant CAN (11 bits, ou 29 bits avec CAN_ID_EXT).
+ * @param data : octets à envoyer.
+ * @param len : nombre d’octets (0..CAN_PAYLOAD_MAX).
+ * @return true si la trame est envoyée ou en attente, false sinon.
  */
 bool
-can_send (can_ctx_t *c, uint32_t can_id, const uint8_t data[8])
+can_send (can_ctx_t *c, uint32_t can_id, const uint8_t *data, uint8_t len)
 {
-  if (!c || c->fd < 0)
+  if (!can_queue (c, can_id, data, len, CAN_TX_NO_KEY, 0))
+    return false;
+  return (can_flush (c) >= 0);
+}
+
+/**
+ * @brief Écrit une trame sur la socket, sans passer par la file d’émission.
+ *
+ * Réservé aux trames de service du lecteur CAN (FC des messages
+ * segmentés) : la file d’émission et ses compteurs appartiennent à son
+ * propriétaire, seul le compteur global des métriques est mis à jour.
+ *
+ * @param c : contexte CAN actif.
+ * @param can_id : identifiant CAN (11 bits, ou 29 bits avec CAN_ID_EXT).
+ * @param data : octets à envoyer.
+ * @param len : nombre d’octets (cf. can_queue()).
+ * @return true si la trame est écrite.
+ */
+bool
+can_write (can_ctx_t *c, uint32_t can_id, const uint8_t *data, uint8_t len)
+{
+  if (!c || c->fd < 0 || len > CAN_PAYLOAD_MAX || (len > 8 && !c->fd_frames))
     return false;
 
-  struct can_frame f;
+  struct canfd_frame f;
   memset (&f, 0, sizeof (f));
-  f.can_id = can_id & CAN_SFF_MASK;   /**< ID standard sur 11 bits */
-  f.can_dlc = 8;   /**< Longueur fixe : 8 octets */
+  f.can_id = can_id_bus (can_id);
+  f.len = can_fd_len (len);
+  f.flags = (f.len > 8) ? CANFD_BRS : 0;
+  memcpy (f.data, data, len);
+  size_t mtu = (f.len > 8) ? CANFD_MTU : CAN_MTU;
+  if (send (c->fd, &f, mtu, MSG_DONTWAIT) != (ssize_t) mtu)
+    {
+      metrics_inc (MC_CAN_TX_DROP);
+      return false;
+    }
+  metrics_inc (MC_CAN_TX_SENT);
+  return true;
+}
 
-  memcpy (f.data, data, 8);
+/**
+ * @brief Met une trame dans la file d’émission.
+ *
+ * Si `c->tx_collapse` est actif et qu’une trame de même ID et de même clé
+ * est encore en attente, ses données sont remplacées (la dernière valeur
+ * gagne) sans changer sa place dans la file. Si la file est pleine, on
+ * tente d’abord de la vider.
+ *
+ * Au-delà de 8 octets, la trame part en CAN FD avec changement de débit
+ * (CANFD_BRS), complétée par des 0 jusqu’à la longueur FD valide
+ * suivante (12, 16, 20, 24, 32, 48 ou 64).
+ *
+ * @param c : contexte CAN actif.
+ * @param can_id : identifiant CAN (11 bits, ou 29 bits avec CAN_ID_EXT).
+ * @param data : octets à envoyer.
+ * @param len : nombre d’octets (0..CAN_PAYLOAD_MAX).
+ * @param key : clé de fusion (ex : inner ID du mode tunnel), CAN_TX_NO_KEY si aucune.
+ * @param t0 : réception de la commande MQTT (metrics_now_ns()), 0 si sans
+ *             objet ; une trame remplacée prend le t0 de la plus récente.
+ * @return true si la trame est en file, false si la file est pleine ou
+ *         si une trame FD est demandée sur une interface classique.
+ */
+bool
+can_queue (can_ctx_t *c, uint32_t can_id, const uint8_t *data, uint8_t len, uint32_t key, uint64_t t0)
+{
+  if (!c || c->fd < 0 || !c->txb || len > CAN_PAYLOAD_MAX)
+    return false;
+  if (len > 8 && !c->fd_frames)
+    {
+      LOGE ("Trame de %u octets sur l’ID 0x%X : interface sans CAN FD, trame perdue", (unsigned) len, can_id);
+      c->tx_stats.dropped++;
+      metrics_inc (MC_CAN_TX_DROP);
+      return false;
+    }
 
-  ssize_t n = write (c->fd, &f, sizeof (f));
-  if (n < 0)
+  struct can_tx_batch_s *b = c->txb;
+  uint8_t flen = can_fd_len (len);
+  can_id = can_id_bus (can_id);  /**< 11 bits, ou 29 bits + CAN_EFF_FLAG */
+
+  if (c->tx_collapse && key != CAN_TX_NO_KEY)
     {
-      LOGE ("CAN write: %s", strerror (errno));
+      for (size_t i = 0; i < c->tx_count; i++)
+        {
+          size_t k = (c->tx_head + i) % CAN_TX_QUEUE;
+          if (b->keys[k] == key && b->frames[k].can_id == can_id && b->frames[k].len == flen)
+            {
+              memcpy (b->frames[k].data, data, len);
+              b->t0[k] = t0;
+              c->tx_stats.collapsed++;
+              return true;
+            }
+        }
+    }
+
+  if (c->tx_count == CAN_TX_QUEUE)
+    (void) can_flush (c);
+  if (c->tx_count == CAN_TX_QUEUE)
+    {
+      c->tx_stats.dropped++;
+      metrics_inc (MC_CAN_TX_DROP);
       return false;
     }
-  return (n == (ssize_t) sizeof (f));
+
+  size_t k = (c->tx_head + c->tx_count) % CAN_TX_QUEUE;
+  memset (&b->frames[k], 0, sizeof (b->frames[k]));
+  b->frames[k].can_id = can_id;
+  b->frames[k].len = flen;
+  b->frames[k].flags = (flen > 8) ? CANFD_BRS : 0;
+  memcpy (b->frames[k].data, data, len);
+  b->keys[k] = key;
+  b->t0[k] = t0;
+  c->tx_count++;
+  c->tx_stats.queued++;
+  return true;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                    Limitation des commandes MQTT -> CAN                    */
+/* -------------------------------------------------------------------------- */
+
+/** @brief État de limitation d’un couple (CAN ID, clé). */
+typedef struct can_shape_slot_s
+{
+  uint64_t id;                  /* (can_id << 32 | clé) + 1, 0 = libre */
+  uint64_t tat_ns;              /* seau à jetons (GCRA) : instant théorique du prochain jeton */
+  uint64_t window_ns;           /* fin de la fenêtre de fusion en cours */
+  uint64_t due_ns;              /* échéance de la commande retenue */
+  cmd_policy_t cmd;             /* limitation de la dernière commande reçue */
+  bool held;
+  uint64_t t0;                  /* réception MQTT de la commande retenue */
+  uint8_t len;                  /* commande retenue */
+  uint8_t data[CAN_PAYLOAD_MAX];
+} can_shape_slot_t;
+
+/** @brief Table des états de limitation (adressage ouvert, jamais vidée). */
+typedef struct can_shape_s
+{
+  can_shape_slot_t *slots;
+  size_t mask;
+  size_t count;
+} can_shape_t;
+
+/**
+ * @brief Position de départ du sondage pour un identifiant d’emplacement.
+ */
+static size_t
+shape_hash (uint64_t id, size_t mask)
+{
+  return (size_t) ((id * 0x9E3779B97F4A7C15ull) >> 32) & mask;
+}
+
+/**
+ * @brief Emplacement de limitation d’un couple (CAN ID, clé), créé si absent.
+ *
+ * @return emplacement, NULL si allocation impossible.
+ */
+static can_shape_slot_t *
+shape_slot (can_ctx_t *c, uint32_t can_id, uint32_t key)
+{
+  can_shape_t *s = c->shape;
+  if (!s)
+    {
+      s = c->shape = (can_shape_t *) calloc (1, sizeof (*s));
+      if (!s)
+        return NULL;
+    }
+
+  /* Facteur de charge < 50 % : la table double, les emplacements sont réinsérés */
+  if (2 * (s->count + 1) > (s->slots ? s->mask + 1 : 0))
+    {
+      size_t cap = s->slots ? 2 * (s->mask + 1) : 32;
+      can_shape_slot_t *ns = (can_shape_slot_t *) calloc (cap, sizeof (*ns));
+      if (!ns)
+        return NULL;
+      for (size_t i = 0; s->slots && i <= s->mask; i++)
+        {
+          if (!s->slots[i].id)
+            continue;
+          size_t k = shape_hash (s->slots[i].id, cap - 1);
+          while (ns[k].id)
+            k = (k + 1) & (cap - 1);
+          ns[k] = s->slots[i];
+        }
+      free (s->slots);
+      s->slots = ns;
+      s->mask = cap - 1;
+    }
+
+  uint64_t id = (((uint64_t) can_id << 32) | key) + 1;
+  size_t k = shape_hash (id, s->mask);
+  while (s->slots[k].id && s->slots[k].id != id)
+    k = (k + 1) & s->mask;
+  if (!s->slots[k].id)
+    {
+      s->slots[k].id = id;
+      s->count++;
+    }
+  return &s->slots[k];
+}
+
+/**
+ * @brief Premier instant où une commande peut partir (jeton et fenêtre).
+ *
+ * Seau à jetons sous forme GCRA : un jeton tous les interval_us, au plus
+ * burst jetons d’avance.
+ */
+static uint64_t
+shape_ready_ns (const can_shape_slot_t *s)
+{
+  uint64_t tau = (uint64_t) s->cmd.interval_us * 1000ull * (s->cmd.burst ? s->cmd.burst - 1 : 0);
+  uint64_t tok = (s->tat_ns > tau) ? s->tat_ns - tau : 0;
+  return (tok > s->window_ns) ? tok : s->window_ns;
+}
+
+/**
+ * @brief Met en file la commande d’un emplacement et consomme un jeton.
+ */
+static bool
+shape_emit (can_ctx_t *c, can_shape_slot_t *s, const uint8_t *data, uint8_t len, uint64_t t0, uint64_t now)
+{
+  uint64_t base = (s->tat_ns > now) ? s->tat_ns : now;
+  s->tat_ns = base + (uint64_t) s->cmd.interval_us * 1000ull;
+  s->window_ns = now + (uint64_t) s->cmd.coalesce_ms * 1000000ull;
+  return can_queue (c, (uint32_t) ((s->id - 1) >> 32), data, len, (uint32_t) (s->id - 1), t0);
+}
+
+/**
+ * @brief Met en file une commande selon la limitation de son entrée.
+ *
+ * Sans limitation, équivaut à can_queue(). Sinon, par couple (CAN ID,
+ * clé) — l’inner ID en mode tunnel :
+ * - la commande part tout de suite si un jeton est disponible et
+ *   qu’aucune fenêtre de fusion n’est en cours ; elle ouvre alors une
+ *   nouvelle fenêtre de coalesce_ms ;
+ * - sinon elle est retenue jusqu’à l’échéance (cf. can_tx_release()) ;
+ *   une commande plus récente remplace la commande retenue.
+ *
+ * Une rafale de commandes (curseur d’interface) produit donc au plus une
+ * trame par fenêtre, portant la dernière valeur.
+ *
+ * @param c : contexte CAN actif.
+ * @param can_id : identifiant CAN (11 bits, ou 29 bits avec CAN_ID_EXT).
+ * @param data : octets à envoyer.
+ * @param len : nombre d’octets (cf. can_queue()).
+ * @param key : clé (inner ID), CAN_TX_NO_KEY si aucune.
+ * @param cmd : limitation de l’entrée, NULL si aucune.
+ * @param t0 : réception de la commande MQTT (cf. can_queue()) ; une
+ *             commande retenue garde le sien jusqu’à son émission.
+ * @return true si la commande est en file ou retenue, false si la file est pleine.
+ */
+bool
+can_queue_cmd (can_ctx_t *c, uint32_t can_id, const uint8_t *data, uint8_t len, uint32_t key,
+               const cmd_policy_t *cmd, uint64_t t0)
+{
+  if (!cmd || (!cmd->interval_us && !cmd->coalesce_ms) || len > CAN_PAYLOAD_MAX)
+    return can_queue (c, can_id, data, len, key, t0);
+
+  can_shape_slot_t *s = shape_slot (c, can_id_bus (can_id), key);
+  if (!s)
+    return can_queue (c, can_id, data, len, key, t0);
+  s->cmd = *cmd;
+
+  if (s->held)
+    {
+      memcpy (s->data, data, len);
+      s->len = len;
+      s->t0 = t0;
+      s->due_ns = shape_ready_ns (s);
+      c->tx_stats.collapsed++;
+      return true;
+    }
+
+  uint64_t now = metrics_now_ns ();
+  uint64_t ready = shape_ready_ns (s);
+  if (now >= ready)
+    return shape_emit (c, s, data, len, t0, now);
+
+  memcpy (s->data, data, len);
+  s->len = len;
+  s->t0 = t0;
+  s->due_ns = ready;
+  s->held = true;
+  c->tx_held++;
+  c->tx_stats.held++;
+  return true;
+}
+
+/**
+ * @brief Met en file les commandes retenues arrivées à échéance.
+ *
+ * À appeler par le propriétaire de la file d’émission avant can_flush() ;
+ * la valeur de retour borne son attente suivante. Les messages segmentés
+ * en cours avancent aussi (FC reçu, CF espacés par STmin, cf. isotp.h).
+ *
+ * @param c : contexte CAN actif.
+ * @return délai en ms jusqu’à la prochaine échéance, -1 si rien n’est en attente.
+ */
+int
+can_tx_release (can_ctx_t *c)
+{
+  if (!c)
+    return -1;
+  int seg = isotp_tx_release (c);
+  if (!c->tx_held || !c->shape)
+    return seg;
+
+  can_shape_t *s = c->shape;
+  uint64_t now = metrics_now_ns ();
+  uint64_t next = UINT64_MAX;
+  for (size_t i = 0; i <= s->mask && c->tx_held; i++)
+    {
+      can_shape_slot_t *sl = &s->slots[i];
+      if (!sl->held)
+        continue;
+      if (sl->due_ns > now)
+        {
+          if (sl->due_ns < next)
+            next = sl->due_ns;
+          continue;
+        }
+      sl->held = false;
+      c->tx_held--;
+      if (!shape_emit (c, sl, sl->data, sl->len, sl->t0, now))
+        LOGE ("File CAN TX pleine, commande retenue perdue (ID 0x%X)", (unsigned) ((sl->id - 1) >> 32));
+    }
+  if (!c->tx_held)
+    return seg;
+  int due = (int) ((next - now + 999999ull) / 1000000ull);
+  return (seg >= 0 && seg < due) ? seg : due;
+}
+
+/**
+ * @brief Envoie les trames en attente, par lots (sendmmsg).
+ *
+ * EAGAIN / ENOBUFS (socket ou file du contrôleur pleine) laissent les
+ * trames restantes en file et sont mémorisés dans `c->tx_err`. Toute
+ * autre erreur vide la file (trames perdues, comptées dans `dropped`).
+ *
+ * La latence MQTT -> CAN (ML_MQTT_TO_CAN) des commandes est relevée ici,
+ * une fois la trame acceptée par la socket : elle compte l’attente en
+ * file, la limitation et les envois différés.
+ *
+ * @param c : contexte CAN actif.
+ * @return nombre de trames envoyées, -1 si erreur socket.
+ */
+int
+can_flush (can_ctx_t *c)
+{
+  if (!c || c->fd < 0 || !c->txb)
+    return -1;
+
+  struct can_tx_batch_s *b = c->txb;
+  int sent = 0;
+  c->tx_err = 0;
+
+  while (c->tx_count > 0)
+    {
+      /* Partie contiguë de l’anneau */
+      size_t n = CAN_TX_QUEUE - c->tx_head;
+      if (n > c->tx_count)
+        n = c->tx_count;
+      for (size_t i = 0; i < n; i++)
+        {
+          size_t k = c->tx_head + i;
+          b->iov[i].iov_base = &b->frames[k];
+          b->iov[i].iov_len = (b->frames[k].len > 8) ? CANFD_MTU : CAN_MTU;
+          memset (&b->msgs[i], 0, sizeof (b->msgs[i]));
+          b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+          b->msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+      int r = sendmmsg (c->fd, b->msgs, (unsigned int) n, MSG_DONTWAIT);
+      if (r < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS)
+            {
+              c->tx_err = errno;
+              c->tx_stats.busy++;
+              return sent;
+            }
+          LOGE ("CAN sendmmsg: %s (%zu trame(s) perdue(s))", strerror (errno), c->tx_count);
+          c->tx_stats.dropped += c->tx_count;
+          metrics_add (MC_CAN_TX_DROP, c->tx_count);
+          c->tx_head = 0;
+          c->tx_count = 0;
+          return -1;
+        }
+
+      uint64_t now = metrics_now_ns ();
+      for (int i = 0; i < r; i++)
+        if (b->t0[c->tx_head + (size_t) i])
+          metrics_lat (ML_MQTT_TO_CAN, now - b->t0[c->tx_head + (size_t) i]);
+
+      c->tx_head = (c->tx_head + (size_t) r) % CAN_TX_QUEUE;
+      c->tx_count -= (size_t) r;
+      c->tx_stats.sent += (uint64_t) r;
+      metrics_add (MC_CAN_TX_SENT, (uint64_t) r);
+      sent += r;
+    }
+  c->tx_head = 0;
+  return sent;
+}
+
+/**
+ * @brief Indique si des trames attendent d’être envoyées.
+ *
+ * @param c : contexte CAN.
+ * @return true si la file d’émission n’est pas vide.
+ */
+bool
+can_tx_pending (const can_ctx_t *c)
+{
+  return (c && c->tx_count > 0);
+}
+
+/**
+ * @brief Journalise les compteurs de la file d’émission.
+ *
+ * @param c : contexte CAN.
+ */
+void
+can_tx_report (const can_ctx_t *c)
+{
+  if (!c || !c->tx_stats.queued)
+    return;
+  const can_tx_stats_t *s = &c->tx_stats;
+  LOGI ("CAN TX: %llu en file, %llu envoyées, %llu fusionnées, %llu perdues, %llu différées, %llu retenues",
+        (unsigned long long) s->queued, (unsigned long long) s->sent, (unsigned long long) s->collapsed,
+        (unsigned long long) s->dropped, (unsigned long long) s->busy, (unsigned long long) s->held);
 }
 
 /**
@@ -166,11 +949,7 @@ can_send (can_ctx_t *c, uint32_t can_id, const uint8_t data[8])
  *
  * Fonction appelée en boucle dans `my_loop()`.  
  * Elle récupère jusqu’à `max_frames` trames à chaque itération
- * et transmet les données décodées vers MQTT.
- *
- * Deux cas sont gérés :
- * - ID standard : trame directement connue dans la table.
- * - Mode tunnel : les deux premiers octets contiennent un "inner ID" à décoder.
+ * et transmet les données décodées vers MQTT (cf. dispatch_frame()).
  *
  * @param c : contexte CAN.
  * @param t : table de conversion topic/ID.
@@ -179,62 +958,222 @@ can_send (can_ctx_t *c, uint32_t can_id, const uint8_t data[8])
  */
 void
 can_poll (can_ctx_t *c, const table_t *t, mqtt_ctx_t *m, int max_frames)
+{
+  can_poll_wait (c, t, m, max_frames, 0);
+}
+
+/**
+ * @brief Attend des trames CAN puis les traite (cf. can_poll()).
+ *
+ * Utilisé par le thread de réception du mode multithread : le thread
+ * dort dans poll() au lieu de tourner à vide.
+ *
+ * @param c : contexte CAN.
+ * @param t : table de conversion topic/ID.
+ * @param m  : contexte MQTT (pour republier).
+ * @param max_frames : nombre maximum de trames à lire par appel.
+ * @param timeout_ms : attente maximale (0 = aucune, -1 = infinie).
+ */
+void
+can_poll_wait (can_ctx_t *c, const table_t *t, mqtt_ctx_t *m, int max_frames, int timeout_ms)
+{
+  if (can_wait (c, timeout_ms))
+    can_poll_ready (c, t, m, max_frames);
+}
+
+/**
+ * @brief Attend que des trames soient disponibles.
+ *
+ * @param c : contexte CAN.
+ * @param timeout_ms : attente maximale (0 = aucune, -1 = infinie).
+ * @return true si la socket est lisible.
+ */
+bool
+can_wait (can_ctx_t *c, int timeout_ms)
 {
   if (!c || c->fd < 0)
-    return;
-  if (max_frames <= 0)
-    max_frames = 8;
+    return false;
 
-  fd_set rfds;
-  struct timeval tv = (struct timeval)
-  { 0, 0 };
-  FD_ZERO (&rfds);
-  FD_SET (c->fd, &rfds);
+  /* Vérifie s’il y a des données à lire (sans bloquer si timeout_ms = 0) */
+  struct pollfd pfd = { .fd = c->fd, .events = POLLIN, .revents = 0 };
+  int rv = poll (&pfd, 1, timeout_ms);
+  return (rv > 0 && (pfd.revents & POLLIN));
+}
 
-  /* Vérifie s’il y a des données à lire sans bloquer */
-  int rv = select (c->fd + 1, &rfds, NULL, NULL, &tv);
-  if (rv <= 0 || !FD_ISSET (c->fd, &rfds))
-    return;
+/**
+ * @brief Lit un lot de trames CAN en un seul appel système.
+ *
+ * Les trames sont recopiées dans `c->rx` avec leur horodatage noyau
+ * (horloge logicielle CLOCK_REALTIME, sinon horloge matérielle brute)
+ * et le compteur de pertes de la socket. Une augmentation de ce
+ * compteur est signalée dans le journal.
+ *
+ * @param c : contexte CAN.
+ * @param max_frames : nombre maximum de trames (borné à CAN_RX_BATCH).
+ * @param timeout_ms : attente maximale (0 = aucune, -1 = infinie).
+ * @return nombre de trames lues, 0 si aucune, -1 si erreur.
+ */
+int
+can_poll_burst (can_ctx_t *c, int max_frames, int timeout_ms)
+{
+  if (!c || c->fd < 0 || !c->batch)
+    return -1;
+  if (max_frames <= 0 || max_frames > CAN_RX_BATCH)
+    max_frames = CAN_RX_BATCH;
+
+  if (timeout_ms != 0)
+    {
+      struct pollfd pfd = { .fd = c->fd, .events = POLLIN, .revents = 0 };
+      int rv = poll (&pfd, 1, timeout_ms);
+      if (rv < 0)
+        return (errno == EINTR) ? 0 : -1;
+      if (rv == 0 || !(pfd.revents & POLLIN))
+        return 0;
+    }
 
+  struct can_rx_batch_s *b = c->batch;
   for (int i = 0; i < max_frames; i++)
     {
-      struct can_frame f;
-      ssize_t n = read (c->fd, &f, sizeof (f));
-      if (n < 0)
-        {
-          if (errno == EAGAIN || errno == EWOULDBLOCK)
-            break;
-          LOGW ("CAN read: %s", strerror (errno));
-          break;
-        }
-      if ((size_t) n != sizeof (f))
-        break;
+      b->iov[i].iov_base = &b->frames[i];
+      b->iov[i].iov_len = sizeof (b->frames[i]);
+      memset (&b->msgs[i], 0, sizeof (b->msgs[i]));
+      b->msgs[i].msg_hdr.msg_iov = &b->iov[i];
+      b->msgs[i].msg_hdr.msg_iovlen = 1;
+      b->msgs[i].msg_hdr.msg_control = b->ctrl[i];
+      b->msgs[i].msg_hdr.msg_controllen = sizeof (b->ctrl[i]);
+    }
 
-      /* 1) tentative d'identification par ID CAN */
-      const entry_t *e = t ? table_find_by_canid (t, f.can_id) : NULL;
-      const uint8_t *payload = f.data;
-      uint8_t shifted[8];
+  int n = recvmmsg (c->fd, b->msgs, (unsigned int) max_frames, MSG_DONTWAIT, NULL);
+  if (n < 0)
+    {
+      if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+        return 0;
+      LOGW ("CAN recvmmsg: %s", strerror (errno));
+      return -1;
+    }
+
+  int out = 0;
+  for (int i = 0; i < n; i++)
+    {
+      /* Trame classique (CAN_MTU) ou FD (CANFD_MTU) */
+      unsigned max_len;
+      if (b->msgs[i].msg_len == CAN_MTU)
+        max_len = 8;
+      else if (b->msgs[i].msg_len == CANFD_MTU)
+        max_len = CAN_PAYLOAD_MAX;
+      else
+        continue;
 
-      /* 2) Si echec, on tente le mode tunnel (ID dans les 2 premiers octets) */
-      if (!e && f.can_dlc >= 2)
+      const struct canfd_frame *f = &b->frames[i];
+      can_rx_frame_t *r = &c->rx[out++];
+      r->can_id = f->can_id;
+      r->len = (f->len > max_len) ? (uint8_t) max_len : f->len;
+      memcpy (r->data, f->data, r->len);
+      memset (r->data + r->len, 0, sizeof (r->data) - r->len);
+      r->meta.ts_ns = 0;
+      r->meta.drops = c->rx_drops;
+
+      struct msghdr *h = &b->msgs[i].msg_hdr;
+      for (struct cmsghdr *cm = CMSG_FIRSTHDR (h); cm; cm = CMSG_NXTHDR (h, cm))
         {
-          uint16_t inner_id = ((uint16_t) f.data[0] << 8) | f.data[1];
-          e = table_find_by_canid (t, inner_id);
-          if (e)
+          if (cm->cmsg_level != SOL_SOCKET)
+            continue;
+          if (cm->cmsg_type == SO_TIMESTAMPING)
+            {
+              /* ts[0] : logiciel ; ts[2] (matériel brut) n’est pas demandé */
+              struct timespec ts[3];
+              memcpy (ts, CMSG_DATA (cm), sizeof (ts));
+              r->meta.ts_ns = ts_to_ns (&ts[0]);
+            }
+          else if (cm->cmsg_type == SO_TIMESTAMPNS)
             {
-              /* on “retire” les 2 octets d’en-tête et on recale le payload */
-              memset (shifted, 0, sizeof (shifted));
-              size_t copy = (f.can_dlc > 2) ? (size_t) (f.can_dlc - 2) : 0;
-              if (copy > 6)
-                copy = 6;       /* place restante (8-2) */
-              memcpy (shifted, f.data + 2, copy);
-              payload = shifted;
+              struct timespec ts;
+              memcpy (&ts, CMSG_DATA (cm), sizeof (ts));
+              r->meta.ts_ns = ts_to_ns (&ts);
             }
+          else if (cm->cmsg_type == SO_RXQ_OVFL)
+            memcpy (&r->meta.drops, CMSG_DATA (cm), sizeof (uint32_t));
         }
-      /* 3) Si l’entrée correspond, on renvoie vers MQTT */
-      if (!e)
-        continue;
-      (void) mqtt_handle_can_message (m, e, payload);
+
+      if (r->meta.drops != c->rx_drops)
+        {
+          LOGW ("CAN: %u trame(s) perdue(s) par la socket (total %u)",
+                (unsigned) (r->meta.drops - c->rx_drops), (unsigned) r->meta.drops);
+          metrics_add (MC_CAN_RX_OVERFLOW, r->meta.drops - c->rx_drops);
+          c->rx_drops = r->meta.drops;
+        }
+    }
+  metrics_add (MC_CAN_RX, (uint64_t) out);
+  return out;
+}
+
+/**
+ * @brief Associe une trame reçue à une entrée de la table et la publie.
+ *
+ * Le décodage est choisi par le CAN ID (cf. table_find_rx()) :
+ * - ID de transport tunnel : les deux premiers octets contiennent l’inner ID ;
+ * - autre ID : trame directement connue dans la table.
+ *
+ * La trame est enregistrée avant la recherche si une capture est en
+ * cours (cf. capture.h). Les trames des entrées segmentées sont
+ * réassemblées par isotp_rx(), qui publie le message complet.
+ */
+static void
+dispatch_frame (can_ctx_t *c, const can_rx_frame_t *r, const table_t *t, mqtt_ctx_t *m)
+{
+  if (capture_on ())
+    capture_can (r->can_id, r->data, r->len);
+
+  uint8_t hdr;
+  const entry_t *e = table_find_rx (t, r->can_id, r->data, r->len, &hdr);
+  if (!e)
+    {
+      metrics_inc (MC_CANID_MISS);
+      return;
+    }
+
+  if (e->seg)
+    {
+      isotp_rx (c, e, r, hdr, m);
+      return;
+    }
+
+  /* on “retire” l’en-tête tunnel : r->data est complété par des 0
+     jusqu’à CAN_PAYLOAD_MAX, le décalage reste dans le tampon */
+  (void) mqtt_handle_can_message (m, e, r->data + hdr, &r->meta);
+}
+
+/**
+ * @brief Traite les trames d’une socket déjà signalée lisible.
+ *
+ * Variante sans attente de can_poll(), pour une boucle d’événements
+ * (epoll) qui sait déjà que des trames sont disponibles. Les trames
+ * sont lues par lots de CAN_RX_BATCH.
+ *
+ * @param c : contexte CAN.
+ * @param t : table de conversion topic/ID.
+ * @param m  : contexte MQTT (pour republier).
+ * @param max_frames : nombre maximum de trames à lire.
+ */
+void
+can_poll_ready (can_ctx_t *c, const table_t *t, mqtt_ctx_t *m, int max_frames)
+{
+  if (!c || c->fd < 0)
+    return;
+  if (max_frames <= 0)
+    max_frames = 8;
+
+  while (max_frames > 0)
+    {
+      int want = (max_frames < CAN_RX_BATCH) ? max_frames : CAN_RX_BATCH;
+      int n = can_poll_burst (c, want, 0);
+      if (n <= 0)
+        break;
+      for (int i = 0; i < n; i++)
+        dispatch_frame (c, &c->rx[i], t, m);
+      if (n < want)
+        break;                  /* socket vidée */
+      max_frames -= n;
     }
 }
 
@@ -253,9 +1192,151 @@ can_cleanup (can_ctx_t *c)
     return;
   if (c->fd >= 0)
     {
+      /* Les commandes retenues partent sans attendre leur échéance */
+      for (size_t i = 0; c->shape && c->tx_held && i <= c->shape->mask; i++)
+        if (c->shape->slots[i].held)
+          {
+            c->shape->slots[i].held = false;
+            c->tx_held--;
+            (void) shape_emit (c, &c->shape->slots[i], c->shape->slots[i].data,
+                               c->shape->slots[i].len, c->shape->slots[i].t0, metrics_now_ns ());
+          }
+      if (can_tx_pending (c))
+        (void) can_flush (c);   /* dernière chance pour les trames en attente */
       close (c->fd);
       c->fd = -1;
     }
+  free (c->batch);
+  c->batch = NULL;
+  free (c->txb);
+  c->txb = NULL;
+  c->tx_count = 0;
+  if (c->shape)
+    free (c->shape->slots);
+  free (c->shape);
+  c->shape = NULL;
+  c->tx_held = 0;
+  isotp_destroy (c->isotp);
+  c->isotp = NULL;
+}
+
+
+/* -------------------------------------------------------------------------- */
+/*                     File d’émission inter-threads                          */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Initialise la file d’émission (mode multithread).
+ *
+ * @param q : file à initialiser.
+ * @return true si succès.
+ */
+bool
+can_txq_init (can_txq_t *q)
+{
+  if (!q)
+    return false;
+  spsc_init (&q->ring);
+  atomic_init (&q->dropped, 0);
+  return (sem_init (&q->ready, 0, 0) == 0);
+}
+
+/**
+ * @brief Libère la file d’émission.
+ *
+ * @param q : file à libérer.
+ */
+void
+can_txq_destroy (can_txq_t *q)
+{
+  if (q)
+    sem_destroy (&q->ready);
+}
+
+/**
+ * @brief Dépose une trame dans la file (côté callback MQTT).
+ *
+ * L’écriture dans l’anneau est sans verrou ; sem_post() ne fait un appel
+ * système que si le thread TX est endormi.
+ *
+ * @param q : file d’émission.
+ * @param can_id : identifiant CAN de transport.
+ * @param data : octets à émettre.
+ * @param len : nombre d’octets (0..CAN_PAYLOAD_MAX).
+ * @param key : clé de fusion (cf. can_queue()).
+ * @param cmd : limitation de l’entrée (cf. can_queue_cmd()), NULL si aucune.
+ * @param seg : 0, ou options ISOTP_* d’un message segmenté (cf. isotp_send()).
+ * @param t0 : réception de la commande MQTT (cf. can_queue()).
+ * @return true si la trame est en file, false si la file est pleine.
+ */
+bool
+can_txq_push (can_txq_t *q, uint32_t can_id, const uint8_t *data, uint8_t len, uint32_t key,
+              const cmd_policy_t *cmd, uint8_t seg, uint64_t t0)
+{
+  if (!seg && len > CAN_PAYLOAD_MAX)
+    return false;
+  can_msg_t msg;
+  msg.t0 = t0;
+  msg.can_id = can_id;
+  msg.key = key;
+  msg.seg = seg;
+  msg.len = len;
+  memcpy (msg.data, data, len);
+  if (cmd)
+    msg.cmd = *cmd;
+  else
+    memset (&msg.cmd, 0, sizeof (msg.cmd));
+  if (!spsc_push (&q->ring, &msg))
+    {
+      atomic_fetch_add_explicit (&q->dropped, 1, memory_order_relaxed);
+      metrics_inc (MC_CAN_TX_DROP);
+      return false;
+    }
+  sem_post (&q->ready);
+  return true;
+}
+
+/**
+ * @brief Retire une trame de la file, en attendant au plus timeout_ms.
+ *
+ * @param q : file d’émission.
+ * @param[out] out : trame retirée.
+ * @param timeout_ms : attente maximale en millisecondes.
+ * @return true si une trame a été retirée.
+ */
+bool
+can_txq_pop_wait (can_txq_t *q, can_msg_t *out, int timeout_ms)
+{
+  struct timespec ts;
+  clock_gettime (CLOCK_REALTIME, &ts);
+  ts.tv_sec += timeout_ms / 1000;
+  ts.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L)
+    {
+      ts.tv_sec++;
+      ts.tv_nsec -= 1000000000L;
+    }
+
+  while (sem_timedwait (&q->ready, &ts) < 0)
+    {
+      if (errno != EINTR)
+        return false;
+    }
+  return spsc_pop (&q->ring, out);
+}
+
+/**
+ * @brief Réveille le thread consommateur (arrêt, FC d’un message segmenté).
+ *
+ * Le consommateur réveillé sans trame reçoit false de can_txq_pop_wait().
+ *
+ * @param q : file d’émission.
+ */
+void
+can_txq_wake (can_txq_t *q)
+{
+  if (q)
+    sem_post (&q->ready);
 }
 
 // End of file
@@ -0,0 +1,475 @@
+/**
+ * @file capture.c
+ * @brief Enregistrement et relecture du trafic CAN et MQTT du pont.
+ *
+ * Format du fichier (entiers en LEB128 non signé, « varint ») :
+ *
+ *   en-tête        : "CBCAP01\n", varint heure de début (CLOCK_REALTIME, ns)
+ *   enregistrement : u8 type, varint écart au précédent (ns), puis
+ *     CAPTURE_CAN  : varint CAN ID, u8 longueur, octets (64 au plus, CAN FD)
+ *     CAPTURE_MQTT : varint longueur du topic, topic, '\0',
+ *                    varint longueur du payload, payload
+ *
+ * Une trame CAN classique tient ainsi en 12 à 16 octets, un message MQTT en sa
+ * taille utile plus 4 à 8 octets. Le '\0' du topic permet au rejeu de le
+ * passer tel quel à on_message, sans copie.
+ *
+ * Enregistrement : même anneau que le journal (log.c). Chaque point de
+ * capture réserve une case par compare-and-swap, y copie l’horodatage et
+ * les octets, puis la publie ; un thread d’écriture, seul consommateur,
+ * encode les cases dans l’ordre et les écrit dans le fichier. Anneau
+ * plein : l’enregistrement est perdu et compté, l’appelant n’attend
+ * jamais le disque.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "log.h"
+#include "capture.h"
+
+#define CAPTURE_MAGIC     "CBCAP01\n"
+#define CAPTURE_MAGIC_LEN 8
+#define VARINT_MAX        10
+
+_Static_assert(CAPTURE_INLINE_MAX >= CAPTURE_CAN_MAX, "CAPTURE_INLINE_MAX < CAPTURE_CAN_MAX");
+
+_Atomic bool g_capture_on;
+
+/** @brief Enregistrement en attente d’écriture. */
+typedef struct cap_rec_s {
+  _Atomic size_t seq;       /* == position + 1 : case publiée */
+  uint8_t   kind;           /* capture_kind_t */
+  uint8_t   dlc;            /* CAPTURE_CAN */
+  uint32_t  can_id;
+  uint64_t  ts_ns;          /* CLOCK_MONOTONIC, pris par le producteur */
+  size_t    tlen;           /* CAPTURE_MQTT : topic (sans '\0') */
+  size_t    plen;           /*                payload */
+  uint8_t  *heap;           /* topic '\0' payload hors case (NULL : dans body) */
+  uint8_t   body[CAPTURE_INLINE_MAX];   /* CAN : données ; MQTT : topic '\0' payload */
+} cap_rec_t;
+
+/** @brief État de l’enregistrement ; f, path et les totaux sont à l’écrivain. */
+static struct {
+  alignas(64) _Atomic size_t head;    /* prochaine case à réserver (producteurs) */
+  alignas(64) size_t tail;            /* prochaine case à écrire (écrivain) */
+  alignas(64) _Atomic uint64_t dropped;
+  _Atomic bool stop;
+  bool      running;                  /* thread d’écriture lancé */
+  sem_t     ready;
+  pthread_t thread;
+  FILE     *f;
+  char     *path;
+  uint64_t  last_ns;                  /* horodatage du dernier enregistrement écrit */
+  uint64_t  records;
+  uint64_t  lost;
+  cap_rec_t ring[CAPTURE_RING_SIZE];
+} g_cap;
+
+static uint64_t now_ns(clockid_t clk){
+  struct timespec ts;
+  clock_gettime(clk, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief Encode v en varint.
+ *
+ * @return octets écrits (VARINT_MAX au plus).
+ */
+static size_t put_varint(uint8_t *p, uint64_t v){
+  size_t n = 0;
+  while(v >= 0x80){
+    p[n++] = (uint8_t)(v | 0x80);
+    v >>= 7;
+  }
+  p[n++] = (uint8_t)v;
+  return n;
+}
+
+/**
+ * @brief Écrit des octets ; une erreur arrête l’enregistrement.
+ *
+ * Appelé par l’écrivain seul (ou avant son lancement).
+ */
+static bool put(const void *p, size_t n){
+  if(!g_cap.f) return false;
+  if(n == 0 || fwrite(p, 1, n, g_cap.f) == n) return true;
+  LOGE("Écriture de la capture %s: %s (enregistrement arrêté)", g_cap.path, strerror(errno));
+  atomic_store_explicit(&g_capture_on, false, memory_order_relaxed);
+  fclose(g_cap.f);
+  g_cap.f = NULL;
+  return false;
+}
+
+/**
+ * @brief Réserve une case de l’anneau.
+ *
+ * @param[out] pos position réservée.
+ * @return la case, NULL si l’anneau est plein (perte comptée).
+ */
+static cap_rec_t *rec_claim(size_t *pos){
+  size_t p = atomic_load_explicit(&g_cap.head, memory_order_relaxed);
+  for(;;){
+    cap_rec_t *r = &g_cap.ring[p & (CAPTURE_RING_SIZE - 1)];
+    size_t seq = atomic_load_explicit(&r->seq, memory_order_acquire);
+    if(seq == p){
+      if(atomic_compare_exchange_weak_explicit(&g_cap.head, &p, p + 1,
+                                               memory_order_relaxed, memory_order_relaxed)){
+        *pos = p;
+        return r;
+      }
+    }else if((ptrdiff_t)(seq - p) < 0){
+      atomic_fetch_add_explicit(&g_cap.dropped, 1, memory_order_relaxed);
+      return NULL;
+    }else{
+      p = atomic_load_explicit(&g_cap.head, memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * @brief Horodate et publie une case remplie ; réveille l’écrivain toutes
+ *        les CAPTURE_RING_SIZE / 2 cases.
+ */
+static void rec_publish(cap_rec_t *r, size_t pos){
+  r->ts_ns = now_ns(CLOCK_MONOTONIC);
+  atomic_store_explicit(&r->seq, pos + 1, memory_order_release);   /* la case n’est plus à nous */
+  if((pos & (CAPTURE_RING_SIZE / 2 - 1)) == 0 && capture_on()) sem_post(&g_cap.ready);
+}
+
+/**
+ * @brief Encode et écrit une case.
+ *
+ * Deux producteurs peuvent publier dans le désordre de leurs horodatages
+ * à quelques nanosecondes près : un écart négatif est ramené à 0.
+ */
+static void rec_write(const cap_rec_t *r){
+  uint8_t hdr[1 + 3 * VARINT_MAX + 1];
+  uint64_t dt = (r->ts_ns > g_cap.last_ns) ? r->ts_ns - g_cap.last_ns : 0;
+  size_t n = 0;
+  hdr[n++] = r->kind;
+  n += put_varint(hdr + n, dt);
+  g_cap.last_ns += dt;
+  g_cap.records++;
+
+  if(r->kind == CAPTURE_CAN){
+    n += put_varint(hdr + n, r->can_id);
+    hdr[n++] = r->dlc;
+    (void)(put(hdr, n) && put(r->body, r->dlc));
+  }else{
+    const uint8_t *b = r->heap ? r->heap : r->body;
+    uint8_t plen[VARINT_MAX];
+    n += put_varint(hdr + n, r->tlen);
+    (void)(put(hdr, n) && put(b, r->tlen + 1) &&
+           put(plen, put_varint(plen, r->plen)) && put(b + r->tlen + 1, r->plen));
+  }
+}
+
+/**
+ * @brief Écrit les cases publiées (écrivain seul, ou capture_close()).
+ *
+ * Après une erreur d’écriture, les cases sont libérées sans être écrites.
+ */
+static void drain(void){
+  size_t n = 0;
+  uint64_t lost = atomic_exchange_explicit(&g_cap.dropped, 0, memory_order_relaxed);
+  if(lost){
+    g_cap.lost += lost;
+    LOGW("Capture : %llu enregistrement(s) perdu(s) (file pleine)", (unsigned long long)lost);
+  }
+  for(;;){
+    cap_rec_t *r = &g_cap.ring[g_cap.tail & (CAPTURE_RING_SIZE - 1)];
+    if(atomic_load_explicit(&r->seq, memory_order_acquire) != g_cap.tail + 1) break;
+    if(g_cap.f) rec_write(r);
+    free(r->heap);
+    r->heap = NULL;
+    atomic_store_explicit(&r->seq, g_cap.tail + CAPTURE_RING_SIZE, memory_order_release);
+    g_cap.tail++;
+    n++;
+  }
+  if(n && g_cap.f) fflush(g_cap.f);
+}
+
+/**
+ * @brief Thread d’écriture : vide l’anneau toutes les CAPTURE_FLUSH_MS,
+ *        ou plus tôt si un producteur le réveille.
+ */
+static void *writer(void *arg){
+  (void)arg;
+  while(!atomic_load(&g_cap.stop)){
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += (long)CAPTURE_FLUSH_MS * 1000000L;
+    until.tv_sec += until.tv_nsec / 1000000000L;
+    until.tv_nsec %= 1000000000L;
+    if(sem_timedwait(&g_cap.ready, &until) < 0 && errno != EINTR && errno != ETIMEDOUT) break;
+    while(sem_trywait(&g_cap.ready) == 0) ;   /* un seul passage pour tout le lot */
+    drain();
+  }
+  return NULL;
+}
+
+/**
+ * @brief Démarre l’enregistrement dans path (écrasé).
+ *
+ * @return false si le fichier ne peut être créé ou le thread d’écriture
+ *         lancé.
+ */
+bool capture_open(const char *path){
+  if(!path) return false;
+  capture_close();
+
+  FILE *f = fopen(path, "wb");
+  if(!f){
+    LOGE("Ouvrir la capture %s: %s", path, strerror(errno));
+    return false;
+  }
+  setvbuf(f, NULL, _IOFBF, 1u << 16);
+
+  uint8_t hdr[CAPTURE_MAGIC_LEN + VARINT_MAX];
+  memcpy(hdr, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN);
+  size_t n = CAPTURE_MAGIC_LEN + put_varint(hdr + CAPTURE_MAGIC_LEN, now_ns(CLOCK_REALTIME));
+
+  g_cap.f = f;
+  g_cap.path = strdup(path);
+  g_cap.last_ns = now_ns(CLOCK_MONOTONIC);
+  g_cap.records = 0;
+  g_cap.lost = 0;
+  if(!put(hdr, n)){
+    free(g_cap.path);
+    g_cap.path = NULL;
+    return false;
+  }
+
+  for(size_t i = 0; i < CAPTURE_RING_SIZE; i++) atomic_init(&g_cap.ring[i].seq, i);
+  atomic_init(&g_cap.head, 0);
+  atomic_init(&g_cap.dropped, 0);
+  g_cap.tail = 0;
+  atomic_store(&g_cap.stop, false);
+  int rc = -1;
+  if(sem_init(&g_cap.ready, 0, 0) == 0){
+    /* Le thread d’écriture ne reçoit aucun signal (signalfd, sigtimedwait) */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_SETMASK, &all, &old);
+    rc = pthread_create(&g_cap.thread, NULL, writer, NULL);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+    if(rc != 0) sem_destroy(&g_cap.ready);
+  }
+  if(rc != 0){
+    LOGE("Capture %s : thread d’écriture impossible", path);
+    fclose(g_cap.f);
+    g_cap.f = NULL;
+    free(g_cap.path);
+    g_cap.path = NULL;
+    return false;
+  }
+  g_cap.running = true;
+
+  atomic_store_explicit(&g_capture_on, true, memory_order_relaxed);
+  LOGI("Enregistrement du trafic dans %s", path);
+  return true;
+}
+
+/**
+ * @brief Arrête l’enregistrement, écrit les cases en attente et ferme le
+ *        fichier.
+ */
+void capture_close(void){
+  atomic_store_explicit(&g_capture_on, false, memory_order_relaxed);
+  if(!g_cap.running) return;
+  atomic_store(&g_cap.stop, true);
+  sem_post(&g_cap.ready);
+  pthread_join(g_cap.thread, NULL);
+  g_cap.running = false;
+  drain();
+  sem_destroy(&g_cap.ready);
+
+  if(g_cap.f){
+    if(fclose(g_cap.f) != 0)
+      LOGE("Fermer la capture %s: %s", g_cap.path, strerror(errno));
+    else
+      LOGI("Capture %s : %llu enregistrements, %llu perdus", g_cap.path,
+           (unsigned long long)g_cap.records, (unsigned long long)g_cap.lost);
+    g_cap.f = NULL;
+  }
+  free(g_cap.path);
+  g_cap.path = NULL;
+}
+
+/**
+ * @brief Enregistre une trame CAN reçue (copie dans l’anneau).
+ */
+void capture_can(uint32_t can_id, const uint8_t *data, uint8_t dlc){
+  if(!capture_on()) return;
+  size_t pos;
+  cap_rec_t *r = rec_claim(&pos);
+  if(!r) return;
+  if(dlc > CAPTURE_CAN_MAX) dlc = CAPTURE_CAN_MAX;
+  r->kind = CAPTURE_CAN;
+  r->can_id = can_id;
+  r->dlc = dlc;
+  r->heap = NULL;
+  memcpy(r->body, data, dlc);
+  rec_publish(r, pos);
+}
+
+/**
+ * @brief Enregistre un message MQTT reçu (copie dans l’anneau).
+ *
+ * Topic et payload sont copiés dans la case s’ils tiennent dans
+ * CAPTURE_INLINE_MAX octets, sinon dans un bloc alloué que l’écrivain
+ * libère.
+ */
+void capture_mqtt(const char *topic, const void *payload, size_t len){
+  if(!capture_on()) return;
+  size_t tlen = strlen(topic);
+  if(!payload) len = 0;
+  size_t need = tlen + 1 + len;
+  uint8_t *heap = NULL;
+  if(need > CAPTURE_INLINE_MAX && !(heap = malloc(need))){
+    atomic_fetch_add_explicit(&g_cap.dropped, 1, memory_order_relaxed);
+    return;
+  }
+  size_t pos;
+  cap_rec_t *r = rec_claim(&pos);
+  if(!r){
+    free(heap);
+    return;
+  }
+  uint8_t *b = heap ? heap : r->body;
+  memcpy(b, topic, tlen + 1);
+  if(len) memcpy(b + tlen + 1, payload, len);
+  r->kind = CAPTURE_MQTT;
+  r->tlen = tlen;
+  r->plen = len;
+  r->heap = heap;
+  rec_publish(r, pos);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               Relecture                                    */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Décode un varint à la position courante.
+ *
+ * @return false si le fichier est tronqué ou le varint trop long.
+ */
+static bool get_varint(capture_reader_t *r, uint64_t *v){
+  *v = 0;
+  for(unsigned shift = 0; shift < 7 * VARINT_MAX && r->pos < r->size; shift += 7){
+    uint8_t b = r->buf[r->pos++];
+    *v |= (uint64_t)(b & 0x7F) << shift;
+    if(!(b & 0x80)) return true;
+  }
+  return false;
+}
+
+/**
+ * @brief Charge un fichier de capture en mémoire et vérifie l’en-tête.
+ *
+ * @param[out] r lecteur.
+ * @param path fichier de capture.
+ * @return true si succès.
+ */
+bool capture_reader_open(capture_reader_t *r, const char *path){
+  memset(r, 0, sizeof(*r));
+  FILE *f = fopen(path, "rb");
+  if(!f){
+    LOGE("Ouvrir la capture %s: %s", path, strerror(errno));
+    return false;
+  }
+  long size = (fseek(f, 0, SEEK_END) == 0) ? ftell(f) : -1;
+  if(size < CAPTURE_MAGIC_LEN || fseek(f, 0, SEEK_SET) != 0 || !(r->buf = malloc((size_t)size)) ||
+     fread(r->buf, 1, (size_t)size, f) != (size_t)size || memcmp(r->buf, CAPTURE_MAGIC, CAPTURE_MAGIC_LEN)){
+    LOGE("Capture %s illisible ou invalide", path);
+    fclose(f);
+    capture_reader_close(r);
+    return false;
+  }
+  fclose(f);
+  r->size = (size_t)size;
+  r->pos = CAPTURE_MAGIC_LEN;
+  uint64_t start;
+  if(!get_varint(r, &start)){
+    LOGE("Capture %s tronquée", path);
+    capture_reader_close(r);
+    return false;
+  }
+  r->ts_ns = 0;
+  return true;
+}
+
+/**
+ * @brief Revient au premier enregistrement.
+ */
+void capture_rewind(capture_reader_t *r){
+  uint64_t start;
+  r->pos = CAPTURE_MAGIC_LEN;
+  r->ts_ns = 0;
+  if(r->size) (void)get_varint(r, &start);
+}
+
+/**
+ * @brief Lit l’enregistrement suivant.
+ *
+ * @param r lecteur.
+ * @param[out] rec enregistrement (pointe dans le tampon du lecteur).
+ * @return false en fin de fichier ; un enregistrement tronqué ou
+ *         inconnu est signalé et termine la lecture.
+ */
+bool capture_next(capture_reader_t *r, capture_rec_t *rec){
+  if(r->pos >= r->size) return false;
+  uint64_t dt, v, len;
+  size_t start = r->pos;
+  rec->kind = (capture_kind_t)r->buf[r->pos++];
+  if(!get_varint(r, &dt)) goto bad;
+  rec->ts_ns = r->ts_ns + dt;
+
+  if(rec->kind == CAPTURE_CAN){
+    if(!get_varint(r, &v) || r->pos >= r->size) goto bad;
+    rec->can_id = (uint32_t)v;
+    rec->dlc = r->buf[r->pos++];
+    if(rec->dlc > CAPTURE_CAN_MAX || r->size - r->pos < rec->dlc) goto bad;
+    memset(rec->data, 0, sizeof(rec->data));
+    memcpy(rec->data, r->buf + r->pos, rec->dlc);
+    r->pos += rec->dlc;
+  }else if(rec->kind == CAPTURE_MQTT){
+    if(!get_varint(r, &len) || r->size - r->pos <= len || r->buf[r->pos + len] != '\0') goto bad;
+    rec->topic = (const char *)r->buf + r->pos;
+    r->pos += len + 1;
+    if(!get_varint(r, &len) || r->size - r->pos < len) goto bad;
+    rec->payload = r->buf + r->pos;
+    rec->len = (size_t)len;
+    r->pos += len;
+  }else{
+    goto bad;
+  }
+  r->ts_ns = rec->ts_ns;
+  return true;
+
+bad:
+  LOGW("Capture : enregistrement invalide à l’octet %zu, lecture arrêtée", start);
+  r->pos = r->size;
+  return false;
+}
+
+void capture_reader_close(capture_reader_t *r){
+  free(r->buf);
+  memset(r, 0, sizeof(*r));
+}
+
+// End of file
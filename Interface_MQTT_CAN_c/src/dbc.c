@@ -0,0 +1,511 @@
+/**
+ * @file dbc.c
+ * @brief Import d’un fichier DBC (Vector) comme dictionnaire de conversion.
+ *
+ * Le fichier est traduit en un document JSON de même forme que
+ * conversion.json, que table_load() construit ensuite comme d’habitude :
+ *
+ *   BO_ <id> <nom>: <dlc> <émetteur>
+ *       entrée "direct" d’ID <id>, "extended" si le bit 31 de <id> est
+ *       levé, "can_fd" si <dlc> dépasse 8 ;
+ *   SG_ <nom> : <bit>|<long>@<ordre><signe> (<facteur>,<offset>) ...
+ *       champ "uint" (+) ou "sint" (-) de <long> bits, "start_bit" <bit>,
+ *       "byte_order" intel (1) ou motorola (0), "scale"/"offset" repris
+ *       du facteur et de l’offset ;
+ *   VAL_ <id> <signal> <valeur> "<texte>" ... ;
+ *       champ "enum" si le signal est non signé, de 8 bits au plus et
+ *       sans conversion (sinon la table est ignorée) ;
+ *   SIG_VALTYPE_ <id> <signal> : 1;
+ *       champ "float" (32 bits) ;
+ *   BA_ "MqttTopic" BO_ <id> "<topic>";
+ *       topic imposé (cf. DBC_TOPIC_ATTR), sinon "<émetteur>/<message>".
+ *
+ * Ne sont pas repris (signal ignoré, un avertissement par message) : les
+ * signaux multiplexés (mN ; le multiplexeur M reste un champ ordinaire),
+ * ceux de plus de 32 bits et les doubles (SIG_VALTYPE_ 2). Les autres
+ * sections (CM_, BA_DEF_, VAL_TABLE_, ...) sont ignorées.
+ *
+ * Lecture en un seul passage sur le fichier en mémoire, les noms restant
+ * dans ce tampon. Les lignes VAL_, SIG_VALTYPE_ et BA_ sont traitées une
+ * fois tous les messages lus, en retrouvant leur message par recherche
+ * dichotomique sur l’ID.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <cjson/cJSON.h>
+
+#include "types.h"
+#include "log.h"
+#include "dbc.h"
+
+/* Nom dans le tampon du fichier (non terminé) */
+typedef struct dbc_str_s {
+  const char *s;
+  size_t      n;
+} dbc_str_t;
+
+/* Signal SG_ */
+typedef struct dbc_sig_s {
+  dbc_str_t name;
+  char     *vals;        /* VAL_ : suite "<valeur> \"<texte>\" ..." du signal, NULL si aucune */
+  double    factor, offset;
+  uint16_t  start;       /* bit de départ DBC (LSB en intel, MSB en motorola) */
+  uint8_t   len;
+  uint8_t   valtype;     /* SIG_VALTYPE_ : 0 entier, 1 float, 2 double */
+  bool      little, sign, muxed;
+} dbc_sig_t;
+
+/* Message BO_, ses signaux sont sig[first .. first + count) */
+typedef struct dbc_msg_s {
+  uint32_t    id;        /* tel qu’écrit : bit 31 = ID étendu */
+  uint8_t     dlc;
+  dbc_str_t   name, node;
+  const char *topic;     /* attribut DBC_TOPIC_ATTR, NULL si absent */
+  size_t      first, count;
+} dbc_msg_t;
+
+typedef struct dbc_s {
+  dbc_msg_t  *msg;   size_t nmsg, cmsg;
+  dbc_sig_t  *sig;   size_t nsig, csig;
+  char      **late;  size_t nlate, clate;   /* lignes VAL_, SIG_VALTYPE_, BA_ */
+  dbc_msg_t **by_id;                        /* messages triés par ID */
+  bool        oom;
+} dbc_t;
+
+/**
+ * @brief Agrandit un tableau dynamique pour recevoir un élément de plus.
+ *
+ * @param[in,out] p tableau.
+ * @param[in,out] cap capacité, doublée si n l’atteint.
+ * @param n nombre d’éléments.
+ * @param size taille d’un élément.
+ * @return false si la mémoire manque.
+ */
+static bool grow(void **p, size_t *cap, size_t n, size_t size){
+  if(n < *cap) return true;
+  size_t c = *cap ? 2 * *cap : 64;
+  void *tmp = realloc(*p, c * size);
+  if(!tmp) return false;
+  *p = tmp;
+  *cap = c;
+  return true;
+}
+
+/* --- Lecture d’une ligne (le curseur avance si l’élément est présent) --- */
+
+static char* skip_ws(char *p){
+  while(*p == ' ' || *p == '\t') p++;
+  return p;
+}
+
+/**
+ * @brief Mot-clé de section, suivi d’un séparateur ("VAL_" ne prend pas "VAL_TABLE_").
+ */
+static bool take_keyword(char **pp, const char *kw){
+  size_t n = strlen(kw);
+  char *p = skip_ws(*pp);
+  if(strncmp(p, kw, n) != 0) return false;
+  if(p[n] != ' ' && p[n] != '\t' && p[n] != ':' && p[n] != '\0') return false;
+  *pp = p + n;
+  return true;
+}
+
+/**
+ * @brief Identifiant C (nom de message, de signal, de nœud).
+ */
+static bool take_ident(char **pp, dbc_str_t *out){
+  char *p = skip_ws(*pp), *s = p;
+  while((*p >= 'A' && *p <= 'Z') || (*p >= 'a' && *p <= 'z') || (*p >= '0' && *p <= '9') || *p == '_') p++;
+  if(p == s) return false;
+  out->s = s;
+  out->n = (size_t)(p - s);
+  *pp = p;
+  return true;
+}
+
+static bool take_char(char **pp, char c){
+  char *p = skip_ws(*pp);
+  if(*p != c) return false;
+  *pp = p + 1;
+  return true;
+}
+
+static bool take_uint(char **pp, unsigned long long *v){
+  char *p = skip_ws(*pp), *end;
+  if(*p < '0' || *p > '9') return false;
+  *v = strtoull(p, &end, 10);
+  *pp = end;
+  return true;
+}
+
+static bool take_num(char **pp, double *v){
+  char *p = skip_ws(*pp), *end;
+  *v = strtod(p, &end);
+  if(end == p) return false;
+  *pp = end;
+  return true;
+}
+
+/**
+ * @brief Chaîne entre guillemets, terminée sur place dans le tampon.
+ */
+static bool take_quoted(char **pp, char **out){
+  char *p = skip_ws(*pp);
+  if(*p != '"') return false;
+  char *s = ++p;
+  while(*p && *p != '"'){
+    if(*p == '\\' && p[1]) p++;
+    p++;
+  }
+  if(*p != '"') return false;
+  *p = '\0';
+  *out = s;
+  *pp = p + 1;
+  return true;
+}
+
+/**
+ * @brief true si la ligne ouvre ou ferme une chaîne (commentaire CM_ sur
+ *        plusieurs lignes) : nombre impair de guillemets non échappés.
+ */
+static bool odd_quotes(const char *p){
+  bool odd = false;
+  for(; *p; p++){
+    if(*p == '\\' && p[1]) p++;
+    else if(*p == '"') odd = !odd;
+  }
+  return odd;
+}
+
+static bool str_eq(dbc_str_t a, const char *s, size_t n){
+  return a.n == n && memcmp(a.s, s, n) == 0;
+}
+
+/* --- Sections --- */
+
+/**
+ * @brief BO_ <id> <nom>: <dlc> <émetteur>
+ *
+ * @return false si la ligne est illisible.
+ */
+static bool parse_bo(dbc_t *d, char *p){
+  unsigned long long id, dlc;
+  dbc_msg_t m;
+  memset(&m, 0, sizeof(m));
+  if(!take_uint(&p, &id) || !take_ident(&p, &m.name) || !take_char(&p, ':') || !take_uint(&p, &dlc)) return false;
+  if(id > 0xFFFFFFFFull) return false;
+  take_ident(&p, &m.node);
+  m.id    = (uint32_t)id;
+  m.dlc   = (uint8_t)(dlc > 64 ? 64 : dlc);
+  m.first = d->nsig;
+
+  if(!grow((void**)&d->msg, &d->cmsg, d->nmsg, sizeof(dbc_msg_t))){ d->oom = true; return true; }
+  d->msg[d->nmsg++] = m;
+  return true;
+}
+
+/**
+ * @brief SG_ <nom> [M|mN] : <bit>|<long>@<ordre><signe> (<facteur>,<offset>) [<min>|<max>] "<unité>" <récepteurs>
+ *
+ * Le signal est rattaché au dernier BO_ lu.
+ *
+ * @return false si la ligne est illisible ou hors message.
+ */
+static bool parse_sg(dbc_t *d, char *p){
+  unsigned long long start, len;
+  dbc_sig_t s;
+  memset(&s, 0, sizeof(s));
+  if(!d->nmsg || !take_ident(&p, &s.name)) return false;
+
+  p = skip_ws(p);
+  if(*p == 'm' || *p == 'M'){         /* multiplexé (mN) ou multiplexeur (M) */
+    s.muxed = (*p == 'm');
+    while(*p && *p != ':' && *p != ' ' && *p != '\t') p++;
+  }
+  if(!take_char(&p, ':') || !take_uint(&p, &start) || !take_char(&p, '|') ||
+     !take_uint(&p, &len) || !take_char(&p, '@')) return false;
+  if((p[0] != '0' && p[0] != '1') || (p[1] != '+' && p[1] != '-')) return false;
+  s.little = (p[0] == '1');
+  s.sign   = (p[1] == '-');
+  p += 2;
+  if(!take_char(&p, '(') || !take_num(&p, &s.factor) || !take_char(&p, ',') ||
+     !take_num(&p, &s.offset) || !take_char(&p, ')')) return false;
+  if(start >= 8 * 64 || len == 0 || len > 64) return false;
+  s.start = (uint16_t)start;
+  s.len   = (uint8_t)len;
+
+  if(!grow((void**)&d->sig, &d->csig, d->nsig, sizeof(dbc_sig_t))){ d->oom = true; return true; }
+  d->sig[d->nsig++] = s;
+  d->msg[d->nmsg - 1].count++;
+  return true;
+}
+
+static int cmp_msg_id(const void *a, const void *b){
+  uint32_t x = (*(dbc_msg_t* const*)a)->id, y = (*(dbc_msg_t* const*)b)->id;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Message d’ID id (tel qu’écrit dans le DBC), NULL si inconnu.
+ */
+static dbc_msg_t* find_msg(const dbc_t *d, uint32_t id){
+  size_t lo = 0, hi = d->nmsg;
+  while(lo < hi){
+    size_t mid = lo + (hi - lo) / 2;
+    if(d->by_id[mid]->id < id) lo = mid + 1;
+    else hi = mid;
+  }
+  return (lo < d->nmsg && d->by_id[lo]->id == id) ? d->by_id[lo] : NULL;
+}
+
+/**
+ * @brief Lit "<id> <signal>" et retrouve le signal désigné, NULL si inconnu.
+ */
+static dbc_sig_t* find_sig(const dbc_t *d, char **pp){
+  unsigned long long id;
+  dbc_str_t name;
+  if(!take_uint(pp, &id) || id > 0xFFFFFFFFull || !take_ident(pp, &name)) return NULL;
+  dbc_msg_t *m = find_msg(d, (uint32_t)id);
+  if(!m) return NULL;
+  for(size_t i = 0; i < m->count; i++)
+    if(str_eq(d->sig[m->first + i].name, name.s, name.n)) return &d->sig[m->first + i];
+  return NULL;
+}
+
+/**
+ * @brief Ligne VAL_, SIG_VALTYPE_ ou BA_, une fois tous les messages lus.
+ *        Une ligne qui ne désigne pas un signal ou un message connu
+ *        (variables d’environnement, autres attributs) est ignorée.
+ */
+static void parse_late(dbc_t *d, char *p){
+  if(take_keyword(&p, "VAL_")){
+    dbc_sig_t *s = find_sig(d, &p);
+    if(s) s->vals = p;
+  } else if(take_keyword(&p, "SIG_VALTYPE_")){
+    unsigned long long vt;
+    dbc_sig_t *s = find_sig(d, &p);
+    if(s && take_char(&p, ':') && take_uint(&p, &vt)) s->valtype = (uint8_t)(vt > 2 ? 2 : vt);
+  } else if(take_keyword(&p, "BA_")){
+    unsigned long long id;
+    char *attr, *topic;
+    if(!take_quoted(&p, &attr) || strcmp(attr, DBC_TOPIC_ATTR) != 0) return;
+    if(!take_keyword(&p, "BO_") || !take_uint(&p, &id) || id > 0xFFFFFFFFull || !take_quoted(&p, &topic)) return;
+    dbc_msg_t *m = find_msg(d, (uint32_t)id);
+    if(m && *topic) m->topic = topic;
+  }
+}
+
+/* --- Traduction en dictionnaire JSON --- */
+
+/**
+ * @brief Dictionnaire d’un champ enum depuis la suite d’un VAL_.
+ */
+static cJSON* dbc_dict(char *p){
+  cJSON *dict = cJSON_CreateObject();
+  double v;
+  char *txt;
+  while(dict && take_num(&p, &v) && take_quoted(&p, &txt)){
+    if(!cJSON_AddNumberToObject(dict, txt, v)){ cJSON_Delete(dict); return NULL; }
+  }
+  return dict;
+}
+
+/**
+ * @brief Décrit un signal comme un champ de "data" (cf. field_desc()).
+ *
+ * @return objet du champ, NULL si la mémoire manque.
+ */
+static cJSON* dbc_field(const dbc_sig_t *s){
+  char name[128];
+  snprintf(name, sizeof(name), "%.*s", (int)s->name.n, s->name.s);
+
+  bool is_enum = s->vals && !s->valtype && !s->sign && s->len <= 8 && s->factor == 1.0 && s->offset == 0.0;
+  const char *type = (s->valtype == 1) ? "float" : is_enum ? "enum" : s->sign ? "sint" : "uint";
+
+  cJSON *f = cJSON_CreateObject();
+  bool ok = f && cJSON_AddStringToObject(f, "name", name) && cJSON_AddStringToObject(f, "type", type);
+  if(ok && s->valtype != 1) ok = cJSON_AddNumberToObject(f, "bits", s->len) != NULL;
+  ok = ok && cJSON_AddNumberToObject(f, "start_bit", s->start) &&
+       cJSON_AddStringToObject(f, "byte_order", s->little ? "intel" : "motorola");
+  if(ok && s->factor != 1.0) ok = cJSON_AddNumberToObject(f, "scale", s->factor) != NULL;
+  if(ok && s->offset != 0.0) ok = cJSON_AddNumberToObject(f, "offset", s->offset) != NULL;
+  if(ok && is_enum){
+    cJSON *dict = dbc_dict(s->vals);
+    if(dict) cJSON_AddItemToObject(f, "dict", dict);
+    ok = dict != NULL;
+  }
+  if(!ok){ cJSON_Delete(f); return NULL; }
+  return f;
+}
+
+/**
+ * @brief Topic d’un message : attribut DBC_TOPIC_ATTR, sinon
+ *        "<émetteur>/<message>" en minuscules.
+ */
+static void dbc_topic(const dbc_msg_t *m, char *buf, size_t len){
+  if(m->topic){ snprintf(buf, len, "%s", m->topic); return; }
+
+  size_t from = 0;
+  if(!m->node.n || str_eq(m->node, "Vector__XXX", 11)){
+    snprintf(buf, len, "%s/%.*s", DBC_TOPIC_ROOT, (int)m->name.n, m->name.s);
+    from = strlen(DBC_TOPIC_ROOT);
+  } else {
+    snprintf(buf, len, "%.*s/%.*s", (int)m->node.n, m->node.s, (int)m->name.n, m->name.s);
+  }
+  for(char *c = buf + from; *c; c++)
+    if(*c >= 'A' && *c <= 'Z') *c = (char)(*c - 'A' + 'a');
+}
+
+/**
+ * @brief Décrit un message comme une entrée du dictionnaire.
+ *
+ * @param d DBC lu.
+ * @param m message.
+ * @param[out] out entrée, NULL si le message n’a aucun signal repris.
+ * @return false si la mémoire manque.
+ */
+static bool dbc_entry(const dbc_t *d, const dbc_msg_t *m, cJSON **out){
+  *out = NULL;
+  bool ext = (m->id & CAN_ID_EXT) != 0;
+  uint32_t id = m->id & ~CAN_ID_EXT;
+  if(str_eq(m->name, "VECTOR__INDEPENDENT_SIG_MSG", 27)) return true;
+  if(id > CAN_ID_EXT_MASK){
+    LOGW("DBC %.*s : ID 0x%X hors plage 29 bits, message ignoré", (int)m->name.n, m->name.s, m->id);
+    return true;
+  }
+
+  size_t skipped = 0;
+  cJSON *data = cJSON_CreateArray();
+  if(!data) return false;
+  for(size_t i = 0; i < m->count; i++){
+    const dbc_sig_t *s = &d->sig[m->first + i];
+    if(s->muxed || s->len > 32 || s->valtype == 2 || (s->valtype == 1 && s->len != 32)){ skipped++; continue; }
+    cJSON *f = dbc_field(s);
+    if(!f){ cJSON_Delete(data); return false; }
+    cJSON_AddItemToArray(data, f);
+  }
+  if(skipped)
+    LOGW("DBC %.*s : %zu signal(aux) ignoré(s) (multiplexé, plus de 32 bits ou double)", (int)m->name.n, m->name.s, skipped);
+  if(!data->child){ cJSON_Delete(data); return true; }
+
+  char topic[256];
+  dbc_topic(m, topic, sizeof(topic));
+  cJSON *e = cJSON_CreateObject();
+  bool ok = e && cJSON_AddStringToObject(e, "topic", topic) &&
+            cJSON_AddNumberToObject(e, "arbitration_id", id) &&
+            cJSON_AddStringToObject(e, "transport", "direct");
+  if(ok && ext)        ok = cJSON_AddBoolToObject(e, "extended", true) != NULL;
+  if(ok && m->dlc > 8) ok = cJSON_AddBoolToObject(e, "can_fd", true) != NULL;
+  if(!ok){ cJSON_Delete(e); cJSON_Delete(data); return false; }
+  cJSON_AddItemToObject(e, "data", data);
+  *out = e;
+  return true;
+}
+
+/**
+ * @brief Vérifie l’extension du fichier.
+ *
+ * @param path chemin du dictionnaire.
+ * @return true si path se termine par ".dbc" (casse indifférente).
+ */
+bool dbc_is(const char *path){
+  size_t n = path ? strlen(path) : 0;
+  return n > 4 && strcasecmp(path + n - 4, ".dbc") == 0;
+}
+
+/**
+ * @brief Lit un fichier DBC et le traduit en dictionnaire JSON.
+ *
+ * @param path chemin du fichier.
+ * @return document à construire par table_load (cJSON_Delete par
+ *         l’appelant), NULL si le fichier est illisible ou la mémoire manque.
+ */
+cJSON* dbc_to_json(const char *path){
+  char *txt = NULL;
+  {
+    FILE *f = fopen(path, "rb");
+    if(!f){ LOGE("Ouvrir %s", path); return NULL; }
+    fseek(f, 0, SEEK_END);
+    long L = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    txt = (L >= 0) ? (char*)malloc((size_t)L + 1) : NULL;
+    if(!txt){ fclose(f); return NULL; }
+    if(fread(txt, 1, (size_t)L, f) != (size_t)L){ fclose(f); free(txt); return NULL; }
+    fclose(f);
+    txt[L] = '\0';
+  }
+
+  dbc_t d;
+  memset(&d, 0, sizeof(d));
+  bool in_str = false;
+  size_t lineno = 0;
+  for(char *line = txt, *next; line && !d.oom; line = next){
+    char *eol = strchr(line, '\n');
+    next = eol ? eol + 1 : NULL;
+    if(eol){
+      *eol = '\0';
+      if(eol > line && eol[-1] == '\r') eol[-1] = '\0';
+    }
+    lineno++;
+
+    /* Suite d’une chaîne ouverte sur une ligne précédente */
+    bool cont = in_str;
+    if(odd_quotes(line)) in_str = !in_str;
+    if(cont) continue;
+
+    char *p = line;
+    if(take_keyword(&p, "BO_")){
+      if(!parse_bo(&d, p)) LOGW("%s:%zu : BO_ illisible", path, lineno);
+    } else if(take_keyword(&p, "SG_")){
+      if(!parse_sg(&d, p)) LOGW("%s:%zu : SG_ illisible", path, lineno);
+    } else if(take_keyword(&p, "VAL_") || take_keyword(&p, "SIG_VALTYPE_") || take_keyword(&p, "BA_")){
+      if(!grow((void**)&d.late, &d.clate, d.nlate, sizeof(char*))) d.oom = true;
+      else d.late[d.nlate++] = line;
+    }
+  }
+
+  cJSON *root = NULL;
+  if(!d.oom){
+    d.by_id = (dbc_msg_t**)malloc((d.nmsg ? d.nmsg : 1) * sizeof(dbc_msg_t*));
+    d.oom = !d.by_id;
+  }
+  if(!d.oom){
+    for(size_t i = 0; i < d.nmsg; i++) d.by_id[i] = &d.msg[i];
+    qsort(d.by_id, d.nmsg, sizeof(dbc_msg_t*), cmp_msg_id);
+    for(size_t i = 0; i < d.nlate; i++) parse_late(&d, d.late[i]);
+
+    /* Entrées dans l’ordre du fichier */
+    root = cJSON_CreateObject();
+    d.oom = !root;
+    for(size_t i = 0; !d.oom && i < d.nmsg; i++){
+      cJSON *e;
+      if(!dbc_entry(&d, &d.msg[i], &e)){ d.oom = true; break; }
+      if(!e) continue;
+      char key[128];
+      snprintf(key, sizeof(key), "%.*s", (int)d.msg[i].name.n, d.msg[i].name.s);
+      cJSON_AddItemToObject(root, key, e);
+    }
+  }
+
+  if(d.oom){
+    LOGE("Lecture du DBC %s impossible (mémoire)", path);
+    cJSON_Delete(root);
+    root = NULL;
+  } else {
+    LOGI("DBC %s : %zu messages, %zu signaux", path, d.nmsg, d.nsig);
+  }
+  free(d.by_id);
+  free(d.late);
+  free(d.sig);
+  free(d.msg);
+  free(txt);
+  return root;
+}
+
+// End of file
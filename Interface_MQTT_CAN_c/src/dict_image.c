@@ -0,0 +1,480 @@
+/**
+ * @file dict_image.c
+ * @brief Dictionnaire compilé : image binaire de la table, chargée par mmap.
+ *
+ * L’outil `dictc` charge conversion.json avec table_load() puis écrit la
+ * table complète (entrées, champs, enums, fragments JSON, index de hash)
+ * dans une image contiguë :
+ *
+ *   [en-tête][table_t][entry_t...][field_spec_t...][enum_kv_t...]
+ *   [index enum][index de hash][chaînes][relocations]
+ *
+ * Les pointeurs y sont stockés comme des décalages depuis le début de
+ * l’image (0 = NULL) ; la liste des emplacements de pointeurs suit.
+ * Au chargement, l’image est mappée (MAP_PRIVATE), les pointeurs sont
+ * relogés en place puis l’image passe en lecture seule : chaînes et index
+ * restent partagés avec le cache de pages, sans copie ni allocation.
+ *
+ * L’image dépend de l’ABI (taille des pointeurs, boutisme, disposition
+ * des structures) : elle doit être produite par un `dictc` compilé comme
+ * le pont. L’en-tête permet de refuser une image incompatible.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "types.h"
+#include "log.h"
+#include "table.h"
+#include "dict_image.h"
+
+/* Alignement des sections de l’image */
+#define IMG_ALIGN 8u
+
+/** @brief En-tête de l’image (début de fichier). */
+typedef struct dict_image_hdr_s {
+  char     magic[8];       /* DICT_IMAGE_MAGIC */
+  uint32_t version;        /* DICT_IMAGE_VERSION */
+  uint16_t endian;         /* 0x0102 dans l’ordre natif */
+  uint16_t ptr_size;
+  uint32_t sz_table, sz_entry, sz_field, sz_kv;
+  uint64_t image_size;     /* taille totale du fichier */
+  uint64_t table_off;      /* table_t */
+  uint64_t reloc_off;      /* tableau de uint64_t : emplacements de pointeurs */
+  uint64_t reloc_count;
+} dict_image_hdr_t;
+
+/** @brief Image en cours de construction (tampon extensible + relocations). */
+typedef struct img_s {
+  uint8_t  *buf;
+  size_t    len, cap;
+  uint64_t *reloc;
+  size_t    nreloc, creloc;
+  bool      ok;
+} img_t;
+
+
+/**
+ * @brief Réserve size octets alignés (mis à zéro) dans l’image.
+ *
+ * @return décalage de la zone, 0 si échec (img->ok passe à false).
+ */
+static size_t img_alloc(img_t *im, size_t size){
+  if(!im->ok) return 0;
+  size_t off = (im->len + IMG_ALIGN - 1) & ~(size_t)(IMG_ALIGN - 1);
+  if(off + size > im->cap){
+    size_t ncap = im->cap ? im->cap : 4096;
+    while(ncap < off + size) ncap *= 2;
+    uint8_t *tmp = (uint8_t*)realloc(im->buf, ncap);
+    if(!tmp){ im->ok = false; return 0; }
+    memset(tmp + im->cap, 0, ncap - im->cap);
+    im->buf = tmp;
+    im->cap = ncap;
+  }
+  im->len = off + size;
+  return off;
+}
+
+/**
+ * @brief Écrit dans l’emplacement at un pointeur vers target (décalage, 0 = NULL).
+ */
+static void img_ptr(img_t *im, size_t at, size_t target){
+  if(!im->ok) return;
+  uintptr_t v = (uintptr_t)target;
+  memcpy(im->buf + at, &v, sizeof(v));
+  if(!target) return;
+  if(im->nreloc == im->creloc){
+    size_t nc = im->creloc ? 2 * im->creloc : 256;
+    uint64_t *tmp = (uint64_t*)realloc(im->reloc, nc * sizeof(uint64_t));
+    if(!tmp){ im->ok = false; return; }
+    im->reloc = tmp;
+    im->creloc = nc;
+  }
+  im->reloc[im->nreloc++] = (uint64_t)at;
+}
+
+/**
+ * @brief Copie n octets dans l’image.
+ *
+ * @return décalage de la copie, 0 si src est NULL ou en cas d’échec.
+ */
+static size_t img_bytes(img_t *im, const void *src, size_t n){
+  if(!src) return 0;
+  size_t off = img_alloc(im, n);
+  if(im->ok) memcpy(im->buf + off, src, n);
+  return im->ok ? off : 0;
+}
+
+/**
+ * @brief Copie une chaîne (avec '\0') dans l’image.
+ */
+static size_t img_str(img_t *im, const char *s){
+  return s ? img_bytes(im, s, strlen(s) + 1) : 0;
+}
+
+/**
+ * @brief Copie un tableau d’index (uint32_t) dans l’image.
+ */
+static size_t img_slots(img_t *im, const uint32_t *slots, size_t n){
+  return slots ? img_bytes(im, slots, n * sizeof(uint32_t)) : 0;
+}
+
+/**
+ * @brief Sérialise les champs d’une entrée.
+ *
+ * @return décalage du tableau de field_spec_t.
+ */
+static size_t img_fields(img_t *im, const entry_t *e){
+  if(!e->fields || !e->field_count) return 0;
+  size_t at = img_alloc(im, e->field_count * sizeof(field_spec_t));
+
+  for(size_t k = 0; k < e->field_count && im->ok; k++){
+    const field_spec_t *fs = &e->fields[k];
+    size_t fo = at + k * sizeof(field_spec_t);
+    field_spec_t tmp = *fs;
+    tmp.name = NULL; tmp.enum_list = NULL; tmp.enum_by_code = NULL; tmp.json_key = NULL;
+    memcpy(im->buf + fo, &tmp, sizeof(tmp));
+
+    img_ptr(im, fo + offsetof(field_spec_t, name), img_str(im, fs->name));
+    img_ptr(im, fo + offsetof(field_spec_t, json_key), img_str(im, fs->json_key));
+
+    /* Liste d’enums : nœuds contigus, chaînés dans le même ordre */
+    size_t nkv = 0;
+    for(const enum_kv_t *kv = fs->enum_list; kv; kv = kv->next) nkv++;
+    if(!nkv) continue;
+    size_t kvo = img_alloc(im, nkv * sizeof(enum_kv_t));
+    size_t i = 0;
+    for(const enum_kv_t *kv = fs->enum_list; kv && im->ok; kv = kv->next, i++){
+      size_t o = kvo + i * sizeof(enum_kv_t);
+      enum_kv_t t = *kv;
+      t.key = NULL; t.next = NULL; t.json = NULL;
+      memcpy(im->buf + o, &t, sizeof(t));
+      img_ptr(im, o + offsetof(enum_kv_t, key), img_str(im, kv->key));
+      img_ptr(im, o + offsetof(enum_kv_t, json), img_str(im, kv->json));
+      img_ptr(im, o + offsetof(enum_kv_t, next), kv->next ? o + sizeof(enum_kv_t) : 0);
+    }
+    img_ptr(im, fo + offsetof(field_spec_t, enum_list), kvo);
+
+    if(fs->enum_by_code){
+      size_t bo = img_alloc(im, 256 * sizeof(const enum_kv_t*));
+      for(size_t c = 0; c < 256 && im->ok; c++){
+        if(!fs->enum_by_code[c]) continue;
+        size_t j = 0;
+        const enum_kv_t *kv = fs->enum_list;
+        while(kv && kv != fs->enum_by_code[c]){ kv = kv->next; j++; }
+        if(kv) img_ptr(im, bo + c * sizeof(const enum_kv_t*), kvo + j * sizeof(enum_kv_t));
+      }
+      img_ptr(im, fo + offsetof(field_spec_t, enum_by_code), bo);
+    }
+  }
+  return at;
+}
+
+/**
+ * @brief Écrit l’image binaire d’une table chargée.
+ *
+ * @param t : table construite par table_load() (depuis le JSON).
+ * @param path : fichier de sortie.
+ * @return true si succès.
+ */
+bool dict_image_write(const table_t *t, const char *path){
+  if(!t || !path || t->image) return false;
+
+  img_t im;
+  memset(&im, 0, sizeof(im));
+  im.ok = true;
+
+  size_t ho = img_alloc(&im, sizeof(dict_image_hdr_t));
+  size_t to = img_alloc(&im, sizeof(table_t));
+  size_t eo = img_alloc(&im, t->entry_count * sizeof(entry_t));
+
+  for(size_t i = 0; i < t->entry_count && im.ok; i++){
+    const entry_t *e = &t->entries[i];
+    size_t o = eo + i * sizeof(entry_t);
+    entry_t tmp = *e;
+    tmp.topic = NULL; tmp.fields = NULL;
+    memcpy(im.buf + o, &tmp, sizeof(tmp));
+    img_ptr(&im, o + offsetof(entry_t, topic), img_str(&im, e->topic));
+    img_ptr(&im, o + offsetof(entry_t, fields), img_fields(&im, e));
+  }
+
+  /* Index de recherche, recopiés tels quels */
+  table_t tt = *t;
+  tt.entries = NULL; tt.topic_slots = NULL; tt.canid_direct = NULL; tt.canid_slots = NULL;
+  tt.route_slots = NULL; tt.transport_map = NULL; tt.image = NULL; tt.image_size = 0;
+  tt.entry_hash = NULL; tt.entry_canid = NULL; tt.entry_route = NULL; tt.arena = NULL; tt.arena_size = 0;
+  if(im.ok) memcpy(im.buf + to, &tt, sizeof(tt));
+  img_ptr(&im, to + offsetof(table_t, entries), t->entry_count ? eo : 0);
+  img_ptr(&im, to + offsetof(table_t, entry_hash), img_slots(&im, t->entry_hash, t->entry_count));
+  img_ptr(&im, to + offsetof(table_t, entry_canid), img_slots(&im, t->entry_canid, t->entry_count));
+  img_ptr(&im, to + offsetof(table_t, entry_route), img_slots(&im, t->entry_route, t->entry_count));
+  img_ptr(&im, to + offsetof(table_t, topic_slots), img_slots(&im, t->topic_slots, t->topic_mask + 1));
+  img_ptr(&im, to + offsetof(table_t, canid_slots), img_slots(&im, t->canid_slots, t->canid_mask + 1));
+  img_ptr(&im, to + offsetof(table_t, route_slots), img_slots(&im, t->route_slots, t->route_mask + 1));
+  img_ptr(&im, to + offsetof(table_t, canid_direct), img_slots(&im, t->canid_direct, TABLE_CANID_DIRECT));
+  img_ptr(&im, to + offsetof(table_t, transport_map),
+          t->transport_map ? img_bytes(&im, t->transport_map, TABLE_CANID_DIRECT) : 0);
+
+  /* Relocations en fin d’image */
+  size_t nreloc = im.nreloc;
+  size_t ro = img_alloc(&im, nreloc * sizeof(uint64_t));
+  if(im.ok){
+    memcpy(im.buf + ro, im.reloc, nreloc * sizeof(uint64_t));
+
+    dict_image_hdr_t h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, DICT_IMAGE_MAGIC, sizeof(h.magic));
+    h.version = DICT_IMAGE_VERSION;
+    h.endian = 0x0102;
+    h.ptr_size = (uint16_t)sizeof(void*);
+    h.sz_table = (uint32_t)sizeof(table_t);
+    h.sz_entry = (uint32_t)sizeof(entry_t);
+    h.sz_field = (uint32_t)sizeof(field_spec_t);
+    h.sz_kv = (uint32_t)sizeof(enum_kv_t);
+    h.image_size = im.len;
+    h.table_off = to;
+    h.reloc_off = ro;
+    h.reloc_count = nreloc;
+    memcpy(im.buf + ho, &h, sizeof(h));
+  }
+
+  bool ok = im.ok;
+  if(!ok) LOGE("Construction de l’image impossible (mémoire) %c", 0);
+  else {
+    FILE *f = fopen(path, "wb");
+    if(!f){ LOGE("Ouvrir %s: %s", path, strerror(errno)); ok = false; }
+    else {
+      ok = (fwrite(im.buf, 1, im.len, f) == im.len);
+      ok = (fclose(f) == 0) && ok;
+      if(!ok) LOGE("Écriture de %s impossible", path);
+    }
+  }
+  if(ok) LOGI("Image %s: %zu entrées, %zu octets, %zu relocations", path, t->entry_count, im.len, nreloc);
+  free(im.buf);
+  free(im.reloc);
+  return ok;
+}
+
+/**
+ * @brief Indique si un fichier commence par la signature d’image.
+ */
+bool dict_image_is(const char *path){
+  char magic[8];
+  FILE *f = path ? fopen(path, "rb") : NULL;
+  if(!f) return false;
+  bool ok = (fread(magic, 1, sizeof(magic), f) == sizeof(magic)) && memcmp(magic, DICT_IMAGE_MAGIC, sizeof(magic)) == 0;
+  fclose(f);
+  return ok;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                       Contrôle d’une image relogée                         */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Vérifie qu’un tableau relogé de n éléments tient dans la partie
+ *        données de l’image ([0, end) : avant les relocations).
+ *
+ * Un pointeur laissé sans relocation (décalage brut) tombe hors de
+ * l’image et échoue aussi.
+ */
+static bool img_in(const uint8_t *base, uint64_t end, const void *p, size_t n, size_t size){
+  if(!p) return n == 0;
+  uintptr_t off = (uintptr_t)p - (uintptr_t)base;
+  if(off >= end || off % IMG_ALIGN != 0) return false;
+  return n <= (end - off) / size;
+}
+
+/**
+ * @brief Vérifie qu’une chaîne relogée est terminée dans la partie données.
+ */
+static bool img_str_in(const uint8_t *base, uint64_t end, const char *s){
+  uintptr_t off = (uintptr_t)s - (uintptr_t)base;
+  return s && off < end && memchr(s, '\0', (size_t)(end - off)) != NULL;
+}
+
+/**
+ * @brief Vérifie qu’un booléen de l’image vaut 0 ou 1 (lu comme octet).
+ */
+static bool img_bool_ok(const bool *b){
+  return *(const unsigned char*)b <= 1;
+}
+
+/**
+ * @brief Vérifie un index à adressage ouvert : mask + 1 emplacements
+ *        (puissance de 2) dans l’image, valeurs d’entrée <= n, et au moins
+ *        un emplacement vide (fin des sondages).
+ */
+static bool img_slots_ok(const uint8_t *base, uint64_t end, const uint32_t *slots, size_t mask, size_t n){
+  size_t cap = mask + 1;
+  if(cap == 0 || (cap & mask) != 0 || !img_in(base, end, slots, cap, sizeof(uint32_t))) return false;
+  bool empty = false;
+  for(size_t k = 0; k < cap; k++){
+    if(slots[k] > n) return false;
+    empty |= (slots[k] == 0);
+  }
+  return empty;
+}
+
+/**
+ * @brief Vérifie les champs d’une entrée : tableau, chaînes, disposition
+ *        des champs packés dans la charge utile, listes et index d’enums.
+ */
+static bool img_fields_ok(const uint8_t *base, uint64_t end, const entry_t *e){
+  if(e->field_count > ENTRY_FIELDS_MAX || !img_in(base, end, e->fields, e->field_count, sizeof(field_spec_t))) return false;
+  for(size_t k = 0; k < e->field_count; k++){
+    const field_spec_t *fs = &e->fields[k];
+    if(fs->type > FT_FLOAT || fs->bits < 1 || fs->bits > 32) return false;
+    if(!img_bool_ok(&fs->little) || !img_bool_ok(&fs->scaled)) return false;
+    if(fs->mask != ((fs->bits >= 32) ? 0xFFFFFFFFu : (1u << fs->bits) - 1u)) return false;
+    if(!img_str_in(base, end, fs->name) || !img_str_in(base, end, fs->json_key) ||
+       strlen(fs->json_key) != fs->json_key_len) return false;
+    /* hors trame : offset borné à payload_max (tampon de pack.c) */
+    if(fs->width < 1 || fs->width > 5 || fs->shift + fs->bits > 8u * fs->width ||
+       fs->offset + (k < e->packed_count ? fs->width : 0u) > e->payload_max) return false;
+
+    /* Nœuds contigus dans l’ordre de la liste : next toujours plus loin */
+    for(const enum_kv_t *kv = fs->enum_list; kv; kv = kv->next){
+      if(!img_in(base, end, kv, 1, sizeof(*kv)) || (kv->next && kv->next <= kv)) return false;
+      if(!img_str_in(base, end, kv->key) || !img_str_in(base, end, kv->json) ||
+         strlen(kv->json) != kv->json_len) return false;
+    }
+    if(fs->type != FT_ENUM) continue;
+    if(fs->bits > 8 || !img_in(base, end, fs->enum_by_code, 256, sizeof(const enum_kv_t*))) return false;
+    for(size_t c = 0; c < 256; c++)
+      if(fs->enum_by_code[c] && !img_in(base, end, fs->enum_by_code[c], 1, sizeof(enum_kv_t))) return false;
+  }
+  return true;
+}
+
+/**
+ * @brief Vérifie une table relogée avant publication.
+ *
+ * @return NULL si la table est utilisable, sinon la partie en défaut.
+ */
+static const char* img_table_check(const uint8_t *base, uint64_t end, const table_t *t){
+  size_t n = t->entry_count;
+  if(n == 0 || n >= UINT32_MAX || !img_in(base, end, t->entries, n, sizeof(entry_t))) return "entrées";
+  if(!img_in(base, end, t->entry_hash, n, sizeof(uint32_t)) || !img_in(base, end, t->entry_canid, n, sizeof(uint32_t)) ||
+     !img_in(base, end, t->entry_route, n, sizeof(uint32_t))) return "tableaux d’entrées";
+  if(!img_slots_ok(base, end, t->topic_slots, t->topic_mask, n)) return "index des topics";
+  if(!img_slots_ok(base, end, t->canid_slots, t->canid_mask, n)) return "index des CAN ID";
+  if(!img_slots_ok(base, end, t->route_slots, t->route_mask, n)) return "index tunnel";
+  if(!img_in(base, end, t->canid_direct, TABLE_CANID_DIRECT, sizeof(uint32_t)) ||
+     !img_in(base, end, t->transport_map, TABLE_CANID_DIRECT, 1)) return "accès direct";
+  for(size_t i = 0; i < TABLE_CANID_DIRECT; i++)
+    if(t->canid_direct[i] > n) return "accès direct";
+
+  for(size_t i = 0; i < n; i++){
+    const entry_t *e = &t->entries[i];
+    unsigned hdr = (e->route == ROUTE_TUNNEL) ? 2u : 0u;
+    if(e->route > ROUTE_DIRECT || !img_str_in(base, end, e->topic)) return "entrée";
+    if(!img_bool_ok(&e->fd) || !img_bool_ok(&e->seg) || !img_bool_ok(&e->pub.on_change)) return "entrée";
+    if(e->packed_count > e->field_count || e->packed_count > ENTRY_PAYLOAD_MAX || e->packed_size > e->payload_max ||
+       e->frame_len > CAN_PAYLOAD_MAX || (!e->seg && hdr + e->payload_max > CAN_PAYLOAD_MAX)) return "entrée";
+    if(!img_fields_ok(base, end, e)) return "champs";
+    if(e->json_max != table_json_max(e)) return "json_max";
+  }
+  return NULL;
+}
+
+/**
+ * @brief Mappe une image et initialise t pour pointer dedans (sans copie).
+ *
+ * Vérifiés avant publication de la table :
+ * - l’en-tête (signature, version, ABI, tailles et décalages) ;
+ * - chaque relocation : emplacement aligné et cible dans l’image ;
+ * - la table relogée : nombre d’entrées, tableaux (nombre × taille
+ *   d’élément tenant avant les relocations), masques des index et
+ *   contenu des emplacements, chaînes terminées, disposition des champs
+ *   packés dans la charge utile, listes et index d’enums, json_max.
+ * Les valeurs de conversion (échelle, enums, politiques) ne sont pas
+ * recontrôlées : l’image est celle écrite par dictc.
+ *
+ * @param t : table à initialiser (libérée par table_free()).
+ * @param path : image produite par dictc.
+ * @return true si succès.
+ */
+bool dict_image_map(table_t *t, const char *path){
+  if(!t || !path) return false;
+  memset(t, 0, sizeof(*t));
+
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd < 0){ LOGE("Ouvrir %s", path); return false; }
+  struct stat st;
+  if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(dict_image_hdr_t)){ close(fd); return false; }
+  size_t size = (size_t)st.st_size;
+  uint8_t *base = (uint8_t*)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(base == MAP_FAILED){ LOGE("mmap %s: %s", path, strerror(errno)); return false; }
+
+  dict_image_hdr_t h;
+  memcpy(&h, base, sizeof(h));
+  if(memcmp(h.magic, DICT_IMAGE_MAGIC, sizeof(h.magic)) != 0 || h.version != DICT_IMAGE_VERSION ||
+     h.endian != 0x0102 || h.ptr_size != sizeof(void*) || h.sz_table != sizeof(table_t) ||
+     h.sz_entry != sizeof(entry_t) || h.sz_field != sizeof(field_spec_t) || h.sz_kv != sizeof(enum_kv_t)){
+    LOGE("Image %s incompatible (version ou ABI), régénérer avec dictc", path);
+    munmap(base, size);
+    return false;
+  }
+  if(h.image_size != size || h.table_off % IMG_ALIGN != 0 || h.table_off + sizeof(table_t) > size ||
+     h.reloc_off > size || h.reloc_count > (size - h.reloc_off) / sizeof(uint64_t)){
+    LOGE("Image %s corrompue", path);
+    munmap(base, size);
+    return false;
+  }
+
+  /* Relocation des pointeurs */
+  for(uint64_t i = 0; i < h.reloc_count; i++){
+    uint64_t at;
+    memcpy(&at, base + h.reloc_off + i * sizeof(uint64_t), sizeof(at));
+    uintptr_t v;
+    if(at % sizeof(void*) != 0 || at + sizeof(v) > h.reloc_off) goto corrupt;
+    memcpy(&v, base + at, sizeof(v));
+    if(v == 0 || v >= h.reloc_off) goto corrupt;
+    v += (uintptr_t)base;
+    memcpy(base + at, &v, sizeof(v));
+  }
+  mprotect(base, size, PROT_READ);
+
+  memcpy(t, base + h.table_off, sizeof(*t));
+  const char *bad = img_table_check(base, h.reloc_off, t);
+  if(bad){
+    LOGE("Image %s corrompue (%s)", path, bad);
+    munmap(base, size);
+    memset(t, 0, sizeof(*t));
+    return false;
+  }
+  t->image = base;
+  t->image_size = size;
+  LOGI("Table chargée (image %s): %zu entrées, %zu transport(s) tunnel", path, t->entry_count, t->transport_count);
+  return t->entry_count > 0;
+
+corrupt:
+  LOGE("Image %s corrompue (relocation)", path);
+  munmap(base, size);
+  memset(t, 0, sizeof(*t));
+  return false;
+}
+
+/**
+ * @brief Libère une table chargée depuis une image.
+ */
+void dict_image_unmap(table_t *t){
+  if(t && t->image){
+    munmap(t->image, t->image_size);
+    memset(t, 0, sizeof(*t));
+  }
+}
+
+// End of file
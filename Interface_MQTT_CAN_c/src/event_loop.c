@@ -0,0 +1,334 @@
+/**
+ * @file event_loop.c
+ * @brief Boucle d’événements mono-thread basée sur epoll.
+ *
+ * Alternative à `my_loop()` (qui interroge MQTT et CAN en continu) :
+ * le processus dort dans `epoll_wait()` jusqu’à ce qu’un des descripteurs
+ * suivants soit prêt :
+ * - la socket SocketCAN (trames reçues, et écriture si la file d’émission
+ *   est bloquée par EAGAIN) ;
+ * - la socket du client mosquitto (lecture, et écriture si des paquets
+ *   sont en attente : `mosquitto_want_write()`) ;
+ * - un timerfd périodique (keepalive via `mosquitto_loop_misc()`,
+ *   reconnexion, statistiques, publication des métriques) ;
+ * - un signalfd qui remplace les gestionnaires `on_sig` (SIGINT, SIGTERM)
+ *   et `on_hup` (SIGHUP : rechargement de la table) ;
+ * - le descripteur inotify du rechargement à chaud (conversion.json modifié).
+ *
+ * Les trames MQTT -> CAN mises en file pendant une itération sont envoyées
+ * en un seul `sendmmsg()` en fin d’itération. Si le contrôleur CAN est
+ * saturé (ENOBUFS, non signalé par epoll), l’attente est bornée à
+ * CAN_TX_RETRY_MS pour retenter l’envoi ; elle l’est aussi par l’échéance
+ * de la prochaine commande retenue par la limitation MQTT -> CAN.
+ *
+ * Au repos, le processus ne se réveille donc qu’au rythme du timer.
+ * La latence "réveil → fin de traitement" est mesurée par source
+ * et affichée périodiquement.
+ */
+
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <mosquitto.h>
+
+#include "types.h"
+#include "table.h"
+#include "mqtt_io.h"
+#include "spsc.h"
+#include "can_io.h"
+#include "log.h"
+#include "metrics.h"
+#include "reload.h"
+#include "event_loop.h"
+
+
+/** @brief Sources d’événements (champ data.u32 d’epoll). */
+enum
+{
+  EV_CAN = 1,
+  EV_MQTT,
+  EV_TIMER,
+  EV_SIGNAL,
+  EV_RELOAD
+};
+
+/** @brief Statistiques de latence réveil → fin de traitement. */
+typedef struct lat_stat_s
+{
+  uint64_t count;
+  uint64_t sum_ns;
+  uint64_t max_ns;
+} lat_stat_t;
+
+
+/**
+ * @brief Ajoute une mesure de latence.
+ */
+static void
+lat_add (lat_stat_t *s, uint64_t ns)
+{
+  s->count++;
+  s->sum_ns += ns;
+  if (ns > s->max_ns)
+    s->max_ns = ns;
+}
+
+/**
+ * @brief Affiche puis remet à zéro des statistiques de latence.
+ */
+static void
+lat_report (const char *name, lat_stat_t *s)
+{
+  if (!s->count)
+    return;
+  LOGI ("epoll %s: %llu évts, latence réveil->traitement moy=%.1f us max=%.1f us", name,
+        (unsigned long long) s->count, (double) s->sum_ns / (double) s->count / 1000.0, (double) s->max_ns / 1000.0);
+  memset (s, 0, sizeof (*s));
+}
+
+/**
+ * @brief Ajoute ou modifie un descripteur dans l’epoll.
+ */
+static bool
+ep_set (int ep, int op, int fd, uint32_t events, uint32_t tag)
+{
+  struct epoll_event ev;
+  memset (&ev, 0, sizeof (ev));
+  ev.events = events;
+  ev.data.u32 = tag;
+  if (epoll_ctl (ep, op, fd, &ev) < 0)
+    {
+      LOGE ("epoll_ctl(fd=%d): %s", fd, strerror (errno));
+      return false;
+    }
+  return true;
+}
+
+/**
+ * @brief Synchronise la socket MQTT surveillée avec l’état du client.
+ *
+ * La socket change après une reconnexion, et l’intérêt en écriture
+ * dépend de `mosquitto_want_write()`.
+ *
+ * @param ep descripteur epoll.
+ * @param m contexte MQTT.
+ * @param[in,out] mfd socket actuellement enregistrée (-1 si aucune).
+ * @param[in,out] mev événements actuellement demandés.
+ */
+static void
+mqtt_watch (int ep, mqtt_ctx_t *m, int *mfd, uint32_t *mev)
+{
+  int fd = mosquitto_socket (m->mosq);
+  uint32_t want = EPOLLIN | (mosquitto_want_write (m->mosq) ? EPOLLOUT : 0);
+
+  if (fd != *mfd)
+    {
+      if (*mfd >= 0)
+        (void) epoll_ctl (ep, EPOLL_CTL_DEL, *mfd, NULL);
+      *mfd = -1;
+      if (fd >= 0 && ep_set (ep, EPOLL_CTL_ADD, fd, want, EV_MQTT))
+        {
+          *mfd = fd;
+          *mev = want;
+        }
+      return;
+    }
+  if (fd >= 0 && want != *mev && ep_set (ep, EPOLL_CTL_MOD, fd, want, EV_MQTT))
+    *mev = want;
+}
+
+/**
+ * @brief Fait tourner le pont dans une boucle epoll jusqu’à SIGINT/SIGTERM.
+ *
+ * @param tables : table de conversion courante.
+ * @param c : contexte CAN initialisé.
+ * @param m : contexte MQTT initialisé (connecté ou non).
+ * @param rl : rechargement à chaud (NULL si désactivé).
+ * @return true si l’arrêt est propre, false si l’initialisation a échoué.
+ */
+bool
+event_loop_run (table_rcu_t *tables, can_ctx_t *c, mqtt_ctx_t *m, reload_t *rl)
+{
+  if (!c || c->fd < 0 || !m || !m->mosq)
+    return false;
+
+  bool ok = false;
+  int ep = -1, tfd = -1, sfd = -1;
+
+  /* Les signaux d’arrêt passent par le signalfd */
+  sigset_t set;
+  sigemptyset (&set);
+  sigaddset (&set, SIGINT);
+  sigaddset (&set, SIGTERM);
+  sigaddset (&set, SIGHUP);
+  if (sigprocmask (SIG_BLOCK, &set, NULL) < 0 || (sfd = signalfd (-1, &set, SFD_CLOEXEC)) < 0)
+    {
+      LOGE ("signalfd: %s", strerror (errno));
+      goto out;
+    }
+
+  tfd = timerfd_create (CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+  if (tfd < 0)
+    {
+      LOGE ("timerfd_create: %s", strerror (errno));
+      goto out;
+    }
+  struct itimerspec its;
+  memset (&its, 0, sizeof (its));
+  its.it_interval.tv_sec = EVENT_LOOP_TICK_MS / 1000;
+  its.it_interval.tv_nsec = (long) (EVENT_LOOP_TICK_MS % 1000) * 1000000L;
+  its.it_value = its.it_interval;
+  timerfd_settime (tfd, 0, &its, NULL);
+
+  ep = epoll_create1 (EPOLL_CLOEXEC);
+  if (ep < 0)
+    {
+      LOGE ("epoll_create1: %s", strerror (errno));
+      goto out;
+    }
+  if (!ep_set (ep, EPOLL_CTL_ADD, c->fd, EPOLLIN, EV_CAN)
+      || !ep_set (ep, EPOLL_CTL_ADD, tfd, EPOLLIN, EV_TIMER) || !ep_set (ep, EPOLL_CTL_ADD, sfd, EPOLLIN, EV_SIGNAL))
+    goto out;
+  if (reload_fd (rl) >= 0 && !ep_set (ep, EPOLL_CTL_ADD, reload_fd (rl), EPOLLIN, EV_RELOAD))
+    goto out;
+
+  int mfd = -1;
+  uint32_t mev = 0, cev = EPOLLIN;
+  int due_ms = -1;              /* prochaine commande retenue (can_tx_release) */
+  lat_stat_t lat_can, lat_mqtt;
+  memset (&lat_can, 0, sizeof (lat_can));
+  memset (&lat_mqtt, 0, sizeof (lat_mqtt));
+  uint64_t last_report = metrics_now_ns ();
+  bool running = true;
+
+  LOGI ("Boucle epoll démarrée %c", 0);
+  while (running)
+    {
+      mqtt_watch (ep, m, &mfd, &mev);
+
+      /* File d’émission CAN bloquée : EPOLLOUT (EAGAIN) ou nouvel essai différé (ENOBUFS) */
+      bool tx_wait = can_tx_pending (c);
+      uint32_t cwant = EPOLLIN | ((tx_wait && c->tx_err != ENOBUFS) ? EPOLLOUT : 0);
+      if (cwant != cev && ep_set (ep, EPOLL_CTL_MOD, c->fd, cwant, EV_CAN))
+        cev = cwant;
+
+      int timeout = (tx_wait && c->tx_err == ENOBUFS) ? CAN_TX_RETRY_MS : -1;
+      if (due_ms >= 0 && (timeout < 0 || due_ms < timeout))
+        timeout = due_ms;
+
+      struct epoll_event evs[8];
+      int n = epoll_wait (ep, evs, 8, timeout);
+      if (n < 0)
+        {
+          if (errno == EINTR)
+            continue;
+          LOGE ("epoll_wait: %s", strerror (errno));
+          break;
+        }
+      uint64_t woke = metrics_now_ns ();
+
+      for (int i = 0; i < n; i++)
+        {
+          switch (evs[i].data.u32)
+            {
+            case EV_CAN:
+              if (evs[i].events & EPOLLIN)
+                {
+                  const table_t *t = table_rcu_enter (tables, TABLE_READER_CAN);
+                  can_poll_ready (c, t, m, 64);
+                  table_rcu_leave (tables, TABLE_READER_CAN);
+                }
+              if (evs[i].events & EPOLLOUT)
+                (void) can_flush (c);
+              lat_add (&lat_can, metrics_now_ns () - woke);
+              break;
+
+            case EV_MQTT:
+              if (evs[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+                (void) mosquitto_loop_read (m->mosq, 1);
+              if (evs[i].events & EPOLLOUT)
+                (void) mosquitto_loop_write (m->mosq, 1);
+              lat_add (&lat_mqtt, metrics_now_ns () - woke);
+              break;
+
+            case EV_TIMER:
+              {
+                uint64_t ticks;
+                if (read (tfd, &ticks, sizeof (ticks)) != (ssize_t) sizeof (ticks))
+                  break;
+                if (mosquitto_loop_misc (m->mosq) == MOSQ_ERR_NO_CONN)
+                  (void) mosquitto_reconnect (m->mosq);
+                if (woke - last_report >= (uint64_t) EVENT_LOOP_STATS_S * 1000000000ull)
+                  {
+                    lat_report ("CAN", &lat_can);
+                    lat_report ("MQTT", &lat_mqtt);
+                    can_tx_report (c);
+                    mqtt_pub_report (m);
+                    last_report = woke;
+                  }
+                (void) mqtt_metrics_tick (m);
+              }
+              break;
+
+            case EV_SIGNAL:
+              {
+                struct signalfd_siginfo si;
+                if (read (sfd, &si, sizeof (si)) != (ssize_t) sizeof (si))
+                  break;
+                if (si.ssi_signo == SIGHUP)
+                  {
+                    if (rl)
+                      {
+                        reload_request (rl);
+                        (void) reload_poll (rl);
+                      }
+                    break;
+                  }
+                LOGI ("Signal %u reçu, arrêt", si.ssi_signo);
+                running = false;
+              }
+              break;
+
+            case EV_RELOAD:
+              (void) reload_poll (rl);
+              break;
+            }
+        }
+
+      /* Trames MQTT -> CAN mises en file pendant l’itération, et commandes
+         retenues arrivées à échéance : un seul sendmmsg */
+      due_ms = can_tx_release (c);
+      if (can_tx_pending (c))
+        (void) can_flush (c);
+
+      /* Les publications CAN -> MQTT ont pu remplir le tampon d’émission */
+      if (mosquitto_want_write (m->mosq))
+        (void) mosquitto_loop_write (m->mosq, 1);
+    }
+
+  lat_report ("CAN", &lat_can);
+  lat_report ("MQTT", &lat_mqtt);
+  ok = true;
+
+out:
+  if (ep >= 0)
+    close (ep);
+  if (tfd >= 0)
+    close (tfd);
+  if (sfd >= 0)
+    close (sfd);
+  sigprocmask (SIG_UNBLOCK, &set, NULL);
+  return ok;
+}
+
+// End of file
@@ -0,0 +1,528 @@
+/**
+ * @file isotp.c
+ * @brief Messages segmentés sur plusieurs trames CAN (façon ISO-TP).
+ *
+ * Les sessions d’émission appartiennent au propriétaire de la file
+ * d’émission (boucle principale ou thread CAN TX), celles de réception
+ * au lecteur CAN. Les deux ne partagent que le FC reçu pour une
+ * émission : le lecteur le dépose dans la session (atomique) et réveille
+ * le thread d’émission (c->tx_wake), qui l’applique au prochain
+ * can_tx_release().
+ *
+ * Le FC de réception part directement sur la socket (can_write()) : le
+ * lecteur n’a pas accès à la file d’émission.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "types.h"
+#include "log.h"
+#include "mqtt_io.h"
+#include "spsc.h"
+#include "can_io.h"
+#include "metrics.h"
+#include "isotp.h"
+
+#define ISOTP_TIMEOUT_NS ((uint64_t)ISOTP_TIMEOUT_MS * 1000000ull)
+
+/* PCI (quartet haut du premier octet) */
+enum { PCI_SF = 0x0, PCI_FF = 0x1, PCI_CF = 0x2, PCI_FC = 0x3 };
+
+/* État d’une session d’émission */
+enum { TX_IDLE = 0, TX_WAIT_FC, TX_SEND };
+
+/** @brief Session d’émission. */
+typedef struct isotp_tx_s {
+  alignas(64) _Atomic uint64_t id;   /* (can_id << 32 | clé) + 1, 0 = libre ; lu par le lecteur CAN */
+  _Atomic uint32_t fc;               /* dernier FC : numéro << 24 | FS << 16 | BS << 8 | STmin
+                                        (écrit par le lecteur CAN) */
+  uint32_t fc_seen;                  /* numéro du dernier FC appliqué */
+  uint32_t can_id, key;
+  uint8_t  state, flags;
+  uint8_t  sn;                       /* numéro du prochain CF */
+  uint8_t  bs;                       /* CF restant avant le prochain FC, 0 = sans limite */
+  uint64_t st_ns;                    /* écart minimal entre CF (STmin) */
+  uint64_t due_ns;                   /* prochain CF, ou abandon si aucun FC */
+  size_t   len, pos;
+  uint64_t t0, next_t0;              /* réception MQTT (cf. can_queue), relevée au SF/FF */
+  bool     has_next;
+  size_t   next_len;
+  uint8_t  data[ENTRY_PAYLOAD_MAX];
+  uint8_t  next[ENTRY_PAYLOAD_MAX];  /* message suivant (le plus récent) */
+} isotp_tx_t;
+
+/** @brief Session de réception. */
+typedef struct isotp_rx_s {
+  uint64_t id;                       /* (can_id << 32 | inner ID) + 1, 0 = libre */
+  uint64_t due_ns;                   /* abandon si aucun CF avant */
+  size_t   len, pos;
+  uint8_t  sn;                       /* numéro du CF attendu */
+  uint8_t  data[ENTRY_PAYLOAD_MAX];
+} isotp_rx_t;
+
+struct isotp_s {
+  isotp_tx_t tx[ISOTP_SESSIONS];
+  size_t     tx_active;              /* sessions d’émission en cours */
+  alignas(64) isotp_rx_t rx[ISOTP_SESSIONS];
+};
+
+struct isotp_s *isotp_create(void){
+  struct isotp_s *s = aligned_alloc(alignof(struct isotp_s), sizeof(struct isotp_s));
+  if(s) memset(s, 0, sizeof(*s));
+  return s;
+}
+
+void isotp_destroy(struct isotp_s *s){
+  if(s && s->tx_active) LOGW("%zu émissions segmentées abandonnées à l’arrêt", s->tx_active);
+  free(s);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Trames                                     */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Octets par trame après l’en-tête tunnel (PCI compris).
+ */
+static size_t frame_cap(uint8_t flags){
+  return ((flags & ISOTP_FD) ? CAN_PAYLOAD_MAX : 8u) - ((flags & ISOTP_TUNNEL) ? 2u : 0u);
+}
+
+/**
+ * @brief Construit une trame : en-tête tunnel, PCI, données, remplissage.
+ *
+ * @param[out] f trame (CAN_PAYLOAD_MAX octets).
+ * @return longueur de la trame : 8 au moins, puis longueur CAN FD valide.
+ */
+static uint8_t build_frame(uint8_t *f, uint8_t flags, uint32_t key, const uint8_t *pci, size_t npci,
+                           const uint8_t *d, size_t n){
+  size_t h = 0;
+  if(flags & ISOTP_TUNNEL){
+    f[h++] = (uint8_t)(key >> 8);
+    f[h++] = (uint8_t)key;
+  }
+  memcpy(f + h, pci, npci);
+  h += npci;
+  if(n) memcpy(f + h, d, n);
+  h += n;
+  uint8_t len = can_fd_len(h < 8 ? 8u : (unsigned)h);
+  memset(f + h, 0, len - h);
+  return len;
+}
+
+/**
+ * @brief PCI d’un message tenant dans une trame (SF).
+ *
+ * @return octets de PCI, 0 si le message ne tient pas dans une trame.
+ */
+static size_t sf_pci(uint8_t flags, size_t len, uint8_t *pci){
+  size_t cap = frame_cap(flags);
+  if(len <= 7 && len + 1 <= cap){
+    pci[0] = (uint8_t)len;
+    return 1;
+  }
+  if((flags & ISOTP_FD) && len + 2 <= cap){
+    pci[0] = 0;
+    pci[1] = (uint8_t)len;
+    return 2;
+  }
+  return 0;
+}
+
+/**
+ * @brief STmin (octet du FC) en ns ; valeur réservée : 127 ms.
+ */
+static uint64_t stmin_ns(uint8_t v){
+  if(v <= 0x7F) return (uint64_t)v * 1000000ull;
+  if(v >= 0xF1 && v <= 0xF9) return (uint64_t)(v - 0xF0) * 100000ull;
+  return 127ull * 1000000ull;
+}
+
+/**
+ * @brief Met une trame de session en file, si la file a de la place.
+ *
+ * Une file pleine n’est pas une perte : la trame repartira au prochain
+ * can_tx_release().
+ */
+static bool tx_queue(can_ctx_t *c, const isotp_tx_t *t, const uint8_t *f, uint8_t len, uint64_t t0){
+  if(c->tx_count == CAN_TX_QUEUE) (void)can_flush(c);
+  if(c->tx_count == CAN_TX_QUEUE) return false;
+  /* Pas de clé de fusion : les segments d’un message ne se remplacent pas */
+  return can_queue(c, t->can_id, f, len, CAN_TX_NO_KEY, t0);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 Émission                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Émet le début du message d’une session (SF ou FF).
+ *
+ * @return true si la session attend maintenant un FC, false si le
+ *         message est parti en une trame ou n’a pas pu partir.
+ */
+static bool tx_start(can_ctx_t *c, isotp_tx_t *t, uint64_t now){
+  uint8_t f[CAN_PAYLOAD_MAX], pci[2];
+  size_t npci = sf_pci(t->flags, t->len, pci);
+  if(npci){
+    if(tx_queue(c, t, f, build_frame(f, t->flags, t->key, pci, npci, t->data, t->len), t->t0)) metrics_inc(MC_SEG_TX);
+    else{
+      LOGE("File CAN TX pleine, message segmenté perdu (ID 0x%X, inner_id=0x%X)", t->can_id, t->key);
+      metrics_inc(MC_SEG_FAIL);
+    }
+    return false;
+  }
+
+  size_t first = frame_cap(t->flags) - 2;
+  pci[0] = (uint8_t)((PCI_FF << 4) | ((t->len >> 8) & 0x0F));
+  pci[1] = (uint8_t)t->len;
+  t->fc_seen = atomic_load_explicit(&t->fc, memory_order_relaxed) >> 24;
+  if(!tx_queue(c, t, f, build_frame(f, t->flags, t->key, pci, 2, t->data, first), t->t0)){
+    LOGE("File CAN TX pleine, message segmenté perdu (ID 0x%X, inner_id=0x%X)", t->can_id, t->key);
+    metrics_inc(MC_SEG_FAIL);
+    return false;
+  }
+  t->pos = first;
+  t->sn = 1;
+  t->state = TX_WAIT_FC;
+  t->due_ns = now + ISOTP_TIMEOUT_NS;
+  return true;
+}
+
+/**
+ * @brief Termine le message d’une session : passe au suivant ou libère.
+ */
+static void tx_end(can_ctx_t *c, isotp_tx_t *t, uint64_t now){
+  while(t->has_next){
+    t->has_next = false;
+    memcpy(t->data, t->next, t->next_len);
+    t->len = t->next_len;
+    t->t0 = t->next_t0;
+    if(tx_start(c, t, now)) return;
+  }
+  t->state = TX_IDLE;
+  atomic_store_explicit(&t->id, 0, memory_order_release);
+  c->isotp->tx_active--;
+}
+
+/**
+ * @brief Applique le dernier FC reçu, ou abandonne passé le délai.
+ */
+static void tx_fc(can_ctx_t *c, isotp_tx_t *t, uint64_t now){
+  uint32_t fc = atomic_load_explicit(&t->fc, memory_order_acquire);
+  if((fc >> 24) == t->fc_seen){
+    if(now >= t->due_ns){
+      LOGW("Émission segmentée ID 0x%X, inner_id=0x%X : pas de FC après %d ms, message abandonné",
+           t->can_id, t->key, ISOTP_TIMEOUT_MS);
+      metrics_inc(MC_SEG_FAIL);
+      tx_end(c, t, now);
+    }
+    return;
+  }
+  t->fc_seen = fc >> 24;
+  switch((fc >> 16) & 0x0F){
+    case 0:   /* continuer */
+      t->state = TX_SEND;
+      t->bs = (uint8_t)(fc >> 8);
+      t->st_ns = stmin_ns((uint8_t)fc);
+      t->due_ns = now;
+      break;
+    case 1:   /* attendre : nouveau délai */
+      t->due_ns = now + ISOTP_TIMEOUT_NS;
+      break;
+    default:
+      LOGW("Émission segmentée ID 0x%X, inner_id=0x%X : refusée par le récepteur (FC 0x%X), message abandonné",
+           t->can_id, t->key, (unsigned)((fc >> 16) & 0x0F));
+      metrics_inc(MC_SEG_FAIL);
+      tx_end(c, t, now);
+      break;
+  }
+}
+
+/**
+ * @brief Met en file les CF permis par le FC (bloc BS, écart STmin).
+ */
+static void tx_send(can_ctx_t *c, isotp_tx_t *t, uint64_t now){
+  uint8_t f[CAN_PAYLOAD_MAX];
+  size_t cap = frame_cap(t->flags) - 1;
+  while(t->pos < t->len){
+    if(now < t->due_ns) return;
+    uint8_t pci = (uint8_t)((PCI_CF << 4) | t->sn);
+    size_t n = (t->len - t->pos < cap) ? t->len - t->pos : cap;
+    if(!tx_queue(c, t, f, build_frame(f, t->flags, t->key, &pci, 1, t->data + t->pos, n), 0)){
+      t->due_ns = now + (uint64_t)CAN_TX_RETRY_MS * 1000000ull;
+      return;
+    }
+    t->pos += n;
+    t->sn = (t->sn + 1) & 0x0F;
+    if(t->st_ns) t->due_ns = now + t->st_ns;
+    if(t->bs && --t->bs == 0 && t->pos < t->len){
+      t->state = TX_WAIT_FC;
+      t->due_ns = now + ISOTP_TIMEOUT_NS;
+      return;
+    }
+  }
+  metrics_inc(MC_SEG_TX);
+  tx_end(c, t, now);
+}
+
+/**
+ * @brief Émet un message segmenté.
+ *
+ * Un message court part en une trame (SF). Sinon une session est ouverte
+ * et le FF mis en file ; la suite dépend du FC du récepteur (cf.
+ * isotp_tx_release()). Un message pour une session déjà en cours la suit.
+ *
+ * @param c contexte CAN (propriétaire de la file d’émission).
+ * @param can_id ID CAN (ID de transport en mode tunnel).
+ * @param key inner ID.
+ * @param flags options ISOTP_*.
+ * @param data charge utile.
+ * @param len octets (<= ENTRY_PAYLOAD_MAX).
+ * @param t0 réception de la commande MQTT (cf. can_queue()), relevée à
+ *           l’émission du SF ou du FF.
+ * @return true si le message est en file ou en attente de sa session.
+ */
+bool isotp_send(can_ctx_t *c, uint32_t can_id, uint32_t key, uint8_t flags, const uint8_t *data, size_t len,
+                uint64_t t0){
+  struct isotp_s *s = c ? c->isotp : NULL;
+  if(!s || len > ENTRY_PAYLOAD_MAX) return false;
+  can_id = can_id_bus(can_id);
+  uint64_t id = (((uint64_t)can_id << 32) | key) + 1;
+
+  isotp_tx_t *t = NULL;
+  for(size_t i = 0; i < ISOTP_SESSIONS; i++){
+    isotp_tx_t *x = &s->tx[i];
+    uint64_t v = atomic_load_explicit(&x->id, memory_order_relaxed);
+    if(v == id){
+      if(x->has_next) c->tx_stats.collapsed++;
+      memcpy(x->next, data, len);
+      x->next_len = len;
+      x->next_t0 = t0;
+      x->has_next = true;
+      return true;
+    }
+    if(!v && !t) t = x;
+  }
+
+  /* Message court, aucune session en cours : une trame, sans session */
+  uint8_t f[CAN_PAYLOAD_MAX], pci[2];
+  size_t npci = sf_pci(flags, len, pci);
+  if(npci){
+    if(!can_queue(c, can_id, f, build_frame(f, flags, key, pci, npci, data, len), CAN_TX_NO_KEY, t0)) return false;
+    metrics_inc(MC_SEG_TX);
+    return true;
+  }
+
+  if(!t){
+    LOGW("Émission segmentée ID 0x%X, inner_id=0x%X : %d sessions occupées, message perdu",
+         can_id, key, ISOTP_SESSIONS);
+    metrics_inc(MC_SEG_FAIL);
+    return false;
+  }
+  t->can_id = can_id;
+  t->key = key;
+  t->flags = flags;
+  t->len = len;
+  t->t0 = t0;
+  t->has_next = false;
+  memcpy(t->data, data, len);
+  atomic_store_explicit(&t->id, id, memory_order_release);
+  s->tx_active++;
+  if(tx_start(c, t, metrics_now_ns())) return true;
+  tx_end(c, t, 0);
+  return false;
+}
+
+/**
+ * @brief Fait avancer les émissions en cours.
+ *
+ * @param c contexte CAN (propriétaire de la file d’émission).
+ * @return délai en ms jusqu’à la prochaine échéance (CF retardé par
+ *         STmin, fin d’attente d’un FC), -1 si aucune émission en cours.
+ */
+int isotp_tx_release(can_ctx_t *c){
+  struct isotp_s *s = c ? c->isotp : NULL;
+  if(!s || !s->tx_active) return -1;
+
+  uint64_t now = metrics_now_ns(), next = UINT64_MAX;
+  for(size_t i = 0; i < ISOTP_SESSIONS && s->tx_active; i++){
+    isotp_tx_t *t = &s->tx[i];
+    if(t->state == TX_WAIT_FC) tx_fc(c, t, now);
+    if(t->state == TX_SEND) tx_send(c, t, now);
+    if(t->state != TX_IDLE && t->due_ns < next) next = t->due_ns;
+  }
+  if(next == UINT64_MAX) return -1;
+  return (next > now) ? (int)((next - now + 999999ull) / 1000000ull) : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                Réception                                   */
+/* -------------------------------------------------------------------------- */
+
+/**
+ * @brief Envoie un FC pour une réception (directement sur la socket).
+ */
+static bool rx_fc(can_ctx_t *c, const entry_t *e, uint32_t can_id, uint8_t fs){
+  uint8_t f[CAN_PAYLOAD_MAX];
+  const uint8_t pci[3] = { (uint8_t)((PCI_FC << 4) | fs), 0, 0 };   /* BS 0, STmin 0 */
+  return can_write(c, can_id, f, build_frame(f, isotp_flags(e) & ~ISOTP_FD, e->can_id, pci, 3, NULL, 0));
+}
+
+/**
+ * @brief Session de réception d’un message (existante, libre ou expirée).
+ *
+ * Les sessions expirées sont abandonnées au passage.
+ *
+ * @return session, NULL si toutes sont occupées.
+ */
+static isotp_rx_t *rx_slot(struct isotp_s *s, uint64_t id, uint64_t now){
+  isotp_rx_t *free_x = NULL, *same = NULL;
+  for(size_t i = 0; i < ISOTP_SESSIONS; i++){
+    isotp_rx_t *x = &s->rx[i];
+    if(x->id == id) same = x;
+    else if(x->id && now > x->due_ns){
+      LOGW("Réception segmentée ID 0x%X, inner_id=0x%X : pas de CF après %d ms, message abandonné",
+           (unsigned)((x->id - 1) >> 32), (unsigned)(x->id - 1), ISOTP_TIMEOUT_MS);
+      metrics_inc(MC_SEG_FAIL);
+      x->id = 0;
+    }
+    if(!x->id && !free_x) free_x = x;
+  }
+  if(same){
+    LOGW("Réception segmentée ID 0x%X, inner_id=0x%X : nouveau FF, message précédent abandonné",
+         (unsigned)((id - 1) >> 32), (unsigned)(id - 1));
+    metrics_inc(MC_SEG_FAIL);
+    return same;
+  }
+  return free_x;
+}
+
+/**
+ * @brief Session de réception en cours d’un message, NULL si aucune.
+ */
+static isotp_rx_t *rx_find(struct isotp_s *s, uint64_t id){
+  for(size_t i = 0; i < ISOTP_SESSIONS; i++)
+    if(s->rx[i].id == id) return &s->rx[i];
+  return NULL;
+}
+
+/**
+ * @brief Traite une trame reçue d’une entrée segmentée.
+ *
+ * @param c contexte CAN (lecteur).
+ * @param e entrée de la trame.
+ * @param r trame reçue.
+ * @param hdr octets d’en-tête tunnel.
+ * @param m contexte MQTT de publication.
+ */
+void isotp_rx(can_ctx_t *c, const entry_t *e, const can_rx_frame_t *r, unsigned hdr, mqtt_ctx_t *m){
+  struct isotp_s *s = c ? c->isotp : NULL;
+  if(!s || r->len <= hdr) return;
+  const uint8_t *p = r->data + hdr;
+  size_t avail = r->len - hdr;   /* PCI compris */
+  uint64_t id = (((uint64_t)r->can_id << 32) | e->can_id) + 1;
+
+  switch(p[0] >> 4){
+    case PCI_SF: {
+      size_t len = p[0] & 0x0F, off = 1;
+      if(len == 0 && avail >= 2){
+        len = p[1];
+        off = 2;
+      }
+      if(len > avail - off || len > e->payload_max){
+        LOGW("%s : SF invalide (%zu octets)", e->topic, len);
+        metrics_inc(MC_SEG_FAIL);
+        return;
+      }
+      uint8_t buf[ENTRY_PAYLOAD_MAX];
+      memcpy(buf, p + off, len);
+      memset(buf + len, 0, e->payload_max - len);
+      metrics_inc(MC_SEG_RX);
+      (void)mqtt_handle_can_message(m, e, buf, &r->meta);
+      return;
+    }
+
+    case PCI_FF: {
+      if(avail < 2) return;
+      size_t len = ((size_t)(p[0] & 0x0F) << 8) | p[1];
+      if(len > e->payload_max){
+        LOGW("%s : message segmenté de %zu octets, %u au plus", e->topic, len, (unsigned)e->payload_max);
+        metrics_inc(MC_SEG_FAIL);
+        (void)rx_fc(c, e, r->can_id, 2);   /* débordement */
+        return;
+      }
+      uint64_t now = metrics_now_ns();
+      isotp_rx_t *x = rx_slot(s, id, now);
+      if(!x){
+        LOGW("%s : %d réceptions segmentées en cours, message ignoré", e->topic, ISOTP_SESSIONS);
+        metrics_inc(MC_SEG_FAIL);
+        return;
+      }
+      size_t n = (avail - 2 < len) ? avail - 2 : len;
+      memcpy(x->data, p + 2, n);
+      x->id = id;
+      x->len = len;
+      x->pos = n;
+      x->sn = 1;
+      x->due_ns = now + ISOTP_TIMEOUT_NS;
+      if(!rx_fc(c, e, r->can_id, 0)){
+        LOGW("%s : FC non envoyé, message abandonné", e->topic);
+        metrics_inc(MC_SEG_FAIL);
+        x->id = 0;
+      }
+      return;
+    }
+
+    case PCI_CF: {
+      isotp_rx_t *x = rx_find(s, id);
+      if(!x) return;   /* CF hors session (message déjà abandonné) */
+      uint64_t now = metrics_now_ns();
+      if(now > x->due_ns || (p[0] & 0x0F) != x->sn){
+        LOGW("%s : %s, message segmenté abandonné (%zu/%zu octets)", e->topic,
+             now > x->due_ns ? "délai dépassé" : "CF hors séquence", x->pos, x->len);
+        metrics_inc(MC_SEG_FAIL);
+        x->id = 0;
+        return;
+      }
+      size_t n = (avail - 1 < x->len - x->pos) ? avail - 1 : x->len - x->pos;
+      memcpy(x->data + x->pos, p + 1, n);
+      x->pos += n;
+      x->sn = (x->sn + 1) & 0x0F;
+      x->due_ns = now + ISOTP_TIMEOUT_NS;
+      if(x->pos < x->len) return;
+      x->id = 0;
+      memset(x->data + x->len, 0, e->payload_max - x->len);
+      metrics_inc(MC_SEG_RX);
+      (void)mqtt_handle_can_message(m, e, x->data, &r->meta);
+      return;
+    }
+
+    case PCI_FC: {
+      if(avail < 3) return;
+      for(size_t i = 0; i < ISOTP_SESSIONS; i++){
+        isotp_tx_t *t = &s->tx[i];
+        if(atomic_load_explicit(&t->id, memory_order_acquire) != id) continue;
+        uint32_t n = (atomic_load_explicit(&t->fc, memory_order_relaxed) >> 24) + 1;
+        atomic_store_explicit(&t->fc, (n << 24) | ((uint32_t)(p[0] & 0x0F) << 16) |
+                              ((uint32_t)p[1] << 8) | p[2], memory_order_release);
+        if(c->tx_wake) can_txq_wake(c->tx_wake);
+        return;
+      }
+      return;   /* FC sans émission en cours */
+    }
+
+    default:
+      return;
+  }
+}
+
+// End of file
@@ -0,0 +1,326 @@
+/**
+ * @file log.c
+ * @brief Journal asynchrone : anneau sans verrou et thread d’écriture.
+ *
+ * L’anneau est une file bornée à numéros de séquence par case : chaque
+ * producteur réserve une case par compare-and-swap sur la tête, la
+ * remplit, puis la publie en avançant son numéro de séquence. Le thread
+ * d’écriture, seul consommateur, lit les cases publiées dans l’ordre,
+ * les formate si besoin (LOG_BIN) et les écrit, puis vide stdout/stderr
+ * une fois l’anneau vide.
+ *
+ * L’écrivain se réveille toutes les LOG_FLUSH_MS ; un producteur ne le
+ * réveille (sem_post, donc appel système s’il dort) que pour une erreur
+ * ou quand l’anneau se remplit de moitié.
+ *
+ * L’horodatage est pris par le producteur à la seconde (time()) ; sa mise
+ * en forme (localtime_r + strftime) n’est refaite qu’au changement de
+ * seconde, dans un cache propre à chaque thread.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <semaphore.h>
+
+#include "log.h"
+
+_Atomic int      g_log_level = LOG_INFO;
+_Atomic uint32_t g_log_sample[LOG_CAT_COUNT];
+
+/** @brief Compteurs d’échantillonnage, un par ligne de cache. */
+static struct {
+  alignas(64) _Atomic uint32_t n;
+} g_seen[LOG_CAT_COUNT];
+
+static const char *const cat_name[LOG_CAT_COUNT] = { "gen", "mqtt", "can" };
+static const char *const level_name[] = { "err", "warn", "info", "debug" };
+static const char *const level_tag[] = { "ERR ", "WARN", "INFO", "DBG " };
+
+/** @brief Ligne en attente d’écriture. */
+typedef struct log_rec_s {
+  _Atomic size_t seq;       /* == position + 1 : case publiée */
+  uint8_t  level;
+  bool     binary;          /* true : fmt + args à formater par l’écrivain */
+  time_t   sec;
+  const char *fmt;
+  union {
+    char     text[LOG_LINE_MAX];
+    uint64_t args[LOG_BIN_ARGS];
+  } u;
+} log_rec_t;
+
+static struct {
+  alignas(64) _Atomic size_t head;    /* prochaine case à réserver (producteurs) */
+  alignas(64) size_t tail;            /* prochaine case à écrire (écrivain) */
+  alignas(64) _Atomic uint64_t dropped;
+  _Atomic bool async;                 /* thread d’écriture actif */
+  _Atomic bool stop;
+  sem_t     ready;
+  pthread_t thread;
+  log_rec_t ring[LOG_RING_SIZE];
+} g_log;
+
+/**
+ * @brief Horodatage "AAAA-MM-JJ hh:mm:ss", recalculé une fois par seconde.
+ */
+static const char *ts_text(time_t sec){
+  static _Thread_local time_t last = (time_t)-1;
+  static _Thread_local char buf[32];
+  if(sec != last){
+    struct tm tm;
+    localtime_r(&sec, &tm);
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", &tm);
+    last = sec;
+  }
+  return buf;
+}
+
+/**
+ * @brief Écrit une ligne complète.
+ */
+static void emit(int level, time_t sec, const char *text){
+  FILE *out = (level == LOG_ERR) ? stderr : stdout;
+  fprintf(out, "[%s] [%s] %s\n", ts_text(sec), level_tag[level], text);
+}
+
+/**
+ * @brief Réserve une case de l’anneau.
+ *
+ * @param[out] pos position réservée.
+ * @return la case, NULL si l’anneau est plein.
+ */
+static log_rec_t *rec_claim(size_t *pos){
+  size_t p = atomic_load_explicit(&g_log.head, memory_order_relaxed);
+  for(;;){
+    log_rec_t *r = &g_log.ring[p & (LOG_RING_SIZE - 1)];
+    size_t seq = atomic_load_explicit(&r->seq, memory_order_acquire);
+    if(seq == p){
+      if(atomic_compare_exchange_weak_explicit(&g_log.head, &p, p + 1,
+                                               memory_order_relaxed, memory_order_relaxed)){
+        *pos = p;
+        return r;
+      }
+    }else if((ptrdiff_t)(seq - p) < 0){
+      atomic_fetch_add_explicit(&g_log.dropped, 1, memory_order_relaxed);
+      return NULL;
+    }else{
+      p = atomic_load_explicit(&g_log.head, memory_order_relaxed);
+    }
+  }
+}
+
+/**
+ * @brief Publie une case remplie ; réveille l’écrivain pour une erreur
+ *        ou toutes les LOG_RING_SIZE / 2 lignes.
+ */
+static void rec_publish(log_rec_t *r, size_t pos){
+  bool wake = (r->level == LOG_ERR || (pos & (LOG_RING_SIZE / 2 - 1)) == 0);
+  atomic_store_explicit(&r->seq, pos + 1, memory_order_release);   /* la case n’est plus à nous */
+  if(wake) sem_post(&g_log.ready);
+}
+
+/**
+ * @brief Écrit les cases publiées (écrivain seul, ou log_stop()).
+ *
+ * @return nombre de lignes écrites.
+ */
+static size_t drain(void){
+  size_t n = 0;
+  uint64_t lost = atomic_exchange_explicit(&g_log.dropped, 0, memory_order_relaxed);
+  if(lost){
+    char msg[64];
+    snprintf(msg, sizeof(msg), "%llu ligne(s) de journal perdue(s)", (unsigned long long)lost);
+    emit(LOG_WARN, time(NULL), msg);
+  }
+  for(;;){
+    log_rec_t *r = &g_log.ring[g_log.tail & (LOG_RING_SIZE - 1)];
+    if(atomic_load_explicit(&r->seq, memory_order_acquire) != g_log.tail + 1) break;
+    if(r->binary){
+      char text[LOG_LINE_MAX];
+      const uint64_t *a = r->u.args;
+      snprintf(text, sizeof(text), r->fmt, (unsigned long long)a[0], (unsigned long long)a[1],
+               (unsigned long long)a[2], (unsigned long long)a[3]);
+      emit(r->level, r->sec, text);
+    }else{
+      emit(r->level, r->sec, r->u.text);
+    }
+    atomic_store_explicit(&r->seq, g_log.tail + LOG_RING_SIZE, memory_order_release);
+    g_log.tail++;
+    n++;
+  }
+  if(n || lost){ fflush(stdout); fflush(stderr); }
+  return n;
+}
+
+/**
+ * @brief Thread d’écriture : vide l’anneau toutes les LOG_FLUSH_MS, ou
+ *        plus tôt si un producteur le réveille.
+ */
+static void *writer(void *arg){
+  (void)arg;
+  while(!atomic_load(&g_log.stop)){
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_nsec += (long)LOG_FLUSH_MS * 1000000L;
+    until.tv_sec += until.tv_nsec / 1000000000L;
+    until.tv_nsec %= 1000000000L;
+    if(sem_timedwait(&g_log.ready, &until) < 0 && errno != EINTR && errno != ETIMEDOUT) break;
+    while(sem_trywait(&g_log.ready) == 0) ;   /* un seul passage pour tout le lot */
+    drain();
+  }
+  return NULL;
+}
+
+bool log_sampled(log_cat_t cat){
+  uint32_t every = atomic_load_explicit(&g_log_sample[cat], memory_order_relaxed);
+  uint32_t n = atomic_fetch_add_explicit(&g_seen[cat].n, 1, memory_order_relaxed);
+  return every <= 1 || n % every == 0;
+}
+
+/**
+ * @brief Journalise une ligne formatée par l’appelant.
+ *
+ * @param lvl Niveau.
+ * @param fmt Format printf.
+ */
+void log_printf(log_level_t lvl, const char *fmt, ...){
+  va_list ap;
+  va_start(ap, fmt);
+  if(!atomic_load_explicit(&g_log.async, memory_order_acquire)){
+    char text[LOG_LINE_MAX];
+    vsnprintf(text, sizeof(text), fmt, ap);
+    emit(lvl, time(NULL), text);
+  }else{
+    size_t pos;
+    log_rec_t *r = rec_claim(&pos);
+    if(r){
+      r->level = (uint8_t)lvl;
+      r->binary = false;
+      r->sec = time(NULL);
+      vsnprintf(r->u.text, sizeof(r->u.text), fmt, ap);
+      rec_publish(r, pos);
+    }
+  }
+  va_end(ap);
+}
+
+/**
+ * @brief Journalise une ligne à formater par le thread d’écriture.
+ *
+ * @param lvl Niveau.
+ * @param fmt Format (littéral, conversions 64 bits uniquement).
+ * @param args Arguments.
+ * @param n Nombre d’arguments (au plus LOG_BIN_ARGS).
+ */
+void log_binary(log_level_t lvl, const char *fmt, const uint64_t *args, unsigned n){
+  uint64_t a[LOG_BIN_ARGS] = { 0 };
+  if(n > LOG_BIN_ARGS) n = LOG_BIN_ARGS;
+  if(n) memcpy(a, args, n * sizeof(a[0]));
+  if(!atomic_load_explicit(&g_log.async, memory_order_acquire)){
+    char text[LOG_LINE_MAX];
+    snprintf(text, sizeof(text), fmt, (unsigned long long)a[0], (unsigned long long)a[1],
+             (unsigned long long)a[2], (unsigned long long)a[3]);
+    emit(lvl, time(NULL), text);
+    return;
+  }
+  size_t pos;
+  log_rec_t *r = rec_claim(&pos);
+  if(!r) return;
+  r->level = (uint8_t)lvl;
+  r->binary = true;
+  r->sec = time(NULL);
+  r->fmt = fmt;
+  memcpy(r->u.args, a, sizeof(a));
+  rec_publish(r, pos);
+}
+
+/**
+ * @brief Démarre le thread d’écriture.
+ *
+ * @return true si le journal est asynchrone.
+ */
+bool log_start(void){
+  if(atomic_load(&g_log.async)) return true;
+  for(size_t i = 0; i < LOG_RING_SIZE; i++) atomic_init(&g_log.ring[i].seq, i);
+  atomic_init(&g_log.head, 0);
+  g_log.tail = 0;
+  atomic_store(&g_log.stop, false);
+  if(sem_init(&g_log.ready, 0, 0) != 0) return false;
+
+  /* Le thread d’écriture ne reçoit aucun signal (signalfd, sigtimedwait) */
+  sigset_t all, old;
+  sigfillset(&all);
+  pthread_sigmask(SIG_SETMASK, &all, &old);
+  int rc = pthread_create(&g_log.thread, NULL, writer, NULL);
+  pthread_sigmask(SIG_SETMASK, &old, NULL);
+  if(rc != 0){
+    sem_destroy(&g_log.ready);
+    return false;
+  }
+  atomic_store_explicit(&g_log.async, true, memory_order_release);
+  return true;
+}
+
+/**
+ * @brief Arrête le thread d’écriture après avoir écrit les lignes en attente.
+ *
+ * Les lignes suivantes sont écrites directement par l’appelant.
+ */
+void log_stop(void){
+  if(!atomic_load(&g_log.async)) return;
+  atomic_store_explicit(&g_log.async, false, memory_order_release);
+  atomic_store(&g_log.stop, true);
+  sem_post(&g_log.ready);
+  pthread_join(g_log.thread, NULL);
+  drain();
+  sem_destroy(&g_log.ready);
+}
+
+void log_set_level(log_level_t lvl){
+  atomic_store_explicit(&g_log_level, (int)lvl, memory_order_relaxed);
+}
+
+/**
+ * @brief Fixe le niveau par son nom ("err", "warn", "info", "debug").
+ *
+ * @return false si le nom est inconnu.
+ */
+bool log_set_level_name(const char *name){
+  for(int i = LOG_ERR; name && i <= LOG_DEBUG; i++)
+    if(strcmp(name, level_name[i]) == 0){ log_set_level((log_level_t)i); return true; }
+  return false;
+}
+
+/**
+ * @brief Échantillonne une catégorie : "cat=n" garde une ligne sur n.
+ *
+ * Exemple : "can=100" n’écrit qu’une trame CAN -> MQTT sur 100.
+ *
+ * @return false si la catégorie ou n est invalide.
+ */
+bool log_set_sampling(const char *spec){
+  const char *eq = spec ? strchr(spec, '=') : NULL;
+  if(!eq) return false;
+  char *end;
+  unsigned long n = strtoul(eq + 1, &end, 10);
+  if(*end || end == eq + 1 || n == 0 || n > UINT32_MAX) return false;
+  for(int c = 0; c < LOG_CAT_COUNT; c++)
+    if(strlen(cat_name[c]) == (size_t)(eq - spec) && strncmp(spec, cat_name[c], (size_t)(eq - spec)) == 0){
+      atomic_store_explicit(&g_log_sample[c], (uint32_t)n, memory_order_relaxed);
+      return true;
+    }
+  return false;
+}
+
+// End of file
@@ -0,0 +1,142 @@
+/**
+ * @file metrics.c
+ * @brief Métriques du pont : compteurs et histogrammes de latence.
+ *
+ * Les mises à jour (metrics_inc(), metrics_lat()) sont en ligne dans
+ * metrics.h. Ce module ne fait que le rendu JSON : il relit les compteurs
+ * atomiques et calcule les percentiles sur la différence entre deux
+ * rendus successifs, sans jamais remettre les histogrammes à zéro (les
+ * threads qui les alimentent ne sont pas interrompus).
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+
+#include "metrics.h"
+
+metrics_t g_metrics;
+
+/** @brief Noms JSON des compteurs (ordre de metric_id_t). */
+static const char *const counter_name[MC_COUNT] = {
+  "mqtt_rx", "topic_miss", "json_invalid", "pack_fail", "can_tx_sent", "can_tx_drop",
+  "can_rx", "canid_miss", "can_rx_overflow", "unpack_fail", "mqtt_pub", "mqtt_pub_fail",
+  "mqtt_pub_skipped", "seg_tx", "seg_rx", "seg_fail"
+};
+
+/** @brief Noms JSON des latences (ordre de metric_lat_t). */
+static const char *const lat_name[ML_COUNT] = { "mqtt_to_can", "can_to_mqtt" };
+
+/** @brief Histogrammes au rendu précédent (seul le thread de rendu y accède). */
+static struct {
+  uint64_t sum_ns;
+  uint64_t bucket[METRICS_BUCKETS];
+} g_prev[ML_COUNT];
+
+static uint64_t g_prev_ns;
+
+/**
+ * @brief Plus petite durée (ns) rangée dans le seau i.
+ */
+static uint64_t bucket_low(unsigned i){
+  if(i < METRICS_SUB) return i;
+  unsigned msb = i / METRICS_SUB + METRICS_SUB_BITS - 1;
+  return (uint64_t)(METRICS_SUB + i % METRICS_SUB) << (msb - METRICS_SUB_BITS);
+}
+
+/**
+ * @brief Plus grande durée (ns) rangée dans le seau i (valeur rapportée).
+ */
+static uint64_t bucket_high(unsigned i){
+  return (i + 1 < METRICS_BUCKETS) ? bucket_low(i + 1) - 1 : bucket_low(i);
+}
+
+/**
+ * @brief Ajoute du texte formaté au tampon.
+ *
+ * @return false si le tampon est plein.
+ */
+static bool put(char *buf, size_t len, size_t *pos, const char *fmt, ...){
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(buf + *pos, len - *pos, fmt, ap);
+  va_end(ap);
+  if(n < 0 || (size_t)n >= len - *pos) return false;
+  *pos += (size_t)n;
+  return true;
+}
+
+/**
+ * @brief Rend une latence : différence avec le rendu précédent.
+ *
+ * @param id Latence.
+ * @param buf, len, pos Tampon de sortie.
+ * @return false si le tampon est plein.
+ */
+static bool lat_json(metric_lat_t id, char *buf, size_t len, size_t *pos){
+  const metrics_hist_t *h = &g_metrics.lat[id];
+  uint64_t d[METRICS_BUCKETS], count = 0;
+  for(unsigned i = 0; i < METRICS_BUCKETS; i++){
+    uint64_t v = atomic_load_explicit(&h->bucket[i], memory_order_relaxed);
+    d[i] = v - g_prev[id].bucket[i];
+    g_prev[id].bucket[i] = v;
+    count += d[i];
+  }
+  uint64_t sum = atomic_load_explicit(&h->sum_ns, memory_order_relaxed);
+  uint64_t dsum = sum - g_prev[id].sum_ns;
+  g_prev[id].sum_ns = sum;
+
+  if(!put(buf, len, pos, "\"%s\":{\"count\":%llu", lat_name[id], (unsigned long long)count)) return false;
+  if(!count) return put(buf, len, pos, "}");
+
+  /* Percentiles : seau contenant le rang ceil(q * count) */
+  static const unsigned pct[] = { 50, 90, 99 };
+  double val[3];
+  uint64_t seen = 0;
+  unsigned i = 0, max = 0;
+  for(unsigned k = 0; k < 3; k++){
+    uint64_t rank = (count * pct[k] + 99) / 100;
+    while(i < METRICS_BUCKETS && seen + d[i] < rank) seen += d[i++];
+    val[k] = (double)bucket_high(i < METRICS_BUCKETS ? i : METRICS_BUCKETS - 1) / 1000.0;
+  }
+  for(unsigned k = 0; k < METRICS_BUCKETS; k++) if(d[k]) max = k;
+
+  return put(buf, len, pos, ",\"mean_us\":%.1f,\"p50_us\":%.1f,\"p90_us\":%.1f,\"p99_us\":%.1f,\"max_us\":%.1f}",
+             (double)dsum / (double)count / 1000.0, val[0], val[1], val[2], (double)bucket_high(max) / 1000.0);
+}
+
+/**
+ * @brief Rend les métriques en JSON.
+ *
+ * Exemple :
+ * {"interval_s":10.0,"counters":{"mqtt_rx":12,...},
+ *  "latency":{"mqtt_to_can":{"count":12,"mean_us":41.3,"p50_us":39.9,...},...}}
+ *
+ * @param buf Tampon de sortie.
+ * @param len Taille du tampon (METRICS_JSON_MAX suffit).
+ * @return longueur écrite, 0 si le tampon est trop petit.
+ */
+size_t metrics_json(char *buf, size_t len){
+  if(!buf || !len) return 0;
+  uint64_t now = metrics_now_ns();
+  double interval = g_prev_ns ? (double)(now - g_prev_ns) / 1e9 : 0.0;
+  g_prev_ns = now;
+
+  size_t pos = 0;
+  bool ok = put(buf, len, &pos, "{\"interval_s\":%.1f,\"counters\":{", interval);
+  for(int i = 0; ok && i < MC_COUNT; i++)
+    ok = put(buf, len, &pos, "%s\"%s\":%llu", i ? "," : "", counter_name[i],
+             (unsigned long long)atomic_load_explicit(&g_metrics.counter[i].v, memory_order_relaxed));
+  ok = ok && put(buf, len, &pos, "},\"latency\":{");
+  for(int i = 0; ok && i < ML_COUNT; i++)
+    ok = (!i || put(buf, len, &pos, ",")) && lat_json((metric_lat_t)i, buf, len, &pos);
+  ok = ok && put(buf, len, &pos, "}}");
+  return ok ? pos : 0;
+}
+
+// End of file
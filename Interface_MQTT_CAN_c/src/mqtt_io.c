@@ -7,7 +7,7 @@
  *
  * Il utilise la bibliothèque **libmosquitto** pour :
  * - se connecter au broker MQTT ;
- * - s’abonner à tous les topics du système ;
+ * - s’abonner aux seuls topics de la table de conversion ;
  * - publier les messages convertis depuis le bus CAN ;
  * - recevoir les commandes depuis MQTT et les transmettre vers le bus CAN.
  *
@@ -17,9 +17,13 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <pthread.h>
 
 
 #include <mosquitto.h>
@@ -30,41 +34,34 @@
 #include "pack.h"
 #include "log.h"
 #include "mqtt_io.h"
+#include "spsc.h"
 #include "can_io.h"
+#include "isotp.h"
+#include "metrics.h"
+#include "capture.h"
 
 
+/**
+ * @brief Protège la liste d’abonnements (rechargement vs. reconnexion
+ *        dans le thread réseau mosquitto).
+ */
+static pthread_mutex_t g_sub_lock = PTHREAD_MUTEX_INITIALIZER;
+
 /* -------------------------------------------------------------------------- */
 /*                            Configuration du pont                           */
 /* -------------------------------------------------------------------------- */
 
 /**
- * @def BRIDGE_TUNNEL_CANID
- * @brief Identifiant CAN utilisé comme canal de transport pour le mode “tunnel”.
+ * @def BRIDGE_JSON_BUF
+ * @brief Taille du buffer (sur la pile) utilisé pour encoder le JSON CAN → MQTT.
  *
- * Dans ce mode, la STM32 envoie toutes ses trames sur cet ID fixe 
- * et le pont extrait les 2 premiers octets pour identifier le message interne réel.
+ * Les entrées dont le JSON maximal dépasse cette taille passent par cJSON.
  */
 
-#ifndef BRIDGE_TUNNEL_CANID
-#define BRIDGE_TUNNEL_CANID 0x431
+#ifndef BRIDGE_JSON_BUF
+#define BRIDGE_JSON_BUF 512
 #endif
 
-/**
- * @brief Structure interne contenant les pointeurs nécessaires aux callbacks MQTT.
- *
- * Cette structure regroupe :
- * - la table de correspondance (topics ↔ IDs CAN)
- * - le contexte CAN
- * - le contexte MQTT
- */
-
-typedef struct user_bundle_s
-{
-  const table_t *table;
-  struct can_ctx_s *can;
-  mqtt_ctx_t *mqtt;
-} user_bundle_t;
-
 /* -------------------------------------------------------------------------- */
 /*                              Fonctions utilitaires                         */
 /* -------------------------------------------------------------------------- */
@@ -135,11 +132,27 @@ static void
 on_connect (struct mosquitto *m, void *ud, int rc)
 {
   (void) m;
-  (void) ud;
-  if (rc == 0)
-    LOGI ("MQTT connecté %c", 0);
-  else
-    LOGW ("MQTT connect rc=%d", rc);
+  if (rc != 0)
+    {
+      LOGW ("MQTT connect rc=%d", rc);
+      return;
+    }
+  LOGI ("MQTT connecté %c", 0);
+
+  /* Session propre : les abonnements sont perdus à chaque reconnexion */
+  user_bundle_t *ub = (user_bundle_t *) ud;
+  mqtt_ctx_t *ctx = ub ? ub->mqtt : NULL;
+  if (!ctx)
+    return;
+  pthread_mutex_lock (&g_sub_lock);
+  if (ctx->connects++ > 0 && ctx->sub_count > 0)
+    {
+      int rc2 = mosquitto_subscribe_multiple (ctx->mosq, NULL, ctx->sub_count, ctx->subs, ctx->qos_sub,
+                                              MQTT_SUB_OPT_NO_LOCAL, NULL);
+      if (rc2 != MOSQ_ERR_SUCCESS)
+        LOGE ("Réabonnement rc=%d", rc2);
+    }
+  pthread_mutex_unlock (&g_sub_lock);
 }
 
 /**
@@ -159,82 +172,124 @@ on_disconnect (struct mosquitto *m, void *ud, int rc)
 }
 
 /**
- * @brief Callback principal pour le traitement des messages MQTT entrants.
+ * @brief Traitement des messages MQTT entrants.
  *
  * Chaque fois qu’un message arrive sur un topic :
  * 1. On vérifie s’il correspond à une entrée de la table.
- * 2. On convertit le JSON reçu en trame binaire CAN (pack_payload()).
- * 3. On envoie la trame via le mode tunnel (ID transport fixe 0x431).
+ * 2. On convertit le JSON reçu en trame binaire CAN (pack_parse_json(),
+ *    directement sur le payload, sans copie ni arbre cJSON).
+ * 3. On met la trame en file d’émission, en mode tunnel (ID de transport
+ *    de l’entrée) ou direct ; la boucle principale la vide par lots (can_flush()).
  *
- * @param m Contexte Mosquitto.
- * @param ud Données utilisateur (structure user_bundle_t).
+ * @param ub Données utilisateur.
+ * @param t Table courante.
  * @param msg Message MQTT reçu.
+ * @param t0 Instant de réception (metrics_now_ns()), porté par la trame jusqu’à
+ *           son écriture sur la socket (latence MQTT -> CAN, cf. can_flush()).
  */
 
 static void
-on_message (struct mosquitto *m, void *ud, const struct mosquitto_message *msg)
+handle_message (user_bundle_t *ub, const table_t *t, const struct mosquitto_message *msg, uint64_t t0)
 {
-  (void) m;
-  if (!ud || !msg || !msg->topic)
-    return;
-
-  user_bundle_t *ub = (user_bundle_t *) ud;
-  if (!ub->table || !ub->can)
-    return;
-
   char base[256];
   topic_base_from_input (msg->topic, base, sizeof (base));
   if (base[0] == '\0')
     return;                     /* /state ignoré */
 
-  const entry_t *e = table_find_by_topic (ub->table, base);
+  const entry_t *e = table_find_by_topic (t, base);
   if (!e)
     {
+      metrics_inc (MC_TOPIC_MISS);
       LOGW ("Topic inconnu: %s", msg->topic);
       return;
     }
 
-  /* Lecture du JSON reçu */
-  cJSON *in = NULL;
-  if (msg->payload && msg->payloadlen > 0)
-    {
-      char *buf = (char *) malloc ((size_t) msg->payloadlen + 1);
-      if (!buf)
-        return;
-      memcpy (buf, msg->payload, (size_t) msg->payloadlen);
-      buf[msg->payloadlen] = '\0';
-      in = cJSON_Parse (buf);
-      free (buf);
-    }
-  if (!in)
+  /* Mode tunnel : [ID haut, ID bas, data...] sur l’ID de transport de l’entrée.
+     Mode direct : les données sur le CAN ID de l’entrée. La trame fait
+     e->frame_len octets (8, ou la longueur FD de l’entrée) ; une entrée
+     segmentée envoie ses e->packed_size octets par isotp_send(), l’en-tête
+     tunnel étant alors ajouté à chaque segment. */
+  uint8_t frame[2 + ENTRY_PAYLOAD_MAX] = { 0 };
+  unsigned hdr = (e->route == ROUTE_TUNNEL) ? 2u : 0u;
+
+  /* Lecture du JSON reçu et conversion JSON → binaire (en place, sans copie) */
+  switch (pack_parse_json (frame + hdr, e, (const char *) msg->payload, msg->payloadlen > 0 ? (size_t) msg->payloadlen : 0))
     {
+    case PACK_OK:
+      break;
+    case PACK_ERR_JSON:
+      metrics_inc (MC_JSON_INVALID);
       LOGW ("Payload JSON invalide sur %s", msg->topic);
       return;
+    case PACK_ERR_FIELD:
+      metrics_inc (MC_PACK_FAIL);
+      LOGE ("Pack échoué pour topic %s", base);
+      return;
     }
 
-  /* Conversion JSON → binaire */
-  uint8_t body[8] = { 0 };
-  bool ok_body = pack_payload (body, e, in);
-  cJSON_Delete (in);
-  if (!ok_body)
+  uint32_t tx_id = e->can_id;
+  if (hdr)
     {
-      LOGE ("Pack échoué pour topic %s", base);
+      tx_id = e->transport_id;
+      frame[0] = (uint8_t) ((e->can_id >> 8) & 0xFF);
+      frame[1] = (uint8_t) (e->can_id & 0xFF);
+    }
+
+  uint8_t seg = isotp_flags (e);
+
+  /* Mode multithread : la trame est confiée au thread CAN TX */
+  if (ub->txq)
+    {
+      bool ok = seg ? can_txq_push (ub->txq, tx_id, frame + hdr, (uint8_t) e->packed_size, e->can_id, NULL, seg, t0)
+                    : can_txq_push (ub->txq, tx_id, frame, e->frame_len, e->can_id, &e->cmd, 0, t0);
+      if (!ok)
+        LOGE ("File CAN TX pleine, trame perdue (inner_id=0x%X)", e->can_id);
       return;
     }
 
-  /* Construction du message tunnel : [ID haut, ID bas, data...] */
-  uint8_t out8[8] = { 0 };
-  out8[0] = (uint8_t) ((e->can_id >> 8) & 0xFF);
-  out8[1] = (uint8_t) (e->can_id & 0xFF);
-  memcpy (out8 + 2, body, 6);   /* on place au plus 6 octets derrière */
+  if (seg)
+    {
+      if (!isotp_send (ub->can, tx_id, e->can_id, seg, frame + hdr, e->packed_size, t0))
+        LOGE ("Message segmenté perdu (transport=0x%X, inner_id=0x%X)", tx_id, e->can_id);
+      return;
+    }
 
-  /* Envoi sur le bus CAN */
-  if (!can_send (ub->can, BRIDGE_TUNNEL_CANID, out8))
+  /* Mise en file d’émission CAN (vidée par la boucle principale), selon
+     la limitation de l’entrée ; l’inner ID sert de clé de fusion
+     "dernière valeur gagne" */
+  if (!can_queue_cmd (ub->can, tx_id, frame, e->frame_len, e->can_id, &e->cmd, t0))
     {
-      LOGE ("Envoi CAN échoué (transport=0x%X, inner_id=0x%X)", BRIDGE_TUNNEL_CANID, e->can_id);
+      LOGE ("File CAN TX pleine, trame perdue (transport=0x%X, inner_id=0x%X)", tx_id, e->can_id);
       return;
     }
-  LOGI ("MQTT->CAN OK topic=%s transport=0x%X inner_id=0x%X", base, BRIDGE_TUNNEL_CANID, e->can_id);
+  LOG_BIN (LOG_INFO, LOG_CAT_MQTT_CAN, "MQTT->CAN OK transport=0x%llX inner_id=0x%llX", tx_id, e->can_id);
+}
+
+/**
+ * @brief Callback mosquitto : traite le message sur la table courante.
+ *
+ * La table est lue sous table_rcu_enter()/table_rcu_leave() : un
+ * rechargement concurrent ne la libère pas pendant le traitement.
+ * Le message est enregistré si une capture est en cours (cf. capture.h).
+ */
+static void
+on_message (struct mosquitto *m, void *ud, const struct mosquitto_message *msg)
+{
+  (void) m;
+  if (!ud || !msg || !msg->topic)
+    return;
+
+  user_bundle_t *ub = (user_bundle_t *) ud;
+  if (!ub->tables || !ub->can)
+    return;
+
+  uint64_t t0 = metrics_now_ns ();
+  metrics_inc (MC_MQTT_RX);
+  if (capture_on ())
+    capture_mqtt (msg->topic, msg->payload, (size_t) msg->payloadlen);
+  const table_t *t = table_rcu_enter (ub->tables, TABLE_READER_MQTT);
+  handle_message (ub, t, msg, t0);
+  table_rcu_leave (ub->tables, TABLE_READER_MQTT);
 }
 
 /* -------------------------------------------------------------------------- */
@@ -312,6 +367,169 @@ mqtt_subscribe_all_nolocal (mqtt_ctx_t *ctx)
   return true;
 }
 
+/** @brief Topic de la table et longueur de son parent (avant le dernier '/'). */
+typedef struct sub_topic_s
+{
+  const char *topic;
+  size_t parent_len;            /* 0 : pas de parent */
+} sub_topic_t;
+
+/**
+ * @brief Tri des topics par parent (comparateur qsort).
+ */
+static int
+sub_topic_cmp (const void *a, const void *b)
+{
+  const sub_topic_t *x = (const sub_topic_t *) a, *y = (const sub_topic_t *) b;
+  size_t n = (x->parent_len < y->parent_len) ? x->parent_len : y->parent_len;
+  int c = strncmp (x->topic, y->topic, n);
+  if (c)
+    return c;
+  if (x->parent_len != y->parent_len)
+    return (x->parent_len < y->parent_len) ? -1 : 1;
+  return strcmp (x->topic, y->topic);
+}
+
+/**
+ * @brief Ajoute un abonnement "préfixe + suffixe" à la liste.
+ */
+static bool
+sub_add (char **subs, int *n, const char *prefix, size_t prefix_len, const char *suffix)
+{
+  size_t sl = strlen (suffix);
+  char *s = (char *) malloc (prefix_len + sl + 1);
+  if (!s)
+    return false;
+  memcpy (s, prefix, prefix_len);
+  memcpy (s + prefix_len, suffix, sl + 1);
+  subs[(*n)++] = s;
+  return true;
+}
+
+/**
+ * @brief Libère la liste d’abonnements du contexte.
+ */
+static void
+subs_free (mqtt_ctx_t *ctx)
+{
+  for (int i = 0; i < ctx->sub_count; i++)
+    free (ctx->subs[i]);
+  free (ctx->subs);
+  ctx->subs = NULL;
+  ctx->sub_count = 0;
+}
+
+/**
+ * @brief S’abonne aux seuls topics utiles au pont.
+ *
+ * Pour chaque topic T de la table, le pont traite T et T/cmd (T/state est
+ * ignoré). On s’abonne donc à T et T/cmd ; si un même parent P regroupe
+ * au moins MQTT_SUB_WILDCARD_MIN topics, "P/+" et "P/+/cmd" les remplacent
+ * (les topics inconnus qu’ils laissent passer sont écartés par on_message()).
+ * Tous les filtres partent dans un seul SUBSCRIBE et sont rejoués à chaque
+ * reconnexion. Appelée à nouveau après un rechargement de la table, elle
+ * se désabonne des filtres qui ont disparu.
+ *
+ * @param ctx Contexte MQTT.
+ * @param t Table chargée.
+ * @return true si succès, false sinon.
+ */
+bool
+mqtt_subscribe_table (mqtt_ctx_t *ctx, const table_t *t)
+{
+  if (!ctx || !ctx->mosq || !t)
+    return false;
+
+  size_t n = 0;
+  sub_topic_t *tp = (sub_topic_t *) malloc ((t->entry_count + 1) * sizeof (*tp));
+  char **subs = (char **) malloc ((2 * t->entry_count + 1) * sizeof (char *));
+  if (!tp || !subs)
+    {
+      free (tp);
+      free (subs);
+      return false;
+    }
+
+  for (size_t i = 0; i < t->entry_count; i++)
+    {
+      const entry_t *e = &t->entries[i];
+      if (!e->topic || !e->topic[0] || table_find_by_topic (t, e->topic) != e)
+        continue;               /* doublon */
+      const char *slash = strrchr (e->topic, '/');
+      tp[n].topic = e->topic;
+      /* Pas de regroupement pour un parent contenant déjà un joker */
+      tp[n].parent_len = (slash && !strpbrk (e->topic, "+#")) ? (size_t) (slash - e->topic) : 0;
+      n++;
+    }
+  qsort (tp, n, sizeof (*tp), sub_topic_cmp);
+
+  int ns = 0;
+  bool ok = true;
+  for (size_t i = 0; i < n && ok;)
+    {
+      size_t j = i + 1;
+      while (j < n && tp[i].parent_len && tp[j].parent_len == tp[i].parent_len
+             && strncmp (tp[j].topic, tp[i].topic, tp[i].parent_len) == 0)
+        j++;
+
+      if (tp[i].parent_len && j - i >= MQTT_SUB_WILDCARD_MIN)
+        ok = sub_add (subs, &ns, tp[i].topic, tp[i].parent_len, "/+")
+          && sub_add (subs, &ns, tp[i].topic, tp[i].parent_len, "/+/cmd");
+      else
+        for (size_t k = i; k < j && ok; k++)
+          ok = sub_add (subs, &ns, tp[k].topic, strlen (tp[k].topic), "")
+            && sub_add (subs, &ns, tp[k].topic, strlen (tp[k].topic), "/cmd");
+      i = j;
+    }
+  free (tp);
+  if (!ok)
+    {
+      for (int i = 0; i < ns; i++)
+        free (subs[i]);
+      free (subs);
+      return false;
+    }
+
+  pthread_mutex_lock (&g_sub_lock);
+
+  /* Filtres de l’ancienne liste absents de la nouvelle */
+  int nu = 0;
+  for (int i = 0; i < ctx->sub_count; i++)
+    {
+      int k = 0;
+      while (k < ns && strcmp (ctx->subs[i], subs[k]) != 0)
+        k++;
+      if (k == ns)
+        ctx->subs[nu++] = ctx->subs[i]; /* compactés en tête, libérés par subs_free */
+      else
+        {
+          free (ctx->subs[i]);
+          ctx->subs[i] = NULL;
+        }
+    }
+  int rc = MOSQ_ERR_SUCCESS;
+  if (nu > 0)
+    rc = mosquitto_unsubscribe_multiple (ctx->mosq, NULL, nu, ctx->subs, NULL);
+  if (rc != MOSQ_ERR_SUCCESS)
+    LOGW ("Unsubscribe multiple (%d filtres) rc=%d", nu, rc);
+  ctx->sub_count = nu;
+  subs_free (ctx);
+
+  ctx->subs = subs;
+  ctx->sub_count = ns;
+  rc = (ns > 0) ? mosquitto_subscribe_multiple (ctx->mosq, NULL, ns, ctx->subs, ctx->qos_sub, MQTT_SUB_OPT_NO_LOCAL, NULL)
+    : MOSQ_ERR_SUCCESS;
+  pthread_mutex_unlock (&g_sub_lock);
+
+  if (rc != MOSQ_ERR_SUCCESS)
+    {
+      LOGE ("Subscribe multiple (%d filtres) rc=%d", ns, rc);
+      return false;
+    }
+  LOGI ("Abonnements: %d filtre(s) pour %zu topic(s), %d retiré(s)", ns, n, nu);
+  return true;
+}
+
 /**
  * @brief Raccourci vers mqtt_subscribe_all_nolocal().
  */
@@ -385,41 +603,288 @@ mqtt_set_qos (mqtt_ctx_t *ctx, int qos_sub, int qos_pub)
     ctx->qos_pub = qos_pub;
 }
 
+/* -------------------------------------------------------------------------- */
+/*                  Politique de publication CAN -> MQTT                      */
+/* -------------------------------------------------------------------------- */
+
+/** @brief Dernière publication d’une entrée. */
+typedef struct pub_slot_s
+{
+  uint64_t key;                 /* pub_key() de l’entrée, 0 = libre */
+  uint64_t last_ns;             /* instant de la dernière publication */
+  uint8_t data[ENTRY_PAYLOAD_MAX]; /* payload publié (e->payload_max octets) */
+} pub_slot_t;
+
+/**
+ * @brief Derniers payloads publiés, par CAN ID (adressage ouvert).
+ *
+ * Accédé uniquement par le lecteur CAN (boucle principale ou thread RX) ;
+ * les entrées retirées par un rechargement restent sans effet.
+ */
+typedef struct pub_cache_s
+{
+  pub_slot_t *slots;
+  size_t mask;
+  size_t count;
+} pub_cache_t;
+
+/**
+ * @brief Clé du cache : CAN ID, qualifié par l’ID de transport en mode tunnel.
+ */
+static uint64_t
+pub_key (const entry_t *e)
+{
+  uint64_t tag = (e->route == ROUTE_TUNNEL) ? (uint64_t) e->transport_id + 1 : 0;
+  return ((tag << 32) | e->can_id) + 1;
+}
+
+/**
+ * @brief Emplacement du cache d’une clé (créé si absent).
+ *
+ * @return emplacement, NULL si allocation impossible.
+ */
+static pub_slot_t *
+pub_slot (mqtt_ctx_t *ctx, uint64_t key)
+{
+  pub_cache_t *c = ctx->pub;
+  if (!c)
+    {
+      c = ctx->pub = (pub_cache_t *) calloc (1, sizeof (*c));
+      if (!c)
+        return NULL;
+    }
+
+  /* Facteur de charge < 50 % : la table double, les emplacements sont réinsérés */
+  if (2 * (c->count + 1) > (c->slots ? c->mask + 1 : 0))
+    {
+      size_t cap = c->slots ? 2 * (c->mask + 1) : 64;
+      pub_slot_t *ns = (pub_slot_t *) calloc (cap, sizeof (*ns));
+      if (!ns)
+        return NULL;
+      for (size_t i = 0; c->slots && i <= c->mask; i++)
+        {
+          if (!c->slots[i].key)
+            continue;
+          size_t k = (size_t) (c->slots[i].key * 0x9E3779B97F4A7C15ull >> 32) & (cap - 1);
+          while (ns[k].key)
+            k = (k + 1) & (cap - 1);
+          ns[k] = c->slots[i];
+        }
+      free (c->slots);
+      c->slots = ns;
+      c->mask = cap - 1;
+    }
+
+  size_t k = (size_t) (key * 0x9E3779B97F4A7C15ull >> 32) & c->mask;
+  while (c->slots[k].key && c->slots[k].key != key)
+    k = (k + 1) & c->mask;
+  if (!c->slots[k].key)
+    {
+      c->slots[k].key = key;
+      c->count++;
+    }
+  return &c->slots[k];
+}
+
+/**
+ * @brief Applique la politique de publication d’une entrée à une trame.
+ *
+ * Sans politique (défaut), chaque trame est publiée sans consulter le
+ * cache. Sinon la trame est comparée au dernier payload publié pour ce
+ * CAN ID : inchangée (hors heartbeat) ou trop proche de la précédente,
+ * elle est comptée puis ignorée. Le cache n’est pas modifié ici : seule
+ * une publication réussie l’est (cf. pub_commit()), une valeur perdue
+ * (broker injoignable, file pleine) sera donc republiée.
+ *
+ * @param ctx Contexte MQTT.
+ * @param e Entrée de la trame.
+ * @param data Payload (e->payload_max octets, en-tête tunnel retiré).
+ * @param[out] slot emplacement à mettre à jour après publication (NULL si aucun).
+ * @return true si la trame doit être publiée.
+ */
+static bool
+pub_filter (mqtt_ctx_t *ctx, const entry_t *e, const uint8_t *data, pub_slot_t **slot)
+{
+  const pub_policy_t *p = &e->pub;
+  *slot = NULL;
+  if (!p->on_change && !p->min_interval_ms)
+    return true;
+
+  pub_slot_t *s = pub_slot (ctx, pub_key (e));
+  if (!s)
+    return true;
+
+  uint64_t now = metrics_now_ns ();
+  if (s->last_ns)
+    {
+      uint64_t since = now - s->last_ns;
+      if (p->on_change && memcmp (s->data, data, e->payload_max) == 0
+          && !(p->heartbeat_ms && since >= (uint64_t) p->heartbeat_ms * 1000000ull))
+        {
+          ctx->pub_stats.unchanged++;
+          return false;
+        }
+      if (since < (uint64_t) p->min_interval_ms * 1000000ull)
+        {
+          ctx->pub_stats.limited++;
+          return false;
+        }
+    }
+  *slot = s;
+  return true;
+}
+
+/**
+ * @brief Enregistre une publication réussie dans le cache de pub_filter().
+ *
+ * @param e Entrée publiée.
+ * @param s Emplacement rendu par pub_filter() (NULL : rien à faire).
+ * @param data Payload publié (e->payload_max octets).
+ */
+static void
+pub_commit (const entry_t *e, pub_slot_t *s, const uint8_t *data)
+{
+  if (!s)
+    return;
+  s->last_ns = metrics_now_ns ();
+  memcpy (s->data, data, e->payload_max);
+}
+
+/**
+ * @brief Journalise les compteurs de publication CAN -> MQTT.
+ *
+ * @param ctx Contexte MQTT.
+ */
+void
+mqtt_pub_report (const mqtt_ctx_t *ctx)
+{
+  if (!ctx)
+    return;
+  const mqtt_pub_stats_t *s = &ctx->pub_stats;
+  if (!s->published && !s->unchanged && !s->limited)
+    return;
+  LOGI ("CAN->MQTT: %llu publiées, %llu inchangées ignorées, %llu limitées (intervalle)",
+        (unsigned long long) s->published, (unsigned long long) s->unchanged, (unsigned long long) s->limited);
+}
+
+/**
+ * @brief Publie les métriques sur METRICS_TOPIC si la période est écoulée.
+ *
+ * QoS 0, sans rétention : une publication perdue est remplacée par la
+ * suivante. À appeler périodiquement depuis un seul thread (boucle
+ * principale, timer epoll ou thread principal du mode multithread).
+ *
+ * @param ctx Contexte MQTT.
+ * @return true si les métriques ont été publiées.
+ */
+bool
+mqtt_metrics_tick (mqtt_ctx_t *ctx)
+{
+  if (!ctx || !ctx->mosq || METRICS_PERIOD_S <= 0)
+    return false;
+  char buf[METRICS_JSON_MAX];
+  uint64_t now = metrics_now_ns ();
+  if (!ctx->metrics_ns)
+    {
+      /* Premier appel : point de départ du premier intervalle */
+      ctx->metrics_ns = now;
+      (void) metrics_json (buf, sizeof (buf));
+      return false;
+    }
+  if (now - ctx->metrics_ns < (uint64_t) METRICS_PERIOD_S * 1000000000ull)
+    return false;
+  ctx->metrics_ns = now;
+
+  size_t len = metrics_json (buf, sizeof (buf));
+  if (!len)
+    return false;
+  int rc = mosquitto_publish (ctx->mosq, NULL, METRICS_TOPIC, (int) len, buf, 0, false);
+  if (rc != MOSQ_ERR_SUCCESS)
+    {
+      LOGW ("Publication des métriques rc=%d", rc);
+      return false;
+    }
+  return true;
+}
+
 /**
  * @brief Traite un message CAN et le publie sur MQTT.
  *
  * Cette fonction est appelée à chaque réception d’une trame CAN.
- * Elle reconvertit la trame binaire en JSON via `unpack_payload()`
- * et la publie sur le topic correspondant.
+ * La politique de publication de l’entrée est appliquée en premier
+ * (cf. pub_filter()) : une trame ignorée ne coûte ni encodage JSON ni
+ * trafic vers le broker. Sinon elle encode la trame binaire en JSON via `pack_encode_json()`
+ * dans un buffer sur la pile (aucune allocation) et la publie sur
+ * le topic correspondant. Si le buffer est trop petit, elle repasse
+ * par `unpack_payload()` et cJSON.
  *
  * @param ctx Contexte MQTT.
  * @param e Entrée de la table correspondant à l’ID CAN.
- * @param data Tableau de 8 octets CAN.
- * @return true si la publication réussit, false sinon.
+ * @param data Payload CAN (e->payload_max octets, en-tête tunnel retiré).
+ * @param meta Horodatage noyau et pertes de la trame (NULL si inconnus) ;
+ *             donne l’âge de la trame à la publication (journal et
+ *             latence CAN -> MQTT des métriques).
+ * @return true si la publication réussit ou si la trame est ignorée par la
+ *         politique de publication, false sinon.
  */
 bool
-mqtt_handle_can_message (mqtt_ctx_t *ctx, const entry_t *e, const uint8_t data[8])
+mqtt_handle_can_message (mqtt_ctx_t *ctx, const entry_t *e, const uint8_t *data, const can_rx_meta_t *meta)
 {
   if (!ctx || !e)
     return false;
-  cJSON *obj = unpack_payload (data, e);
-  if (!obj)
+  pub_slot_t *slot;
+  if (!pub_filter (ctx, e, data, &slot))
     {
-      LOGE ("Unpack échoué id=0x%X", e->can_id);
-      return false;
+      metrics_inc (MC_MQTT_PUB_SKIPPED);
+      return true;
     }
-  char *out = cJSON_PrintUnformatted (obj);
-  cJSON_Delete (obj);
-  if (!out)
+
+  char buf[BRIDGE_JSON_BUF];
+  char *out = buf;
+  char *heap = NULL;
+
+  /* Chemin lent (JSON plus grand que le buffer) : passage par cJSON */
+  if (pack_encode_json (buf, sizeof (buf), data, e) == 0)
     {
-      LOGE ("cJSON_PrintUnformatted %c", 0);
-      return false;
+      cJSON *obj = unpack_payload (data, e);
+      if (!obj)
+        {
+          metrics_inc (MC_UNPACK_FAIL);
+          LOGE ("Unpack échoué id=0x%X", e->can_id);
+          return false;
+        }
+      heap = cJSON_PrintUnformatted (obj);
+      cJSON_Delete (obj);
+      if (!heap)
+        {
+          metrics_inc (MC_UNPACK_FAIL);
+          LOGE ("cJSON_PrintUnformatted %c", 0);
+          return false;
+        }
+      out = heap;
     }
 
   bool ok = mqtt_publish_json (ctx, e->topic, out);     /* publier sur le topic de base */
-  free (out);
+  free (heap);
   if (ok)
-    LOGI ("CAN->MQTT OK id=0x%X topic=%s", e->can_id, e->topic);
+    {
+      pub_commit (e, slot, data);
+      ctx->pub_stats.published++;
+      metrics_inc (MC_MQTT_PUB);
+    }
+  else
+    metrics_inc (MC_MQTT_PUB_FAIL);
+  if (ok && meta && meta->ts_ns)
+    {
+      struct timespec now;
+      clock_gettime (CLOCK_REALTIME, &now);
+      int64_t age = (int64_t) ((uint64_t) now.tv_sec * 1000000000ull + (uint64_t) now.tv_nsec - meta->ts_ns);
+      metrics_lat (ML_CAN_TO_MQTT, age > 0 ? (uint64_t) age : 0);
+      LOG_BIN (LOG_INFO, LOG_CAT_CAN_MQTT, "CAN->MQTT OK id=0x%llX age=%llu us", e->can_id,
+               age > 0 ? (uint64_t) age / 1000u : 0);
+    }
+  else if (ok)
+    LOG_BIN (LOG_INFO, LOG_CAT_CAN_MQTT, "CAN->MQTT OK id=0x%llX", e->can_id);
   else
     LOGE ("CAN->MQTT publish échoué topic=%s", e->topic);
   return ok;
@@ -458,6 +923,13 @@ mqtt_cleanup (mqtt_ctx_t *ctx)
       mosquitto_destroy (ctx->mosq);
       ctx->mosq = NULL;
     }
+  subs_free (ctx);
+  if (ctx->pub)
+    {
+      free (ctx->pub->slots);
+      free (ctx->pub);
+      ctx->pub = NULL;
+    }
   mosquitto_lib_cleanup ();
 }
 
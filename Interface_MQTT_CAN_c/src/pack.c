@@ -1,6 +1,6 @@
 /**
  * @file pack.c
- * @brief Conversion des données entre format JSON et trame CAN (8 octets).
+ * @brief Conversion des données entre format JSON et trame CAN.
  *
  * Ce module contient les fonctions responsables de la transformation :
  * - du format JSON (utilisé par MQTT) vers le format binaire CAN (pack)
@@ -8,6 +8,20 @@
  *
  * Il s’appuie sur la table de conversion chargée depuis `conversion.json`,
  * qui indique le type de chaque champ (int, bool, hex, enum…).
+ *
+ * Hors hex, un champ est une valeur brute de 1 à 32 bits, lue sur
+ * fs->width octets puis décalée et masquée selon le plan précompilé par
+ * table_load (cf. raw_get() / raw_put()), éventuellement convertie en
+ * valeur physique (brut * scale + offset).
+ *
+ * La charge utile d’une entrée fait entry->payload_max octets (6 ou 8 en
+ * CAN classique, 62 ou 64 en CAN FD, ENTRY_PAYLOAD_MAX pour une entrée
+ * segmentée) ; un tampon de ENTRY_PAYLOAD_MAX octets convient toujours.
+ *
+ * Les champs qui ne tiennent pas dans la charge utile (au-delà de
+ * entry->packed_count, cf. compile_entry) sont traités comme par le pont
+ * d’origine, qui n’émettait en tunnel que les 6 premiers octets : exigés
+ * et validés au pack mais non émis, lus à 0 à l’unpack.
  */
 
 #include <stdio.h>
@@ -17,6 +31,8 @@
 #include <stdlib.h>
 #include <ctype.h>
 #include <string.h>
+#include <limits.h>
+#include <float.h>
 
 #include <cjson/cJSON.h>
 
@@ -37,6 +53,105 @@
  */
 static inline uint8_t clamp_u8(int x){ if(x<0) return 0; if(x>255) return 255; return (uint8_t)x; }
 
+/* Champs hors trame : offset borné à payload_max, 5 octets au plus */
+#define OFF_FRAME_MAX (ENTRY_PAYLOAD_MAX + 8u)
+
+/* Lecture des champs hors trame : toujours 0 */
+static const uint8_t g_off_frame_zero[OFF_FRAME_MAX];
+
+
+/**
+ * @brief Lit la valeur brute d’un champ (plan précompilé par table_load).
+ *
+ * @param in : charge utile.
+ * @param fs : champ.
+ * @return valeur brute sur fs->bits bits.
+ */
+static inline uint32_t raw_get(const uint8_t *in, const field_spec_t *fs){
+  const uint8_t *p = in + fs->offset;
+  if(fs->width == 1) return (uint32_t)(p[0] >> fs->shift) & fs->mask;
+  uint64_t r = 0;
+  if(fs->little) for(unsigned i = fs->width; i--; ) r = (r << 8) | p[i];
+  else           for(unsigned i = 0; i < fs->width; i++) r = (r << 8) | p[i];
+  return (uint32_t)(r >> fs->shift) & fs->mask;
+}
+
+/**
+ * @brief Écrit la valeur brute d’un champ dans une charge utile remise à 0.
+ *
+ * @param out : charge utile (octets du champ à 0, sauf bits d’autres champs).
+ * @param fs : champ.
+ * @param v : valeur brute (tronquée à fs->bits bits).
+ */
+static inline void raw_put(uint8_t *out, const field_spec_t *fs, uint32_t v){
+  uint8_t *p = out + fs->offset;
+  uint64_t r = (uint64_t)(v & fs->mask) << fs->shift;
+  if(fs->little) for(unsigned i = 0; i < fs->width; i++, r >>= 8) p[i] |= (uint8_t)r;
+  else           for(unsigned i = fs->width; i--; r >>= 8) p[i] |= (uint8_t)r;
+}
+
+/**
+ * @brief Valeur d’un champ numérique à partir de sa valeur brute.
+ *
+ * @param fs : champ (FT_INT, FT_INT16, FT_UINT, FT_SINT ou FT_FLOAT).
+ * @param raw : valeur brute.
+ * @return valeur physique.
+ */
+static double raw_to_value(const field_spec_t *fs, uint32_t raw){
+  double v;
+  if(fs->type == FT_SINT) v = (raw > fs->mask / 2) ? (double)raw - (double)fs->mask - 1.0 : (double)raw;
+  else if(fs->type == FT_FLOAT){ float f; memcpy(&f, &raw, sizeof(f)); v = f; }
+  else v = raw;
+  return fs->scaled ? v * fs->scale + fs->bias : v;
+}
+
+/**
+ * @brief Valeur brute d’un champ numérique à partir d’une valeur JSON.
+ *
+ * Sans conversion, la partie entière est retenue (comme l’int d’origine) ;
+ * avec scale/offset, la valeur brute la plus proche. Un float hors de la
+ * plage de la simple précision est refusé.
+ *
+ * @param fs : champ numérique.
+ * @param x : valeur lue.
+ * @param[out] raw : valeur brute.
+ * @param[out] shown : valeur rapportée si hors plage.
+ * @return false si la valeur ne tient pas dans le champ.
+ */
+static bool value_to_raw(const field_spec_t *fs, double x, uint32_t *raw, double *shown){
+  if(fs->type == FT_FLOAT){
+    double q = fs->scaled ? (x - fs->bias) / fs->scale : x;
+    if(q > FLT_MAX || q < -FLT_MAX){ *shown = x; return false; }
+    float f = (float)q;
+    memcpy(raw, &f, sizeof(f));
+    return true;
+  }
+  double q = fs->scaled ? (x - fs->bias) / fs->scale : x;
+  double lo = (fs->type == FT_SINT) ? -(double)(fs->mask / 2) - 1.0 : 0.0;
+  double hi = (fs->type == FT_SINT) ? (double)(fs->mask / 2) : (double)fs->mask;
+  if(!(q > -4e18 && q < 4e18)){ *shown = x; return false; }   /* NaN compris */
+  int64_t r = fs->scaled ? (int64_t)(q < 0 ? q - 0.5 : q + 0.5) : (int64_t)q;
+  if(r < lo || r > hi){ *shown = fs->scaled ? x : (double)r; return false; }
+  *raw = (uint32_t)r;
+  return true;
+}
+
+/**
+ * @brief Libellé du type attendu dans les messages d’erreur.
+ */
+static const char* type_hint(field_type_t t){
+  switch(t){
+    case FT_INT:   return "int";
+    case FT_BOOL:  return "bool";
+    case FT_HEX:   return "hex(#RRGGBB)";
+    case FT_INT16: return "int16";
+    case FT_ENUM:  return "enum(string)";
+    case FT_UINT:  return "uint32";
+    case FT_SINT:  return "sint";
+    case FT_FLOAT: return "float";
+  }
+  return "?";
+}
 
 /**
  * @brief Convertit une couleur hexadécimale "#RRGGBB" en trois octets RGB.
@@ -74,86 +189,66 @@ static bool enum_str_to_code(const field_spec_t *fs, const char *s, uint8_t *cod
   }
   return false;
 }
-/**
- * @brief Convertit un code numérique d’un enum en texte.
- *
- * Exemple : 1 → "ON"
- *
- * @param fs :description du champ.
- * @param code : code entier.
- * @return nom du champ correspondant, ou NULL si non trouvé.
- */
-static const char* enum_code_to_str(const field_spec_t *fs, uint8_t code){
-  if(!fs || fs->type!=FT_ENUM) return NULL;
-  for(enum_kv_t *kv=fs->enum_list; kv; kv=kv->next){
-    if((kv->value & 0xFF) == code) return kv->key;
-  }
-  return NULL;
-}
 
 
 /**
- * @brief Convertit un objet JSON en tableau de 8 octets CAN.
+ * @brief Convertit un objet JSON en charge utile CAN.
  *
  * Cette fonction transforme chaque champ du JSON (int, bool, hex, etc.)
  * selon le type défini dans la table.  
- * Les valeurs sont ensuite placées dans le tableau de 8 octets à envoyer
- * sur le bus CAN.
+ * Les valeurs sont ensuite placées dans la charge utile à envoyer
+ * sur le bus CAN, à l’offset précompilé par table_load.
  *
- * @param[out] out8 : tableau de 8 octets à remplir.
+ * @param[out] out : charge utile à remplir (entry->payload_max octets).
  * @param entry : structure décrivant le message (topic, champs, types).
  * @param json_in : objet JSON d’entrée.
  * @return true si la conversion a réussi, false sinon.
  */
-bool pack_payload(uint8_t out8[8], const entry_t *entry, cJSON *json_in){
-  memset(out8,0,8);
-  if(!entry || !json_in) return false;
-  size_t idx=0;
+bool pack_payload(uint8_t *out, const entry_t *entry, cJSON *json_in){
+  if(!entry) return false;
+  memset(out,0,entry->payload_max);
+  if(!json_in) return false;
 
+  /* Plan précompilé ; les champs hors trame sont écrits dans off, jeté */
+  uint8_t off[OFF_FRAME_MAX];
+  if(entry->packed_count < entry->field_count) memset(off, 0, sizeof(off));
   for(size_t i=0;i<entry->field_count;i++){
     const field_spec_t *fs = &entry->fields[i];
+    uint8_t *dst = (i < entry->packed_count) ? out : off;
     cJSON *v = cJSON_GetObjectItemCaseSensitive(json_in, fs->name);
     if(!v){
       LOGW("Champ manquant: %s", fs->name);
       return false;
     }
     switch(fs->type){
-      case FT_INT:{
-        if(!cJSON_IsNumber(v)) { LOGW("Type int attendu pour %s", fs->name); return false; }
-        if(idx+1>8) return false;
-        int x = (int)v->valuedouble;
-        if(x<0 || x>255){ LOGW("Valeur %s hors plage: %d", fs->name, x); return false; }
-        out8[idx++] = (uint8_t)x;
+      case FT_INT:
+      case FT_INT16:
+      case FT_UINT:
+      case FT_SINT:
+      case FT_FLOAT:{
+        if(!cJSON_IsNumber(v)) { LOGW("Type %s attendu pour %s", type_hint(fs->type), fs->name); return false; }
+        uint32_t raw; double shown;
+        if(!value_to_raw(fs, v->valuedouble, &raw, &shown)){ LOGW("Valeur %s hors plage: %.15g", fs->name, shown); return false; }
+        raw_put(dst, fs, raw);
       }break;
       case FT_BOOL:{
         if(!cJSON_IsBool(v)) { LOGW("Type bool attendu pour %s", fs->name); return false; }
-        if(idx+1>8) return false;
-        out8[idx++] = cJSON_IsTrue(v) ? 1 : 0;
+        raw_put(dst, fs, cJSON_IsTrue(v) ? 1 : 0);
       }break;
       case FT_HEX:{
         if(!cJSON_IsString(v)) { LOGW("Type hex(#RRGGBB) attendu pour %s", fs->name); return false; }
-        if(idx+3>8) return false;
         uint8_t rgb[3];
         if(!parse_hex_rgb(v->valuestring, rgb)){ LOGW("Format hex invalide pour %s", fs->name); return false; }
-        out8[idx++]=rgb[0]; out8[idx++]=rgb[1]; out8[idx++]=rgb[2];
-      }break;
-      case FT_INT16:{
-        if(!cJSON_IsNumber(v)){ LOGW("Type int16 attendu pour %s", fs->name); return false; }
-        if(idx+2>8) return false;
-        int x = (int)v->valuedouble;
-        if(x<0 || x>65535){ LOGW("Valeur %s hors plage: %d", fs->name, x); return false; }
-        out8[idx++] = (uint8_t)((x>>8)&0xFF);
-        out8[idx++] = (uint8_t)(x & 0xFF);
+        memcpy(dst + fs->offset, rgb, 3);
       }break;
       case FT_ENUM:{
         if(!cJSON_IsString(v)){ LOGW("Type enum(string) attendu pour %s", fs->name); return false; }
-        if(idx+1>8) return false;
-        uint8_t code=0;
+        uint8_t code;
         if(!enum_str_to_code(fs, v->valuestring, &code)){
           LOGW("Valeur enum inconnue '%s' pour %s", v->valuestring, fs->name);
           return false;
         }
-        out8[idx++] = code;
+        raw_put(dst, fs, code);
       }break;
     }
   }
@@ -162,56 +257,578 @@ bool pack_payload(uint8_t out8[8], const entry_t *entry, cJSON *json_in){
 }
 
 /**
- * @brief Convertit une trame CAN (8 octets) en objet JSON.
+ * @brief Convertit une charge utile CAN en objet JSON.
  *
  * Cette fonction fait l’opération inverse de `pack_payload()` :
- * elle lit les 8 octets d’une trame CAN et reconstruit un
+ * elle lit la charge utile d’une trame CAN et reconstruit un
  * objet JSON lisible pour MQTT.
  *
- * @param in8 : tableau d’octets CAN reçu.
+ * Les offsets et les noms d’enum sont précompilés par table_load :
+ * aucun calcul de position ni parcours de liste ici.
+ *
+ * @param frame : charge utile reçue (entry->payload_max octets, complétée par des 0).
  * @param entry : structure décrivant le message attendu.
  * @return objet JSON reconstruit, ou NULL en cas d’erreur.
  */
-cJSON* unpack_payload(const uint8_t in8[8], const entry_t *entry){
+cJSON* unpack_payload(const uint8_t *frame, const entry_t *entry){
   if(!entry) return NULL;
   cJSON *obj = cJSON_CreateObject();
   if(!obj) return NULL;
-  size_t idx=0;
 
   for(size_t i=0;i<entry->field_count;i++){
     const field_spec_t *fs = &entry->fields[i];
+    const uint8_t *in = (i < entry->packed_count) ? frame : g_off_frame_zero;
     switch(fs->type){
-      case FT_INT:{
-        if(idx+1>8) goto fail;
-        cJSON_AddNumberToObject(obj, fs->name, (int)in8[idx++]);
-      }break;
-      case FT_BOOL:{
-        if(idx+1>8) goto fail;
-        cJSON_AddBoolToObject(obj, fs->name, in8[idx++] ? 1:0);
-      }break;
+      case FT_INT:
+      case FT_INT16:
+      case FT_UINT:
+      case FT_SINT:
+      case FT_FLOAT:
+        cJSON_AddNumberToObject(obj, fs->name, raw_to_value(fs, raw_get(in, fs)));
+        break;
+      case FT_BOOL:
+        cJSON_AddBoolToObject(obj, fs->name, raw_get(in, fs) ? 1:0);
+        break;
       case FT_HEX:{
-        if(idx+3>8) goto fail;
-        char buf[8]; snprintf(buf,sizeof(buf),"#%02X%02X%02X", in8[idx],in8[idx+1],in8[idx+2]);
-        cJSON_AddStringToObject(obj, fs->name, buf); idx+=3;
-      }break;
-      case FT_INT16:{
-        if(idx+2>8) goto fail;
-        int v = ((int)in8[idx]<<8) | (int)in8[idx+1]; idx+=2;
-        cJSON_AddNumberToObject(obj, fs->name, v);
+        const uint8_t *src = in + fs->offset;
+        char buf[8]; snprintf(buf,sizeof(buf),"#%02X%02X%02X", src[0],src[1],src[2]);
+        cJSON_AddStringToObject(obj, fs->name, buf);
       }break;
       case FT_ENUM:{
-        if(idx+1>8) goto fail;
-        uint8_t code = in8[idx++];
-        const char *s = enum_code_to_str(fs, code);
-        if(s) cJSON_AddStringToObject(obj, fs->name, s);
+        uint32_t code = raw_get(in, fs);
+        const enum_kv_t *kv = fs->enum_by_code[code];
+        if(kv) cJSON_AddStringToObject(obj, fs->name, kv->key);
         else  cJSON_AddNumberToObject(obj, fs->name, (int)code);
       }break;
     }
   }
   return obj;
-fail:
-  cJSON_Delete(obj);
-  return NULL;
+}
+
+
+/**
+ * @brief Écrit un entier non signé en décimal (sans '\0').
+ *
+ * @param p position d’écriture.
+ * @param v valeur.
+ * @return position après le dernier chiffre.
+ */
+static inline char* put_uint(char *p, uint32_t v){
+  char tmp[10]; int n = 0;
+  do { tmp[n++] = (char)('0' + v % 10); v /= 10; } while(v);
+  while(n) *p++ = tmp[--n];
+  return p;
+}
+
+/**
+ * @brief Écrit un nombre comme cJSON_PrintUnformatted() (sans '\0').
+ *
+ * Entier représentable en int : "%d" ; sinon "%1.15g", ou "%1.17g" si
+ * la relecture ne redonne pas la valeur ; NaN et infinis : null.
+ *
+ * @param p position d’écriture (24 caractères au plus).
+ * @param d valeur.
+ * @return position après le dernier caractère.
+ */
+static char* put_double(char *p, double d){
+  if(d != d || d - d != 0){ memcpy(p, "null", 4); return p + 4; }
+  int vi = (d >= INT_MAX) ? INT_MAX : (d <= INT_MIN) ? INT_MIN : (int)d;
+  if(d == (double)vi){
+    if(vi < 0){ *p++ = '-'; return put_uint(p, 0u - (uint32_t)vi); }
+    return put_uint(p, (uint32_t)vi);
+  }
+  char tmp[32];
+  int n = snprintf(tmp, sizeof(tmp), "%1.15g", d);
+  double back = strtod(tmp, NULL);
+  double diff = back > d ? back - d : d - back;
+  double big = (back < 0 ? -back : back) > (d < 0 ? -d : d) ? (back < 0 ? -back : back) : (d < 0 ? -d : d);
+  if(diff > big * DBL_EPSILON) n = snprintf(tmp, sizeof(tmp), "%1.17g", d);
+  memcpy(p, tmp, (size_t)n);
+  return p + n;
+}
+
+/**
+ * @brief Encode directement une charge utile CAN en texte JSON.
+ *
+ * Équivalent de `cJSON_PrintUnformatted(unpack_payload(in, entry))`,
+ * au caractère près, mais sans aucune allocation : le texte est écrit
+ * dans le buffer fourni par l’appelant (pile ou anneau), à partir des
+ * fragments de clés pré-rendus par table_load.
+ *
+ * @param[out] buf : buffer de sortie (terminé par '\0').
+ * @param cap : taille du buffer, au moins entry->json_max + 1.
+ * @param frame : charge utile reçue (entry->payload_max octets, complétée par des 0).
+ * @param entry : structure décrivant le message attendu.
+ * @return longueur écrite (hors '\0'), ou 0 en cas d’erreur ou de buffer trop petit.
+ */
+size_t pack_encode_json(char *buf, size_t cap, const uint8_t *frame, const entry_t *entry){
+  static const char hexd[] = "0123456789ABCDEF";
+  if(!buf || !entry) return 0;
+  if(cap <= entry->json_max) return 0;
+
+  char *p = buf;
+  if(entry->field_count == 0) *p++ = '{';
+
+  for(size_t i=0;i<entry->field_count;i++){
+    const field_spec_t *fs = &entry->fields[i];
+    const uint8_t *in = (i < entry->packed_count) ? frame : g_off_frame_zero;
+    memcpy(p, fs->json_key, fs->json_key_len);
+    p += fs->json_key_len;
+    switch(fs->type){
+      case FT_INT:
+      case FT_INT16:
+      case FT_UINT:
+        if(fs->scaled) p = put_double(p, raw_to_value(fs, raw_get(in, fs)));
+        else p = put_uint(p, raw_get(in, fs));
+        break;
+      case FT_SINT:{
+        uint32_t raw = raw_get(in, fs);
+        if(fs->scaled) p = put_double(p, raw_to_value(fs, raw));
+        else if(raw > fs->mask / 2){ *p++ = '-'; p = put_uint(p, fs->mask - raw + 1); }
+        else p = put_uint(p, raw);
+      }break;
+      case FT_FLOAT:
+        p = put_double(p, raw_to_value(fs, raw_get(in, fs)));
+        break;
+      case FT_BOOL:
+        if(raw_get(in, fs)){ memcpy(p, "true", 4);  p += 4; }
+        else               { memcpy(p, "false", 5); p += 5; }
+        break;
+      case FT_HEX:{
+        const uint8_t *src = in + fs->offset;
+        *p++ = '"'; *p++ = '#';
+        for(int k=0;k<3;k++){ *p++ = hexd[src[k] >> 4]; *p++ = hexd[src[k] & 0x0F]; }
+        *p++ = '"';
+      }break;
+      case FT_ENUM:{
+        uint32_t code = raw_get(in, fs);
+        const enum_kv_t *kv = fs->enum_by_code[code];
+        if(kv){ memcpy(p, kv->json, kv->json_len); p += kv->json_len; }
+        else  p = put_uint(p, code);
+      }break;
+    }
+  }
+  *p++ = '}';
+  *p = '\0';
+  return (size_t)(p - buf);
+}
+
+
+/* -------------------------------------------------------------------------- */
+/*                  Analyse JSON directe (MQTT -> CAN, sans DOM)              */
+/* -------------------------------------------------------------------------- */
+
+/* Mêmes limites que cJSON, pour accepter et refuser les mêmes payloads */
+#define JSON_NESTING_LIMIT 1000
+#define JSON_NUMBER_MAX    63
+
+/* Taille max d’une chaîne décodée pour le journal (enum inconnu) ; les
+   clés et libellés d’enum sont comparés en place, sans limite */
+#define JSON_STR_MAX       128
+
+/** @brief Curseur de lecture sur un texte JSON non terminé par '\0'. */
+typedef struct jcur_s {
+  const char *p;
+  const char *end;
+} jcur_t;
+
+/** @brief Nature d’une valeur JSON lue. */
+typedef enum {
+  JV_NULL, JV_FALSE, JV_TRUE, JV_NUMBER, JV_STRING, JV_ARRAY, JV_OBJECT
+} jv_kind_t;
+
+/** @brief Valeur JSON lue (les conteneurs sont validés puis sautés). */
+typedef struct jv_s {
+  jv_kind_t   kind;
+  double      num;       /* JV_NUMBER */
+  const char *str;       /* JV_STRING : contenu brut (échappé), hors guillemets */
+  size_t      str_len;
+} jv_t;
+
+/** @brief État d’un champ pendant l’analyse (erreurs rapportées dans l’ordre des champs). */
+typedef enum {
+  FS_MISSING = 0, FS_OK, FS_BAD_TYPE, FS_RANGE, FS_BAD_HEX, FS_BAD_ENUM
+} field_state_kind_t;
+
+typedef struct field_state_s {
+  uint8_t     state;     /* field_state_kind_t */
+  double      num;       /* FS_RANGE : valeur rapportée */
+  const char *str;       /* FS_BAD_ENUM : chaîne brute */
+  size_t      str_len;
+} field_state_t;
+
+
+/**
+ * @brief Saute les blancs (tout octet <= 32, comme cJSON).
+ */
+static inline void j_ws(jcur_t *c){
+  while(c->p < c->end && (uint8_t)*c->p <= 32) c->p++;
+}
+
+/**
+ * @brief Lit 4 chiffres hexadécimaux (séquence \\uXXXX).
+ */
+static bool j_hex4(const char *s, unsigned *out){
+  unsigned v = 0;
+  for(int i=0;i<4;i++){
+    char ch = s[i];
+    v <<= 4;
+    if(ch>='0' && ch<='9')      v |= (unsigned)(ch-'0');
+    else if(ch>='A' && ch<='F') v |= (unsigned)(ch-'A'+10);
+    else if(ch>='a' && ch<='f') v |= (unsigned)(ch-'a'+10);
+    else return false;
+  }
+  *out = v;
+  return true;
+}
+
+/** @brief Destination du décodage d’une chaîne : copie et/ou comparaison. */
+typedef struct jout_s {
+  char       *out;     /* copie tronquée à cap-1 octets (NULL : aucune) */
+  size_t      cap;
+  const char *cmp;     /* chaîne comparée (NULL : aucune) */
+  size_t      k;       /* octets décodés avant le premier '\0' */
+  bool        cut;     /* copie tronquée */
+  bool        diff;    /* le texte décodé diffère de cmp */
+  bool        nul;     /* '\0' décodé : fin de la chaîne C, comme pour cJSON */
+} jout_t;
+
+/**
+ * @brief Reçoit un octet décodé.
+ */
+static inline void j_put(jout_t *o, unsigned ch){
+  if(o->nul) return;
+  if(ch == 0){ o->nul = true; return; }
+  if(o->out){
+    if(o->k + 1 < o->cap) o->out[o->k] = (char)ch;
+    else o->cut = true;
+  }
+  if(o->cmp && !o->diff && (o->cmp[o->k] == '\0' || (uint8_t)o->cmp[o->k] != (uint8_t)ch)) o->diff = true;
+  o->k++;
+}
+
+/**
+ * @brief Décode le contenu brut d’une chaîne JSON en UTF-8.
+ *
+ * Valide les échappements comme cJSON (y compris les paires de
+ * substitution UTF-16). Les octets décodés vont à o (copie et/ou
+ * comparaison) ; un \u0000 termine la chaîne vue par cJSON et donc ici.
+ *
+ * @param s contenu brut (entre les guillemets).
+ * @param n longueur brute.
+ * @param o destination (NULL : validation seule).
+ * @return false si un échappement est invalide.
+ */
+static bool j_decode_to(const char *s, size_t n, jout_t *o){
+  const char *end = s + n;
+  jout_t none = { 0 };
+  if(!o) o = &none;
+
+  while(s < end){
+    if(*s != '\\'){ j_put(o, (uint8_t)*s); s++; continue; }
+    if(end - s < 2) return false;
+    switch(s[1]){
+      case 'b': j_put(o, '\b'); s += 2; break;
+      case 'f': j_put(o, '\f'); s += 2; break;
+      case 'n': j_put(o, '\n'); s += 2; break;
+      case 'r': j_put(o, '\r'); s += 2; break;
+      case 't': j_put(o, '\t'); s += 2; break;
+      case '"': case '\\': case '/': j_put(o, (uint8_t)s[1]); s += 2; break;
+      case 'u':{
+        unsigned cp, lo;
+        if(end - s < 6 || !j_hex4(s + 2, &cp)) return false;
+        if(cp >= 0xDC00 && cp <= 0xDFFF) return false;
+        s += 6;
+        if(cp >= 0xD800 && cp <= 0xDBFF){
+          if(end - s < 6 || s[0] != '\\' || s[1] != 'u' || !j_hex4(s + 2, &lo)) return false;
+          if(lo < 0xDC00 || lo > 0xDFFF) return false;
+          cp = 0x10000 + (((cp & 0x3FF) << 10) | (lo & 0x3FF));
+          s += 6;
+        }
+        if(cp < 0x80) j_put(o, cp);
+        else if(cp < 0x800){ j_put(o, 0xC0 | (cp >> 6)); j_put(o, 0x80 | (cp & 0x3F)); }
+        else if(cp < 0x10000){ j_put(o, 0xE0 | (cp >> 12)); j_put(o, 0x80 | ((cp >> 6) & 0x3F)); j_put(o, 0x80 | (cp & 0x3F)); }
+        else { j_put(o, 0xF0 | (cp >> 18)); j_put(o, 0x80 | ((cp >> 12) & 0x3F)); j_put(o, 0x80 | ((cp >> 6) & 0x3F)); j_put(o, 0x80 | (cp & 0x3F)); }
+      }break;
+      default:
+        return false;
+    }
+  }
+  return true;
+}
+
+/**
+ * @brief Décode une chaîne JSON (déjà validée) dans un buffer.
+ *
+ * La sortie est tronquée à cap-1 octets et toujours terminée par '\0'.
+ *
+ * @param s contenu brut (entre les guillemets).
+ * @param n longueur brute.
+ * @param[out] out buffer de sortie.
+ * @param cap taille du buffer (1 au moins).
+ * @param[out] trunc mis à true si la sortie a été tronquée (peut être NULL).
+ */
+static void j_decode(const char *s, size_t n, char *out, size_t cap, bool *trunc){
+  jout_t o = { .out = out, .cap = cap };
+  (void)j_decode_to(s, n, &o);
+  out[o.k < cap ? o.k : cap - 1] = '\0';
+  if(trunc) *trunc = o.cut;
+}
+
+/**
+ * @brief Compare une chaîne JSON (déjà validée) décodée à z, en place.
+ *
+ * Même résultat que strcmp(z, chaîne décodée par cJSON) == 0, quelle que
+ * soit la longueur des deux chaînes.
+ */
+static bool j_equals(const char *s, size_t n, const char *z){
+  if(!memchr(s, '\\', n)) return strncmp(z, s, n) == 0 && z[n] == '\0';
+  jout_t o = { .cmp = z };
+  (void)j_decode_to(s, n, &o);
+  return !o.diff && z[o.k] == '\0';
+}
+
+/**
+ * @brief Repère une chaîne JSON (curseur sur '"') et la valide.
+ *
+ * @param c curseur, avancé après le guillemet fermant.
+ * @param[out] str début du contenu brut.
+ * @param[out] len longueur du contenu brut.
+ * @return false si la chaîne est non terminée ou mal échappée.
+ */
+static bool j_string(jcur_t *c, const char **str, size_t *len){
+  if(c->p >= c->end || *c->p != '"') return false;
+  const char *s = ++c->p;
+  while(c->p < c->end && *c->p != '"'){
+    if(*c->p == '\\'){
+      if(c->p + 1 >= c->end) return false;
+      c->p++;
+    }
+    c->p++;
+  }
+  if(c->p >= c->end) return false;
+  *str = s;
+  *len = (size_t)(c->p - s);
+  c->p++;
+  return j_decode_to(s, *len, NULL);
+}
+
+/**
+ * @brief Lit un nombre JSON (même règle que cJSON : strtod sur [0-9+-eE.]).
+ */
+static bool j_number(jcur_t *c, double *out){
+  char tmp[JSON_NUMBER_MAX + 1];
+  size_t n = 0;
+  while(n < JSON_NUMBER_MAX && c->p + n < c->end){
+    char ch = c->p[n];
+    if(!((ch>='0' && ch<='9') || ch=='+' || ch=='-' || ch=='e' || ch=='E' || ch=='.')) break;
+    tmp[n++] = ch;
+  }
+  tmp[n] = '\0';
+  char *after = NULL;
+  *out = strtod(tmp, &after);
+  if(after == tmp) return false;
+  c->p += after - tmp;
+  return true;
+}
+
+/**
+ * @brief Lit une valeur JSON quelconque ; les objets et tableaux sont
+ *        validés puis sautés.
+ *
+ * @param c curseur (blancs déjà sautés).
+ * @param depth profondeur d’imbrication courante.
+ * @param[out] v valeur lue.
+ * @return false si le JSON est invalide.
+ */
+static bool j_value(jcur_t *c, int depth, jv_t *v){
+  size_t left = (size_t)(c->end - c->p);
+  if(left == 0) return false;
+
+  if(left >= 4 && !memcmp(c->p, "null", 4)) { c->p += 4; v->kind = JV_NULL;  return true; }
+  if(left >= 5 && !memcmp(c->p, "false", 5)){ c->p += 5; v->kind = JV_FALSE; return true; }
+  if(left >= 4 && !memcmp(c->p, "true", 4)) { c->p += 4; v->kind = JV_TRUE;  return true; }
+  if(*c->p == '"'){ v->kind = JV_STRING; return j_string(c, &v->str, &v->str_len); }
+  if(*c->p == '-' || (*c->p >= '0' && *c->p <= '9')){ v->kind = JV_NUMBER; return j_number(c, &v->num); }
+
+  if(*c->p == '[' || *c->p == '{'){
+    bool obj = (*c->p == '{');
+    char close = obj ? '}' : ']';
+    if(depth >= JSON_NESTING_LIMIT) return false;
+    v->kind = obj ? JV_OBJECT : JV_ARRAY;
+    c->p++;
+    j_ws(c);
+    if(c->p < c->end && *c->p == close){ c->p++; return true; }
+    for(;;){
+      jv_t sub;
+      j_ws(c);
+      if(obj){
+        const char *k; size_t kl;
+        if(!j_string(c, &k, &kl)) return false;
+        j_ws(c);
+        if(c->p >= c->end || *c->p != ':') return false;
+        c->p++;
+        j_ws(c);
+      }
+      if(!j_value(c, depth + 1, &sub)) return false;
+      j_ws(c);
+      if(c->p >= c->end) return false;
+      if(*c->p == ','){ c->p++; continue; }
+      if(*c->p == close){ c->p++; return true; }
+      return false;
+    }
+  }
+  return false;
+}
+
+/**
+ * @brief Convertit la valeur d’un champ et l’écrit à son offset.
+ *
+ * @param fs champ cible.
+ * @param v valeur lue.
+ * @param[out] out charge utile de sortie.
+ * @param[out] st état du champ.
+ */
+static void j_store_field(const field_spec_t *fs, const jv_t *v, uint8_t *out, field_state_t *st){
+  char buf[8];          /* "#RRGGBB" : plus long, la chaîne est invalide */
+  bool trunc = false;
+
+  st->state = FS_BAD_TYPE;
+  switch(fs->type){
+    case FT_INT:
+    case FT_INT16:
+    case FT_UINT:
+    case FT_SINT:
+    case FT_FLOAT:{
+      if(v->kind != JV_NUMBER) return;
+      uint32_t raw;
+      if(!value_to_raw(fs, v->num, &raw, &st->num)){ st->state = FS_RANGE; return; }
+      raw_put(out, fs, raw);
+    }break;
+    case FT_BOOL:
+      if(v->kind != JV_TRUE && v->kind != JV_FALSE) return;
+      raw_put(out, fs, (v->kind == JV_TRUE) ? 1 : 0);
+      break;
+    case FT_HEX:{
+      if(v->kind != JV_STRING) return;
+      uint8_t *dst = out + fs->offset;
+      uint8_t rgb[3];
+      j_decode(v->str, v->str_len, buf, sizeof(buf), &trunc);
+      if(trunc || !parse_hex_rgb(buf, rgb)){ st->state = FS_BAD_HEX; return; }
+      dst[0]=rgb[0]; dst[1]=rgb[1]; dst[2]=rgb[2];
+    }break;
+    case FT_ENUM:{
+      if(v->kind != JV_STRING) return;
+      const enum_kv_t *kv = fs->enum_list;
+      while(kv && !(kv->key && j_equals(v->str, v->str_len, kv->key))) kv = kv->next;
+      if(!kv){
+        st->state = FS_BAD_ENUM; st->str = v->str; st->str_len = v->str_len;
+        return;
+      }
+      raw_put(out, fs, (uint8_t)(kv->value & 0xFF));
+    }break;
+  }
+  st->state = FS_OK;
+}
+
+/**
+ * @brief Analyse un payload JSON et le packe directement en charge utile CAN.
+ *
+ * Analyse en une seule passe, sans copie ni arbre cJSON : le texte est lu
+ * en place (`msg->payload`, `payloadlen`) et chaque valeur reconnue par la
+ * liste de champs de l’entrée est convertie et écrite à son offset
+ * précompilé. Les autres clés sont validées puis sautées.
+ *
+ * Le comportement reproduit `cJSON_Parse()` + `pack_payload()` :
+ * mêmes JSON acceptés (arrêt au premier '\0', BOM UTF-8 ignoré, texte
+ * après la valeur racine ignoré), première occurrence d’une clé retenue,
+ * et mêmes erreurs rapportées dans l’ordre des champs (champ manquant,
+ * mauvais type, hors plage, hex invalide, enum inconnu).
+ *
+ * @param[out] out : charge utile à remplir (entry->payload_max octets).
+ * @param entry : structure décrivant le message.
+ * @param json : texte JSON (non nécessairement terminé par '\0').
+ * @param len : longueur du texte.
+ * @return PACK_OK, PACK_ERR_JSON (JSON invalide) ou PACK_ERR_FIELD.
+ */
+pack_status_t pack_parse_json(uint8_t *out, const entry_t *entry, const char *json, size_t len){
+  if(!entry) return PACK_ERR_JSON;
+  memset(out,0,entry->payload_max);
+  if(!json || len == 0) return PACK_ERR_JSON;
+
+  len = strnlen(json, len);
+  jcur_t c = { json, json + len };
+  if(len >= 3 && !memcmp(json, "\xEF\xBB\xBF", 3)) c.p += 3;
+  j_ws(&c);
+
+  /* au plus ENTRY_FIELDS_MAX champs (cf. build_fields) ; hors trame dans off, jeté */
+  field_state_t st[ENTRY_FIELDS_MAX];
+  uint8_t off[OFF_FRAME_MAX];
+  size_t nf = entry->field_count;
+  memset(st, 0, nf * sizeof(st[0]));
+  if(entry->packed_count < nf) memset(off, 0, sizeof(off));
+
+  if(c.p < c.end && *c.p == '{'){
+    c.p++;
+    j_ws(&c);
+    if(c.p < c.end && *c.p == '}') c.p++;
+    else for(;;){
+      const char *k; size_t kl;
+      jv_t v;
+
+      j_ws(&c);
+      if(!j_string(&c, &k, &kl)) return PACK_ERR_JSON;
+      j_ws(&c);
+      if(c.p >= c.end || *c.p != ':') return PACK_ERR_JSON;
+      c.p++;
+      j_ws(&c);
+      if(!j_value(&c, 1, &v)) return PACK_ERR_JSON;
+
+      for(size_t i=0; i<nf; i++){
+        if(!j_equals(k, kl, entry->fields[i].name)) continue;
+        if(st[i].state == FS_MISSING) j_store_field(&entry->fields[i], &v, (i < entry->packed_count) ? out : off, &st[i]);
+        break;
+      }
+
+      j_ws(&c);
+      if(c.p >= c.end) return PACK_ERR_JSON;
+      if(*c.p == ','){ c.p++; continue; }
+      if(*c.p == '}'){ c.p++; break; }
+      return PACK_ERR_JSON;
+    }
+  } else {
+    /* JSON valide mais pas un objet : tous les champs sont manquants */
+    jv_t v;
+    if(!j_value(&c, 0, &v)) return PACK_ERR_JSON;
+  }
+
+  /* Rapport d’erreurs dans l’ordre des champs, comme pack_payload() */
+  for(size_t i=0;i<nf;i++){
+    const field_spec_t *fs = &entry->fields[i];
+    char buf[JSON_STR_MAX];
+    switch(st[i].state){
+      case FS_OK:
+        continue;
+      case FS_MISSING:
+        LOGW("Champ manquant: %s", fs->name);
+        break;
+      case FS_BAD_TYPE:
+        LOGW("Type %s attendu pour %s", type_hint(fs->type), fs->name);
+        break;
+      case FS_RANGE:
+        LOGW("Valeur %s hors plage: %.15g", fs->name, st[i].num);
+        break;
+      case FS_BAD_HEX:
+        LOGW("Format hex invalide pour %s", fs->name);
+        break;
+      case FS_BAD_ENUM:
+        j_decode(st[i].str, st[i].str_len, buf, sizeof(buf), NULL);
+        LOGW("Valeur enum inconnue '%s' pour %s", buf, fs->name);
+        break;
+    }
+    return PACK_ERR_FIELD;
+  }
+  return PACK_OK;
 }
 
 // End of file
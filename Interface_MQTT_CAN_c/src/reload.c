@@ -0,0 +1,190 @@
+/**
+ * @file reload.c
+ * @brief Rechargement à chaud du dictionnaire de conversion.
+ *
+ * La nouvelle table est construite à côté de la table courante, puis
+ * publiée par table_rcu_swap() : les lectures en cours (on_message(),
+ * réception CAN) se terminent sur l’ancienne table, les suivantes voient
+ * la nouvelle, sans verrou côté lecteurs. Les filtres CAN et les
+ * abonnements MQTT sont ensuite mis à jour, sans fermer ni la socket
+ * CAN ni la session MQTT.
+ *
+ * Les durées de chargement et de bascule (attente des lecteurs incluse)
+ * sont journalisées.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include <stdalign.h>
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <libgen.h>
+
+#include <sys/inotify.h>
+
+#include "types.h"
+#include "table.h"
+#include "mqtt_io.h"
+#include "spsc.h"
+#include "can_io.h"
+#include "log.h"
+#include "metrics.h"
+#include "reload.h"
+
+
+/**
+ * @brief Prépare le rechargement de path.
+ *
+ * La surveillance porte sur le répertoire du fichier (IN_CLOSE_WRITE,
+ * IN_MOVED_TO) ; si inotify est indisponible, seul SIGHUP reste actif.
+ *
+ * @param r : contexte à initialiser.
+ * @param path : chemin de conversion.json (doit rester valide).
+ * @param tables : table courante.
+ * @param can : contexte CAN (filtres).
+ * @param mqtt : contexte MQTT (abonnements).
+ * @return true si succès.
+ */
+bool
+reload_init (reload_t *r, const char *path, table_rcu_t *tables, can_ctx_t *can, mqtt_ctx_t *mqtt)
+{
+  if (!r || !path || !tables)
+    return false;
+  memset (r, 0, sizeof (*r));
+  r->tables = tables;
+  r->can = can;
+  r->mqtt = mqtt;
+  r->path = path;
+  r->ifd = -1;
+  atomic_init (&r->requested, 0);
+
+  const char *slash = strrchr (path, '/');
+  r->name = slash ? slash + 1 : path;
+
+  char dir[4096];
+  snprintf (dir, sizeof (dir), "%s", path);
+  int fd = inotify_init1 (IN_NONBLOCK | IN_CLOEXEC);
+  if (fd < 0 || inotify_add_watch (fd, dirname (dir), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+      LOGW ("inotify indisponible (%s), rechargement par SIGHUP uniquement", strerror (errno));
+      if (fd >= 0)
+        close (fd);
+      return true;
+    }
+  r->ifd = fd;
+  return true;
+}
+
+/**
+ * @brief Ferme la surveillance du fichier.
+ */
+void
+reload_cleanup (reload_t *r)
+{
+  if (r && r->ifd >= 0)
+    {
+      close (r->ifd);
+      r->ifd = -1;
+    }
+}
+
+/**
+ * @brief Descripteur inotify (pour poll/epoll), -1 si indisponible.
+ */
+int
+reload_fd (const reload_t *r)
+{
+  return r ? r->ifd : -1;
+}
+
+/**
+ * @brief Demande un rechargement (async-signal-safe).
+ */
+void
+reload_request (reload_t *r)
+{
+  atomic_store (&r->requested, 1);
+}
+
+/**
+ * @brief Traite les événements en attente, sans bloquer.
+ *
+ * Plusieurs événements successifs (écriture puis renommage par un
+ * éditeur) ne provoquent qu’un seul rechargement.
+ *
+ * @param r : contexte de rechargement.
+ * @return true si un rechargement a eu lieu et a réussi.
+ */
+bool
+reload_poll (reload_t *r)
+{
+  if (!r)
+    return false;
+  bool changed = atomic_exchange (&r->requested, 0) != 0;
+
+  if (r->ifd >= 0)
+    {
+      alignas (struct inotify_event) char buf[4096];
+      ssize_t n;
+      while ((n = read (r->ifd, buf, sizeof (buf))) > 0)
+        {
+          for (char *p = buf; p < buf + n;)
+            {
+              const struct inotify_event *ev = (const struct inotify_event *) p;
+              if (ev->len && strcmp (ev->name, r->name) == 0)
+                changed = true;
+              p += sizeof (*ev) + ev->len;
+            }
+        }
+    }
+
+  return changed && reload_now (r);
+}
+
+/**
+ * @brief Recharge conversion.json et bascule sur la nouvelle table.
+ *
+ * @param r : contexte de rechargement.
+ * @return true si la nouvelle table est en service.
+ */
+bool
+reload_now (reload_t *r)
+{
+  uint64_t t0 = metrics_now_ns ();
+
+  table_t *nt = (table_t *) malloc (sizeof (*nt));
+  if (!nt)
+    return false;
+  if (!table_load (nt, r->path))
+    {
+      LOGW ("Rechargement de %s refusé, table précédente conservée", r->path);
+      table_free (nt);
+      free (nt);
+      return false;
+    }
+  uint64_t t1 = metrics_now_ns ();
+
+  table_t *old = table_rcu_swap (r->tables, nt);
+  uint64_t t2 = metrics_now_ns ();
+
+  if (r->can && !can_set_filters (r->can, nt))
+    LOGW ("Filtres CAN non mis à jour %c", 0);
+  if (r->mqtt && !mqtt_subscribe_table (r->mqtt, nt))
+    LOGW ("Abonnements MQTT non mis à jour %c", 0);
+  uint64_t t3 = metrics_now_ns ();
+
+  table_free (old);
+  free (old);
+
+  LOGI ("Table rechargée: %zu entrées, chargement %.2f ms, bascule %.1f us, filtres+abonnements %.2f ms",
+        nt->entry_count, (double) (t1 - t0) / 1e6, (double) (t2 - t1) / 1e3, (double) (t3 - t2) / 1e6);
+  return true;
+}
+
+// End of file
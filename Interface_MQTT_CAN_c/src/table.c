@@ -8,7 +8,8 @@
  * - et un identifiant CAN (valeur numérique)
  *
  * Chaque entrée décrit la structure des données associées
- * (noms, types, enums, etc.).
+ * (noms, types, enums, etc.). Un fichier DBC peut remplacer le JSON
+ * (cf. dbc.c).
  *
  * Ce fichier joue donc un rôle essentiel : il définit la "grammaire"
  * du pont MQTT/CAN.
@@ -21,92 +22,672 @@
 #include <string.h>
 #include <stdlib.h>
 #include <strings.h>
+#include <stdatomic.h>
+#include <sched.h>
 #include <cjson/cJSON.h>
 
 #include "types.h"
 #include "log.h"
 #include "table.h"
+#include "dict_image.h"
+#include "dbc.h"
+
+/* Alignement des structures allouées dans l’arène */
+#define ARENA_ALIGN 8u
+
+/* Élément de la pile du parcours de conversion.json */
+typedef struct dfs_item_s {
+  cJSON        *node;
+  route_mode_t  route;          /* routage hérité du groupe */
+  uint32_t      transport_id;
+  bool          fd;             /* trames CAN FD */
+  bool          seg;            /* message segmenté (ISO-TP) */
+  bool          ext;            /* ID étendu (29 bits) */
+  pub_policy_t  pub;            /* politique de publication héritée */
+  cmd_policy_t  cmd;            /* limitation des commandes héritée */
+} dfs_item_t;
+
+/* Entrée relevée par le parcours, construite une fois l’arène dimensionnée */
+typedef struct cand_s {
+  cJSON        *jtopic;
+  cJSON        *jdata;
+  uint32_t      can_id;
+  route_mode_t  route;
+  uint32_t      transport_id;
+  bool          fd;
+  bool          seg;
+  pub_policy_t  pub;
+  cmd_policy_t  cmd;
+} cand_t;
+
+/* Arène de la table : un bloc unique, dimensionné avant la construction */
+typedef struct arena_s {
+  uint8_t *base;
+  size_t   used, size;
+} arena_t;
+
+/* Pool de chaînes internées (index temporaire, chaînes dans l’arène) */
+typedef struct strpool_s {
+  arena_t     *arena;
+  const char **slots;
+  uint32_t    *hash;
+  size_t       mask;
+} strpool_t;
 
 /**
- * @brief Duplique une chaîne de caractères.
- * 
- * @param s chaîne d’entrée.
- * @return copie allouée dynamiquement (à libérer plus tard).
+ * @brief Réserve n octets dans l’arène (mémoire déjà à zéro).
+ *
+ * @param a arène.
+ * @param n taille demandée.
+ * @param align alignement (puissance de 2).
+ * @return zone réservée, NULL si l’arène est pleine.
  */
-static char* sdup(const char *s){
-  if(!s) return NULL;
-  size_t n = strlen(s) + 1;
-  char *p = (char*)malloc(n);
-  if(p) memcpy(p, s, n);
-  return p;
+static void* arena_alloc(arena_t *a, size_t n, size_t align){
+  size_t off = (a->used + align - 1) & ~(align - 1);
+  if(off > a->size || n > a->size - off) return NULL;
+  a->used = off + n;
+  return a->base + off;
 }
 
 /**
- * @brief Crée une liste chaînée des paires clé/valeur pour un champ "enum".
+ * @brief Interprète le type d’un champ à partir d’une chaîne.
  *
- * Exemple :  
- * ```json
- * "mode": { "ON":1, "OFF":2, "AUTO":3 }
- * ```
+ * Exemples :
+ * - "int", "uint8" → FT_INT (8 bits)
+ * - "hex" → FT_HEX  
+ * - "int16", "uint16" → FT_INT16 (16 bits)
+ * - "enum" → FT_ENUM  
+ * - "int32", "uint32" → FT_UINT (32 bits)
+ * - "sint8", "sint16", "sint32" (ou "i8", "i16", "i32") → FT_SINT
+ * - "float", "float32" → FT_FLOAT
  *
- * @param obj objet JSON représentant le dictionnaire enum.
- * @return pointeur vers la liste allouée.
+ * Comme "int16", "int32" est non signé ; les entiers signés sont les
+ * types "sint".
+ *
+ * @param s chaîne du type lue dans le JSON.
+ * @param[out] type type de champ correspondant (FT_INT si inconnu).
+ * @param[out] bits largeur par défaut du type, en bits.
+ * @return false si le type est inconnu.
  */
-static enum_kv_t* enum_list_from_obj(cJSON *obj){
-  if(!obj || !cJSON_IsObject(obj)) return NULL;
-  enum_kv_t *head = NULL, *tail = NULL;
-  for(cJSON *it = obj->child; it; it = it->next){
-    if(!it->string || !cJSON_IsNumber(it)) continue;
-    enum_kv_t *node = (enum_kv_t*)calloc(1, sizeof(enum_kv_t));
-    if(!node) break;
-    node->key   = sdup(it->string);
-    node->value = (int)it->valuedouble;
-    if(!head) head = tail = node; else { tail->next = node; tail = node; }
+static bool parse_type(const char *s, field_type_t *type, uint8_t *bits){
+  static const struct { const char *name; field_type_t type; uint8_t bits; } types[] = {
+    { "int", FT_INT, 8 },       { "uint8", FT_INT, 8 },     { "u8", FT_INT, 8 },
+    { "bool", FT_BOOL, 8 },     { "boolean", FT_BOOL, 8 },
+    { "hex", FT_HEX, 24 },      { "rgb", FT_HEX, 24 },
+    { "int16", FT_INT16, 16 },  { "u16", FT_INT16, 16 },    { "uint16", FT_INT16, 16 },
+    { "enum", FT_ENUM, 8 },     { "dict", FT_ENUM, 8 },
+    { "int32", FT_UINT, 32 },   { "uint32", FT_UINT, 32 },  { "u32", FT_UINT, 32 },  { "uint", FT_UINT, 32 },
+    { "sint8", FT_SINT, 8 },    { "i8", FT_SINT, 8 },
+    { "sint16", FT_SINT, 16 },  { "i16", FT_SINT, 16 },
+    { "sint32", FT_SINT, 32 },  { "i32", FT_SINT, 32 },     { "sint", FT_SINT, 32 },
+    { "float", FT_FLOAT, 32 },  { "float32", FT_FLOAT, 32 }, { "f32", FT_FLOAT, 32 },
+  };
+  for(size_t i = 0; s && i < sizeof(types) / sizeof(types[0]); i++){
+    if(strcasecmp(s, types[i].name) != 0) continue;
+    *type = types[i].type;
+    *bits = types[i].bits;
+    return true;
   }
-  return head;
+  *type = FT_INT;
+  *bits = 8;
+  return false;
+}
+
+/**
+ * @brief Hash FNV-1a 32 bits d’une chaîne (index des topics).
+ *
+ * @param s chaîne à hacher.
+ * @return valeur de hash.
+ */
+static uint32_t hash_str(const char *s){
+  uint32_t h = 2166136261u;
+  while(*s){ h ^= (uint8_t)*s++; h *= 16777619u; }
+  return h;
 }
 
 /**
- * @brief Libère la mémoire associée à une liste d’enums.
- * @param kv Pointeur vers la première entrée.
+ * @brief Rend une chaîne interne à la table.
+ *
+ * Les chaînes identiques (noms de champs, clés d’enum, fragments JSON
+ * répétés d’une entrée à l’autre) ne sont stockées qu’une fois.
+ *
+ * @param p pool de chaînes.
+ * @param s chaîne à interner.
+ * @param len longueur de s.
+ * @return copie dans l’arène, NULL si l’arène est pleine.
  */
-static void enum_list_free(enum_kv_t *kv){
-  while(kv){
-    enum_kv_t *n = kv->next;
-    free(kv->key);
-    free(kv);
-    kv = n;
+static const char* pool_intern(strpool_t *p, const char *s, size_t len){
+  uint32_t h = hash_str(s);
+  size_t k = h & p->mask;
+  for(; p->slots[k]; k = (k + 1) & p->mask)
+    if(p->hash[k] == h && strcmp(p->slots[k], s) == 0) return p->slots[k];
+
+  char *c = (char*)arena_alloc(p->arena, len + 1, 1);
+  if(!c) return NULL;
+  memcpy(c, s, len + 1);
+  p->slots[k] = c;
+  p->hash[k]  = h;
+  return c;
+}
+
+/**
+ * @brief Mélange un CAN ID pour l’index par hash (hors plage directe).
+ *
+ * @param id identifiant CAN.
+ * @return valeur de hash.
+ */
+static uint32_t hash_canid(uint32_t id){
+  id ^= id >> 16;
+  id *= 0x7feb352du;
+  id ^= id >> 15;
+  return id;
+}
+
+/**
+ * @brief Calcule un nombre de slots (puissance de 2) pour n clés.
+ *
+ * Le facteur de charge reste inférieur à 50 % afin de garder des
+ * sondages courts.
+ *
+ * @param n nombre de clés.
+ * @return nombre de slots.
+ */
+static size_t slots_for(size_t n){
+  size_t cap = 8;
+  while(cap < 2 * n) cap <<= 1;
+  return cap;
+}
+
+/**
+ * @brief Clé de routage tunnel : ID de transport et inner ID (16 bits).
+ */
+static uint32_t route_key(uint32_t transport_id, uint32_t inner_id){
+  return (transport_id << 16) | (inner_id & 0xFFFFu);
+}
+
+/**
+ * @brief Taille des index d’une table de n entrées (pour l’arène).
+ */
+static size_t index_bytes(size_t n){
+  return 3 * n * sizeof(uint32_t)                       /* champs chauds */
+       + 3 * slots_for(n) * sizeof(uint32_t)            /* topic, can_id, route */
+       + TABLE_CANID_DIRECT * (sizeof(uint32_t) + 1)    /* accès direct, transports */
+       + 8 * ARENA_ALIGN;
+}
+
+/**
+ * @brief Construit les index de recherche (topic, CAN ID et routage tunnel).
+ *
+ * - champs chauds (hash du topic, can_id, clé de routage) recopiés dans
+ *   des tableaux parallèles, seuls lus pendant les sondages ;
+ * - topics : table de hash à adressage ouvert (sondage linéaire) ;
+ * - CAN ID < TABLE_CANID_DIRECT : tableau à accès direct ;
+ * - autres CAN ID : table de hash à adressage ouvert ;
+ * - IDs de transport : tableau à accès direct, puis (transport, inner ID)
+ *   dans une table de hash.
+ *
+ * En cas de doublon, la première entrée rencontrée est conservée
+ * (même comportement que l’ancien parcours linéaire).
+ *
+ * @param t table dont les entrées sont déjà chargées.
+ * @param a arène de la table (dimensionnée avec index_bytes()).
+ * @return true si succès, false si l’arène est pleine.
+ */
+static bool table_build_index(table_t *t, arena_t *a){
+  size_t n = t->entry_count, cap = slots_for(n);
+
+  t->entry_hash    = (uint32_t*)arena_alloc(a, n * sizeof(uint32_t), ARENA_ALIGN);
+  t->entry_canid   = (uint32_t*)arena_alloc(a, n * sizeof(uint32_t), ARENA_ALIGN);
+  t->entry_route   = (uint32_t*)arena_alloc(a, n * sizeof(uint32_t), ARENA_ALIGN);
+  t->topic_slots   = (uint32_t*)arena_alloc(a, cap * sizeof(uint32_t), ARENA_ALIGN);
+  t->canid_slots   = (uint32_t*)arena_alloc(a, cap * sizeof(uint32_t), ARENA_ALIGN);
+  t->route_slots   = (uint32_t*)arena_alloc(a, cap * sizeof(uint32_t), ARENA_ALIGN);
+  t->canid_direct  = (uint32_t*)arena_alloc(a, TABLE_CANID_DIRECT * sizeof(uint32_t), ARENA_ALIGN);
+  t->transport_map = (uint8_t*)arena_alloc(a, TABLE_CANID_DIRECT, 1);
+  if(!t->entry_hash || !t->entry_canid || !t->entry_route || !t->topic_slots ||
+     !t->canid_slots || !t->canid_direct || !t->route_slots || !t->transport_map) return false;
+  t->topic_mask = cap - 1;
+  t->canid_mask = cap - 1;
+  t->route_mask = cap - 1;
+
+  for(size_t i = 0; i < n; i++){
+    const entry_t *e = &t->entries[i];
+    t->entry_hash[i]  = hash_str(e->topic);
+    t->entry_canid[i] = e->can_id;
+    t->entry_route[i] = route_key(e->transport_id, e->can_id);
   }
+
+  for(size_t i = 0; i < n; i++){
+    const entry_t *e = &t->entries[i];
+    uint32_t h = t->entry_hash[i];
+
+    size_t k = h & t->topic_mask;
+    bool dup = false;
+    while(t->topic_slots[k]){
+      uint32_t o = t->topic_slots[k] - 1;
+      if(t->entry_hash[o] == h && strcmp(t->entries[o].topic, e->topic) == 0){ dup = true; break; }
+      k = (k + 1) & t->topic_mask;
+    }
+    if(dup) LOGW("Topic en double ignoré par l’index: %s", e->topic);
+    else    t->topic_slots[k] = (uint32_t)(i + 1);
+
+    if(e->route == ROUTE_TUNNEL){
+      if(!t->transport_map[e->transport_id]){ t->transport_map[e->transport_id] = 1; t->transport_count++; }
+      uint32_t key = t->entry_route[i];
+      k = hash_canid(key) & t->route_mask;
+      while(t->route_slots[k] && t->entry_route[t->route_slots[k] - 1] != key)
+        k = (k + 1) & t->route_mask;
+      if(!t->route_slots[k]) t->route_slots[k] = (uint32_t)(i + 1);
+    }
+
+    if(e->can_id < TABLE_CANID_DIRECT){
+      if(!t->canid_direct[e->can_id]) t->canid_direct[e->can_id] = (uint32_t)(i + 1);
+      continue;
+    }
+    k = hash_canid(e->can_id) & t->canid_mask;
+    while(t->canid_slots[k] && t->entry_canid[t->canid_slots[k] - 1] != e->can_id)
+      k = (k + 1) & t->canid_mask;
+    if(!t->canid_slots[k]) t->canid_slots[k] = (uint32_t)(i + 1);
+  }
+
+  /* Un ID de transport est toujours décodé en tunnel */
+  for(size_t i = 0; i < n; i++){
+    const entry_t *e = &t->entries[i];
+    if(e->can_id < TABLE_CANID_DIRECT && t->transport_map[e->can_id])
+      LOGW("ID 0x%X utilisé comme transport tunnel : %s non joignable en direct", e->can_id, e->topic);
+  }
+  return true;
 }
 
 /**
- * @brief Interprète le type d’un champ à partir d’une chaîne.
+ * @brief Lit les options de routage d’un nœud (entrée ou groupe).
  *
- * Exemples :
- * - "int" → FT_INT  
- * - "hex" → FT_HEX  
- * - "enum" → FT_ENUM  
+ * Clés reconnues :
+ * - `"transport"` : `"tunnel"` ou `"direct"` ;
+ * - `"transport_id"` : ID de transport tunnel (11 bits) ;
+ * - `"can_fd"` : `true` pour des trames CAN FD (jusqu’à 64 octets) ;
+ * - `"segmented"` : `true` pour un message segmenté sur plusieurs trames
+ *   (ISO-TP, jusqu’à ENTRY_PAYLOAD_MAX octets, cf. isotp.h) ;
+ * - `"extended"` : `true` pour un ID étendu sur 29 bits, même inférieur à
+ *   0x800 (implicite au-delà de 11 bits en direct, cf. table_build()).
  *
- * @param s chaîne du type lue dans le JSON.
- * @return type de champ correspondant.
+ * Les valeurs absentes ou invalides laissent les valeurs héritées.
+ *
+ * @param node objet JSON.
+ * @param[in,out] route mode hérité, remplacé si précisé.
+ * @param[in,out] transport_id ID hérité, remplacé si précisé.
+ * @param[in,out] fd CAN FD hérité, remplacé si précisé.
+ * @param[in,out] seg segmentation héritée, remplacée si précisée.
+ * @param[in,out] ext ID étendu hérité, remplacé si précisé.
+ */
+static void route_from_node(cJSON *node, route_mode_t *route, uint32_t *transport_id, bool *fd, bool *seg, bool *ext){
+  cJSON *jm = cJSON_GetObjectItemCaseSensitive(node, "transport");
+  if(jm && cJSON_IsString(jm)){
+    if(strcasecmp(jm->valuestring, "tunnel") == 0)      *route = ROUTE_TUNNEL;
+    else if(strcasecmp(jm->valuestring, "direct") == 0) *route = ROUTE_DIRECT;
+    else LOGW("transport inconnu: %s", jm->valuestring);
+  }
+  cJSON *jt = cJSON_GetObjectItemCaseSensitive(node, "transport_id");
+  if(jt && cJSON_IsNumber(jt)){
+    if(jt->valuedouble >= 0 && jt->valuedouble < TABLE_CANID_DIRECT) *transport_id = (uint32_t)jt->valuedouble;
+    else LOGW("transport_id hors plage 11 bits: %g", jt->valuedouble);
+  }
+  cJSON *jf = cJSON_GetObjectItemCaseSensitive(node, "can_fd");
+  if(jf){
+    if(cJSON_IsBool(jf)) *fd = cJSON_IsTrue(jf);
+    else LOGW("can_fd doit être un booléen %c", 0);
+  }
+  cJSON *js = cJSON_GetObjectItemCaseSensitive(node, "segmented");
+  if(js){
+    if(cJSON_IsBool(js)) *seg = cJSON_IsTrue(js);
+    else LOGW("segmented doit être un booléen %c", 0);
+  }
+  cJSON *je = cJSON_GetObjectItemCaseSensitive(node, "extended");
+  if(je){
+    if(cJSON_IsBool(je)) *ext = cJSON_IsTrue(je);
+    else LOGW("extended doit être un booléen %c", 0);
+  }
+}
+
+/**
+ * @brief Lit une durée positive (en ms) d’un nœud.
+ *
+ * @param node objet JSON.
+ * @param key clé de la durée.
+ * @param scale nombre de ms par unité (1 pour "_ms", 1000 pour "_s").
+ * @param[in,out] ms valeur héritée, remplacée si précisée.
  */
-static field_type_t parse_type(const char *s){
-  if(!s) return FT_INT;
-  if(!strcasecmp(s, "int"))     return FT_INT;
-  if(!strcasecmp(s, "bool") || !strcasecmp(s, "boolean")) return FT_BOOL;
-  if(!strcasecmp(s, "hex")  || !strcasecmp(s, "rgb"))     return FT_HEX;
-  if(!strcasecmp(s, "int16")|| !strcasecmp(s,"u16") || !strcasecmp(s,"uint16")) return FT_INT16;
-  if(!strcasecmp(s, "enum") || !strcasecmp(s, "dict"))    return FT_ENUM;
-  return FT_INT;
+static void duration_from_node(cJSON *node, const char *key, double scale, uint32_t *ms){
+  cJSON *j = cJSON_GetObjectItemCaseSensitive(node, key);
+  if(!j) return;
+  if(cJSON_IsNumber(j) && j->valuedouble >= 0 && j->valuedouble * scale < 4294967295.0) *ms = (uint32_t)(j->valuedouble * scale);
+  else LOGW("%s invalide", key);
+}
+
+/**
+ * @brief Lit la politique de publication CAN -> MQTT d’un nœud (entrée ou groupe).
+ *
+ * Clés reconnues :
+ * - `"publish"` : `"always"` (chaque trame) ou `"change"` (seulement si
+ *   le payload diffère du dernier publié) ;
+ * - `"min_interval_ms"` : au plus une publication par période ;
+ * - `"heartbeat_s"` : avec `"change"`, republie un payload inchangé
+ *   après ce délai.
+ *
+ * Les valeurs absentes ou invalides laissent les valeurs héritées.
+ *
+ * @param node objet JSON.
+ * @param[in,out] pub politique héritée, modifiée si précisée.
+ */
+static void policy_from_node(cJSON *node, pub_policy_t *pub){
+  cJSON *jp = cJSON_GetObjectItemCaseSensitive(node, "publish");
+  if(jp && cJSON_IsString(jp)){
+    if(strcasecmp(jp->valuestring, "always") == 0)      pub->on_change = false;
+    else if(strcasecmp(jp->valuestring, "change") == 0) pub->on_change = true;
+    else LOGW("publish inconnu: %s", jp->valuestring);
+  }
+  duration_from_node(node, "min_interval_ms", 1.0, &pub->min_interval_ms);
+  duration_from_node(node, "heartbeat_s", 1000.0, &pub->heartbeat_ms);
+}
+
+/**
+ * @brief Lit la limitation des commandes MQTT -> CAN d’un nœud (entrée ou groupe).
+ *
+ * Clés reconnues :
+ * - `"cmd_rate_hz"` : débit maximal soutenu (seau à jetons, 0 = sans limite) ;
+ * - `"cmd_burst"` : nombre de commandes acceptées d’affilée (défaut 1) ;
+ * - `"cmd_coalesce_ms"` : après un envoi, les commandes suivantes sont
+ *   retenues pendant cette fenêtre et seule la dernière est envoyée.
+ *
+ * Les valeurs absentes ou invalides laissent les valeurs héritées.
+ *
+ * @param node objet JSON.
+ * @param[in,out] cmd limitation héritée, modifiée si précisée.
+ */
+static void cmd_policy_from_node(cJSON *node, cmd_policy_t *cmd){
+  cJSON *jr = cJSON_GetObjectItemCaseSensitive(node, "cmd_rate_hz");
+  if(jr){
+    if(cJSON_IsNumber(jr) && jr->valuedouble == 0) cmd->interval_us = 0;
+    else if(cJSON_IsNumber(jr) && jr->valuedouble >= 0.001 && jr->valuedouble <= 1e6) cmd->interval_us = (uint32_t)(1e6 / jr->valuedouble);
+    else LOGW("cmd_rate_hz invalide %c", 0);
+  }
+  cJSON *jb = cJSON_GetObjectItemCaseSensitive(node, "cmd_burst");
+  if(jb){
+    if(cJSON_IsNumber(jb) && jb->valuedouble >= 1 && jb->valuedouble <= 65535) cmd->burst = (uint32_t)jb->valuedouble;
+    else LOGW("cmd_burst invalide %c", 0);
+  }
+  duration_from_node(node, "cmd_coalesce_ms", 1.0, &cmd->coalesce_ms);
+}
+
+/**
+ * @brief Place un champ dans la charge utile et précompile son accès.
+ *
+ * Un champ sans `start_bit` suit le précédent : sur l’octet suivant s’il
+ * fait un nombre entier d’octets (ordre big-endian par défaut, comme
+ * l’int16 d’origine), sinon bit à bit, poids faible en tête (ordre
+ * Intel). Un `start_bit` suit la convention DBC : bit de poids faible en
+ * ordre Intel, bit de poids fort en ordre Motorola (big-endian), les bits
+ * étant numérotés octet * 8 + rang dans l’octet (0 = poids faible).
+ *
+ * Les octets couverts, le décalage et le masque sont calculés ici :
+ * pack/unpack n’ont plus qu’un décalage et un masque à appliquer.
+ *
+ * @param fs champ (type, bits, little et start_bit renseignés).
+ * @param[in,out] cursor prochain bit libre (numérotation Intel).
+ * @param cap taille de la charge utile en octets.
+ * @return true si le champ tient dans la charge utile.
+ */
+static bool field_layout(field_spec_t *fs, unsigned *cursor, unsigned cap){
+  unsigned bits = fs->bits, start = fs->start_bit, lo, hi, shift;
+  if(start == FIELD_START_AUTO){
+    if(bits % 8 == 0){
+      unsigned at = (*cursor + 7) / 8;
+      start = fs->little ? at * 8 : at * 8 + 7;
+    } else {
+      start = *cursor;
+      fs->little = true;
+    }
+  }
+  if(fs->type == FT_HEX){
+    lo = start / 8; hi = lo + 2; shift = 0;
+  } else if(fs->little){
+    lo = start / 8; hi = (start + bits - 1) / 8; shift = start % 8;
+  } else {
+    unsigned msb = (start / 8) * 8 + 7 - start % 8, lsb = msb + bits - 1;   /* numérotation big-endian */
+    lo = msb / 8; hi = lsb / 8; shift = 7 - lsb % 8;
+  }
+  unsigned end = (fs->little && fs->type != FT_HEX) ? start + bits : (hi + 1) * 8;
+  if(end > *cursor) *cursor = end;
+
+  fs->offset = (uint8_t)(lo < cap ? lo : cap);
+  fs->width  = (uint8_t)(hi - lo + 1);
+  fs->shift  = (uint8_t)shift;
+  fs->mask   = (bits >= 32) ? 0xFFFFFFFFu : ((1u << bits) - 1u);
+  return hi < cap;
+}
+
+/**
+ * @brief Taille maximale d’un fragment JSON rendu depuis s ('\0' compris).
+ */
+static size_t json_fragment_max(const char *s){
+  return 6 * strlen(s) + 5;   /* \u00XX par caractère, lead + 2 guillemets + ':' + '\0' */
+}
+
+/**
+ * @brief Rend une chaîne en fragment JSON : [lead]"texte échappé"[:]
+ *
+ * L’échappement suit celui de cJSON_PrintUnformatted() afin que
+ * l’encodeur direct produise exactement le même texte.
+ * Le fragment est rendu dans scratch (json_fragment_max(s) octets au
+ * moins) puis interné.
+ *
+ * @param p pool de chaînes.
+ * @param scratch tampon de travail.
+ * @param lead caractère de tête ('{', ',' ou '\0' pour aucun).
+ * @param s chaîne à rendre.
+ * @param colon ajouter ':' en fin de fragment.
+ * @param[out] out_len longueur du fragment (hors '\0').
+ * @return fragment interné, ou NULL.
+ */
+static const char* json_fragment(strpool_t *p, char *scratch, char lead, const char *s, bool colon, size_t *out_len){
+  char *o = scratch;
+  if(lead) *o++ = lead;
+  *o++ = '"';
+  for(const char *c = s; *c; c++){
+    uint8_t ch = (uint8_t)*c;
+    switch(ch){
+      case '"':  *o++ = '\\'; *o++ = '"';  break;
+      case '\\': *o++ = '\\'; *o++ = '\\'; break;
+      case '\b': *o++ = '\\'; *o++ = 'b';  break;
+      case '\f': *o++ = '\\'; *o++ = 'f';  break;
+      case '\n': *o++ = '\\'; *o++ = 'n';  break;
+      case '\r': *o++ = '\\'; *o++ = 'r';  break;
+      case '\t': *o++ = '\\'; *o++ = 't';  break;
+      default:
+        if(ch < 32) o += snprintf(o, 7, "\\u%04x", ch);
+        else *o++ = (char)ch;
+    }
+  }
+  *o++ = '"';
+  if(colon) *o++ = ':';
+  *o = '\0';
+  *out_len = (size_t)(o - scratch);
+  return pool_intern(p, scratch, *out_len);
+}
+
+/**
+ * @brief Longueur maximale du texte JSON d’une valeur de champ.
+ *
+ * @param fs champ (déjà compilé pour les enums).
+ * @return nombre maximal de caractères.
+ */
+static size_t field_json_max(const field_spec_t *fs){
+  size_t digits = 1;
+  for(uint32_t m = (fs->type == FT_SINT) ? fs->mask / 2 + 1 : fs->mask; m >= 10; m /= 10) digits++;
+  switch(fs->type){
+    case FT_INT:
+    case FT_INT16:
+    case FT_UINT:  return fs->scaled ? 24 : digits;  /* 255, 65535… ; double : -1.7976931348623157e+308 */
+    case FT_SINT:  return fs->scaled ? 24 : digits + 1;
+    case FT_FLOAT: return 24;
+    case FT_BOOL:  return 5;              /* false */
+    case FT_HEX:   return 9;              /* "#RRGGBB" */
+    case FT_ENUM:{
+      size_t m = 3;                       /* code numérique inconnu */
+      for(enum_kv_t *kv = fs->enum_list; kv; kv = kv->next)
+        if(kv->json_len > m) m = kv->json_len;
+      return m;
+    }
+  }
+  return 0;
+}
+
+/**
+ * @brief Longueur maximale du JSON encodé d’une entrée compilée.
+ *
+ * Calculée par compile_entry(), recontrôlée au chargement d’une image
+ * (cf. dict_image_map()) : pack_encode_json() s’y fie pour ne pas
+ * déborder.
+ *
+ * @param e entrée (clés pré-rendues et enums compilés).
+ * @return valeur de e->json_max (hors '\0').
+ */
+size_t table_json_max(const entry_t *e){
+  size_t n = 2;   /* '{' '}' */
+  for(size_t k = 0; k < e->field_count; k++)
+    n += e->fields[k].json_key_len + field_json_max(&e->fields[k]);
+  return e->field_count ? n - 1 : n;   /* le '{' est inclus dans la première clé */
+}
+
+/**
+ * @brief Précompile la disposition binaire d’une entrée.
+ *
+ * Calcule pour chaque champ ses octets, son décalage et son masque dans
+ * la trame (cf. field_layout()), le nombre de champs qui tiennent dans
+ * la charge utile de l’entrée (8 octets en CAN classique, 64 en CAN FD,
+ * moins les 2 octets d’inner ID en tunnel ; ENTRY_PAYLOAD_MAX pour une
+ * entrée segmentée), au plus ENTRY_PAYLOAD_MAX champs, la longueur de
+ * trame émise, et construit pour les enums un tableau "code → nom"
+ * (256 cases).
+ * pack_payload() / unpack_payload() n’ont plus qu’à suivre ce plan.
+ *
+ * Les fragments JSON des clés (`{"nom":`, `,"nom":`) et des noms d’enum
+ * sont aussi pré-rendus pour pack_encode_json().
+ *
+ * Pour les enums, en cas de codes en double, le premier nom de la liste
+ * l’emporte (comme le parcours de liste d’origine).
+ *
+ * @param e entrée à compiler.
+ * @param a arène de la table.
+ * @param p pool de chaînes.
+ * @param scratch tampon de rendu des fragments JSON.
+ * @return true si succès, false si l’arène est pleine.
+ */
+static bool compile_entry(entry_t *e, arena_t *a, strpool_t *p, char *scratch){
+  unsigned cursor = 0, used = 0;
+  unsigned hdr = (e->route == ROUTE_TUNNEL) ? 2 : 0;
+  unsigned cap = e->seg ? ENTRY_PAYLOAD_MAX : (e->fd ? CAN_PAYLOAD_MAX : 8) - hdr;
+  e->payload_max = (uint8_t)cap;
+  e->packed_count = 0;
+
+  for(size_t k = 0; k < e->field_count; k++){
+    field_spec_t *fs = &e->fields[k];
+    if(field_layout(fs, &cursor, cap) && e->packed_count == k){
+      e->packed_count = k + 1;
+      if(fs->offset + fs->width > used) used = fs->offset + fs->width;
+    }
+
+    fs->json_key = json_fragment(p, scratch, k ? ',' : '{', fs->name, true, &fs->json_key_len);
+    if(!fs->json_key) return false;
+
+    if(fs->type == FT_ENUM){
+      const enum_kv_t **by_code = (const enum_kv_t**)arena_alloc(a, 256 * sizeof(const enum_kv_t*), ARENA_ALIGN);
+      if(!by_code) return false;
+      fs->enum_by_code = by_code;
+      for(enum_kv_t *kv = fs->enum_list; kv; kv = kv->next){
+        uint8_t code = (uint8_t)(kv->value & fs->mask);
+        if(kv->value < 0 || (uint32_t)kv->value > fs->mask)
+          LOGW("%s : valeur %d de '%s' hors des %u bits du champ %s", e->topic, kv->value, kv->key, fs->bits, fs->name);
+        kv->json = json_fragment(p, scratch, '\0', kv->key, false, &kv->json_len);
+        if(!kv->json) return false;
+        if(!by_code[code]) by_code[code] = kv;
+      }
+    }
+  }
+  e->json_max = table_json_max(e);
+
+  e->packed_size = (uint8_t)used;
+  if(e->seg) e->frame_len = e->fd ? CAN_PAYLOAD_MAX : 8;
+  else e->frame_len = e->fd ? can_fd_len(hdr + e->packed_size < 8 ? 8 : hdr + e->packed_size) : 8;
+  if(e->packed_count < e->field_count)
+    LOGW("%s : champ '%s' hors trame (%u octets%s), non émis et lu à 0 avec les suivants%s",
+         e->topic, e->fields[e->packed_count].name, cap, (hdr && !e->seg) ? " après l’inner ID" : "",
+         e->seg ? "" : " (\"can_fd\": true pour des trames de 64 octets, \"segmented\": true sur plusieurs trames)");
+  return true;
 }
 
 /* Accepte:
    - data = array d’objets: [ { "name":"x", "type":"int", "dict":{...} }, ... ]
-   - data = objet        : { "field1":"int", "field2":"hex", ... }
+   - data = objet        : { "field1":"int", "field2":"hex", "field3": { "type":"sint16", ... }, ... }
 */
 
 /**
- * @brief Construit le tableau de champs (nom + type) pour une entrée.
+ * @brief Lit la disposition et la conversion demandées pour un champ.
+ *
+ * Clés reconnues (toutes facultatives) :
+ * - `"bits"` : longueur en bits (1..32, 8 au plus pour un enum ; sans
+ *   effet sur hex et float) ;
+ * - `"start_bit"` : bit de départ, convention DBC (cf. field_layout()) ;
+ * - `"byte_order"` : `"big"` / `"motorola"` (défaut) ou `"little"` / `"intel"` ;
+ * - `"scale"`, `"offset"` : valeur physique = brut * scale + offset
+ *   (types numériques seulement).
+ *
+ * @param it objet JSON du champ.
+ * @param[in,out] fs champ (type et bits par défaut déjà renseignés).
+ * @param topic topic de l’entrée pour les avertissements, NULL : silence.
+ */
+static void field_opts(cJSON *it, field_spec_t *fs, const char *topic){
+  bool numeric = fs->type == FT_INT || fs->type == FT_INT16 || fs->type == FT_UINT ||
+                 fs->type == FT_SINT || fs->type == FT_FLOAT;
+  unsigned max_bits = (fs->type == FT_ENUM) ? 8 : 32;
+
+  cJSON *j = cJSON_GetObjectItemCaseSensitive(it, "bits");
+  if(j && fs->type != FT_HEX && fs->type != FT_FLOAT){
+    if(cJSON_IsNumber(j) && j->valuedouble >= 1 && j->valuedouble <= max_bits) fs->bits = (uint8_t)j->valuedouble;
+    else if(topic) LOGW("%s.%s : bits invalide (1..%u)", topic, fs->name, max_bits);
+  }
+  j = cJSON_GetObjectItemCaseSensitive(it, "start_bit");
+  if(j){
+    if(cJSON_IsNumber(j) && j->valuedouble >= 0 && j->valuedouble < 8 * ENTRY_PAYLOAD_MAX &&
+       (fs->type != FT_HEX || (unsigned)j->valuedouble % 8 == 0)) fs->start_bit = (uint16_t)j->valuedouble;
+    else if(topic) LOGW("%s.%s : start_bit invalide", topic, fs->name);
+  }
+  j = cJSON_GetObjectItemCaseSensitive(it, "byte_order");
+  if(j){
+    const char *s = cJSON_IsString(j) ? j->valuestring : "";
+    if(!strcasecmp(s, "little") || !strcasecmp(s, "intel")) fs->little = true;
+    else if(!strcasecmp(s, "big") || !strcasecmp(s, "motorola")) fs->little = false;
+    else if(topic) LOGW("%s.%s : byte_order inconnu", topic, fs->name);
+  }
+  cJSON *js = cJSON_GetObjectItemCaseSensitive(it, "scale");
+  cJSON *jo = cJSON_GetObjectItemCaseSensitive(it, "offset");
+  if((js || jo) && !numeric){
+    if(topic) LOGW("%s.%s : scale/offset réservés aux types numériques", topic, fs->name);
+    return;
+  }
+  if(js){
+    if(cJSON_IsNumber(js) && js->valuedouble != 0) fs->scale = js->valuedouble;
+    else if(topic) LOGW("%s.%s : scale invalide", topic, fs->name);
+  }
+  if(jo){
+    if(cJSON_IsNumber(jo)) fs->bias = jo->valuedouble;
+    else if(topic) LOGW("%s.%s : offset invalide", topic, fs->name);
+  }
+  fs->scaled = (fs->scale != 1.0 || fs->bias != 0.0);
+}
+
+/**
+ * @brief Décrit un élément de la section "data" d’une entrée.
  *
  * Gère deux formats possibles dans le JSON :
  * 1. Tableau d’objets :
@@ -117,68 +698,185 @@ static field_type_t parse_type(const char *s){
  *    ```json
  *    "data": { "field1":"int", "field2":"bool" }
  *    ```
+ *    une valeur objet portant "type" décrit le champ comme en 1.
+ *
+ * Dans les deux cas, l’objet d’un champ peut préciser sa disposition et
+ * sa conversion (cf. field_opts()). Un type inconnu est lu comme "int".
  *
  * @param data : nœud JSON correspondant à la clé "data".
- * @param[out] out_arr : tableau de champs (alloué).
- * @param[out] out_n : nombre d’éléments dans le tableau.
- * @return true si succès, false sinon.
- */
-static bool build_fields_from_node(cJSON *data, field_spec_t **out_arr, size_t *out_n){
-  *out_arr = NULL; *out_n = 0;
-
-  if(cJSON_IsArray(data)){
-    size_t n = cJSON_GetArraySize(data);
-    if(n == 0) return true;
-    field_spec_t *arr = (field_spec_t*)calloc(n, sizeof(field_spec_t));
-    if(!arr) return false;
-
-    size_t k = 0;
-    for(cJSON *it = data->child; it; it = it->next){
-      if(!cJSON_IsObject(it)) continue;
-      cJSON *jname = cJSON_GetObjectItemCaseSensitive(it, "name");
-      cJSON *jtype = cJSON_GetObjectItemCaseSensitive(it, "type");
-      if(!cJSON_IsString(jname) || !cJSON_IsString(jtype)) continue;
-
-      arr[k].name = sdup(jname->valuestring);
-      arr[k].type = parse_type(jtype->valuestring);
-      arr[k].enum_list = NULL;
-
-      if(arr[k].type == FT_ENUM){
-        cJSON *jdict = cJSON_GetObjectItemCaseSensitive(it, "dict");
-        if(!jdict) jdict = cJSON_GetObjectItemCaseSensitive(it, "enum");
-        arr[k].enum_list = enum_list_from_obj(jdict);
-      }
-      k++;
+ * @param it : élément de data.
+ * @param[out] fs : type, disposition et conversion du champ.
+ * @param[out] dict : dictionnaire d’un champ enum (format tableau), sinon NULL.
+ * @param topic : topic de l’entrée pour les avertissements, NULL : silence.
+ * @return nom du champ, NULL si l’élément est ignoré.
+ */
+static const char* field_desc(cJSON *data, cJSON *it, field_spec_t *fs, cJSON **dict, const char *topic){
+  const char *name = NULL;
+  cJSON *jtype = NULL;
+  *dict = NULL;
+  fs->start_bit = FIELD_START_AUTO;
+  fs->little = false;
+  fs->scale = 1.0;
+  fs->bias = 0.0;
+  fs->scaled = false;
+
+  if(cJSON_IsObject(data)){
+    name = it->string;
+    if(cJSON_IsObject(it)) jtype = cJSON_GetObjectItemCaseSensitive(it, "type");
+    if(!cJSON_IsString(jtype)){
+      fs->name = name;
+      if(!parse_type(cJSON_IsString(it) ? it->valuestring : "int", &fs->type, &fs->bits) && topic)
+        LOGW("%s.%s : type '%s' inconnu, lu comme int", topic, name, it->valuestring);
+      return name;
     }
-    *out_arr = arr; *out_n = k;
-    return true;
+  } else {
+    if(!cJSON_IsObject(it)) return NULL;
+    cJSON *jname = cJSON_GetObjectItemCaseSensitive(it, "name");
+    jtype = cJSON_GetObjectItemCaseSensitive(it, "type");
+    if(!cJSON_IsString(jname) || !cJSON_IsString(jtype)) return NULL;
+    name = jname->valuestring;
   }
 
-  if(cJSON_IsObject(data)){
-    /* { "field":"int", ... } */
-    size_t n = 0;
-    for(cJSON *it = data->child; it; it = it->next) n++;
-    if(n == 0) return true;
-
-    field_spec_t *arr = (field_spec_t*)calloc(n, sizeof(field_spec_t));
-    if(!arr) return false;
-
-    size_t k = 0;
-    for(cJSON *it = data->child; it; it = it->next){
-      arr[k].name = sdup(it->string);
-      arr[k].type = parse_type(cJSON_IsString(it) ? it->valuestring : "int");
-      arr[k].enum_list = NULL;
-      k++;
+  fs->name = name;
+  if(!parse_type(jtype->valuestring, &fs->type, &fs->bits) && topic)
+    LOGW("%s.%s : type '%s' inconnu, lu comme int", topic, name, jtype->valuestring);
+  if(fs->type == FT_ENUM){
+    *dict = cJSON_GetObjectItemCaseSensitive(it, "dict");
+    if(!*dict) *dict = cJSON_GetObjectItemCaseSensitive(it, "enum");
+    if(!cJSON_IsObject(*dict)) *dict = NULL;
+  }
+  field_opts(it, fs, topic);
+  return name;
+}
+
+/**
+ * @brief Indique si un élément d’un dictionnaire enum est une paire valide.
+ */
+static bool enum_item_valid(const cJSON *it){
+  return it->string && cJSON_IsNumber(it);
+}
+
+/**
+ * @brief Crée la liste des paires clé/valeur pour un champ "enum".
+ *
+ * Exemple :
+ * ```json
+ * "mode": { "ON":1, "OFF":2, "AUTO":3 }
+ * ```
+ *
+ * Les nœuds sont contigus dans l’arène (parcours sans saut de cache)
+ * et restent chaînés dans l’ordre du JSON.
+ *
+ * @param obj objet JSON représentant le dictionnaire enum.
+ * @param a arène de la table.
+ * @param p pool de chaînes.
+ * @param[out] out liste créée (NULL si vide).
+ * @return false si l’arène est pleine.
+ */
+static bool enum_list_from_obj(cJSON *obj, arena_t *a, strpool_t *p, enum_kv_t **out){
+  size_t n = 0;
+  *out = NULL;
+  for(cJSON *it = obj->child; it; it = it->next) n += enum_item_valid(it);
+  if(!n) return true;
+
+  enum_kv_t *kv = (enum_kv_t*)arena_alloc(a, n * sizeof(enum_kv_t), ARENA_ALIGN);
+  if(!kv) return false;
+  size_t k = 0;
+  for(cJSON *it = obj->child; it; it = it->next){
+    if(!enum_item_valid(it)) continue;
+    kv[k].key   = pool_intern(p, it->string, strlen(it->string));
+    kv[k].value = (int)it->valuedouble;
+    kv[k].next  = (k + 1 < n) ? &kv[k + 1] : NULL;
+    if(!kv[k++].key) return false;
+  }
+  *out = kv;
+  return true;
+}
+
+/**
+ * @brief Construit le tableau de champs (nom + type) d’une entrée.
+ *
+ * @param e : entrée à compléter.
+ * @param data : nœud JSON correspondant à la clé "data" (tableau ou objet).
+ * @param a : arène de la table.
+ * @param p : pool de chaînes.
+ * @return false si l’arène est pleine.
+ */
+static bool build_fields(entry_t *e, cJSON *data, arena_t *a, strpool_t *p){
+  size_t n = 0;
+  for(cJSON *it = data->child; it; it = it->next) n++;
+  if(n == 0) return true;
+
+  field_spec_t *arr = (field_spec_t*)arena_alloc(a, n * sizeof(field_spec_t), ARENA_ALIGN);
+  if(!arr) return false;
+
+  size_t k = 0;
+  for(cJSON *it = data->child; it; it = it->next){
+    cJSON *dict;
+    field_spec_t *fs = &arr[k];
+    const char *name = field_desc(data, it, fs, &dict, e->topic);
+    if(!name) continue;
+    if(k == ENTRY_FIELDS_MAX){
+      LOGW("%s : plus de %u champs, '%s' et suivants ignorés", e->topic, ENTRY_FIELDS_MAX, name);
+      break;
     }
-    *out_arr = arr; *out_n = n;
-    return true;
+
+    k++;
+    fs->name = pool_intern(p, name, strlen(name));
+    if(!fs->name) return false;
+    if(dict && !enum_list_from_obj(dict, a, p, &fs->enum_list)) return false;
   }
+  e->fields = arr;
+  e->field_count = k;
+  return true;
+}
 
-  return false;
+/**
+ * @brief Majore la place occupée par une chaîne et ses fragments JSON.
+ */
+static size_t str_bytes(const char *s, size_t *nstr, size_t *scratch){
+  size_t f = json_fragment_max(s);
+  if(f > *scratch) *scratch = f;
+  *nstr += 2;
+  return strlen(s) + 1 + f;
+}
+
+/**
+ * @brief Majore la place occupée dans l’arène par une entrée.
+ *
+ * Suit exactement build_fields() / compile_entry() ; les chaînes sont
+ * comptées sans tenir compte de l’internement.
+ *
+ * @param c : entrée relevée.
+ * @param[in,out] nstr : nombre de chaînes (dimension du pool).
+ * @param[in,out] scratch : taille du tampon de rendu des fragments.
+ * @return nombre d’octets.
+ */
+static size_t measure_entry(const cand_t *c, size_t *nstr, size_t *scratch){
+  size_t bytes = str_bytes(c->jtopic->valuestring, nstr, scratch);
+  size_t n = 0;
+  for(cJSON *it = c->jdata->child; it; it = it->next){
+    field_spec_t fs;
+    cJSON *dict;
+    const char *name = field_desc(c->jdata, it, &fs, &dict, NULL);
+    n++;
+    if(!name) continue;
+    bytes += str_bytes(name, nstr, scratch);
+    if(fs.type == FT_ENUM) bytes += 256 * sizeof(const enum_kv_t*) + ARENA_ALIGN;
+    if(!dict) continue;
+    size_t nkv = 0;
+    for(cJSON *kv = dict->child; kv; kv = kv->next){
+      if(!enum_item_valid(kv)) continue;
+      nkv++;
+      bytes += str_bytes(kv->string, nstr, scratch);
+    }
+    bytes += nkv * sizeof(enum_kv_t) + ARENA_ALIGN;
+  }
+  return bytes + n * sizeof(field_spec_t) + ARENA_ALIGN;
 }
 
 /**
- * @brief Charge le fichier JSON et construit la table de correspondance.
+ * @brief Construit la table de correspondance depuis le document JSON.
  *
  * Cette fonction parcourt récursivement tout le JSON à la recherche
  * d’objets contenant :
@@ -186,7 +884,166 @@ static bool build_fields_from_node(cJSON *data, field_spec_t **out_arr, size_t *
  * - un identifiant CAN (`arbitration_id`),
  * - et une section `data` décrivant la structure.
  *
- * Chaque correspondance est ajoutée à la table.
+ * Chaque correspondance est ajoutée à la table. Les clés `transport`
+ * ("tunnel" / "direct"), `transport_id`, `can_fd`, `segmented` et
+ * `extended` d’une entrée ou d’un groupe fixent son acheminement sur le
+ * bus (défaut : tunnel sur TABLE_DEFAULT_TRANSPORT, CAN classique, une
+ * trame, ID standard) ; un groupe les transmet à ses entrées.
+ * Une entrée directe dont l’ID dépasse 11 bits est émise en ID étendu
+ * (29 bits) ; l’inner ID tunnel n’a que 16 bits et ne porte pas de
+ * format étendu, une telle entrée passe donc en direct.
+ * Il en va de même pour la politique de publication CAN -> MQTT
+ * (cf. policy_from_node()) et la limitation des commandes MQTT -> CAN
+ * (cf. cmd_policy_from_node()).
+ *
+ * La table est construite en deux temps : le parcours relève les
+ * entrées et majore la place nécessaire, puis entrées, champs, enums,
+ * chaînes (internées) et index sont placés dans une arène allouée en un
+ * seul bloc. table_free() n’a qu’un bloc à libérer.
+ *
+ * @param t : table à remplir (mise à zéro).
+ * @param root : document JSON, libéré avant le retour.
+ * @return true si au moins une entrée est chargée, false sinon.
+ */
+static bool table_build(table_t *t, cJSON *root){
+  /* Entrées relevées */
+  size_t cap = 16, n = 0;
+  cand_t *cand = (cand_t*)malloc(cap * sizeof(cand_t));
+  if(!cand){ cJSON_Delete(root); return false; }
+
+  /* DFS sur objets/tableaux (pile extensible : pas de limite de taille).
+     Chaque nœud hérite du routage de son groupe parent. */
+  size_t sp = 0, scap = 64;
+  dfs_item_t *stack = (dfs_item_t*)malloc(scap * sizeof(dfs_item_t));
+  if(!stack){ free(cand); cJSON_Delete(root); return false; }
+  stack[sp++] = (dfs_item_t){ root, ROUTE_TUNNEL, TABLE_DEFAULT_TRANSPORT, false, false, false, { false, 0, 0 }, { 0, 1, 0 } };
+
+  bool ok = true;
+  while(ok && sp > 0){
+    dfs_item_t item = stack[--sp];
+    cJSON *node = item.node;
+    cJSON *skip = NULL;
+
+    if(cJSON_IsObject(node)){
+      route_from_node(node, &item.route, &item.transport_id, &item.fd, &item.seg, &item.ext);
+      policy_from_node(node, &item.pub);
+      cmd_policy_from_node(node, &item.cmd);
+
+      cJSON *jtopic = cJSON_GetObjectItemCaseSensitive(node, "topic");
+      cJSON *jdata  = cJSON_GetObjectItemCaseSensitive(node, "data");
+      cJSON *jid    = cJSON_GetObjectItemCaseSensitive(node, "arbitration_id");
+      if(!jid) jid  = cJSON_GetObjectItemCaseSensitive(node, "id");
+
+      if(jtopic && cJSON_IsString(jtopic) && jdata && jid && cJSON_IsNumber(jid)){
+        skip = jdata;             /* pas d’entrée dans la description des champs */
+        if(!cJSON_IsArray(jdata) && !cJSON_IsObject(jdata)){
+          LOGW("data invalide pour %s", jtopic->valuestring);
+        } else if(jid->valuedouble < 0 || jid->valuedouble > CAN_ID_EXT_MASK){
+          LOGW("arbitration_id hors plage 29 bits pour %s: %g", jtopic->valuestring, jid->valuedouble);
+        } else {
+          if(n == cap){
+            void *tmp = realloc(cand, 2 * cap * sizeof(cand_t));
+            if(!tmp){ ok = false; break; }
+            cand = (cand_t*)tmp;
+            cap *= 2;
+          }
+          cand_t *c = &cand[n++];
+          c->jtopic = jtopic;
+          c->jdata  = jdata;
+          c->can_id = (uint32_t)jid->valuedouble;
+          c->route  = item.route;
+          c->transport_id = item.transport_id;
+          c->fd     = item.fd;
+          c->seg    = item.seg;
+          c->pub    = item.pub;
+          c->cmd    = item.cmd;
+          if(c->route == ROUTE_TUNNEL && c->can_id > 0xFFFFu){
+            LOGW("inner ID 0x%X sur 16 bits impossible, %s passe en direct", c->can_id, jtopic->valuestring);
+            c->route = ROUTE_DIRECT;
+          }
+          if(c->route == ROUTE_TUNNEL && item.ext){
+            LOGW("ID étendu 0x%X impossible en tunnel, %s passe en direct", c->can_id, jtopic->valuestring);
+            c->route = ROUTE_DIRECT;
+          }
+          if(item.ext || (c->route == ROUTE_DIRECT && c->can_id > CAN_ID_STD_MASK))
+            c->can_id |= CAN_ID_EXT;
+        }
+      }
+    }
+    if(!cJSON_IsObject(node) && !cJSON_IsArray(node)) continue;
+
+    for(cJSON *it = node->child; it; it = it->next){
+      if(it == skip || (!cJSON_IsObject(it) && !cJSON_IsArray(it))) continue;
+      if(sp == scap){
+        void *tmp = realloc(stack, 2 * scap * sizeof(dfs_item_t));
+        if(!tmp){ ok = false; break; }
+        stack = (dfs_item_t*)tmp;
+        scap *= 2;
+      }
+      stack[sp++] = (dfs_item_t){ it, item.route, item.transport_id, item.fd, item.seg, item.ext, item.pub, item.cmd };
+    }
+  }
+  free(stack);
+
+  /* Dimensionnement de l’arène, du pool de chaînes et du tampon de rendu */
+  size_t bytes = n * sizeof(entry_t) + index_bytes(n), nstr = 0, scratch_len = 0;
+  for(size_t i = 0; ok && i < n; i++) bytes += measure_entry(&cand[i], &nstr, &scratch_len);
+
+  arena_t a = { NULL, 0, bytes };
+  strpool_t pool = { &a, NULL, NULL, slots_for(nstr) - 1 };
+  char *scratch = NULL;
+  if(ok){
+    a.base       = (uint8_t*)calloc(1, bytes);
+    pool.slots   = (const char**)calloc(pool.mask + 1, sizeof(const char*));
+    pool.hash    = (uint32_t*)malloc((pool.mask + 1) * sizeof(uint32_t));
+    scratch      = (char*)malloc(scratch_len + 1);
+    ok = a.base && pool.slots && pool.hash && scratch;
+  }
+  t->arena   = a.base;
+  t->entries = ok ? (entry_t*)arena_alloc(&a, n * sizeof(entry_t), ARENA_ALIGN) : NULL;
+  ok = ok && t->entries;
+
+  /* Construction, dans l’ordre du document */
+  for(size_t i = 0; ok && i < n; i++){
+    entry_t *e = &t->entries[i];
+    e->topic  = pool_intern(&pool, cand[i].jtopic->valuestring, strlen(cand[i].jtopic->valuestring));
+    e->can_id = cand[i].can_id;
+    e->route  = cand[i].route;
+    e->transport_id = cand[i].transport_id;
+    e->fd     = cand[i].fd;
+    e->seg    = cand[i].seg;
+    e->pub    = cand[i].pub;
+    e->cmd    = cand[i].cmd;
+    ok = e->topic && build_fields(e, cand[i].jdata, &a, &pool) && compile_entry(e, &a, &pool, scratch);
+  }
+  t->entry_count = n;
+  ok = ok && table_build_index(t, &a);
+  t->arena_size = a.used;
+
+  free(scratch);
+  free(pool.hash);
+  free((void*)pool.slots);
+  free(cand);
+  cJSON_Delete(root);
+
+  if(!ok){
+    LOGE("Construction de la table impossible (mémoire) %c", 0);
+    table_free(t);
+    return false;
+  }
+  LOGI("Table chargée: %zu topics, %zu IDs, %zu transport(s) tunnel, %zu octets", n, n, t->transport_count, t->arena_size);
+
+  return (n > 0);
+}
+
+/**
+ * @brief Charge le fichier de configuration et construit la table de correspondance.
+ *
+ * Le format est reconnu au contenu ou à l’extension :
+ * - image compilée par `dictc` (cf. dict_image.c) : mappée directement,
+ *   sans analyse JSON ni allocation ;
+ * - fichier `.dbc` : lu par table_load_dbc() ;
+ * - sinon document JSON (conversion.json, cf. table_build()).
  *
  * @param t : table à remplir.
  * @param json_path : chemin du fichier de configuration.
@@ -196,6 +1053,10 @@ bool table_load(table_t *t, const char *json_path){
   if(!t || !json_path) return false;
   memset(t, 0, sizeof(*t));
 
+  /* Dictionnaire déjà compilé par dictc : mappé tel quel */
+  if(dict_image_is(json_path)) return dict_image_map(t, json_path);
+  if(dbc_is(json_path)) return table_load_dbc(t, json_path);
+
   /* Lire fichier */
   char *txt = NULL;
   {
@@ -214,101 +1075,64 @@ bool table_load(table_t *t, const char *json_path){
   cJSON *root = cJSON_Parse(txt);
   free(txt);
   if(!root){ LOGE("JSON invalide %c", 0); return false; }
+  return table_build(t, root);
+}
 
-  /* Collecte des entrées */
-  size_t cap = 16, n = 0;
-  entry_t *arr = (entry_t*)calloc(cap, sizeof(entry_t));
-  if(!arr){ cJSON_Delete(root); return false; }
-
-  /* DFS sur objets/tableaux */
-  cJSON *stack[64]; int sp = 0;
-  stack[sp++] = root;
-
-  while(sp > 0){
-    cJSON *node = stack[--sp];
-
-    if(cJSON_IsObject(node)){
-      cJSON *jtopic = cJSON_GetObjectItemCaseSensitive(node, "topic");
-      cJSON *jdata  = cJSON_GetObjectItemCaseSensitive(node, "data");
-      cJSON *jid    = cJSON_GetObjectItemCaseSensitive(node, "arbitration_id");
-      if(!jid) jid  = cJSON_GetObjectItemCaseSensitive(node, "id");
-
-      if(jtopic && cJSON_IsString(jtopic) && jdata && jid && cJSON_IsNumber(jid)){
-        if(n == cap){
-          size_t new_cap = cap * 2;
-          void *tmp = realloc(arr, new_cap * sizeof(entry_t));
-          if(!tmp){ free(arr); cJSON_Delete(root); return false; }
-          arr = (entry_t*)tmp;
-          memset(&arr[cap], 0, (new_cap - cap) * sizeof(entry_t));
-          cap = new_cap;
-        }
-
-        entry_t *e = &arr[n];
-        memset(e, 0, sizeof(*e));
-        e->topic  = sdup(jtopic->valuestring);
-        e->can_id = (uint32_t)jid->valuedouble;
-
-        if(!build_fields_from_node(jdata, &e->fields, &e->field_count)){
-          LOGW("data invalide pour %s", e->topic ? e->topic : "(null)");
-        } else {
-          n++;
-        }
-      }
-
-      for(cJSON *it = node->child; it; it = it->next){
-        if(cJSON_IsObject(it) || cJSON_IsArray(it)) stack[sp++] = it;
-      }
-    } else if(cJSON_IsArray(node)){
-      for(cJSON *it = node->child; it; it = it->next){
-        if(cJSON_IsObject(it) || cJSON_IsArray(it)) stack[sp++] = it;
-      }
-    }
-  }
-
-  cJSON_Delete(root);
-
-  t->entries     = arr;
-  t->entry_count = n;
-  LOGI("Table chargée: %zu topics, %zu IDs", n, n);
+/**
+ * @brief Charge un fichier DBC (Vector) et construit la table de correspondance.
+ *
+ * Chaque message BO_ devient une entrée directe sur son ID, chaque signal
+ * SG_ un champ placé à son bit de départ, avec son ordre des octets, son
+ * signe, son facteur et son offset ; une table VAL_ en fait un enum. Le
+ * topic suit la règle de nommage de dbc.h. Le fichier est traduit en
+ * document JSON (cf. dbc.c) puis construit comme conversion.json : la
+ * table obtenue est identique et dictc peut la compiler en image.
+ *
+ * @param t : table à remplir.
+ * @param dbc_path : chemin du fichier DBC.
+ * @return true si le fichier est lu et au moins un message chargé.
+ */
+bool table_load_dbc(table_t *t, const char *dbc_path){
+  if(!t || !dbc_path) return false;
+  memset(t, 0, sizeof(*t));
 
-  return (n > 0);
+  cJSON *root = dbc_to_json(dbc_path);
+  if(!root) return false;
+  return table_build(t, root);
 }
 
 
 /**
  * @brief Libère toute la mémoire associée à une table.
+ *
+ * Un seul bloc (l’arène) pour une table chargée depuis le JSON.
  * 
  * @param t : table à libérer.
  */
 void table_free(table_t *t){
-  if(!t || !t->entries) return;
-  for(size_t i = 0; i < t->entry_count; i++){
-    entry_t *e = &t->entries[i];
-    free(e->topic);
-    if(e->fields){
-      for(size_t k = 0; k < e->field_count; k++){
-        free(e->fields[k].name);
-        enum_list_free(e->fields[k].enum_list);
-      }
-      free(e->fields);
-    }
-  }
-  free(t->entries);
+  if(!t) return;
+  if(t->image){ dict_image_unmap(t); return; }
+  free(t->arena);
   memset(t, 0, sizeof(*t));
 }
 
 
 /**
  * @brief Recherche une entrée à partir d’un topic MQTT.
+ *
+ * Recherche par hash (adressage ouvert) : coût constant quelle que soit
+ * la taille de la table.
  * 
  * @param t : table chargée.
  * @param topic : nom du topic à chercher.
  * @return pointeur vers l’entrée trouvée ou NULL.
  */
 const entry_t* table_find_by_topic(const table_t *t, const char *topic){
-  if(!t || !topic) return NULL;
-  for(size_t i = 0; i < t->entry_count; i++){
-    if(t->entries[i].topic && strcmp(t->entries[i].topic, topic) == 0) return &t->entries[i];
+  if(!t || !topic || !t->topic_slots) return NULL;
+  uint32_t h = hash_str(topic);
+  for(size_t k = h & t->topic_mask; t->topic_slots[k]; k = (k + 1) & t->topic_mask){
+    uint32_t i = t->topic_slots[k] - 1;
+    if(t->entry_hash[i] == h && strcmp(t->entries[i].topic, topic) == 0) return &t->entries[i];
   }
   return NULL;
 }
@@ -316,17 +1140,111 @@ const entry_t* table_find_by_topic(const table_t *t, const char *topic){
 
 /**
  * @brief Recherche une entrée à partir d’un identifiant CAN.
+ *
+ * Accès direct pour les IDs standard, hash pour les autres.
  * 
  * @param t : table chargée.
- * @param can_id : identifiant CAN (11 bits).
+ * @param can_id : identifiant CAN.
  * @return pointeur vers l’entrée trouvée ou NULL.
  */
 const entry_t* table_find_by_canid(const table_t *t, uint32_t can_id){
-  if(!t) return NULL;
-  for(size_t i = 0; i < t->entry_count; i++){
-    if(t->entries[i].can_id == can_id) return &t->entries[i];
+  if(!t || !t->canid_direct) return NULL;
+  if(can_id < TABLE_CANID_DIRECT){
+    uint32_t slot = t->canid_direct[can_id];
+    return slot ? &t->entries[slot - 1] : NULL;
+  }
+  for(size_t k = hash_canid(can_id) & t->canid_mask; t->canid_slots[k]; k = (k + 1) & t->canid_mask){
+    uint32_t i = t->canid_slots[k] - 1;
+    if(t->entry_canid[i] == can_id) return &t->entries[i];
   }
   return NULL;
 }
 
+
+/**
+ * @brief Associe une trame reçue à une entrée.
+ *
+ * Si `can_id` est un ID de transport tunnel, l’inner ID est lu dans les
+ * deux premiers octets et recherché parmi les entrées de ce transport.
+ * Sinon la trame est recherchée par son CAN ID.
+ *
+ * @param t : table chargée.
+ * @param can_id : identifiant CAN de la trame.
+ * @param data : données de la trame.
+ * @param dlc : nombre d’octets valides.
+ * @param[out] hdr : octets d’en-tête à retirer du payload (0 ou 2).
+ * @return pointeur vers l’entrée trouvée ou NULL.
+ */
+const entry_t* table_find_rx(const table_t *t, uint32_t can_id, const uint8_t *data, uint8_t dlc, uint8_t *hdr){
+  *hdr = 0;
+  if(!t || !t->transport_map) return NULL;
+  if(can_id >= TABLE_CANID_DIRECT || !t->transport_map[can_id]) return table_find_by_canid(t, can_id);
+
+  if(dlc < 2) return NULL;
+  uint32_t key = route_key(can_id, ((uint32_t)data[0] << 8) | data[1]);
+  for(size_t k = hash_canid(key) & t->route_mask; t->route_slots[k]; k = (k + 1) & t->route_mask){
+    uint32_t i = t->route_slots[k] - 1;
+    if(t->entry_route[i] == key){ *hdr = 2; return &t->entries[i]; }
+  }
+  return NULL;
+}
+
+/**
+ * @brief Initialise la table courante.
+ *
+ * @param r : poignée à initialiser.
+ * @param t : table déjà chargée (allouée, libérée par l’appelant après table_rcu_swap).
+ */
+void table_rcu_init(table_rcu_t *r, table_t *t){
+  atomic_init(&r->cur, t);
+  atomic_init(&r->epoch, 1);
+  for(int i = 0; i < TABLE_READERS; i++) atomic_init(&r->reader[i], 0);
+}
+
+/**
+ * @brief Début de lecture : rend la table courante, valable jusqu’à table_rcu_leave().
+ *
+ * Sans attente ni verrou : deux écritures/lectures atomiques.
+ *
+ * @param r : poignée.
+ * @param reader : emplacement du thread lecteur (TABLE_READER_*).
+ * @return table courante.
+ */
+const table_t* table_rcu_enter(table_rcu_t *r, int reader){
+  atomic_store(&r->reader[reader], atomic_load(&r->epoch));
+  return atomic_load(&r->cur);
+}
+
+/**
+ * @brief Fin de lecture : la table obtenue par table_rcu_enter() ne doit plus être utilisée.
+ */
+void table_rcu_leave(table_rcu_t *r, int reader){
+  atomic_store_explicit(&r->reader[reader], 0, memory_order_release);
+}
+
+/**
+ * @brief Remplace la table courante.
+ *
+ * Les lectures commencées après la bascule voient nt. On attend ensuite
+ * que chaque lecteur entré avant la bascule soit ressorti : l’ancienne
+ * table n’est alors plus référencée et peut être libérée par l’appelant.
+ * Un seul écrivain à la fois.
+ *
+ * @param r : poignée.
+ * @param nt : nouvelle table.
+ * @return ancienne table.
+ */
+table_t* table_rcu_swap(table_rcu_t *r, table_t *nt){
+  table_t *old = atomic_exchange(&r->cur, nt);
+  uint64_t e = atomic_fetch_add(&r->epoch, 1) + 1;
+  for(int i = 0; i < TABLE_READERS; i++){
+    for(;;){
+      uint64_t v = atomic_load(&r->reader[i]);
+      if(v == 0 || v >= e) break;
+      sched_yield();
+    }
+  }
+  return old;
+}
+
 // End of file
@@ -0,0 +1,187 @@
+/**
+ * @file pack_cases.c
+ * @brief Payloads JSON de commande pour les tests de pack.c.
+ *
+ * Chaque payload est un objet JSON portant les champs d’une entrée, dans
+ * l’ordre du dictionnaire. Les valeurs valides sont tirées à partir de
+ * la valeur brute du champ (bornes comprises), puis converties en valeur
+ * physique. Pour varier le texte, une clé étrangère (objet imbriqué) est
+ * parfois ajoutée en tête, un doublon du premier champ en fin, et un
+ * libellé d’enum peut être écrit avec un échappement \uXXXX.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdarg.h>
+#include <string.h>
+
+#include "types.h"
+#include "pack_cases.h"
+
+/* Tampon de sortie : écriture tronquée détectée à la fin */
+typedef struct out_s {
+  char  *buf;
+  size_t cap, len;
+  bool   full;
+} out_t;
+
+static void put(out_t *o, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+static void put(out_t *o, const char *fmt, ...){
+  if(o->full) return;
+  va_list ap;
+  va_start(ap, fmt);
+  int n = vsnprintf(o->buf + o->len, o->cap - o->len, fmt, ap);
+  va_end(ap);
+  if(n < 0 || (size_t)n >= o->cap - o->len){ o->full = true; return; }
+  o->len += (size_t)n;
+}
+
+/**
+ * @brief Écrit une chaîne JSON ; esc : premier caractère en \uXXXX.
+ */
+static void put_str(out_t *o, const char *s, bool esc){
+  put(o, "\"");
+  for(size_t i = 0; s[i]; i++){
+    if(esc && i == 0 && (uint8_t)s[i] < 0x80) put(o, "\\u%04X", (unsigned)(uint8_t)s[i]);
+    else if(s[i] == '"' || s[i] == '\\') put(o, "\\%c", s[i]);
+    else put(o, "%c", s[i]);
+  }
+  put(o, "\"");
+}
+
+const char* case_name(case_kind_t kind){
+  static const char *names[CASE_KINDS] = { "valide", "manquant", "type", "plage", "enum" };
+  return (kind < CASE_KINDS) ? names[kind] : "?";
+}
+
+uint32_t case_rand(uint32_t *seed){
+  uint32_t x = *seed;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return *seed = x;
+}
+
+/**
+ * @brief Valeur physique d’une valeur brute (signe, conversion).
+ */
+static double raw_value(const field_spec_t *fs, double raw){
+  if(fs->type == FT_SINT && raw > fs->mask / 2) raw -= (double)fs->mask + 1.0;
+  return fs->scaled ? raw * fs->scale + fs->bias : raw;
+}
+
+/**
+ * @brief Valeur numérique valide : bornes de la plage brute une fois sur
+ *        quatre, partie fractionnaire (tronquée) une fois sur huit.
+ */
+static double valid_number(const field_spec_t *fs, uint32_t *seed){
+  uint32_t r = case_rand(seed);
+  if(fs->type == FT_FLOAT){
+    double v = (double)((int32_t)(r % 200001u) - 100000) / 16.0;   /* exact en simple précision */
+    return fs->scaled ? v * fs->scale + fs->bias : v;
+  }
+  uint32_t raw = case_rand(seed) & fs->mask;
+  if(r % 8 == 0) raw = 0;
+  else if(r % 8 == 1) raw = fs->mask;
+  double v = raw_value(fs, raw);
+  if(!fs->scaled && r % 8 == 2 && v >= 0 && v < fs->mask) v += 0.5;
+  return v;
+}
+
+/**
+ * @brief Valeur numérique hors plage, juste au-delà d’une borne.
+ */
+static double range_number(const field_spec_t *fs, uint32_t *seed){
+  bool low = case_rand(seed) & 1;
+  if(fs->type == FT_FLOAT) return low ? -1e300 : 1e300;
+  double lo = (fs->type == FT_SINT) ? -(double)(fs->mask / 2) - 1.0 : 0.0;
+  double hi = (fs->type == FT_SINT) ? (double)(fs->mask / 2) : (double)fs->mask;
+  double raw = low ? lo - 1.0 : hi + 1.0;
+  return fs->scaled ? raw * fs->scale + fs->bias : raw;
+}
+
+/**
+ * @brief Écrit la valeur d’un champ.
+ *
+ * @return false si la classe ne s’applique pas au type du champ.
+ */
+static bool put_value(out_t *o, const field_spec_t *fs, case_kind_t kind, uint32_t *seed){
+  uint32_t r = case_rand(seed);
+  bool numeric = fs->type == FT_INT || fs->type == FT_INT16 || fs->type == FT_UINT ||
+                 fs->type == FT_SINT || fs->type == FT_FLOAT;
+
+  if(kind == CASE_TYPE){
+    if(r % 4 == 0) put(o, "null");
+    else if(numeric) put(o, (r & 4) ? "\"12\"" : "[1]");
+    else if(fs->type == FT_BOOL) put(o, (r & 4) ? "1" : "\"true\"");
+    else put(o, (r & 4) ? "12" : "{}");
+    return true;
+  }
+  if(kind == CASE_RANGE){
+    if(numeric) put(o, "%.17g", range_number(fs, seed));
+    else if(fs->type == FT_HEX) put(o, (r & 1) ? "\"#12G456\"" : "\"123456\"");
+    else return false;
+    return true;
+  }
+  if(kind == CASE_ENUM){
+    if(fs->type != FT_ENUM) return false;
+    put(o, (r & 1) ? "\"__inconnu__\"" : "\"\"");
+    return true;
+  }
+
+  switch(fs->type){
+    case FT_INT:
+    case FT_INT16:
+    case FT_UINT:
+    case FT_SINT:
+    case FT_FLOAT:
+      put(o, "%.17g", valid_number(fs, seed));
+      break;
+    case FT_BOOL:
+      put(o, (r & 1) ? "true" : "false");
+      break;
+    case FT_HEX:
+      put(o, (r & 0x100) ? "\"#%06X\"" : "\"#%06x\"", (unsigned)(case_rand(seed) & 0xFFFFFFu));
+      break;
+    case FT_ENUM:{
+      size_t n = 0;
+      for(const enum_kv_t *kv = fs->enum_list; kv; kv = kv->next) n++;
+      const enum_kv_t *kv = fs->enum_list;
+      for(size_t k = n ? case_rand(seed) % n : 0; kv && k; k--) kv = kv->next;
+      put_str(o, kv ? kv->key : "", r % 8 == 0);
+    }break;
+  }
+  return true;
+}
+
+size_t case_json(char *buf, size_t cap, const entry_t *e, case_kind_t kind, size_t target, uint32_t *seed){
+  out_t o = { buf, cap, 0, cap == 0 };
+  uint32_t r = case_rand(seed);
+  bool first = true;
+
+  put(&o, "{");
+  if(r % 4 == 0){
+    put(&o, " \"_x\" : {\"a\":[1,2.5e3,\"s\\\"t\"],\"b\":null}");
+    first = false;
+  }
+  for(size_t i = 0; i < e->field_count; i++){
+    const field_spec_t *fs = &e->fields[i];
+    case_kind_t k = (i == target) ? kind : CASE_VALID;
+    if(k == CASE_MISSING) continue;
+    put(&o, first ? "" : ",");
+    put_str(&o, fs->name, false);
+    put(&o, ":");
+    if(!put_value(&o, fs, k, seed)) return 0;
+    first = false;
+  }
+  if(r % 4 == 1 && e->field_count){
+    put(&o, first ? "" : ",");
+    put_str(&o, e->fields[0].name, false);
+    put(&o, ":\"doublon\"");
+  }
+  put(&o, "}");
+  return o.full ? 0 : o.len;
+}
+
+// End of file
@@ -0,0 +1,36 @@
+#ifndef PACK_CASES_H
+#define PACK_CASES_H
+
+/*
+ * Génération de payloads JSON de commande pour les tests de pack.c :
+ * valeurs pseudo-aléatoires tirées dans la plage de chaque champ, ou
+ * erreur d’une classe donnée sur un champ cible.
+ *
+ * Prérequis : types.h.
+ */
+
+typedef enum {
+  CASE_VALID = 0,   /* toutes les valeurs dans la plage du champ */
+  CASE_MISSING,     /* champ cible absent */
+  CASE_TYPE,        /* champ cible de mauvais type JSON */
+  CASE_RANGE,       /* champ cible hors plage (numérique) ou hex invalide */
+  CASE_ENUM,        /* champ cible enum de valeur inconnue */
+  CASE_KINDS
+} case_kind_t;
+
+/* Nom de la classe, pour les rapports */
+const char* case_name(case_kind_t kind);
+
+/* Générateur pseudo-aléatoire (xorshift32, graine non nulle) */
+uint32_t case_rand(uint32_t *seed);
+
+/* Écrit dans buf un objet JSON pour l’entrée e : valeurs tirées avec
+   *seed, le champ d’index target portant l’erreur kind (ignoré pour
+   CASE_VALID). Des clés étrangères au dictionnaire sont parfois
+   ajoutées. Retourne la longueur écrite, 0 si la classe ne s’applique
+   pas au champ cible ou si buf est trop petit. */
+size_t case_json(char *buf, size_t cap, const entry_t *e, case_kind_t kind, size_t target, uint32_t *seed);
+
+#endif
+
+// End of file
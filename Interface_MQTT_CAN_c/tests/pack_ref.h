@@ -0,0 +1,22 @@
+#ifndef PACK_REF_H
+#define PACK_REF_H
+
+/*
+ * Implémentation d’origine de pack_payload() / unpack_payload() (trame de
+ * 8 octets, champs placés à la suite, listes d’enum parcourues), gardée
+ * comme référence des tests différentiels.
+ *
+ * Prérequis : types.h, <cjson/cJSON.h>.
+ */
+
+bool   ref_pack_payload(uint8_t out8[8], const entry_t *entry, cJSON *json_in);
+cJSON* ref_unpack_payload(const uint8_t in8[8], const entry_t *entry);
+
+/* true si l’entrée n’utilise que ce que connaît l’implémentation
+   d’origine : types d’origine à leur largeur, placés à la suite, sans
+   conversion, en CAN classique non segmenté */
+bool   ref_entry_legacy(const entry_t *entry);
+
+#endif
+
+// End of file
@@ -0,0 +1,135 @@
+/**
+ * @file test_encode.c
+ * @brief Test de pack_encode_json() contre
+ *        cJSON_PrintUnformatted(unpack_payload()).
+ *
+ * L’encodeur recopie les règles d’impression de cJSON (nombres entiers,
+ * "%1.15g" / "%1.17g", null pour NaN et infinis, échappement des clés et
+ * libellés d’enum) : pour chaque entrée des dictionnaires donnés, les
+ * deux textes doivent être identiques au caractère près sur :
+ * - des charges utiles aléatoires ;
+ * - tout à 0 et tout à 0xFF ;
+ * - des flottants particuliers (±0, NaN, infinis, dénormaux, extrêmes)
+ *   sur chaque champ float ;
+ * et la longueur ne doit jamais dépasser entry->json_max.
+ *
+ * Usage : ./build/test_encode [-n tirages] dictionnaire.json...
+ * Code de sortie non nul au premier écart (détails sur stderr).
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <cjson/cJSON.h>
+
+#include "types.h"
+#include "log.h"
+#include "table.h"
+#include "pack.h"
+#include "pack_cases.h"
+
+static size_t g_cases, g_fail;
+
+/* Motifs de flottants simple précision à tester sur chaque champ float */
+static const uint32_t float_bits[] = {
+  0x00000000u, 0x80000000u,   /* ±0 */
+  0x7FC00000u, 0xFFC00001u,   /* NaN */
+  0x7F800000u, 0xFF800000u,   /* ±infini */
+  0x00000001u, 0x807FFFFFu,   /* dénormaux */
+  0x7F7FFFFFu, 0xFF7FFFFFu,   /* ±FLT_MAX */
+  0x3DCCCCCDu, 0x4B800001u,   /* 0.1f, 2^24 + 2 */
+  0x4F000000u, 0xCF000001u,   /* autour de ±2^31 */
+};
+
+/**
+ * @brief Compare l’encodeur à cJSON sur une charge utile.
+ */
+static void check(const entry_t *e, const uint8_t *in){
+  char buf[4096];
+  cJSON *obj = unpack_payload(in, e);
+  char *ref = obj ? cJSON_PrintUnformatted(obj) : NULL;
+  size_t n = (e->json_max < sizeof(buf)) ? pack_encode_json(buf, sizeof(buf), in, e) : 0;
+  g_cases++;
+
+  bool ok = ref ? (n > 0 && n <= e->json_max && strcmp(ref, buf) == 0) : (n == 0);
+  if(!ok){
+    g_fail++;
+    fprintf(stderr, "%s : encodage (%zu octets, json_max %zu)\n  cJSON    %s\n  encodeur %s\n  trame   ",
+            e->topic, n, e->json_max, ref ? ref : "(null)", n ? buf : "(rien)");
+    for(size_t i = 0; i < e->payload_max; i++) fprintf(stderr, " %02X", in[i]);
+    fprintf(stderr, "\n");
+  }
+
+  /* Tampon d’une taille de json_max exactement : refusé (place du '\0') */
+  if(ref && pack_encode_json(buf, e->json_max, in, e) != 0){
+    g_fail++;
+    fprintf(stderr, "%s : tampon de json_max octets accepté\n", e->topic);
+  }
+  free(ref);
+  cJSON_Delete(obj);
+}
+
+/**
+ * @brief Écrit une valeur brute de 32 bits à l’emplacement d’un champ
+ *        float (ordre des octets du champ).
+ */
+static void put_float_bits(uint8_t *in, const field_spec_t *fs, uint32_t v){
+  for(unsigned i = 0; i < 4; i++){
+    unsigned k = fs->little ? i : 3 - i;
+    in[fs->offset + k] = (uint8_t)(v >> (8 * i));
+  }
+}
+
+/**
+ * @brief Passe toutes les vérifications sur une entrée.
+ */
+static void check_entry(const entry_t *e, size_t draws, uint32_t *seed){
+  uint8_t in[ENTRY_PAYLOAD_MAX];
+  memset(in, 0, sizeof(in));
+  check(e, in);
+  memset(in, 0xFF, e->payload_max);
+  check(e, in);
+
+  for(size_t d = 0; d < draws; d++){
+    for(size_t i = 0; i < e->payload_max; i++) in[i] = (uint8_t)case_rand(seed);
+    check(e, in);
+  }
+
+  for(size_t f = 0; f < e->packed_count; f++){
+    const field_spec_t *fs = &e->fields[f];
+    if(fs->type != FT_FLOAT || fs->shift) continue;
+    for(size_t k = 0; k < sizeof(float_bits) / sizeof(float_bits[0]); k++){
+      put_float_bits(in, fs, float_bits[k]);
+      check(e, in);
+    }
+  }
+}
+
+int main(int argc, char **argv){
+  size_t draws = 2000;
+  int a = 1;
+  if(a + 1 < argc && strcmp(argv[a], "-n") == 0){ draws = (size_t)strtoul(argv[a + 1], NULL, 10); a += 2; }
+  if(a >= argc){
+    fprintf(stderr, "Usage : %s [-n tirages] dictionnaire.json...\n", argv[0]);
+    return 2;
+  }
+
+  log_set_level(LOG_ERR);
+
+  uint32_t seed = 0x9E3779B9u;
+  size_t entries = 0;
+  for(; a < argc; a++){
+    table_t t;
+    if(!table_load(&t, argv[a])){ fprintf(stderr, "Chargement de %s impossible\n", argv[a]); return 1; }
+    for(size_t i = 0; i < t.entry_count; i++, entries++) check_entry(&t.entries[i], draws, &seed);
+    table_free(&t);
+  }
+
+  printf("test_encode : %zu entrées, %zu cas, %zu écart(s)\n", entries, g_cases, g_fail);
+  log_stop();
+  return g_fail ? 1 : 0;
+}
+
+// End of file
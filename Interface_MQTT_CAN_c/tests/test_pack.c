@@ -0,0 +1,143 @@
+/**
+ * @file test_pack.c
+ * @brief Test différentiel de pack_payload() / unpack_payload() contre
+ *        l’implémentation d’origine (tests/pack_ref.c).
+ *
+ * Pour chaque entrée des dictionnaires donnés qui relève de
+ * l’implémentation d’origine (cf. ref_entry_legacy()) :
+ * - pack : payloads valides et de chaque classe d’erreur (champ manquant,
+ *   mauvais type, hors plage, hex invalide, enum inconnu) sur chaque
+ *   champ ; même résultat attendu, et mêmes octets en cas de succès sur
+ *   la charge utile (tunnel : les 6 premiers, seuls émis par l’origine) ;
+ * - unpack : charges utiles aléatoires, bornes (tout à 0, tout à 0xFF) ;
+ *   même JSON imprimé par cJSON.
+ *
+ * Usage : ./build/test_pack [-n tirages] dictionnaire.json...
+ * Code de sortie non nul au premier écart (détails sur stderr).
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <cjson/cJSON.h>
+
+#include "types.h"
+#include "log.h"
+#include "table.h"
+#include "pack.h"
+#include "pack_ref.h"
+#include "pack_cases.h"
+
+static size_t g_cases, g_fail;
+
+/**
+ * @brief Affiche une charge utile en hexadécimal.
+ */
+static void dump(const char *what, const uint8_t *p, size_t n){
+  fprintf(stderr, "  %-8s", what);
+  for(size_t i = 0; i < n; i++) fprintf(stderr, " %02X", p[i]);
+  fprintf(stderr, "\n");
+}
+
+/**
+ * @brief Compare pack_payload() à l’origine sur un payload JSON.
+ */
+static void check_pack(const entry_t *e, const char *json){
+  uint8_t ref[8], cur[ENTRY_PAYLOAD_MAX];
+  cJSON *root = cJSON_Parse(json);
+  if(!root){ fprintf(stderr, "%s : JSON de test invalide %s\n", e->topic, json); g_fail++; return; }
+  bool ref_ok = ref_pack_payload(ref, e, root);
+  bool cur_ok = pack_payload(cur, e, root);
+  cJSON_Delete(root);
+  g_cases++;
+
+  /* L’origine émettait les payload_max premiers octets (tunnel : 6 sur 8) */
+  if(cur_ok == ref_ok && (!cur_ok || memcmp(ref, cur, e->payload_max) == 0)) return;
+
+  g_fail++;
+  fprintf(stderr, "%s : pack %s (origine %s)%s\n  json     %s\n", e->topic, cur_ok ? "ok" : "refusé",
+          ref_ok ? "ok" : "refusé", e->packed_count < e->field_count ? ", champs hors trame" : "", json);
+  dump("origine", ref, sizeof(ref));
+  dump("plan", cur, e->payload_max);
+}
+
+/**
+ * @brief Compare unpack_payload() à l’origine sur une charge utile.
+ */
+static void check_unpack(const entry_t *e, const uint8_t *in){
+  cJSON *a = ref_unpack_payload(in, e), *b = unpack_payload(in, e);
+  char *ta = a ? cJSON_PrintUnformatted(a) : NULL, *tb = b ? cJSON_PrintUnformatted(b) : NULL;
+  g_cases++;
+
+  bool ok = ta && tb && strcmp(ta, tb) == 0;
+  if(!ok){
+    g_fail++;
+    fprintf(stderr, "%s : unpack\n  origine  %s\n  plan     %s\n", e->topic, ta ? ta : "(null)", tb ? tb : "(null)");
+    dump("trame", in, e->payload_max);
+  }
+  free(ta);
+  free(tb);
+  cJSON_Delete(a);
+  cJSON_Delete(b);
+}
+
+/**
+ * @brief Passe toutes les vérifications sur une entrée.
+ */
+static void check_entry(const entry_t *e, size_t draws, uint32_t *seed){
+  char json[1024];
+
+  for(size_t d = 0; d < draws; d++){
+    for(case_kind_t k = CASE_VALID; k < CASE_KINDS; k++){
+      size_t targets = (k == CASE_VALID) ? 1 : e->field_count;
+      for(size_t t = 0; t < targets; t++)
+        if(case_json(json, sizeof(json), e, k, t, seed)) check_pack(e, json);
+    }
+  }
+
+  /* Charge utile : octets au-delà de payload_max nuls, comme à la réception */
+  uint8_t in[ENTRY_PAYLOAD_MAX];
+  memset(in, 0, sizeof(in));
+  check_unpack(e, in);
+  memset(in, 0xFF, e->payload_max);
+  check_unpack(e, in);
+  for(size_t d = 0; d < draws; d++){
+    for(size_t i = 0; i < e->payload_max; i++) in[i] = (uint8_t)case_rand(seed);
+    check_unpack(e, in);
+  }
+}
+
+int main(int argc, char **argv){
+  size_t draws = 200;
+  int a = 1;
+  if(a + 1 < argc && strcmp(argv[a], "-n") == 0){ draws = (size_t)strtoul(argv[a + 1], NULL, 10); a += 2; }
+  if(a >= argc){
+    fprintf(stderr, "Usage : %s [-n tirages] dictionnaire.json...\n", argv[0]);
+    return 2;
+  }
+
+  /* Les refus attendus journalisent : seules les erreurs comptent ici */
+  log_set_level(LOG_ERR);
+
+  uint32_t seed = 0x2545F491u;
+  size_t entries = 0, skipped = 0;
+  for(; a < argc; a++){
+    table_t t;
+    if(!table_load(&t, argv[a])){ fprintf(stderr, "Chargement de %s impossible\n", argv[a]); return 1; }
+    for(size_t i = 0; i < t.entry_count; i++){
+      if(!ref_entry_legacy(&t.entries[i])){ skipped++; continue; }
+      check_entry(&t.entries[i], draws, &seed);
+      entries++;
+    }
+    table_free(&t);
+  }
+
+  printf("test_pack : %zu entrées (%zu hors origine ignorées), %zu cas, %zu écart(s)\n",
+         entries, skipped, g_cases, g_fail);
+  log_stop();
+  return g_fail ? 1 : 0;
+}
+
+// End of file
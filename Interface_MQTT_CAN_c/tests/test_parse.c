@@ -0,0 +1,222 @@
+/**
+ * @file test_parse.c
+ * @brief Test de pack_parse_json() contre le chemin cJSON
+ *        (cJSON_Parse() + pack_payload()).
+ *
+ * Pour chaque entrée des dictionnaires donnés, le même texte passe par
+ * les deux chemins ; même statut attendu (PACK_OK, PACK_ERR_JSON,
+ * PACK_ERR_FIELD) et, en cas de succès, mêmes octets :
+ * - payloads valides et de chaque classe d’erreur (champ manquant,
+ *   mauvais type, hors plage, enum inconnu) sur chaque champ ;
+ * - tous les préfixes tronqués et des mutations d’un octet de payloads
+ *   valides ;
+ * - BOM UTF-8, blancs en tête, texte après la valeur racine, '\0' au
+ *   milieu du texte, racine qui n’est pas un objet, clé de champ dans un
+ *   objet imbriqué, imbrication à la limite de cJSON et au-delà.
+ * Noms de champ et libellés d’enum de plus de 128 octets : cf.
+ * tests/pack_layout.json (test/layout/long_names).
+ *
+ * Le chemin cJSON reçoit une copie terminée par '\0', comme le faisait
+ * le pont avant pack_parse_json().
+ *
+ * Usage : ./build/test_parse [-n tirages] dictionnaire.json...
+ * Code de sortie non nul au premier écart (détails sur stderr).
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <cjson/cJSON.h>
+
+#include "types.h"
+#include "log.h"
+#include "table.h"
+#include "pack.h"
+#include "pack_cases.h"
+
+#define TEXT_MAX 8192
+
+static size_t g_cases, g_fail;
+
+static const char *status_name(pack_status_t s){
+  switch(s){
+    case PACK_OK:        return "PACK_OK";
+    case PACK_ERR_JSON:  return "PACK_ERR_JSON";
+    case PACK_ERR_FIELD: return "PACK_ERR_FIELD";
+  }
+  return "?";
+}
+
+/**
+ * @brief Chemin d’origine : texte copié et terminé, arbre cJSON, pack.
+ */
+static pack_status_t cjson_path(uint8_t *out, const entry_t *e, const char *text, size_t len){
+  char *z = (char*)malloc(len + 1);
+  if(!z) return PACK_ERR_JSON;
+  memcpy(z, text, len);
+  z[len] = '\0';
+  cJSON *root = cJSON_Parse(z);
+  free(z);
+  if(!root) return PACK_ERR_JSON;
+  bool ok = pack_payload(out, e, root);
+  cJSON_Delete(root);
+  return ok ? PACK_OK : PACK_ERR_FIELD;
+}
+
+/**
+ * @brief Compare les deux chemins sur un texte.
+ */
+static void check(const entry_t *e, const char *what, const char *text, size_t len){
+  uint8_t a[ENTRY_PAYLOAD_MAX], b[ENTRY_PAYLOAD_MAX];
+  memset(a, 0xA5, sizeof(a));
+  memset(b, 0x5A, sizeof(b));
+  pack_status_t sa = cjson_path(a, e, text, len);
+  pack_status_t sb = pack_parse_json(b, e, text, len);
+  g_cases++;
+
+  if(sa == sb && (sa != PACK_OK || memcmp(a, b, e->payload_max) == 0)) return;
+
+  g_fail++;
+  fprintf(stderr, "%s : %s, cJSON %s, pack_parse_json %s\n  json     ", e->topic, what,
+          status_name(sa), status_name(sb));
+  for(size_t i = 0; i < len && i < 256; i++)
+    fputc((text[i] >= 32 && text[i] < 127) ? text[i] : '.', stderr);
+  fprintf(stderr, "%s\n", len > 256 ? "..." : "");
+  if(sa == PACK_OK && sb == PACK_OK){
+    fprintf(stderr, "  cJSON   ");
+    for(size_t i = 0; i < e->payload_max; i++) fprintf(stderr, " %02X", a[i]);
+    fprintf(stderr, "\n  analyse ");
+    for(size_t i = 0; i < e->payload_max; i++) fprintf(stderr, " %02X", b[i]);
+    fprintf(stderr, "\n");
+  }
+}
+
+/**
+ * @brief Texte préfixe + json + suffixe (suffixe de longueur slen, '\0' admis).
+ */
+static void check_wrapped(const entry_t *e, const char *what, const char *pre,
+                          const char *json, size_t n, const char *suf, size_t slen){
+  static char text[TEXT_MAX];
+  size_t pl = strlen(pre);
+  if(pl + n + slen > sizeof(text)) return;
+  memcpy(text, pre, pl);
+  memcpy(text + pl, json, n);
+  memcpy(text + pl + n, suf, slen);
+  check(e, what, text, pl + n + slen);
+}
+
+/**
+ * @brief Objet racine précédé d’une clé "_x" imbriquée sur depth niveaux
+ *        (racine comprise), puis les champs du payload json.
+ */
+static void check_nested(const entry_t *e, const char *json, size_t n, size_t depth){
+  static char text[TEXT_MAX];
+  size_t k = 0;
+  if(n < 2 || 2 * depth + n + 16 > sizeof(text)) return;
+  k += (size_t)sprintf(text, "{\"_x\":");
+  for(size_t i = 1; i < depth; i++) text[k++] = '[';
+  for(size_t i = 1; i < depth; i++) text[k++] = ']';
+  if(json[1] != '}') text[k++] = ',';
+  memcpy(text + k, json + 1, n - 1);
+  check(e, depth > 1000 ? "imbrication > 1000" : "imbrication 1000", text, k + n - 1);
+}
+
+/**
+ * @brief Textes dérivés d’un payload valide : troncatures, mutations,
+ *        enrobages.
+ */
+static void check_malformed(const entry_t *e, const char *json, size_t n, uint32_t *seed){
+  static const char noise[] = "{}[]:,\"\\ 0-.eEtfnu#\x01\xEF";
+  char text[1024];
+
+  for(size_t i = 0; i < n; i++) check(e, "tronqué", json, i);
+
+  for(int m = 0; m < 16 && n < sizeof(text); m++){
+    memcpy(text, json, n);
+    text[case_rand(seed) % n] = noise[case_rand(seed) % (sizeof(noise) - 1)];
+    check(e, "mutation", text, n);
+  }
+
+  /* '\0' à la place d’un blanc : fin du texte pour cJSON */
+  const char *colon = memchr(json, ':', n);
+  if(colon && n < sizeof(text)){
+    size_t k = (size_t)(colon - json) + 1;
+    memcpy(text, json, k);
+    text[k] = '\0';
+    memcpy(text + k + 1, json + k, n - k);
+    check(e, "'\\0' au milieu", text, n + 1);
+  }
+
+  check_wrapped(e, "BOM", "\xEF\xBB\xBF", json, n, "", 0);
+  check_wrapped(e, "blancs", " \t\r\n", json, n, " \n", 2);
+  check_wrapped(e, "texte après", "", json, n, " }{ garbage", 11);
+  check_wrapped(e, "'\\0' après", "", json, n, "\0{\"x\":", 6);
+  check_wrapped(e, "tableau", "[", json, n, "]", 1);
+  check_wrapped(e, "BOM incomplet", "\xEF\xBB", json, n, "", 0);
+  check_nested(e, json, n, 1000);
+  check_nested(e, json, n, 1001);
+
+  /* Clé de champ dans un objet imbriqué : ignorée par les deux chemins */
+  if(e->field_count && n > 2 && snprintf(text, sizeof(text), "{\"_x\":{\"%s\":\"?\"},", e->fields[0].name) < 200){
+    size_t k = strlen(text);
+    if(json[1] == '}') text[--k] = '\0';
+    check_wrapped(e, "clé imbriquée", text, json + 1, n - 1, "", 0);
+  }
+}
+
+/**
+ * @brief Passe toutes les vérifications sur une entrée.
+ */
+static void check_entry(const entry_t *e, size_t draws, uint32_t *seed){
+  static const char *roots[] = {
+    "", " ", "{", "}", "{}", "[]", "[1,2]", "1", "-", "\"x\"", "null", "true", "false",
+    "nul", "{\"a\":}", "{\"a\" 1}", "{,}", "{\"a\":1,}", "{\"\\q\":1}", "{\"\\uD800\":1}",
+    "{\"\\uDC00\\u0041\":1}", "{\"a\":\"\\uD83D\\uDE00\"}", "\xEF\xBB\xBF", "{\"a\":1e999}",
+  };
+  char json[1024];
+
+  for(size_t i = 0; i < sizeof(roots) / sizeof(roots[0]); i++)
+    check(e, "racine", roots[i], strlen(roots[i]));
+
+  for(size_t d = 0; d < draws; d++){
+    for(case_kind_t k = CASE_VALID; k < CASE_KINDS; k++){
+      size_t targets = (k == CASE_VALID) ? 1 : e->field_count;
+      for(size_t t = 0; t < targets; t++){
+        size_t n = case_json(json, sizeof(json), e, k, t, seed);
+        if(!n) continue;
+        check(e, case_name(k), json, n);
+        if(k == CASE_VALID && d < 8) check_malformed(e, json, n, seed);
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv){
+  size_t draws = 200;
+  int a = 1;
+  if(a + 1 < argc && strcmp(argv[a], "-n") == 0){ draws = (size_t)strtoul(argv[a + 1], NULL, 10); a += 2; }
+  if(a >= argc){
+    fprintf(stderr, "Usage : %s [-n tirages] dictionnaire.json...\n", argv[0]);
+    return 2;
+  }
+
+  /* Les refus attendus journalisent : seules les erreurs comptent ici */
+  log_set_level(LOG_ERR);
+
+  uint32_t seed = 0x6A09E667u;
+  size_t entries = 0;
+  for(; a < argc; a++){
+    table_t t;
+    if(!table_load(&t, argv[a])){ fprintf(stderr, "Chargement de %s impossible\n", argv[a]); return 1; }
+    for(size_t i = 0; i < t.entry_count; i++, entries++) check_entry(&t.entries[i], draws, &seed);
+    table_free(&t);
+  }
+
+  printf("test_parse : %zu entrées, %zu cas, %zu écart(s)\n", entries, g_cases, g_fail);
+  log_stop();
+  return g_fail ? 1 : 0;
+}
+
+// End of file
@@ -0,0 +1,84 @@
+/**
+ * @file dictc.c
+ * @brief Compilateur de dictionnaire : conversion.json -> image binaire.
+ *
+ * Charge le JSON avec table_load() (mêmes règles et mêmes avertissements
+ * que le pont), écrit l’image avec dict_image_write(), puis la relit par
+ * dict_image_map() pour vérifier que chaque topic et chaque CAN ID y
+ * retrouvent la même entrée.
+ *
+ * Usage : ./build/dictc conversion.json conversion.cbd
+ * Le pont accepte ensuite conversion.cbd à la place du JSON. Un fichier
+ * .dbc (cf. dbc.h) se compile de la même façon.
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "types.h"
+#include "log.h"
+#include "table.h"
+#include "dict_image.h"
+
+/**
+ * @brief Compare une entrée JSON et son équivalent dans l’image.
+ */
+static bool same_entry(const entry_t *a, const entry_t *b){
+  if(!a || !b) return a == b;
+  if(strcmp(a->topic, b->topic) != 0 || a->can_id != b->can_id || a->route != b->route ||
+     a->transport_id != b->transport_id || a->fd != b->fd || a->seg != b->seg || a->payload_max != b->payload_max ||
+     a->frame_len != b->frame_len || a->field_count != b->field_count ||
+     a->packed_count != b->packed_count || a->json_max != b->json_max ||
+     a->pub.on_change != b->pub.on_change || a->pub.min_interval_ms != b->pub.min_interval_ms ||
+     a->pub.heartbeat_ms != b->pub.heartbeat_ms || memcmp(&a->cmd, &b->cmd, sizeof(a->cmd)) != 0) return false;
+  for(size_t k = 0; k < a->field_count; k++){
+    const field_spec_t *x = &a->fields[k], *y = &b->fields[k];
+    if(strcmp(x->name, y->name) != 0 || x->type != y->type || x->offset != y->offset ||
+       x->width != y->width || x->shift != y->shift || x->mask != y->mask || x->little != y->little ||
+       x->scaled != y->scaled || x->scale != y->scale || x->bias != y->bias ||
+       strcmp(x->json_key, y->json_key) != 0) return false;
+    for(int c = 0; x->enum_by_code && c < 256; c++){
+      if(!x->enum_by_code[c] != !y->enum_by_code[c]) return false;
+      if(x->enum_by_code[c] && strcmp(x->enum_by_code[c]->json, y->enum_by_code[c]->json) != 0) return false;
+    }
+  }
+  return true;
+}
+
+int main(int argc, char **argv){
+  if(argc != 3){
+    fprintf(stderr, "Usage : %s conversion.json sortie.cbd\n", argv[0]);
+    return 2;
+  }
+
+  table_t src;
+  if(!table_load(&src, argv[1]) || src.image){
+    LOGE("Chargement de %s impossible (JSON attendu)", argv[1]);
+    table_free(&src);
+    return 1;
+  }
+  if(!dict_image_write(&src, argv[2])){ table_free(&src); return 1; }
+
+  /* Relecture : l’image doit donner les mêmes réponses que le JSON */
+  table_t img;
+  bool ok = dict_image_map(&img, argv[2]) && img.entry_count == src.entry_count;
+  for(size_t i = 0; ok && i < src.entry_count; i++){
+    const entry_t *e = &src.entries[i];
+    uint8_t hdr_a = 0, hdr_b = 0, d[8] = { (uint8_t)(e->can_id >> 8), (uint8_t)e->can_id };
+    ok = same_entry(table_find_by_topic(&src, e->topic), table_find_by_topic(&img, e->topic)) &&
+         same_entry(table_find_by_canid(&src, e->can_id), table_find_by_canid(&img, e->can_id)) &&
+         same_entry(table_find_rx(&src, e->transport_id, d, 8, &hdr_a), table_find_rx(&img, e->transport_id, d, 8, &hdr_b)) &&
+         hdr_a == hdr_b;
+    if(!ok) LOGE("Image incohérente pour %s", e->topic);
+  }
+
+  table_free(&img);
+  table_free(&src);
+  return ok ? 0 : 1;
+}
+
+// End of file